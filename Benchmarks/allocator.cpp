@@ -0,0 +1,97 @@
+/*
+    pool allocator (sq_newpoolallocator) against malloc/realloc/free.
+    1. raw: the allocator functions called directly with the sizes of the VM objects
+    2. script: the same allocation heavy script run in VMs opened with and without the pool
+*/
+#include <squirrel/squirrel.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+static double now_us()
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void *_malloc_alloc(SQUserPointer, SQUnsignedInteger size) { return malloc(size); }
+static void *_malloc_realloc(SQUserPointer, void *p, SQUnsignedInteger, SQUnsignedInteger size) { return realloc(p, size); }
+static void _malloc_free(SQUserPointer, void *p, SQUnsignedInteger) { free(p); }
+
+#define RAW_SLOTS 4096
+#define RAW_ROUNDS 2000
+
+//random alloc/free churn over a working set of RAW_SLOTS blocks of 8 to 512 bytes
+static double raw(const SQAllocator &a)
+{
+    static void *slots[RAW_SLOTS];
+    static SQUnsignedInteger sizes[RAW_SLOTS];
+    unsigned int seed = 12345;
+    for(int i = 0; i < RAW_SLOTS; i++) {
+        sizes[i] = 8 + (i * 37) % 505;
+        slots[i] = a.memalloc(a.up, sizes[i]);
+    }
+    double t0 = now_us();
+    for(int r = 0; r < RAW_ROUNDS; r++) {
+        for(int n = 0; n < 256; n++) {
+            seed = seed * 1103515245 + 12345;
+            int i = (seed >> 8) % RAW_SLOTS;
+            a.memfree(a.up, slots[i], sizes[i]);
+            sizes[i] = 8 + (seed >> 4) % 505;
+            slots[i] = a.memalloc(a.up, sizes[i]);
+        }
+    }
+    double t1 = now_us();
+    for(int i = 0; i < RAW_SLOTS; i++) a.memfree(a.up, slots[i], sizes[i]);
+    return (t1 - t0) * 1000.0 / (RAW_ROUNDS * 256.0);
+}
+
+static const SQChar *workload = _SC(
+    "local res = 0\n"
+    "for(local i = 0; i < 2000; i++) {\n"
+    "    local t = { id = i, name = \"item\" + i, tags = [i, i + 1, i + 2] }\n"
+    "    local f = function() { return t.id }\n"
+    "    res += f() + t.tags.len()\n"
+    "}\n"
+    "return res\n");
+
+#define SCRIPT_RUNS 200
+
+static double script(bool pool)
+{
+    SQAllocator a;
+    if(pool) sq_newpoolallocator(&a);
+    HSQUIRRELVM v = pool ? sq_openex(1024, &a) : sq_open(1024);
+    sq_pushroottable(v);
+    if(SQ_FAILED(sq_compilebuffer(v, workload, (SQInteger)scstrlen(workload), _SC("workload"), SQFalse))) {
+        printf("compile failed\n");
+        exit(1);
+    }
+    double best = 1e30;
+    for(int run = 0; run < SCRIPT_RUNS; run++) {
+        double t0 = now_us();
+        sq_push(v, -1);
+        sq_pushroottable(v);
+        if(SQ_FAILED(sq_call(v, 1, SQFalse, SQFalse))) {
+            printf("run failed\n");
+            exit(1);
+        }
+        sq_pop(v, 1);
+        double t = now_us() - t0;
+        if(t < best) best = t;
+    }
+    sq_close(v);
+    return best;
+}
+
+int main()
+{
+    SQAllocator m = { _malloc_alloc, _malloc_realloc, _malloc_free, NULL, NULL };
+    SQAllocator p;
+    sq_newpoolallocator(&p);
+    double rm = raw(m), rp = raw(p);
+    p.release(p.up);
+    printf("raw alloc+free:   malloc %6.1f ns   pool %6.1f ns\n", rm, rp);
+    double sm = script(false), sp = script(true);
+    printf("script (best of %d): malloc %7.1f us   pool %7.1f us\n", SCRIPT_RUNS, sm, sp);
+    return 0;
+}
@@ -0,0 +1,77 @@
+/*
+    compile-time binding (addFunc<&fn>, Class::addFunc<&T::fn>) against the std::function
+    binding (addFunc(name, std::function) / addFunc(name, &T::fn)) and a raw SQFUNCTION.
+    Time per call of a script loop calling the function, the empty loop is printed apart.
+    Uses the simplesquirrel headers, so it needs CoreMinimal.h (FString) on the include path.
+*/
+#include <simplesquirrel/simplesquirrel.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+static int add(int a, int b) { return a + b; }
+
+struct Counter {
+    int base = 10;
+    int get(int a) { return base + a; }
+};
+
+static SQInteger rawAdd(HSQUIRRELVM v)
+{
+    SQInteger a, b;
+    sq_getinteger(v, 2, &a);
+    sq_getinteger(v, 3, &b);
+    sq_pushinteger(v, a + b);
+    return 1;
+}
+
+#define RUNS 7
+
+//best time per iteration of the loop
+static double bench(ssq::VM& vm, const SQChar* loop, int n)
+{
+    SQChar src[256];
+    swprintf(src, 256, _SC("local c = Counter(); local s = 0; for(local i = 0; i < %d; i++) %ls"), n, loop);
+    ssq::Script script = vm.compileSource(src);
+    double best = 1e30;
+    for (int r = 0; r < RUNS; r++) {
+        auto t0 = std::chrono::steady_clock::now();
+        vm.run(script);
+        auto t1 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(t1 - t0).count() / n);
+    }
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    int n = argc > 1 ? atoi(argv[1]) : 1000000;
+    ssq::VM vm(1024, ssq::Libs::Flag(0));
+    vm.addFunc("addFunction", std::function<int(int, int)>(add));
+    vm.addFunc<&add>("addBound");
+    HSQUIRRELVM v = vm.getHandle();
+    sq_pushobject(v, vm.getRaw());
+    sq_pushstring(v, _SC("addRaw"), -1);
+    sq_newclosure(v, rawAdd, 0);
+    sq_setparamscheck(v, 3, _SC(".ii"));
+    sq_newslot(v, -3, SQFalse);
+    sq_pop(v, 1);
+    ssq::Class cls = vm.addClass("Counter", ssq::Class::Ctor<Counter()>());
+    cls.addFunc("getFunction", &Counter::get);
+    cls.addFunc<&Counter::get>("getBound");
+
+    double loop = bench(vm, _SC("s += i;"), n);
+    double raw = bench(vm, _SC("s += addRaw(i, 1);"), n);
+    double freeFunction = bench(vm, _SC("s += addFunction(i, 1);"), n);
+    double freeBound = bench(vm, _SC("s += addBound(i, 1);"), n);
+    double memberFunction = bench(vm, _SC("s += c.getFunction(i);"), n);
+    double memberBound = bench(vm, _SC("s += c.getBound(i);"), n);
+    wprintf(L"ns per call (best of %d, loop of %d calls), empty loop %.1f ns\n", RUNS, n, loop);
+    wprintf(L"raw SQFUNCTION      %7.1f\n", raw - loop);
+    wprintf(L"free   std::function %7.1f  compile-time %7.1f\n", freeFunction - loop, freeBound - loop);
+    wprintf(L"member std::function %7.1f  compile-time %7.1f\n", memberFunction - loop, memberBound - loop);
+    return 0;
+}
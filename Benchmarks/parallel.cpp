@@ -0,0 +1,85 @@
+/*
+    parallel array operations (array.pmap).
+    1. overhead: a pmap of 64 integers with a trivial callback, the cost of dispatching the
+       slices to the workers and copying the data in and out
+    2. scaling: a pmap of a CPU bound callback split in 1 to 2x the hardware threads slices,
+       speedup against map() on the calling VM
+*/
+#include <squirrel/squirrel.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+
+static double now_us()
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void compile(HSQUIRRELVM v, const std::basic_string<SQChar> &src)
+{
+    if(SQ_FAILED(sq_compilebuffer(v, src.c_str(), (SQInteger)src.size(), _SC("bench"), SQFalse))) {
+        printf("compile failed\n");
+        exit(1);
+    }
+}
+
+//best time of the closure on top of the stack
+static double best(HSQUIRRELVM v, int runs)
+{
+    double t = 1e30;
+    for(int r = 0; r < runs; r++) {
+        sq_push(v, -1);
+        sq_pushroottable(v);
+        double t0 = now_us();
+        if(SQ_FAILED(sq_call(v, 1, SQFalse, SQFalse))) {
+            printf("run failed\n");
+            exit(1);
+        }
+        t = std::min(t, now_us() - t0);
+        sq_pop(v, 1);
+    }
+    sq_pop(v, 1);
+    return t;
+}
+
+static std::basic_string<SQChar> num(int n)
+{
+    std::string s = std::to_string(n);
+    return std::basic_string<SQChar>(s.begin(), s.end());
+}
+
+static const SQChar *work = _SC("function(x) { local s = 0; for(local i = 0; i < 2000; i++) s += (x * i) % 7; return s }");
+
+int main()
+{
+    int hw = (int)std::thread::hardware_concurrency();
+    if(hw < 1) hw = 1;
+    HSQUIRRELVM v = sq_open(1024);
+    sq_pushroottable(v);
+    compile(v, _SC("small <- []; for(local i = 0; i < 64; i++) small.append(i); big <- []; for(local i = 0; i < 4096; i++) big.append(i)"));
+    sq_pushroottable(v);
+    sq_call(v, 1, SQFalse, SQFalse);
+    sq_pop(v, 1);
+
+    compile(v, _SC("::small.pmap(function(x) { return x + 1 }, ") + num(hw) + _SC(")"));
+    double first = best(v, 1);
+    compile(v, _SC("::small.pmap(function(x) { return x + 1 }, ") + num(hw) + _SC(")"));
+    double overhead = best(v, 200);
+    printf("pmap of 64 items on %d workers: first call %.1f us, next calls %.1f us\n", hw, first, overhead);
+
+    compile(v, _SC("::big.map(") + std::basic_string<SQChar>(work) + _SC(")"));
+    double serial = best(v, 5);
+    printf("map of 4096 items on the calling vm: %.0f us\n", serial);
+    printf("%8s %10s %8s\n", "slices", "us", "speedup");
+    for(int n = 1; n <= 2 * hw; n *= 2) {
+        compile(v, _SC("::big.pmap(") + std::basic_string<SQChar>(work) + _SC(", ") + num(n) + _SC(")"));
+        double t = best(v, 5);
+        printf("%8d %10.0f %8.2f\n", n, t, serial / t);
+    }
+    sq_pop(v, 1);
+    sq_close(v);
+    return 0;
+}
@@ -0,0 +1,123 @@
+/*
+    coroutine scheduler (sqstd_register_schedlib).
+    1. memory of a parked coroutine: live bytes of the state per coroutine waiting in nexttick()
+    2. yield/resume: time per coroutine of a tick resuming all of them once
+    3. timers: time per coroutine woken by the timer wheel from sleep()
+    4. events: time per coroutine woken by signal() from waitevent() and resumed by the next tick
+    5. metamethods: time per coroutine of a tick where each one adds two instances with an _add
+       of 30 locals; the first deep call of the thread is a metamethod, which cannot grow the stack
+    for a growing number of coroutines, the costs per coroutine should stay flat
+*/
+#include <squirrel/squirrel.h>
+#include <squirrel/sqstdsched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <chrono>
+
+static double now_ns()
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void run(HSQUIRRELVM v, const std::basic_string<SQChar> &src)
+{
+    SQInteger top = sq_gettop(v);
+    if(SQ_FAILED(sq_compilebuffer(v, src.c_str(), (SQInteger)src.size(), _SC("bench"), SQFalse))) {
+        printf("compile failed\n");
+        exit(1);
+    }
+    sq_pushroottable(v);
+    if(SQ_FAILED(sq_call(v, 1, SQFalse, SQFalse))) {
+        printf("run failed\n");
+        exit(1);
+    }
+    sq_settop(v, top);
+}
+
+static std::basic_string<SQChar> num(int n)
+{
+    std::string s = std::to_string(n);
+    return std::basic_string<SQChar>(s.begin(), s.end());
+}
+
+static HSQUIRRELVM open()
+{
+    HSQUIRRELVM v = sq_open(1024);
+    sq_pushroottable(v);
+    sqstd_register_schedlib(v);
+    sq_pop(v, 1);
+    return v;
+}
+
+#define TICKS 20
+#define TIMER_TICKS 640
+
+static std::basic_string<SQChar> vecclass()
+{
+    std::basic_string<SQChar> s = _SC("class V { x = 0; constructor(a) { x = a } function _add(o) { ");
+    for(int i = 0; i < 30; i++) s += _SC("local l") + num(i) + _SC(" = x + ") + num(i) + _SC("; ");
+    return s + _SC("return V(o.x + l29 - 29) } }");
+}
+
+int main()
+{
+    printf("%10s %14s %16s %14s %14s %14s\n", "coroutines", "bytes/parked", "yield+resume ns", "timer ns", "event ns", "metamethod ns");
+    for(int n = 1000; n <= 100000; n *= 10) {
+        HSQUIRRELVM v = open();
+        SQInteger t = 0;
+        SQMemStats m0, m1;
+        sq_collectgarbage(v);
+        sq_getmemstats(v, &m0);
+        run(v, _SC("for(local i = 0; i < ") + num(n) + _SC("; i++) spawn(function() { while(true) nexttick() })"));
+        sqstd_schedtick(v, ++t);
+        sq_collectgarbage(v);
+        sq_getmemstats(v, &m1);
+        double bytes = (double)(m1.total - m0.total) / n;
+        double t0 = now_ns();
+        for(int r = 0; r < TICKS; r++) sqstd_schedtick(v, ++t);
+        double yield = (now_ns() - t0) / ((double)TICKS * n);
+        sq_close(v);
+
+        //the coroutines sleep 1 to 64 ticks in a loop, TIMER_TICKS ticks wake each one
+        //TIMER_TICKS/d times
+        v = open();
+        t = 0;
+        run(v, _SC("for(local i = 0; i < ") + num(n) + _SC("; i++) spawn(function(d) { while(true) sleep(d) }, i % 64 + 1)"));
+        sqstd_schedtick(v, ++t);
+        double wakes = 0;
+        for(int i = 0; i < n; i++) wakes += TIMER_TICKS / (i % 64 + 1);
+        t0 = now_ns();
+        for(int r = 0; r < TIMER_TICKS; r++) sqstd_schedtick(v, ++t);
+        double timer = (now_ns() - t0) / wakes;
+        sq_close(v);
+
+        v = open();
+        run(v, _SC("for(local i = 0; i < ") + num(n) + _SC("; i++) spawn(function() { while(true) waitevent(\"go\") })"));
+        t = 0;
+        sqstd_schedtick(v, ++t);
+        t0 = now_ns();
+        for(int r = 0; r < TICKS; r++) {
+            run(v, _SC("signal(\"go\")"));
+            sqstd_schedtick(v, ++t);
+        }
+        double event = (now_ns() - t0) / ((double)TICKS * n);
+        sq_close(v);
+
+        v = open();
+        run(v, vecclass());
+        run(v, _SC("for(local i = 0; i < ") + num(n) + _SC("; i++) spawn(function() { while(true) { local r = V(1) + V(2); nexttick() } })"));
+        t = 0;
+        t0 = now_ns();
+        for(int r = 0; r < TICKS; r++) sqstd_schedtick(v, ++t);
+        double meta = (now_ns() - t0) / ((double)TICKS * n);
+        //a coroutine that fails is released by the scheduler
+        if(sqstd_schedcount(v) != n) {
+            printf("metamethod coroutines failed\n");
+            exit(1);
+        }
+        sq_close(v);
+        printf("%10d %14.0f %16.1f %14.1f %14.1f %14.1f\n", n, bytes, yield, timer, event, meta);
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+/*
+    VM snapshots (sq_snapshot): cost of a per-session VM.
+    1. cold: sq_open, registering the math/string/blob libraries and running the init script
+    2. sq_openfromsnapshot of the same state, and sq_close
+    3. sq_resetfromsnapshot of a VM that ran a session script
+    with the default allocator and with the pool allocator
+*/
+#include <squirrel/squirrel.h>
+#include <squirrel/sqstdmath.h>
+#include <squirrel/sqstdstring.h>
+#include <squirrel/sqstdblob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+
+static double now_us()
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//a small game-like environment: a few classes, tables of constants and helper functions
+static const SQChar *init = _SC(
+    "enum Team { Red, Blue }\n"
+    "config <- { speed = 4.5, gravity = 9.8, names = [\"a\", \"b\", \"c\"] }\n"
+    "class Vec { x = 0; y = 0; constructor(_x, _y) { x = _x; y = _y } function len() { return ::sqrt(x * x + y * y) } }\n"
+    "class Entity { pos = null; hp = 100; team = Team.Red; constructor() { pos = Vec(0, 0) } function hit(n) { hp -= n; return hp <= 0 } }\n"
+    "class Player extends Entity { name = \"\"; function greet() { return ::format(\"hi %s\", name) } }\n"
+    "function spawn(n) { local r = []; for(local i = 0; i < n; i++) r.append(Player()); return r }\n"
+    "function score(list) { local s = 0; foreach(p in list) s += p.hp; return s }\n"
+    "helpers <- {}\n"
+    "for(local i = 0; i < 32; i++) helpers[\"h\" + i] <- function(x) { return x + i }.bindenv(this)\n");
+
+static const SQChar *session = _SC("local l = spawn(20); foreach(p in l) p.hit(30); ::last <- score(l)");
+
+static void run(HSQUIRRELVM v, const SQChar *src)
+{
+    if(SQ_FAILED(sq_compilebuffer(v, src, (SQInteger)scstrlen(src), _SC("bench"), SQFalse))) {
+        printf("compile failed\n");
+        exit(1);
+    }
+    sq_pushroottable(v);
+    if(SQ_FAILED(sq_call(v, 1, SQFalse, SQFalse))) {
+        printf("run failed\n");
+        exit(1);
+    }
+    sq_pop(v, 1);
+}
+
+//a pool allocator belongs to one state, sq_close releases it
+static const SQAllocator *allocator(bool pool, SQAllocator &a)
+{
+    if(!pool) return NULL;
+    sq_newpoolallocator(&a);
+    return &a;
+}
+
+static HSQUIRRELVM cold(bool pool)
+{
+    SQAllocator a;
+    HSQUIRRELVM v = sq_openex(1024, allocator(pool, a));
+    sq_pushroottable(v);
+    sqstd_register_mathlib(v);
+    sqstd_register_stringlib(v);
+    sqstd_register_bloblib(v);
+    sq_pop(v, 1);
+    run(v, init);
+    return v;
+}
+
+#define ROUNDS 2000
+
+struct Times
+{
+    double cold, open, close, reset;
+};
+
+static Times measure(bool pool)
+{
+    SQAllocator a;
+    Times t = { 1e30, 1e30, 1e30, 1e30 };
+    HSQUIRRELVM src = cold(pool);
+    HSQSNAPSHOT snap;
+    if(SQ_FAILED(sq_snapshot(src, &snap))) {
+        printf("snapshot failed\n");
+        exit(1);
+    }
+    for(int r = 0; r < ROUNDS / 10; r++) {
+        double t0 = now_us();
+        HSQUIRRELVM v = cold(pool);
+        t.cold = std::min(t.cold, now_us() - t0);
+        sq_close(v);
+    }
+    for(int r = 0; r < ROUNDS; r++) {
+        double t0 = now_us();
+        HSQUIRRELVM v = sq_openfromsnapshot(snap, 1024, allocator(pool, a));
+        double t1 = now_us();
+        sq_close(v);
+        double t2 = now_us();
+        t.open = std::min(t.open, t1 - t0);
+        t.close = std::min(t.close, t2 - t1);
+    }
+    HSQUIRRELVM v = sq_openfromsnapshot(snap, 1024, allocator(pool, a));
+    for(int r = 0; r < ROUNDS; r++) {
+        run(v, session);
+        double t0 = now_us();
+        sq_resetfromsnapshot(v, snap);
+        t.reset = std::min(t.reset, now_us() - t0);
+    }
+    sq_close(v);
+    sq_releasesnapshot(snap);
+    return t;
+}
+
+int main()
+{
+    Times m = measure(false);
+    Times p = measure(true);
+    printf("best of %d, us      cold    open   close   reset\n", ROUNDS);
+    printf("malloc          %7.1f %7.1f %7.1f %7.1f\n", m.cold, m.open, m.close, m.reset);
+    printf("pool            %7.1f %7.1f %7.1f %7.1f\n", p.cold, p.open, p.close, p.reset);
+    return 0;
+}
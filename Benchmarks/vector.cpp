@@ -0,0 +1,93 @@
+/*
+    sqvector growth and shrink policy (SQ_VECTOR_GROWTH, SQ_VECTOR_SHRINK_RATIO): number of
+    allocator calls and time of the array operations that resize the vector of an array.
+    Build it again with -DSQ_VECTOR_GROWTH(c)=... or -DSQ_VECTOR_SHRINK_RATIO=... to compare
+    other policies.
+*/
+#include <squirrel/squirrel.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+static double now_us()
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Counts
+{
+    SQUnsignedInteger allocs;
+    SQUnsignedInteger reallocs;
+    SQUnsignedInteger frees;
+};
+
+static void *_count_alloc(SQUserPointer up, SQUnsignedInteger size) { ((Counts *)up)->allocs++; return malloc(size); }
+static void *_count_realloc(SQUserPointer up, void *p, SQUnsignedInteger, SQUnsignedInteger size) { ((Counts *)up)->reallocs++; return realloc(p, size); }
+static void _count_free(SQUserPointer up, void *p, SQUnsignedInteger) { ((Counts *)up)->frees++; free(p); }
+
+struct Workload
+{
+    const char *name;
+    const SQChar *setup;
+    const SQChar *body;
+};
+
+#define N _SC("100000")
+
+static const Workload workloads[] = {
+    { "append", _SC(""),
+      _SC("local a = []; for(local i = 0; i < ") N _SC("; i++) a.append(i)") },
+    { "resize(len()+1)", _SC(""),
+      _SC("local a = []; for(local i = 0; i < ") N _SC("; i++) a.resize(a.len() + 1, i)") },
+    { "insert(0)", _SC(""),
+      _SC("local a = []; for(local i = 0; i < 20000; i++) a.insert(0, i)") },
+    { "pop to empty", _SC("big <- array(") N _SC(", 0)"),
+      _SC("local a = clone big; while(a.len()) a.pop()") },
+    { "push/pop at threshold", _SC("big <- array(") N _SC(", 0)"),
+      _SC("local a = clone big; a.resize(") N _SC(" / 4); for(local i = 0; i < ") N _SC("; i++) { a.push(i); a.pop(); a.pop(); a.push(i) }") },
+};
+
+static void compile(HSQUIRRELVM v, const SQChar *src)
+{
+    if(SQ_FAILED(sq_compilebuffer(v, src, (SQInteger)scstrlen(src), _SC("workload"), SQFalse))) {
+        printf("compile failed\n");
+        exit(1);
+    }
+}
+
+//calls the closure on top of the stack and leaves it there
+static void call(HSQUIRRELVM v)
+{
+    sq_push(v, -1);
+    sq_pushroottable(v);
+    if(SQ_FAILED(sq_call(v, 1, SQFalse, SQFalse))) {
+        printf("run failed\n");
+        exit(1);
+    }
+}
+
+int main()
+{
+    printf("%-24s %10s %10s %10s %10s\n", "workload", "allocs", "reallocs", "frees", "us");
+    for(const Workload &w : workloads) {
+        Counts c = { 0, 0, 0 };
+        SQAllocator a = { _count_alloc, _count_realloc, _count_free, NULL, &c };
+        HSQUIRRELVM v = sq_openex(1024, &a);
+        if(*w.setup) {
+            compile(v, w.setup);
+            call(v);
+            sq_pop(v, 1);
+        }
+        compile(v, w.body);
+        Counts before = c;
+        double t0 = now_us();
+        call(v);
+        double t = now_us() - t0;
+        printf("%-24s %10llu %10llu %10llu %10.0f\n", w.name,
+            (unsigned long long)(c.allocs - before.allocs), (unsigned long long)(c.reallocs - before.reallocs),
+            (unsigned long long)(c.frees - before.frees), t);
+        sq_pop(v, 1);
+        sq_close(v);
+    }
+    return 0;
+}
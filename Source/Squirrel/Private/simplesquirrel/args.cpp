@@ -6,7 +6,9 @@
 #include <simplesquirrel/function.hpp>
 #include <simplesquirrel/enum.hpp>
 #include <simplesquirrel/array.hpp>
+#include <simplesquirrel/string.hpp>
 #include <squirrel/squirrel.h>
+#include <string>
 
 namespace ssq {
     namespace detail {
@@ -34,5 +36,42 @@ namespace ssq {
         void pushRaw(HSQUIRRELVM vm, const SqWeakRef& value) {
             sq_pushobject(vm, value.getRaw());
         }
+        void pushRaw(HSQUIRRELVM vm, const String& value) {
+            sq_pushobject(vm, value.getRaw());
+        }
+
+        Error lastError(HSQUIRRELVM vm) {
+            const SQChar* err = nullptr;
+            sq_getlasterror(vm);
+            if (SQ_FAILED(sq_getstring(vm, -1, &err))) {
+                err = _SC("unknown error");
+            }
+            Error ret(err);
+            sq_pop(vm, 1);
+            return ret;
+        }
+
+#ifdef SQUNICODE
+        Error popError(HSQUIRRELVM vm, SQInteger index) {
+            return Error("Type error bad cast got: " + FString(typeToStr(Type(sq_gettype(vm, index)))));
+        }
+#else
+        Error popError(HSQUIRRELVM vm, SQInteger index) {
+            return Error(std::string("Type error bad cast got: ") + typeToStr(Type(sq_gettype(vm, index))));
+        }
+#endif
+
+        SQInteger throwArgError(HSQUIRRELVM vm, SQInteger index) {
+            // the parameters are counted from "this", as with the typemask errors
+            static const int size = 96;
+            SQChar* msg = sq_getscratchpad(vm, size * sizeof(SQChar));
+            int len = scsprintf(msg, size, _SC("parameter %d has an invalid type '"), static_cast<int>(index - 1));
+            for (const char* type = typeToStr(Type(sq_gettype(vm, index))); *type && len < size - 2; type++) {
+                msg[len++] = static_cast<SQChar>(*type);
+            }
+            msg[len++] = _SC('\'');
+            msg[len] = _SC('\0');
+            return sq_throwerror(vm, msg);
+        }
     }
 }
\ No newline at end of file
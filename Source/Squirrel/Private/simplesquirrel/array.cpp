@@ -6,8 +6,8 @@
 namespace ssq {
     Array::Array(HSQUIRRELVM vm, size_t len):Object(vm) {
         sq_newarray(vm, len);
-        sq_getstackobj(vm, -1, &obj);
-        sq_addref(vm, &obj);
+        sq_getstackobj(vm, -1, &handle._obj);
+        addRef();
         sq_pop(vm,1); // Pop array
     }
 
@@ -24,30 +24,18 @@ namespace ssq {
     }
 
     size_t Array::size() {
-        sq_pushobject(vm, obj);
+        sq_pushobject(vm, handle._obj);
         SQInteger s = sq_getsize(vm, -1);
         sq_pop(vm, 1);
         return static_cast<size_t>(s);
     }
 
     std::vector<Object> Array::convertRaw() {
-        sq_pushobject(vm, obj);
-        SQInteger s = sq_getsize(vm, -1);
-        std::vector<Object> ret;
-        ret.reserve(s);
-        while(s--) {
-            if(SQ_FAILED(sq_arraypop(vm, -1, true))) {
-                sq_pop(vm, 1);
-                throw TypeException("Failed to pop value from back of the array");
-            }
-            ret.push_back(detail::pop<Object>(vm, -1));
-        }
-        sq_pop(vm, 1);
-        return ret;
+        return convert<Object>();
     }
 
     void Array::pop() {
-        sq_pushobject(vm, obj);
+        sq_pushobject(vm, handle._obj);
         auto s = sq_getsize(vm, -1);
         if(s == 0) {
             sq_pop(vm, 1);
@@ -19,8 +19,8 @@ namespace ssq {
 
         if (object.getType() != Type::CLASS) throw TypeException("bad cast", "CLASS", object.getTypeStr());
         if (vm != nullptr && !object.isEmpty()) {
-            obj = object.getRaw();
-            sq_addref(vm, &obj);
+            handle._obj = object.getRaw();
+            addRef();
         }
     }
 
@@ -70,7 +70,7 @@ namespace ssq {
       }
 
       // Find the table
-      sq_pushobject(vm, obj);
+      sq_pushobject(vm, handle._obj);
       sq_pushstring(vm, *name, name.Len());
 
       if (SQ_FAILED(sq_get(vm, -2))) {
@@ -81,10 +81,10 @@ namespace ssq {
         table = Object(vm);
         sq_newtable(vm);
         sq_getstackobj(vm, -1, &table.getRaw());
-        sq_addref(vm, &table.getRaw());
+        table.addRef();
         sq_pop(vm, 1);
 
-        sq_pushobject(vm, obj); // Push class obj
+        sq_pushobject(vm, handle._obj); // Push class obj
         sq_pushstring(vm, *name, name.Len());
         sq_pushobject(vm, table.getRaw());
         sq_newclosure(vm, dlg, 1);
@@ -100,7 +100,7 @@ namespace ssq {
         // Return one
         table = Object(vm);
         sq_getstackobj(vm, -1, &table.getRaw());
-        sq_addref(vm, &table.getRaw());
+        table.addRef();
         sq_pop(vm, 2);
       }
     }
@@ -112,7 +112,7 @@ namespace ssq {
         }
             
         // Find the table
-        sq_pushobject(vm, obj);
+        sq_pushobject(vm, handle._obj);
         sq_pushstring(vm, name, strlen(name));
 
         if (SQ_FAILED(sq_get(vm, -2))) {
@@ -123,10 +123,10 @@ namespace ssq {
             table = Object(vm);
             sq_newtable(vm);
             sq_getstackobj(vm, -1, &table.getRaw());
-            sq_addref(vm, &table.getRaw());
+            table.addRef();
             sq_pop(vm, 1);
 
-            sq_pushobject(vm, obj); // Push class obj
+            sq_pushobject(vm, handle._obj); // Push class obj
             sq_pushstring(vm, name, strlen(name));
             sq_pushobject(vm, table.getRaw());
             sq_newclosure(vm, dlg, 1);
@@ -141,7 +141,7 @@ namespace ssq {
             // Return one
             table = Object(vm);
             sq_getstackobj(vm, -1, &table.getRaw());
-            sq_addref(vm, &table.getRaw());
+            table.addRef();
             sq_pop(vm, 2);
         }
     }
@@ -13,8 +13,8 @@ namespace ssq {
 
     Enum::Enum(HSQUIRRELVM vm):Object(vm) {
         sq_newtable(vm);
-        sq_getstackobj(vm, -1, &obj);
-        sq_addref(vm, &obj);
+        sq_getstackobj(vm, -1, &handle._obj);
+        addRef();
         sq_pop(vm,1); // Pop enum table
     }
 
@@ -23,7 +23,7 @@ namespace ssq {
     unsigned int Function::getNumOfParams() const {
         SQInteger nparams;
         SQInteger nfreevars;
-        sq_pushobject(vm, obj);
+        sq_pushobject(vm, handle._obj);
         if (SQ_FAILED(sq_getclosureinfo(vm, -1, &nparams, &nfreevars))) {
             sq_pop(vm, 1);
             throw TypeException("Get function info failed");
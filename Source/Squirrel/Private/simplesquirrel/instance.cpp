@@ -27,12 +27,12 @@ namespace ssq {
 
     Class Instance::getClass() {
         Class cls(vm);
-        sq_pushobject(vm, obj);
+        sq_pushobject(vm, handle._obj);
         if(SQ_FAILED(sq_getclass(vm, -1))) {
             throw TypeException("Failed to get class from instance");
         }
         sq_getstackobj(vm, -1, &cls.getRaw());
-        sq_addref(vm, &cls.getRaw());
+        cls.addRef();
         sq_pop(vm, 1);
         return cls;
     }
@@ -64,7 +64,7 @@ namespace ssq {
 
     SqWeakRef::SqWeakRef(const Instance& instance): Instance(instance.getHandle()) {
         weak = true;
-        obj = instance.getRaw();
+        handle._obj = instance.getRaw();
     }
 
     SqWeakRef::SqWeakRef(SqWeakRef&& other):Instance() {
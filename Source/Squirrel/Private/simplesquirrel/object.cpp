@@ -9,7 +9,21 @@
 #include <cstring>
 
 namespace ssq {
-    HSQUIRRELVM Object::caller_vm=nullptr; 
+    static thread_local HSQUIRRELVM callerVM = nullptr;
+
+    HSQUIRRELVM Object::getCallerVM() {
+        return callerVM;
+    }
+
+    namespace detail {
+        CallerScope::CallerScope(HSQUIRRELVM vm):prev(callerVM) {
+            callerVM = vm;
+        }
+
+        CallerScope::~CallerScope() {
+            callerVM = prev;
+        }
+    }
 
     const char* typeToStr(Type type) {
         switch (type) {
@@ -36,12 +50,14 @@ namespace ssq {
     }
 
     Object::Object() :vm(nullptr), weak(false) {
-        sq_resetobject(&obj);
+        sq_resethandle(&handle);
+        sq_resetobject(&held);
     }
 
     Object::Object(HSQUIRRELVM vm) : vm(vm), weak(false) {
         if (vm == nullptr) throw RuntimeException("VM is not initialised");
-        sq_resetobject(&obj);
+        sq_resethandle(&handle);
+        sq_resetobject(&held);
     }
 
     Object::~Object() {
@@ -49,42 +65,73 @@ namespace ssq {
     }
 
     void Object::reset() {
-        if (vm != nullptr && !sq_isnull(obj) && !weak) {
-            sq_release(vm, &obj);
+        if (handle._next != nullptr) {
+            handle._obj = held;
+            sq_releasehandle(&handle);
+        } else if (vm != nullptr && !sq_isnull(handle._obj) && !weak) {
+            // Referenced with sq_addref by the caller of getRaw()
+            sq_release(vm, &handle._obj);
         }
-        sq_resetobject(&obj);
+        sq_resetobject(&handle._obj);
+        sq_resetobject(&held);
         weak = false;
     }
 
+    void Object::addRef() {
+        HSQOBJECT o = handle._obj;
+        // sq_sethandle releases the object the handle referenced until now
+        if (handle._next != nullptr) {
+            handle._obj = held;
+        } else {
+            sq_resetobject(&handle._obj);
+        }
+        sq_sethandle(vm, &handle, &o);
+        held = handle._obj;
+    }
+
     void Object::swap(Object& other) NOEXCEPT {
         using std::swap;
-        swap(obj, other.obj);
+        SQHandle tmp;
+        sq_resethandle(&tmp);
+        sq_movehandle(&tmp, &handle);
+        sq_movehandle(&handle, &other.handle);
+        sq_movehandle(&other.handle, &tmp);
+        swap(held, other.held);
         swap(vm, other.vm);
         swap(weak, other.weak);
     }
 
-    Object::Object(const Object& other) :vm(other.vm), obj(other.obj), weak(other.weak) {
-        if (vm != nullptr && !other.isEmpty() && !weak) {
-            sq_addref(vm, &obj);
+    Object::Object(const Object& other) :vm(other.vm), weak(other.weak) {
+        sq_resethandle(&handle);
+        if (weak || vm == nullptr) {
+            handle._obj = other.handle._obj;
+        } else if (other.handle._next != nullptr) {
+            sq_copyhandle(&handle, &other.handle);
+        } else {
+            sq_sethandle(vm, &handle, &other.handle._obj);
         }
+        held = handle._obj;
     }
 
-    Object::Object(Object&& other) NOEXCEPT :vm(nullptr) {
-        vm = nullptr;
-        sq_resetobject(&obj);
-        swap(other);
+    Object::Object(Object&& other) NOEXCEPT :vm(other.vm), weak(other.weak) {
+        sq_resethandle(&handle);
+        sq_movehandle(&handle, &other.handle);
+        held = other.held;
+        sq_resetobject(&other.held);
+        other.vm = nullptr;
+        other.weak = false;
     }
 
     bool Object::isEmpty() const {
-        return sq_isnull(obj);
+        return sq_isnull(handle._obj);
     }
 
     const HSQOBJECT& Object::getRaw() const {
-        return obj;
+        return handle._obj;
     }
 
     HSQOBJECT& Object::getRaw() {
-        return obj;
+        return handle._obj;
     }
 
     bool Object::isNull() const {
@@ -97,7 +144,7 @@ namespace ssq {
 
       Object ret(vm);
 
-      sq_pushobject(vm, obj);
+      sq_pushobject(vm, handle._obj);
       sq_pushstring(vm, *name, name.Len());
 
       if (SQ_FAILED(sq_get(vm, -2))) {
@@ -106,7 +153,7 @@ namespace ssq {
       }
 
       sq_getstackobj(vm, -1, &ret.getRaw());
-      sq_addref(vm, &ret.getRaw());
+      ret.addRef();
       sq_pop(vm, 2);
 
       return ret;
@@ -118,7 +165,7 @@ namespace ssq {
 
       Object ret(vm);
 
-      sq_pushobject(vm, obj);
+      sq_pushobject(vm, handle._obj);
       sq_pushstring(vm, *name, name.Len());
 
       if (SQ_FAILED(sq_get(vm, -2))) {
@@ -127,7 +174,7 @@ namespace ssq {
       }
 
       sq_getstackobj(vm, -1, &ret.getRaw());
-      sq_addref(vm, &ret.getRaw());
+      ret.addRef();
       sq_pop(vm, 2);
 
       return true;
@@ -138,7 +185,7 @@ namespace ssq {
 
         Object ret(vm);
 
-        sq_pushobject(vm, obj);
+        sq_pushobject(vm, handle._obj);
         sq_pushstring(vm, name, strlen(name));
 
         if (SQ_FAILED(sq_get(vm, -2))) {
@@ -147,7 +194,7 @@ namespace ssq {
         }
 
         sq_getstackobj(vm, -1, &ret.getRaw());
-        sq_addref(vm, &ret.getRaw());
+        ret.addRef();
         sq_pop(vm, 2);
 
         return ret;
@@ -160,13 +207,13 @@ namespace ssq {
         auto valueType = sq_gettype(vm, -1);
         sq_pop(vm, 1);*/
 
-        return Type(obj._type);
+        return Type(handle._obj._type);
     }
 
     size_t Object::getTypeTag() const {
         if (isEmpty()) return 0;
         SQUserPointer typetag;
-        sq_pushobject(vm, obj);
+        sq_pushobject(vm, handle._obj);
         sq_gettypetag(vm, -1, &typetag);
         sq_pop(vm, 1);
         return reinterpret_cast<size_t>(typetag);
@@ -0,0 +1,215 @@
+#include <simplesquirrel/scheduler.hpp>
+#include <squirrel/squirrel.h>
+#include <deque>
+
+// jobs a worker runs on one VM before giving the other VMs of its queue a turn
+#ifndef SSQ_SCHEDULER_BATCH
+#define SSQ_SCHEDULER_BATCH 64
+#endif
+
+namespace ssq {
+    // scheduler and worker index of the calling thread, set on the worker threads only
+    static thread_local Scheduler* currentScheduler = nullptr;
+    static thread_local size_t currentWorker = 0;
+
+    struct Scheduler::Slot {
+        explicit Slot(VM&& vm):vm(std::move(vm)), scheduled(false) {
+        }
+        VM vm;
+        std::mutex mutex;
+        std::deque<Job> jobs;
+        // true while the slot sits in a worker queue or runs, the VM is not touched otherwise
+        bool scheduled;
+    };
+
+    // the owner takes the slots from the back of its queue, thieves from the front
+    struct Scheduler::Worker {
+        std::thread thread;
+        std::mutex mutex;
+        std::deque<Slot*> queue;
+    };
+
+    Scheduler::Scheduler(std::vector<VM>&& vms, size_t workerCount)
+        :next(0), ready(0), pending(0), stopping(false) {
+        if (vms.empty()) {
+            throw RuntimeException("Scheduler without VM");
+        }
+        for (auto& vm : vms) {
+            slots.emplace_back(new Slot(std::move(vm)));
+        }
+        vms.clear();
+        start(workerCount);
+    }
+
+    Scheduler::Scheduler(const VMSnapshot& snapshot, size_t vmCount, size_t workerCount, size_t stackSize)
+        :next(0), ready(0), pending(0), stopping(false) {
+        if (vmCount == 0) {
+            throw RuntimeException("Scheduler without VM");
+        }
+        for (size_t i = 0; i < vmCount; i++) {
+            slots.emplace_back(new Slot(VM(snapshot, stackSize)));
+        }
+        start(workerCount);
+    }
+
+    Scheduler::~Scheduler() {
+        {
+            std::unique_lock<std::mutex> lock(doneMutex);
+            doneCond.wait(lock, [this] { return pending.load() == 0; });
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        sleepCond.notify_all();
+        for (auto& worker : workers) {
+            worker->thread.join();
+        }
+    }
+
+    void Scheduler::start(size_t workerCount) {
+        if (workerCount == 0) {
+            workerCount = std::thread::hardware_concurrency();
+            if (workerCount == 0) workerCount = 1;
+        }
+        for (size_t i = 0; i < workerCount; i++) {
+            workers.emplace_back(new Worker());
+        }
+        for (size_t i = 0; i < workerCount; i++) {
+            workers[i]->thread = std::thread(&Scheduler::run, this, i);
+        }
+    }
+
+    void Scheduler::submit(Job job) {
+        submit(next.fetch_add(1, std::memory_order_relaxed) % slots.size(), std::move(job));
+    }
+
+    void Scheduler::submit(size_t vmIndex, Job job) {
+        if (vmIndex >= slots.size()) {
+            throw RuntimeException("VM index out of range");
+        }
+        Slot* slot = slots[vmIndex].get();
+        pending.fetch_add(1);
+        bool schedule;
+        {
+            std::lock_guard<std::mutex> lock(slot->mutex);
+            slot->jobs.push_back(std::move(job));
+            schedule = !slot->scheduled;
+            slot->scheduled = true;
+        }
+        if (schedule) {
+            // a VM woken from a job stays with that worker, otherwise it goes to its home worker
+            push(slot, currentScheduler == this ? currentWorker : vmIndex % workers.size(), false);
+        }
+    }
+
+    void Scheduler::wait() {
+        if (currentScheduler == this) {
+            throw RuntimeException("Scheduler::wait called from a job");
+        }
+        std::unique_lock<std::mutex> lock(doneMutex);
+        doneCond.wait(lock, [this] { return pending.load() == 0; });
+        std::exception_ptr e;
+        std::swap(e, error);
+        lock.unlock();
+        if (e) {
+            std::rethrow_exception(e);
+        }
+    }
+
+    VM& Scheduler::getVM(size_t vmIndex) {
+        if (vmIndex >= slots.size()) {
+            throw RuntimeException("VM index out of range");
+        }
+        return slots[vmIndex]->vm;
+    }
+
+    void Scheduler::push(Slot* slot, size_t worker, bool front) {
+        Worker& w = *workers[worker];
+        {
+            std::lock_guard<std::mutex> lock(w.mutex);
+            if (front) w.queue.push_front(slot);
+            else w.queue.push_back(slot);
+        }
+        ready.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        sleepCond.notify_one();
+    }
+
+    Scheduler::Slot* Scheduler::take(size_t worker) {
+        {
+            Worker& w = *workers[worker];
+            std::lock_guard<std::mutex> lock(w.mutex);
+            if (!w.queue.empty()) {
+                Slot* slot = w.queue.back();
+                w.queue.pop_back();
+                ready.fetch_sub(1);
+                return slot;
+            }
+        }
+        for (size_t i = 1; i < workers.size(); i++) {
+            Worker& victim = *workers[(worker + i) % workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.queue.empty()) {
+                Slot* slot = victim.queue.front();
+                victim.queue.pop_front();
+                ready.fetch_sub(1);
+                return slot;
+            }
+        }
+        return nullptr;
+    }
+
+    void Scheduler::runSlot(Slot* slot, size_t worker) {
+        for (size_t n = 0; n < SSQ_SCHEDULER_BATCH; n++) {
+            Job job;
+            {
+                std::lock_guard<std::mutex> lock(slot->mutex);
+                if (slot->jobs.empty()) {
+                    slot->scheduled = false;
+                    return;
+                }
+                job = std::move(slot->jobs.front());
+                slot->jobs.pop_front();
+            }
+            try {
+                job(slot->vm);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(doneMutex);
+                if (!error) error = std::current_exception();
+            }
+            if (pending.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(doneMutex);
+                doneCond.notify_all();
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(slot->mutex);
+            if (slot->jobs.empty()) {
+                slot->scheduled = false;
+                return;
+            }
+        }
+        // more jobs left, requeue behind the other VMs of this worker
+        push(slot, worker, true);
+    }
+
+    void Scheduler::run(size_t worker) {
+        currentScheduler = this;
+        currentWorker = worker;
+        for (;;) {
+            Slot* slot = take(worker);
+            if (slot) {
+                runSlot(slot, worker);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepCond.wait(lock, [this] { return stopping || ready.load() > 0; });
+            if (stopping && ready.load() == 0) {
+                return;
+            }
+        }
+    }
+}
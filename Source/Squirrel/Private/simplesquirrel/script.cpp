@@ -20,4 +20,52 @@ namespace ssq {
         Object::operator = (std::forward<Script>(other));
         return *this;
     }
+
+    SharedScript::SharedScript() :code(nullptr) {
+
+    }
+
+    SharedScript::SharedScript(HSQCODE code) :code(code) {
+
+    }
+
+    SharedScript::~SharedScript() {
+        if (code) sq_releasecode(code);
+    }
+
+    void SharedScript::swap(SharedScript& other) NOEXCEPT {
+        using std::swap;
+        swap(code, other.code);
+    }
+
+    SharedScript::SharedScript(const SharedScript& other) :code(other.code) {
+        if (code) sq_addrefcode(code);
+    }
+
+    SharedScript::SharedScript(SharedScript&& other) NOEXCEPT :code(nullptr) {
+        swap(other);
+    }
+
+    SharedScript& SharedScript::operator = (const SharedScript& other) {
+        if (this != &other) {
+            SharedScript o(other);
+            swap(o);
+        }
+        return *this;
+    }
+
+    SharedScript& SharedScript::operator = (SharedScript&& other) NOEXCEPT {
+        if (this != &other) {
+            swap(other);
+        }
+        return *this;
+    }
+
+    bool SharedScript::isEmpty() const {
+        return code == nullptr;
+    }
+
+    HSQCODE SharedScript::getRaw() const {
+        return code;
+    }
 }
@@ -0,0 +1,66 @@
+#include <simplesquirrel/string.hpp>
+#include <simplesquirrel/exceptions.hpp>
+#include <squirrel/squirrel.h>
+
+namespace ssq {
+    String::String(HSQUIRRELVM vm):Object(vm) {
+
+    }
+
+    String::String(HSQUIRRELVM vm, const SQChar* str, size_t len):Object(vm) {
+        sq_pushstring(vm, str, static_cast<SQInteger>(len));
+        sq_getstackobj(vm, -1, &handle._obj);
+        addRef();
+        sq_pop(vm, 1);
+    }
+
+    String::String(HSQUIRRELVM vm, const StringView& str):String(vm, str.data(), str.size()) {
+
+    }
+
+#ifdef SQUNICODE
+    String::String(HSQUIRRELVM vm, const FString& str):String(vm, *str, str.Len()) {
+
+    }
+#else
+    String::String(HSQUIRRELVM vm, const std::string& str):String(vm, str.c_str(), str.size()) {
+
+    }
+#endif
+
+    String::String(const Object& object):Object(object) {
+        if (object.getType() != Type::STRING) throw TypeException("bad cast", "STRING", object.getTypeStr());
+    }
+
+    String::String(const String& other):Object(other) {
+
+    }
+
+    String::String(String&& other) NOEXCEPT :Object(std::forward<String>(other)) {
+
+    }
+
+    StringView String::getView() const {
+        if (isEmpty()) return StringView();
+        const SQChar* str;
+        SQInteger len;
+        sq_pushobject(vm, handle._obj);
+        sq_getstringandsize(vm, -1, &str, &len);
+        sq_pop(vm, 1);
+        return StringView(str, static_cast<size_t>(len));
+    }
+
+    size_t String::size() const {
+        return getView().size();
+    }
+
+    String& String::operator = (const String& other){
+        Object::operator = (other);
+        return *this;
+    }
+
+    String& String::operator = (String&& other) NOEXCEPT {
+        Object::operator = (std::forward<String>(other));
+        return *this;
+    }
+}
@@ -19,8 +19,8 @@ namespace ssq {
 
     Table::Table(HSQUIRRELVM vm):Object(vm) {
         sq_newtable(vm);
-        sq_getstackobj(vm, -1, &obj);
-        sq_addref(vm, &obj);
+        sq_getstackobj(vm, -1, &handle._obj);
+        addRef();
         sq_pop(vm,1); // Pop table
     }
 
@@ -45,7 +45,7 @@ namespace ssq {
 #ifdef SQUNICODE
     Table Table::addTable(const FString &name) {
       Table table(vm);
-      sq_pushobject(vm, obj);
+      sq_pushobject(vm, handle._obj);
       sq_pushstring(vm, *name, name.Len());
       detail::push<Object>(vm, table);
       sq_newslot(vm, -3, false);
@@ -55,7 +55,7 @@ namespace ssq {
 #else
     Table Table::addTable(const char* name) {
         Table table(vm);
-        sq_pushobject(vm, obj);
+        sq_pushobject(vm, handle._obj);
         sq_pushstring(vm, name, strlen(name));
         detail::push<Object>(vm, table);
         sq_newslot(vm, -3, false);
@@ -65,12 +65,28 @@ namespace ssq {
 #endif
 
     size_t Table::size() {
-        sq_pushobject(vm, obj);
+        sq_pushobject(vm, handle._obj);
         SQInteger s = sq_getsize(vm, -1);
         sq_pop(vm, 1);
         return static_cast<size_t>(s);
     }
 
+    void Table::setWeakMode(SQInteger mode) {
+        sq_pushobject(vm, handle._obj);
+        if (SQ_FAILED(sq_setweakmode(vm, -1, mode))) {
+            sq_pop(vm, 1);
+            throw RuntimeException("Cannot set the weak mode of the table");
+        }
+        sq_pop(vm, 1);
+    }
+
+    SQInteger Table::getWeakMode() const {
+        sq_pushobject(vm, handle._obj);
+        SQInteger mode = sq_getweakmode(vm, -1);
+        sq_pop(vm, 1);
+        return mode;
+    }
+
     Table& Table::operator = (const Table& other){
         Object::operator = (other);
         return *this;
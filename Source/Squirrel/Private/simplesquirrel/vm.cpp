@@ -6,7 +6,12 @@
 #include <squirrel/sqstdmath.h>
 #include <squirrel/sqstdblob.h>
 #include <squirrel/sqstdio.h>
+#include <squirrel/sqstdchannel.h>
+#include <squirrel/sqstdsched.h>
 #include <forward_list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <cstdarg>
 #include <cstring>
 #include <iostream>
@@ -14,9 +19,45 @@
 #pragma warning( disable : 4458)
 
 namespace ssq {
-    VM::VM(size_t stackSize, Libs::Flag flags):Table() {
-        vm = sq_open(stackSize);
-        sq_resetobject(&obj);
+    VMSnapshot::VMSnapshot() :snapshot(nullptr) {
+
+    }
+
+    VMSnapshot::VMSnapshot(HSQSNAPSHOT snapshot) :snapshot(snapshot) {
+
+    }
+
+    VMSnapshot::~VMSnapshot() {
+        if (snapshot) sq_releasesnapshot(snapshot);
+    }
+
+    void VMSnapshot::swap(VMSnapshot& other) NOEXCEPT {
+        using std::swap;
+        swap(snapshot, other.snapshot);
+    }
+
+    VMSnapshot::VMSnapshot(VMSnapshot&& other) NOEXCEPT :snapshot(nullptr) {
+        swap(other);
+    }
+
+    VMSnapshot& VMSnapshot::operator = (VMSnapshot&& other) NOEXCEPT {
+        if (this != &other) {
+            swap(other);
+        }
+        return *this;
+    }
+
+    bool VMSnapshot::isEmpty() const {
+        return snapshot == nullptr;
+    }
+
+    HSQSNAPSHOT VMSnapshot::getRaw() const {
+        return snapshot;
+    }
+
+    VM::VM(size_t stackSize, Libs::Flag flags, const SQAllocator* allocator):Table() {
+        vm = sq_openex(stackSize, allocator);
+        sq_resethandle(&handle);
         sq_setforeignptr(vm, this);
 
         registerStdlib(flags);
@@ -26,20 +67,155 @@ namespace ssq {
         setCompileErrorFunc(&VM::defaultCompilerErrorFunc);
 
         sq_pushroottable(vm);
-        sq_getstackobj(vm,-1,&obj);
-        sq_addref(vm, &obj);
+        sq_getstackobj(vm,-1,&handle._obj);
+        addRef();
+        sq_pop(vm, 1);
+    }
+
+    VM::VM(const VMSnapshot& snapshot, size_t stackSize, const SQAllocator* allocator):Table() {
+        if (snapshot.isEmpty()) {
+            throw RuntimeException("Empty snapshot");
+        }
+        vm = sq_openfromsnapshot(snapshot.getRaw(), stackSize, allocator);
+        sq_resethandle(&handle);
+        sq_setforeignptr(vm, this);
+
+        sq_pushroottable(vm);
+        sq_getstackobj(vm,-1,&handle._obj);
+        addRef();
+        sq_pop(vm, 1);
+
+        loadClassMap();
+    }
+
+    VMSnapshot VM::snapshot() {
+        saveClassMap();
+        HSQSNAPSHOT snapshot;
+        if (SQ_FAILED(sq_snapshot(vm, &snapshot))) {
+            const SQChar* err = nullptr;
+            sq_getlasterror(vm);
+            if (SQ_FAILED(sq_getstring(vm, -1, &err))) {
+                err = _SC("The VM cannot be snapshot");
+            }
+            RuntimeException e(err);
+            sq_pop(vm, 1);
+            throw e;
+        }
+        // the state now belongs to the snapshot
+        classSlots.clear();
+        sq_releasehandle(&handle);
+        vm = nullptr;
+        return VMSnapshot(snapshot);
+    }
+
+    void VM::reset(const VMSnapshot& snapshot) {
+        if (snapshot.isEmpty()) {
+            throw RuntimeException("Empty snapshot");
+        }
+        if (SQ_FAILED(sq_resetfromsnapshot(vm, snapshot.getRaw()))) {
+            throw RuntimeException("The VM cannot be reset while running");
+        }
+        runtimeException.reset();
+        compileException.reset();
+        loadClassMap();
+    }
+
+    // the class map points into the VM, it travels with a snapshot through the registry
+    void VM::saveClassMap() {
+        sq_pushregistrytable(vm);
+        sq_pushstring(vm, _SC("ssq_classes"), -1);
+        sq_newtable(vm);
+        for (size_t i = 0; i < classSlots.size(); i++) {
+            if (sq_isnull(classSlots[i])) continue;
+            sq_pushinteger(vm, static_cast<SQInteger>(i));
+            sq_pushobject(vm, classSlots[i]);
+            sq_newslot(vm, -3, false);
+        }
+        sq_newslot(vm, -3, false);
+        sq_pop(vm, 1);
+    }
+
+    void VM::loadClassMap() {
+        classSlots.clear();
+        sq_pushregistrytable(vm);
+        sq_pushstring(vm, _SC("ssq_classes"), -1);
+        if (SQ_SUCCEEDED(sq_rawget(vm, -2))) {
+            sq_pushnull(vm);
+            while (SQ_SUCCEEDED(sq_next(vm, -2))) {
+                SQInteger typeIndex;
+                HSQOBJECT cls;
+                sq_getinteger(vm, -2, &typeIndex);
+                sq_getstackobj(vm, -1, &cls);
+                addClassObj(static_cast<size_t>(typeIndex), cls);
+                sq_pop(vm, 2);
+            }
+            sq_pop(vm, 2);
+        }
         sq_pop(vm, 1);
     }
 
     void VM::destroy() {
-		classMap.clear();
+		classSlots.clear();
         if (vm != nullptr) {
-            sq_resetobject(&obj);
+            sq_releasehandle(&handle);
             sq_close(vm);
         }
         vm = nullptr;
     }
 
+    SQMemStats VM::getMemoryStats() const {
+        SQMemStats stats;
+        sq_getmemstats(vm, &stats);
+        return stats;
+    }
+
+    SQGCStats VM::getGCStats() const {
+        SQGCStats stats;
+        if (SQ_FAILED(sq_getgcstats(vm, &stats))) {
+            throw RuntimeException("Garbage collector statistics are not available");
+        }
+        return stats;
+    }
+
+    void VM::setGCParams(const SQGCParams& params) {
+        if (SQ_FAILED(sq_setgcparams(vm, &params))) {
+            throw RuntimeException("Garbage collector parameters are not available");
+        }
+    }
+
+    SQGCParams VM::getGCParams() const {
+        SQGCParams params;
+        if (SQ_FAILED(sq_getgcparams(vm, &params))) {
+            throw RuntimeException("Garbage collector parameters are not available");
+        }
+        return params;
+    }
+
+    void VM::setMemoryLimit(size_t bytes) {
+        sq_setmemorylimit(vm, bytes);
+    }
+
+    void VM::startAllocProfiler(size_t sampleRate) {
+        if(SQ_FAILED(sq_startallocprofiler(vm, sampleRate))) {
+            throw RuntimeException("The allocation profiler is already running");
+        }
+    }
+
+    void VM::stopAllocProfiler() {
+        sq_stopallocprofiler(vm);
+    }
+
+    Array VM::getAllocProfile() const {
+        if(SQ_FAILED(sq_getallocprofile(vm))) {
+            throw RuntimeException("The allocation profiler is not running");
+        }
+        Object ret(vm);
+        sq_getstackobj(vm, -1, &ret.getRaw());
+        ret.addRef();
+        sq_pop(vm, 1);
+        return Array(ret);
+    }
+
     VM::~VM() {
         destroy();
     }
@@ -49,13 +225,13 @@ namespace ssq {
         Object::swap(other);
         swap(runtimeException, other.runtimeException);
         swap(compileException, other.compileException);
-		swap(classMap, other.classMap);
+		swap(classSlots, other.classSlots);
 
         if(vm != nullptr) {
             sq_setforeignptr(vm, this);
         }
         if(other.vm != nullptr) {
-            sq_setforeignptr(other.vm, this);
+            sq_setforeignptr(other.vm, &other);
         }
     }
         
@@ -76,6 +252,10 @@ namespace ssq {
 //            sqstd_register_systemlib(vm);
         if(flags & ssq::Libs::STRING)
             sqstd_register_stringlib(vm);
+        if(flags & ssq::Libs::CHANNEL)
+            sqstd_register_channellib(vm);
+        if(flags & ssq::Libs::SCHED)
+            sqstd_register_schedlib(vm);
         sq_pop(vm, 1);
     }
 
@@ -105,7 +285,7 @@ namespace ssq {
       }
 
       sq_getstackobj(vm, -1, &script.getRaw());
-      sq_addref(vm, &script.getRaw());
+      script.addRef();
       sq_pop(vm, 1);
       return script;
     }
@@ -118,7 +298,7 @@ namespace ssq {
         }
 
         sq_getstackobj(vm,-1,&script.getRaw());
-        sq_addref(vm, &script.getRaw());
+        script.addRef();
         sq_pop(vm, 1);
         return script;
     }
@@ -133,7 +313,7 @@ namespace ssq {
       }
 
       sq_getstackobj(vm, -1, &script.getRaw());
-      sq_addref(vm, &script.getRaw());
+      script.addRef();
       sq_pop(vm, 1);
       return script;
     }
@@ -146,7 +326,7 @@ namespace ssq {
         }
 
         sq_getstackobj(vm, -1, &script.getRaw());
-        sq_addref(vm, &script.getRaw());
+        script.addRef();
         sq_pop(vm, 1);
         return script;
     }
@@ -168,6 +348,48 @@ namespace ssq {
         }
     }
 
+    Result<void> VM::tryRun(const Script& script) const {
+        if(script.isEmpty()) {
+            return Error(_SC("Empty script object"));
+        }
+        SQInteger top = sq_gettop(vm);
+        sq_pushobject(vm, script.getRaw());
+        sq_pushroottable(vm);
+        if(SQ_FAILED(sq_call(vm, 1, false, false))){
+            Error err = detail::lastError(vm);
+            sq_settop(vm, top);
+            return err;
+        }
+        sq_settop(vm, top);
+        return Result<void>();
+    }
+
+    SharedScript VM::shareScript(const Script& script) const {
+        if(script.isEmpty()) {
+            throw RuntimeException("Empty script object");
+        }
+        HSQCODE code;
+        sq_pushobject(vm, script.getRaw());
+        SQRESULT result = sq_sharecode(vm, -1, &code);
+        sq_pop(vm, 1);
+        if(SQ_FAILED(result)) {
+            throw RuntimeException("The script cannot be shared");
+        }
+        return SharedScript(code);
+    }
+
+    Script VM::loadScript(const SharedScript& shared) {
+        if(shared.isEmpty()) {
+            throw RuntimeException("Empty shared script");
+        }
+        Script script(vm);
+        sq_newclosurefromcode(vm, shared.getRaw());
+        sq_getstackobj(vm, -1, &script.getRaw());
+        script.addRef();
+        sq_pop(vm, 1);
+        return script;
+    }
+
 #ifdef SQUNICODE
     Enum VM::addEnum(const FString &name) {
       Enum enm(vm);
@@ -200,18 +422,48 @@ namespace ssq {
     Object VM::callAndReturn(SQUnsignedInteger nparams, SQInteger top) const {
         if(SQ_FAILED(sq_call(vm, 1 + nparams, true, true))){
             sq_settop(vm, top);
-            if (runtimeException == nullptr)
-                throw RuntimeException("Unknown squirrel runtime error");
-            throw *runtimeException;
+            detail::throwRuntimeError(vm);
         }
             
         Object ret(vm);
         sq_getstackobj(vm, -1, &ret.getRaw());
-        sq_addref(vm, &ret.getRaw());
+        ret.addRef();
+        sq_settop(vm, top);
+        return ret;
+    }
+
+    Result<Object> VM::tryCallAndReturn(SQUnsignedInteger nparams, SQInteger top) const {
+        if(SQ_FAILED(sq_call(vm, 1 + nparams, true, false))){
+            Error err = detail::lastError(vm);
+            sq_settop(vm, top);
+            return err;
+        }
+
+        Object ret(vm);
+        sq_getstackobj(vm, -1, &ret.getRaw());
+        ret.addRef();
         sq_settop(vm, top);
         return ret;
     }
 
+    void VM::runBatch(const Function& func, const Object& env, size_t count,
+        SQBATCHARGS args, SQBATCHRESULT result, SQUserPointer up) const {
+        SQInteger top = sq_gettop(vm);
+        sq_pushobject(vm, func.getRaw());
+        sq_pushobject(vm, env.getRaw());
+        if (SQ_FAILED(sq_callbatch(vm, static_cast<SQInteger>(count), args, result, up, SQFalse))) {
+            const SQChar* err = nullptr;
+            sq_getlasterror(vm);
+            if (SQ_FAILED(sq_getstring(vm, -1, &err))) {
+                err = _SC("The batch cannot be called");
+            }
+            RuntimeException e(err);
+            sq_settop(vm, top);
+            throw e;
+        }
+        sq_settop(vm, top);
+    }
+
     void VM::debugStack() const {
         auto top = getTop();
         while(top >= 0) {
@@ -289,23 +541,47 @@ namespace ssq {
 
     }
 
-	void VM::addClassObj(size_t hashCode, const HSQOBJECT& obj) {
-		classMap[hashCode] = obj;
+	void VM::addClassObj(size_t typeIndex, const HSQOBJECT& obj) {
+		if (typeIndex >= classSlots.size()) {
+			HSQOBJECT empty;
+			sq_resetobject(&empty);
+			classSlots.resize(typeIndex + 1, empty);
+		}
+		classSlots[typeIndex] = obj;
 	}
 
-	const HSQOBJECT& VM::getClassObj(size_t hashCode) {
-		return classMap.at(hashCode);
+	const HSQOBJECT* VM::findClassObj(size_t typeIndex) const {
+		if (typeIndex >= classSlots.size() || sq_isnull(classSlots[typeIndex])) return nullptr;
+		return &classSlots[typeIndex];
 	}
 
 	namespace detail {
-	    void addClassObj(HSQUIRRELVM vm, size_t hashCode, const HSQOBJECT& obj) {
+		size_t registerTypeIndex(const char* name) {
+			static std::mutex mutex;
+			static std::unordered_map<std::string, size_t> indices;
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = indices.find(name);
+			if (it != indices.end()) return it->second;
+			size_t index = indices.size() + 1;
+			indices.emplace(name, index);
+			return index;
+		}
+
+	    void addClassObj(HSQUIRRELVM vm, size_t typeIndex, const HSQOBJECT& obj) {
+		    VM* machine = reinterpret_cast<VM*>(sq_getforeignptr(vm));
+			machine->addClassObj(typeIndex, obj);
+	    }
+
+		const HSQOBJECT* findClassObj(HSQUIRRELVM vm, size_t typeIndex) {
 		    VM* machine = reinterpret_cast<VM*>(sq_getforeignptr(vm));
-			machine->addClassObj(hashCode, obj);
+			return machine->findClassObj(typeIndex);
 	    }
 
-		const HSQOBJECT& getClassObj(HSQUIRRELVM vm, size_t hashCode) {
+		void throwRuntimeError(HSQUIRRELVM vm) {
 		    VM* machine = reinterpret_cast<VM*>(sq_getforeignptr(vm));
-			return machine->getClassObj(hashCode);
+			if (machine == nullptr || machine->runtimeException == nullptr)
+				throw RuntimeException("Unknown squirrel runtime error");
+			throw *machine->runtimeException;
 	    }
     }
 }
@@ -0,0 +1,43 @@
+#include <simplesquirrel/vmpool.hpp>
+#include <squirrel/squirrel.h>
+
+namespace ssq {
+    VMPool::VMPool(VMSnapshot&& snapshot, size_t stackSize)
+        :snapshot(std::move(snapshot)), stackSize(stackSize) {
+        if (this->snapshot.isEmpty()) {
+            throw RuntimeException("Empty snapshot");
+        }
+    }
+
+    VM VMPool::acquire() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!idle.empty()) {
+                VM vm(std::move(idle.back()));
+                idle.pop_back();
+                return vm;
+            }
+        }
+        return VM(snapshot, stackSize);
+    }
+
+    void VMPool::release(VM&& vm) {
+        VM recycled(std::move(vm));
+        recycled.reset(snapshot);
+        std::lock_guard<std::mutex> lock(mutex);
+        idle.push_back(std::move(recycled));
+    }
+
+    void VMPool::reserve(size_t count) {
+        while (size() < count) {
+            VM vm(snapshot, stackSize);
+            std::lock_guard<std::mutex> lock(mutex);
+            idle.push_back(std::move(vm));
+        }
+    }
+
+    size_t VMPool::size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return idle.size();
+    }
+}
@@ -25,6 +25,8 @@ static SQInteger _blob_resize(HSQUIRRELVM v)
     SETUP_BLOB(v);
     SQInteger size;
     sq_getinteger(v,2,&size);
+    if(size > self->Len() && SQ_FAILED(sq_checkmemorylimit(v,size)))
+        return SQ_ERROR;
     if(!self->Resize(size))
         return sq_throwerror(v,_SC("resize failed"));
     return 0;
@@ -136,6 +138,7 @@ static SQInteger _blob_constructor(HSQUIRRELVM v)
         sq_getinteger(v, 2, &size);
     }
     if(size < 0) return sq_throwerror(v, _SC("cannot create blob with negative size"));
+    if(SQ_FAILED(sq_checkmemorylimit(v, sizeof(SQBlob) + size))) return SQ_ERROR;
     //SQBlob *b = new SQBlob(size);
 
     SQBlob *b = new (sq_malloc(sizeof(SQBlob)))SQBlob(size);
@@ -155,6 +158,7 @@ static SQInteger _blob__cloned(HSQUIRRELVM v)
         if(SQ_FAILED(sq_getinstanceup(v,2,(SQUserPointer*)&other,(SQUserPointer)SQSTD_BLOB_TYPE_TAG,SQFalse)))
             return SQ_ERROR;
     }
+    if(SQ_FAILED(sq_checkmemorylimit(v, sizeof(SQBlob) + other->Len()))) return SQ_ERROR;
     //SQBlob *thisone = new SQBlob(other->Len());
     SQBlob *thisone = new (sq_malloc(sizeof(SQBlob)))SQBlob(other->Len());
     memcpy(thisone->GetBuf(),other->GetBuf(),thisone->Len());
@@ -2,6 +2,9 @@
 #ifndef _SQSTD_BLOBIMPL_H_
 #define _SQSTD_BLOBIMPL_H_
 
+#include <stdlib.h>
+#include <string.h>
+
 struct SQBlob : public SQStream
 {
     SQBlob(SQInteger size) {
@@ -11,9 +14,20 @@ struct SQBlob : public SQStream
         memset(_buf, 0, _size);
         _ptr = 0;
         _owns = true;
+        _foreign = false;
     }
     virtual ~SQBlob() {
-        sq_free(_buf, _allocated);
+        FreeBuf();
+    }
+    //takes over a buffer allocated with malloc (a blob received from a channel),
+    //it goes back to free instead of the allocator of the VM
+    void Adopt(unsigned char *buf, SQInteger size) {
+        FreeBuf();
+        _buf = buf;
+        _size = size;
+        _allocated = size;
+        _ptr = 0;
+        _foreign = true;
     }
     SQInteger Write(void *buffer, SQInteger size) {
         if(!CanAdvance(size)) {
@@ -43,7 +57,8 @@ struct SQBlob : public SQStream
                 memcpy(newbuf,_buf,n);
             else
                 memcpy(newbuf,_buf,_size);
-            sq_free(_buf,_allocated);
+            FreeBuf();
+            _foreign = false;
             _buf=newbuf;
             _allocated = n;
             if(_size > _allocated)
@@ -98,11 +113,16 @@ struct SQBlob : public SQStream
     SQInteger Len() { return _size; }
     SQUserPointer GetBuf(){ return _buf; }
 private:
+    void FreeBuf() {
+        if(_foreign) free(_buf);
+        else sq_free(_buf, _allocated);
+    }
     SQInteger _size;
     SQInteger _allocated;
     SQInteger _ptr;
     unsigned char *_buf;
     bool _owns;
+    bool _foreign;
 };
 
 #endif //_SQSTD_BLOBIMPL_H_
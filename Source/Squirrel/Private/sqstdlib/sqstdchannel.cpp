@@ -0,0 +1,733 @@
+/* see copyright notice in squirrel.h */
+#include <new>
+#include <atomic>
+#include <squirrel/squirrel.h>
+#include <squirrel/sqstdio.h>
+#include <squirrel/sqstdblob.h>
+#include <squirrel/sqstdchannel.h>
+#include <string.h>
+#include <stdlib.h>
+#include "sqstdblobimpl.h"
+
+//Channel
+//bounded lock-free queue of values shared by any number of VMs (Vyukov's bounded MPMC queue).
+//the values are copied out of the sending VM into a flat buffer in a single pass and
+//rebuilt in the receiving one; null, bools and numbers travel inside the queue cell
+//without any allocation, a blob alone is handed over to the receiving blob as is.
+//channels live outside of the VMs: plain malloc/free and an atomic reference count
+
+#define SQSTD_CHANNEL_MIN_CAPACITY 2
+#define SQSTD_CHANNEL_CACHE_LINE 64
+
+enum SQChannelMsgKind {
+    SQCHANMSG_NULL,
+    SQCHANMSG_BOOL,
+    SQCHANMSG_INTEGER,
+    SQCHANMSG_FLOAT,
+    SQCHANMSG_DATA, //encoded value, see SQChannelTag
+    SQCHANMSG_BLOB  //raw bytes of a blob
+};
+
+struct SQChannelMsg
+{
+    SQInteger _kind;
+    union {
+        SQInteger _integer;
+        SQFloat _float;
+    };
+    unsigned char *_buf;
+    SQInteger _size;
+};
+
+struct SQChannelCell
+{
+    std::atomic<SQUnsignedInteger> _seq;
+    SQChannelMsg _msg;
+};
+
+struct SQChannel
+{
+    std::atomic<SQInteger> _refs;
+    SQUnsignedInteger _mask;
+    SQChannelCell *_cells;
+    char _pad0[SQSTD_CHANNEL_CACHE_LINE];
+    std::atomic<SQUnsignedInteger> _head; //next cell to write
+    char _pad1[SQSTD_CHANNEL_CACHE_LINE];
+    std::atomic<SQUnsignedInteger> _tail; //next cell to read
+    char _pad2[SQSTD_CHANNEL_CACHE_LINE];
+};
+
+static bool _chan_push(SQChannel *ch, const SQChannelMsg &msg)
+{
+    SQUnsignedInteger pos = ch->_head.load(std::memory_order_relaxed);
+    SQChannelCell *cell;
+    for(;;) {
+        cell = &ch->_cells[pos & ch->_mask];
+        SQUnsignedInteger seq = cell->_seq.load(std::memory_order_acquire);
+        SQInteger dif = (SQInteger)seq - (SQInteger)pos;
+        if(dif == 0) {
+            if(ch->_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if(dif < 0) return false; //full
+        else pos = ch->_head.load(std::memory_order_relaxed);
+    }
+    cell->_msg = msg;
+    cell->_seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+static bool _chan_pop(SQChannel *ch, SQChannelMsg &msg)
+{
+    SQUnsignedInteger pos = ch->_tail.load(std::memory_order_relaxed);
+    SQChannelCell *cell;
+    for(;;) {
+        cell = &ch->_cells[pos & ch->_mask];
+        SQUnsignedInteger seq = cell->_seq.load(std::memory_order_acquire);
+        SQInteger dif = (SQInteger)seq - (SQInteger)(pos + 1);
+        if(dif == 0) {
+            if(ch->_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if(dif < 0) return false; //empty
+        else pos = ch->_tail.load(std::memory_order_relaxed);
+    }
+    msg = cell->_msg;
+    cell->_seq.store(pos + ch->_mask + 1, std::memory_order_release);
+    return true;
+}
+
+//encoded values: a tag followed by its payload, containers are followed by their items.
+//strings, arrays, tables and blobs inside a container get an index in order of appearance,
+//the next occurrence of the same object is a REF to it (shared strings, shared or cyclic containers)
+enum SQChannelTag {
+    SQCHANTAG_NULL,
+    SQCHANTAG_TRUE,
+    SQCHANTAG_FALSE,
+    SQCHANTAG_INTEGER,  //SQInteger
+    SQCHANTAG_FLOAT,    //SQFloat
+    SQCHANTAG_STRING,   //SQInteger length, characters
+    SQCHANTAG_ARRAY,    //SQInteger count, items
+    SQCHANTAG_TABLE,    //SQInteger count, key/value pairs
+    SQCHANTAG_BLOB,     //SQInteger size, bytes
+    SQCHANTAG_CHANNEL,  //SQChannel*, holding a reference
+    SQCHANTAG_REF       //SQInteger index
+};
+
+struct SQChanSeen
+{
+    SQUserPointer _key;
+    SQInteger _index;
+};
+
+struct SQChanWriter
+{
+    unsigned char *_buf;
+    SQInteger _size;
+    SQInteger _allocated;
+    bool _indexed;      //false for a single value, nothing to share
+    SQChanSeen *_seen;  //open addressing, object -> index
+    SQUnsignedInteger _seencap;
+    SQInteger _nindex;
+};
+
+static bool _chan_reserve(SQChanWriter *w, SQInteger n)
+{
+    if(w->_size + n <= w->_allocated) return true;
+    SQInteger size = w->_allocated ? w->_allocated * 2 : 64;
+    while(size < w->_size + n) size *= 2;
+    unsigned char *buf = (unsigned char *)realloc(w->_buf, size);
+    if(!buf) return false;
+    w->_buf = buf;
+    w->_allocated = size;
+    return true;
+}
+
+static bool _chan_writeraw(SQChanWriter *w, unsigned char tag, const void *p, SQInteger n)
+{
+    if(!_chan_reserve(w, n + 1)) return false;
+    w->_buf[w->_size++] = tag;
+    if(n) memcpy(&w->_buf[w->_size], p, n);
+    w->_size += n;
+    return true;
+}
+
+static bool _chan_writeint(SQChanWriter *w, unsigned char tag, SQInteger i)
+{
+    return _chan_writeraw(w, tag, &i, sizeof(SQInteger));
+}
+
+#define _chan_hash(p) ((((SQUnsignedInteger)(p)) >> 4) * 0x9E3779B1u)
+
+static bool _chan_seengrow(SQChanWriter *w)
+{
+    SQUnsignedInteger cap = w->_seencap ? w->_seencap * 2 : 64;
+    SQChanSeen *seen = (SQChanSeen *)calloc(cap, sizeof(SQChanSeen));
+    if(!seen) return false;
+    for(SQUnsignedInteger i = 0; i < w->_seencap; i++) {
+        if(!w->_seen[i]._key) continue;
+        SQUnsignedInteger h = _chan_hash(w->_seen[i]._key) & (cap - 1);
+        while(seen[h]._key) h = (h + 1) & (cap - 1);
+        seen[h] = w->_seen[i];
+    }
+    free(w->_seen);
+    w->_seen = seen;
+    w->_seencap = cap;
+    return true;
+}
+
+//looks up the object at idx (strings are interned, so equal strings are one object),
+//writes a REF if it was seen already otherwise gives it the next index
+static bool _chan_seen(HSQUIRRELVM v, SQChanWriter *w, SQInteger idx, bool *failed)
+{
+    *failed = false;
+    if(!w->_indexed) return false;
+    if((SQUnsignedInteger)(w->_nindex + 1) * 2 > w->_seencap && !_chan_seengrow(w)) {
+        *failed = true;
+        return true;
+    }
+    HSQOBJECT o;
+    sq_getstackobj(v, idx, &o);
+    SQUserPointer key = (SQUserPointer)o._unVal.pRefCounted;
+    SQUnsignedInteger h = _chan_hash(key) & (w->_seencap - 1);
+    while(w->_seen[h]._key) {
+        if(w->_seen[h]._key == key) {
+            *failed = !_chan_writeint(w, SQCHANTAG_REF, w->_seen[h]._index);
+            return true;
+        }
+        h = (h + 1) & (w->_seencap - 1);
+    }
+    w->_seen[h]._key = key;
+    w->_seen[h]._index = w->_nindex++;
+    return false;
+}
+
+static SQChannel *_chan_fromvalue(HSQUIRRELVM v, SQInteger idx);
+
+static SQRESULT _chan_write(HSQUIRRELVM v, SQChanWriter *w, SQInteger idx)
+{
+    bool failed = false;
+    switch(sq_gettype(v, idx)) {
+    case OT_NULL:
+        failed = !_chan_writeraw(w, SQCHANTAG_NULL, NULL, 0);
+        break;
+    case OT_BOOL: {
+        SQBool b;
+        sq_getbool(v, idx, &b);
+        failed = !_chan_writeraw(w, b ? SQCHANTAG_TRUE : SQCHANTAG_FALSE, NULL, 0);
+        }
+        break;
+    case OT_INTEGER: {
+        SQInteger i;
+        sq_getinteger(v, idx, &i);
+        failed = !_chan_writeint(w, SQCHANTAG_INTEGER, i);
+        }
+        break;
+    case OT_FLOAT: {
+        SQFloat f;
+        sq_getfloat(v, idx, &f);
+        failed = !_chan_writeraw(w, SQCHANTAG_FLOAT, &f, sizeof(SQFloat));
+        }
+        break;
+    case OT_STRING: {
+        if(_chan_seen(v, w, idx, &failed)) break;
+        const SQChar *s;
+        SQInteger len;
+        sq_getstringandsize(v, idx, &s, &len);
+        failed = !_chan_writeint(w, SQCHANTAG_STRING, len)
+            || !_chan_reserve(w, len * sizeof(SQChar));
+        if(failed) break;
+        memcpy(&w->_buf[w->_size], s, len * sizeof(SQChar));
+        w->_size += len * sizeof(SQChar);
+        }
+        break;
+    case OT_ARRAY:
+    case OT_TABLE: {
+        if(_chan_seen(v, w, idx, &failed)) break;
+        bool isarray = sq_gettype(v, idx) == OT_ARRAY;
+        if(!_chan_writeint(w, isarray ? SQCHANTAG_ARRAY : SQCHANTAG_TABLE, sq_getsize(v, idx)))
+            return sq_throwerror(v, _SC("out of memory"));
+        sq_pushnull(v);
+        while(SQ_SUCCEEDED(sq_next(v, idx))) {
+            SQInteger top = sq_gettop(v);
+            if((!isarray && SQ_FAILED(_chan_write(v, w, top - 1)))
+                || SQ_FAILED(_chan_write(v, w, top))) {
+                sq_pop(v, 3);
+                return SQ_ERROR;
+            }
+            sq_pop(v, 2);
+        }
+        sq_pop(v, 1);
+        }
+        break;
+    case OT_INSTANCE: {
+        SQUserPointer p;
+        if(SQ_SUCCEEDED(sqstd_getblob(v, idx, &p))) {
+            if(_chan_seen(v, w, idx, &failed)) break;
+            SQInteger size = sqstd_getblobsize(v, idx);
+            failed = !_chan_writeint(w, SQCHANTAG_BLOB, size) || !_chan_reserve(w, size);
+            if(failed) break;
+            memcpy(&w->_buf[w->_size], p, size);
+            w->_size += size;
+            break;
+        }
+        SQChannel *ch = _chan_fromvalue(v, idx);
+        if(ch) {
+            failed = !_chan_writeraw(w, SQCHANTAG_CHANNEL, &ch, sizeof(SQChannel *));
+            if(!failed) sqstd_addrefchannel(ch);
+            break;
+        }
+        }
+        //fall through
+    default:
+        return sq_throwerror(v, _SC("the value cannot be sent through a channel"));
+    }
+    if(failed) return sq_throwerror(v, _SC("out of memory"));
+    return SQ_OK;
+}
+
+//releases the channels held by the encoded values from buf to end
+static void _chan_releasechannels(const unsigned char *buf, const unsigned char *end)
+{
+    SQInteger pos = 0, size = end - buf;
+    while(pos < size) {
+        unsigned char tag = buf[pos++];
+        SQInteger n;
+        switch(tag) {
+        case SQCHANTAG_INTEGER: case SQCHANTAG_ARRAY: case SQCHANTAG_TABLE: case SQCHANTAG_REF:
+            pos += sizeof(SQInteger);
+            break;
+        case SQCHANTAG_FLOAT:
+            pos += sizeof(SQFloat);
+            break;
+        case SQCHANTAG_STRING:
+            memcpy(&n, &buf[pos], sizeof(SQInteger));
+            pos += sizeof(SQInteger) + n * sizeof(SQChar);
+            break;
+        case SQCHANTAG_BLOB:
+            memcpy(&n, &buf[pos], sizeof(SQInteger));
+            pos += sizeof(SQInteger) + n;
+            break;
+        case SQCHANTAG_CHANNEL: {
+            SQChannel *ch;
+            memcpy(&ch, &buf[pos], sizeof(SQChannel *));
+            sqstd_releasechannel(ch);
+            pos += sizeof(SQChannel *);
+            }
+            break;
+        }
+    }
+}
+
+static void _chan_freemsg(SQChannelMsg &msg)
+{
+    if(msg._kind == SQCHANMSG_DATA) _chan_releasechannels(msg._buf, msg._buf + msg._size);
+    free(msg._buf);
+}
+
+struct SQChanReader
+{
+    const unsigned char *_p;
+    SQInteger _index;   //stack position of the array of indexed objects, 0 for a single value
+};
+
+static SQInteger _chan_readint(SQChanReader *r)
+{
+    SQInteger i;
+    memcpy(&i, r->_p, sizeof(SQInteger));
+    r->_p += sizeof(SQInteger);
+    return i;
+}
+
+static void _chan_index(HSQUIRRELVM v, SQChanReader *r)
+{
+    if(!r->_index) return;
+    sq_push(v, -1);
+    sq_arrayappend(v, r->_index);
+}
+
+static SQRESULT _chan_read(HSQUIRRELVM v, SQChanReader *r)
+{
+    unsigned char tag = *r->_p++;
+    switch(tag) {
+    case SQCHANTAG_NULL: sq_pushnull(v); break;
+    case SQCHANTAG_TRUE: sq_pushbool(v, SQTrue); break;
+    case SQCHANTAG_FALSE: sq_pushbool(v, SQFalse); break;
+    case SQCHANTAG_INTEGER: sq_pushinteger(v, _chan_readint(r)); break;
+    case SQCHANTAG_FLOAT: {
+        SQFloat f;
+        memcpy(&f, r->_p, sizeof(SQFloat));
+        r->_p += sizeof(SQFloat);
+        sq_pushfloat(v, f);
+        }
+        break;
+    case SQCHANTAG_STRING: {
+        SQInteger len = _chan_readint(r);
+        if(((SQUnsignedInteger)r->_p) % sizeof(SQChar)) {
+            SQChar *s = sq_getscratchpad(v, len * sizeof(SQChar));
+            memcpy(s, r->_p, len * sizeof(SQChar));
+            sq_pushstring(v, s, len);
+        }
+        else sq_pushstring(v, (const SQChar *)r->_p, len);
+        r->_p += len * sizeof(SQChar);
+        _chan_index(v, r);
+        }
+        break;
+    case SQCHANTAG_ARRAY:
+    case SQCHANTAG_TABLE: {
+        SQInteger n = _chan_readint(r);
+        if(tag == SQCHANTAG_ARRAY) sq_newarray(v, 0);
+        else sq_newtableex(v, n);
+        _chan_index(v, r);
+        for(SQInteger i = 0; i < n; i++) {
+            if(tag == SQCHANTAG_TABLE && SQ_FAILED(_chan_read(v, r))) return SQ_ERROR;
+            if(SQ_FAILED(_chan_read(v, r))) return SQ_ERROR;
+            if(tag == SQCHANTAG_ARRAY) sq_arrayappend(v, -2);
+            else if(SQ_FAILED(sq_rawset(v, -3))) return SQ_ERROR;
+        }
+        }
+        break;
+    case SQCHANTAG_BLOB: {
+        SQInteger size = _chan_readint(r);
+        SQUserPointer p = sqstd_createblob(v, size);
+        r->_p += size;
+        if(!p) return sq_throwerror(v, _SC("the blob library is not registered"));
+        memcpy(p, r->_p - size, size);
+        _chan_index(v, r);
+        }
+        break;
+    case SQCHANTAG_CHANNEL: {
+        SQChannel *ch;
+        memcpy(&ch, r->_p, sizeof(SQChannel *));
+        r->_p += sizeof(SQChannel *);
+        SQRESULT res = sqstd_pushchannel(v, ch);
+        sqstd_releasechannel(ch);
+        if(SQ_FAILED(res)) return SQ_ERROR;
+        }
+        break;
+    case SQCHANTAG_REF:
+        sq_pushinteger(v, _chan_readint(r));
+        if(SQ_FAILED(sq_rawget(v, r->_index))) return sq_throwerror(v, _SC("invalid channel data"));
+        break;
+    default:
+        return sq_throwerror(v, _SC("invalid channel data"));
+    }
+    return SQ_OK;
+}
+
+HSQCHANNEL sqstd_newchannel(SQInteger capacity)
+{
+    SQUnsignedInteger n = SQSTD_CHANNEL_MIN_CAPACITY;
+    while(n < (SQUnsignedInteger)capacity) n <<= 1;
+    SQChannel *ch = (SQChannel *)malloc(sizeof(SQChannel));
+    SQChannelCell *cells = (SQChannelCell *)malloc(n * sizeof(SQChannelCell));
+    if(!ch || !cells) {
+        free(ch);
+        free(cells);
+        return NULL;
+    }
+    new (ch) SQChannel();
+    ch->_refs.store(1, std::memory_order_relaxed);
+    ch->_mask = n - 1;
+    ch->_cells = cells;
+    for(SQUnsignedInteger i = 0; i < n; i++) {
+        new (&cells[i]) SQChannelCell();
+        cells[i]._seq.store(i, std::memory_order_relaxed);
+    }
+    ch->_head.store(0, std::memory_order_relaxed);
+    ch->_tail.store(0, std::memory_order_relaxed);
+    return ch;
+}
+
+void sqstd_addrefchannel(HSQCHANNEL ch)
+{
+    ch->_refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void sqstd_releasechannel(HSQCHANNEL ch)
+{
+    if(ch->_refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+    SQChannelMsg msg;
+    while(_chan_pop(ch, msg)) _chan_freemsg(msg);
+    for(SQUnsignedInteger i = 0; i <= ch->_mask; i++) ch->_cells[i].~SQChannelCell();
+    free(ch->_cells);
+    ch->~SQChannel();
+    free(ch);
+}
+
+//a full channel is not an error, *sent is false
+static SQRESULT _chan_send(HSQUIRRELVM v, SQChannel *ch, SQInteger idx, bool *sent)
+{
+    *sent = false;
+    if(idx < 0) idx = sq_gettop(v) + idx + 1;
+    SQChannelMsg msg;
+    msg._buf = NULL;
+    msg._size = 0;
+    SQUserPointer p;
+    switch(sq_gettype(v, idx)) {
+    case OT_NULL:
+        msg._kind = SQCHANMSG_NULL;
+        break;
+    case OT_BOOL: {
+        SQBool b;
+        sq_getbool(v, idx, &b);
+        msg._kind = SQCHANMSG_BOOL;
+        msg._integer = b;
+        }
+        break;
+    case OT_INTEGER:
+        msg._kind = SQCHANMSG_INTEGER;
+        sq_getinteger(v, idx, &msg._integer);
+        break;
+    case OT_FLOAT:
+        msg._kind = SQCHANMSG_FLOAT;
+        sq_getfloat(v, idx, &msg._float);
+        break;
+    default:
+        if(sq_gettype(v, idx) == OT_INSTANCE && SQ_SUCCEEDED(sqstd_getblob(v, idx, &p))) {
+            msg._kind = SQCHANMSG_BLOB;
+            msg._size = sqstd_getblobsize(v, idx);
+            msg._buf = (unsigned char *)malloc(msg._size ? msg._size : 1);
+            if(!msg._buf) return sq_throwerror(v, _SC("out of memory"));
+            memcpy(msg._buf, p, msg._size);
+            break;
+        }
+        SQChanWriter w;
+        w._buf = NULL;
+        w._size = 0;
+        w._allocated = 0;
+        w._indexed = sq_gettype(v, idx) == OT_ARRAY || sq_gettype(v, idx) == OT_TABLE;
+        w._seen = NULL;
+        w._seencap = 0;
+        w._nindex = 0;
+        SQRESULT res = _chan_write(v, &w, idx);
+        free(w._seen);
+        if(SQ_FAILED(res)) {
+            _chan_releasechannels(w._buf, w._buf + w._size);
+            free(w._buf);
+            return SQ_ERROR;
+        }
+        msg._kind = SQCHANMSG_DATA;
+        msg._buf = w._buf;
+        msg._size = w._size;
+        break;
+    }
+    if(!_chan_push(ch, msg)) {
+        _chan_freemsg(msg);
+        return SQ_OK;
+    }
+    *sent = true;
+    return SQ_OK;
+}
+
+//an empty channel is not an error, nothing is pushed and *received is false
+static SQRESULT _chan_recv(HSQUIRRELVM v, SQChannel *ch, bool *received)
+{
+    SQChannelMsg msg;
+    *received = _chan_pop(ch, msg);
+    if(!*received) return SQ_OK;
+    switch(msg._kind) {
+    case SQCHANMSG_NULL: sq_pushnull(v); break;
+    case SQCHANMSG_BOOL: sq_pushbool(v, msg._integer ? SQTrue : SQFalse); break;
+    case SQCHANMSG_INTEGER: sq_pushinteger(v, msg._integer); break;
+    case SQCHANMSG_FLOAT: sq_pushfloat(v, msg._float); break;
+    case SQCHANMSG_BLOB: {
+        SQBlob *blob = NULL;
+        if(!sqstd_createblob(v, 0)
+            || SQ_FAILED(sq_getinstanceup(v, -1, (SQUserPointer *)&blob, NULL, SQFalse))) {
+            free(msg._buf);
+            return sq_throwerror(v, _SC("the blob library is not registered"));
+        }
+        blob->Adopt(msg._buf, msg._size);
+        }
+        break;
+    case SQCHANMSG_DATA: {
+        SQInteger top = sq_gettop(v);
+        SQChanReader r;
+        r._p = msg._buf;
+        r._index = 0;
+        if(msg._buf[0] == SQCHANTAG_ARRAY || msg._buf[0] == SQCHANTAG_TABLE) {
+            sq_newarray(v, 0);
+            r._index = sq_gettop(v);
+        }
+        if(SQ_FAILED(_chan_read(v, &r))) {
+            //the channels read so far belong to the stack already
+            _chan_releasechannels(r._p, msg._buf + msg._size);
+            free(msg._buf);
+            sq_settop(v, top);
+            return SQ_ERROR;
+        }
+        if(r._index) sq_remove(v, r._index);
+        free(msg._buf);
+        }
+        break;
+    }
+    return SQ_OK;
+}
+
+SQRESULT sqstd_channelsend(HSQUIRRELVM v, HSQCHANNEL ch, SQInteger idx)
+{
+    bool sent;
+    if(SQ_FAILED(_chan_send(v, ch, idx, &sent))) return SQ_ERROR;
+    if(!sent) return sq_throwerror(v, _SC("the channel is full"));
+    return SQ_OK;
+}
+
+SQRESULT sqstd_channelrecv(HSQUIRRELVM v, HSQCHANNEL ch)
+{
+    bool received;
+    if(SQ_FAILED(_chan_recv(v, ch, &received))) return SQ_ERROR;
+    if(!received) return sq_throwerror(v, _SC("the channel is empty"));
+    return SQ_OK;
+}
+
+//any unique address, instances of other classes never carry it
+static const char _channel_tag = 0;
+#define SQSTD_CHANNEL_TYPE_TAG ((SQUserPointer)&_channel_tag)
+
+static SQInteger _channel_releasehook(SQUserPointer p, SQInteger SQ_UNUSED_ARG(size))
+{
+    if(p) sqstd_releasechannel((SQChannel *)p);
+    return 1;
+}
+
+static SQChannel *_chan_fromvalue(HSQUIRRELVM v, SQInteger idx)
+{
+    SQChannel *ch = NULL;
+    if(SQ_FAILED(sq_getinstanceup(v, idx, (SQUserPointer *)&ch, SQSTD_CHANNEL_TYPE_TAG, SQFalse)))
+        return NULL;
+    return ch;
+}
+
+#define SETUP_CHANNEL(v) \
+    SQChannel *self = _chan_fromvalue(v, 1); \
+    if(!self) return sq_throwerror(v,_SC("invalid channel"));
+
+static SQInteger _channel_constructor(HSQUIRRELVM v)
+{
+    SQInteger capacity;
+    sq_getinteger(v, 2, &capacity);
+    if(capacity < 1) return sq_throwerror(v, _SC("the capacity must be at least 1"));
+    SQChannel *ch = sqstd_newchannel(capacity);
+    if(!ch) return sq_throwerror(v, _SC("cannot create channel"));
+    sq_setinstanceup(v, 1, ch);
+    sq_setreleasehook(v, 1, _channel_releasehook);
+    return 0;
+}
+
+static SQInteger _channel_send(HSQUIRRELVM v)
+{
+    SETUP_CHANNEL(v);
+    bool sent;
+    if(SQ_FAILED(_chan_send(v, self, 2, &sent))) return SQ_ERROR;
+    sq_pushbool(v, sent ? SQTrue : SQFalse);
+    return 1;
+}
+
+static SQInteger _channel_recv(HSQUIRRELVM v)
+{
+    SETUP_CHANNEL(v);
+    bool received;
+    if(SQ_FAILED(_chan_recv(v, self, &received))) return SQ_ERROR;
+    if(!received) {
+        if(sq_gettop(v) > 1) sq_push(v, 2);
+        else sq_pushnull(v);
+    }
+    return 1;
+}
+
+static SQInteger _channel_len(HSQUIRRELVM v)
+{
+    SETUP_CHANNEL(v);
+    SQUnsignedInteger tail = self->_tail.load(std::memory_order_relaxed);
+    SQUnsignedInteger head = self->_head.load(std::memory_order_relaxed);
+    sq_pushinteger(v, head > tail ? (SQInteger)(head - tail) : 0);
+    return 1;
+}
+
+static SQInteger _channel_capacity(HSQUIRRELVM v)
+{
+    SETUP_CHANNEL(v);
+    sq_pushinteger(v, (SQInteger)(self->_mask + 1));
+    return 1;
+}
+
+static SQInteger _channel__typeof(HSQUIRRELVM v)
+{
+    sq_pushstring(v, _SC("channel"), -1);
+    return 1;
+}
+
+static SQInteger _channel__cloned(HSQUIRRELVM v)
+{
+    SQChannel *other = _chan_fromvalue(v, 2);
+    if(!other) return SQ_ERROR;
+    sqstd_addrefchannel(other);
+    sq_setinstanceup(v, 1, other);
+    sq_setreleasehook(v, 1, _channel_releasehook);
+    return 0;
+}
+
+#define _DECL_CHANNEL_FUNC(name,nparams,typecheck) {_SC(#name),_channel_##name,nparams,typecheck}
+static const SQRegFunction _channel_methods[] = {
+    _DECL_CHANNEL_FUNC(constructor,2,_SC("xn")),
+    _DECL_CHANNEL_FUNC(send,2,_SC("x.")),
+    _DECL_CHANNEL_FUNC(recv,-1,_SC("x.")),
+    _DECL_CHANNEL_FUNC(len,1,_SC("x")),
+    _DECL_CHANNEL_FUNC(capacity,1,_SC("x")),
+    _DECL_CHANNEL_FUNC(_typeof,1,_SC("x")),
+    _DECL_CHANNEL_FUNC(_cloned,2,_SC("xx")),
+    {NULL,(SQFUNCTION)0,0,NULL}
+};
+
+SQRESULT sqstd_pushchannel(HSQUIRRELVM v, HSQCHANNEL ch)
+{
+    sq_pushregistrytable(v);
+    sq_pushstring(v, _SC("std_channel"), -1);
+    if(SQ_FAILED(sq_rawget(v, -2))) {
+        sq_pop(v, 1);
+        return sq_throwerror(v, _SC("the channel library is not registered"));
+    }
+    sq_remove(v, -2);
+    if(SQ_FAILED(sq_createinstance(v, -1))) {
+        sq_pop(v, 1);
+        return SQ_ERROR;
+    }
+    sq_remove(v, -2);
+    sqstd_addrefchannel(ch);
+    sq_setinstanceup(v, -1, ch);
+    sq_setreleasehook(v, -1, _channel_releasehook);
+    return SQ_OK;
+}
+
+SQRESULT sqstd_getchannel(HSQUIRRELVM v, SQInteger idx, HSQCHANNEL *ch)
+{
+    *ch = _chan_fromvalue(v, idx);
+    if(!*ch) return sq_throwerror(v, _SC("channel expected"));
+    return SQ_OK;
+}
+
+SQRESULT sqstd_register_channellib(HSQUIRRELVM v)
+{
+    sq_pushstring(v, _SC("channel"), -1);
+    sq_newclass(v, SQFalse);
+    sq_settypetag(v, -1, SQSTD_CHANNEL_TYPE_TAG);
+    SQInteger i = 0;
+    while(_channel_methods[i].name != 0) {
+        const SQRegFunction &f = _channel_methods[i];
+        sq_pushstring(v, f.name, -1);
+        sq_newclosure(v, f.f, 0);
+        sq_setparamscheck(v, f.nparamscheck, f.typemask);
+        sq_setnativeclosurename(v, -1, f.name);
+        sq_newslot(v, -3, SQFalse);
+        i++;
+    }
+    //kept in the registry for sqstd_pushchannel
+    sq_pushregistrytable(v);
+    sq_pushstring(v, _SC("std_channel"), -1);
+    sq_push(v, -3);
+    sq_newslot(v, -3, SQFalse);
+    sq_pop(v, 1);
+    sq_newslot(v, -3, SQFalse);
+    return SQ_OK;
+}
@@ -0,0 +1,490 @@
+/* see copyright notice in squirrel.h */
+#include <squirrel/squirrel.h>
+#include <squirrel/sqstdsched.h>
+#include <string.h>
+#include <stdlib.h>
+
+//Scheduler
+//runs script coroutines (threads of the VM) driven by sqstd_schedtick. A coroutine parks itself
+//with sleep/sleepuntil (timer wheel), waitevent (woken by signal) or nexttick and is resumed by
+//a later tick. Coroutines are VM threads with a stack sized from the closure, the VM grows it
+//whenever a deeper frame needs it.
+//the bookkeeping is native: one record per coroutine linked in the ready, next tick, wheel and
+//event lists; the threads themselves are held by an array in the registry so the GC sees them.
+//the time is whatever the host passes to sqstd_schedtick, usually milliseconds
+
+#ifndef SQSTD_SCHED_WHEEL_SIZE
+#define SQSTD_SCHED_WHEEL_SIZE 1024 //slots of one time unit, power of two
+#endif
+#define SQSTD_SCHED_WHEEL_MASK (SQSTD_SCHED_WHEEL_SIZE - 1)
+
+enum SQSchedCoroState {
+    SQCORO_FREE,
+    SQCORO_READY,
+    SQCORO_NEXTTICK,
+    SQCORO_SLEEPING,
+    SQCORO_WAITING,
+    SQCORO_RUNNING
+};
+
+struct SQSchedCoro
+{
+    HSQUIRRELVM _thread;
+    SQInteger _state;
+    SQInteger _next;        //next record in the list holding this one, -1 at the end
+    SQInteger _deadline;
+    SQInteger _nargs;       //arguments of the first call, -1 once started
+    SQBool _hasret;         //a value to return from waitevent is on the thread stack
+};
+
+struct SQSchedList
+{
+    SQInteger _head;
+    SQInteger _tail;
+};
+
+struct SQSched
+{
+    SQSched *_self;         //differs from the address once a VM snapshot copied the userdata
+    SQSchedCoro *_coros;
+    SQInteger _allocated;
+    SQInteger _free;
+    SQInteger _alive;
+    SQSchedList _ready;
+    SQSchedList _nexttick;
+    SQInteger _wheel[SQSTD_SCHED_WHEEL_SIZE];
+    SQInteger _ntimers;
+    SQInteger _time;
+    SQInteger _current;
+    HSQOBJECT _threads;     //array in the registry, slot -> thread
+    HSQOBJECT _events;      //table in the registry, event -> first waiter
+};
+
+static void _sched_append(SQSched *s, SQSchedList &l, SQInteger slot)
+{
+    s->_coros[slot]._next = -1;
+    if(l._tail != -1) s->_coros[l._tail]._next = slot;
+    else l._head = slot;
+    l._tail = slot;
+}
+
+static SQInteger _sched_popfront(SQSched *s, SQSchedList &l)
+{
+    SQInteger slot = l._head;
+    if(slot != -1) {
+        l._head = s->_coros[slot]._next;
+        if(l._head == -1) l._tail = -1;
+    }
+    return slot;
+}
+
+static void _sched_ready(SQSched *s, SQInteger slot)
+{
+    s->_coros[slot]._state = SQCORO_READY;
+    _sched_append(s, s->_ready, slot);
+}
+
+static void _sched_sleep(SQSched *s, SQInteger slot, SQInteger deadline)
+{
+    SQSchedCoro &c = s->_coros[slot];
+    if(deadline <= s->_time) {
+        c._state = SQCORO_NEXTTICK;
+        _sched_append(s, s->_nexttick, slot);
+        return;
+    }
+    SQInteger &head = s->_wheel[deadline & SQSTD_SCHED_WHEEL_MASK];
+    c._state = SQCORO_SLEEPING;
+    c._deadline = deadline;
+    c._next = head;
+    head = slot;
+    s->_ntimers++;
+}
+
+//moves the timers expired at 'now' to the ready list. Only the slots between the previous
+//time and now are visited, each one at most once; timers of later laps stay in place
+static void _sched_advance(SQSched *s, SQInteger now)
+{
+    if(now <= s->_time) return;
+    SQInteger steps = now - s->_time;
+    if(steps > SQSTD_SCHED_WHEEL_SIZE) steps = SQSTD_SCHED_WHEEL_SIZE;
+    for(SQInteger t = now - steps + 1; t <= now && s->_ntimers; t++) {
+        SQInteger *link = &s->_wheel[t & SQSTD_SCHED_WHEEL_MASK];
+        while(*link != -1) {
+            SQInteger slot = *link;
+            SQSchedCoro &c = s->_coros[slot];
+            if(c._deadline <= now) {
+                *link = c._next;
+                s->_ntimers--;
+                _sched_ready(s, slot);
+            }
+            else link = &c._next;
+        }
+    }
+    s->_time = now;
+}
+
+static SQInteger _sched_alloc(HSQUIRRELVM v, SQSched *s)
+{
+    if(s->_free == -1) {
+        SQInteger n = s->_allocated ? s->_allocated * 2 : 64;
+        //the records are allocated outside of the vm: sqstd_schedspawn is called by the host,
+        //where no state is bound, and by the scripts
+        s->_coros = (SQSchedCoro *)realloc(s->_coros, n * sizeof(SQSchedCoro));
+        for(SQInteger i = n - 1; i >= s->_allocated; i--) {
+            s->_coros[i]._state = SQCORO_FREE;
+            s->_coros[i]._next = s->_free;
+            s->_free = i;
+        }
+        s->_allocated = n;
+        sq_pushobject(v, s->_threads);
+        sq_arrayresize(v, -1, n);
+        sq_pop(v, 1);
+    }
+    SQInteger slot = s->_free;
+    s->_free = s->_coros[slot]._next;
+    s->_alive++;
+    return slot;
+}
+
+static void _sched_setthread(HSQUIRRELVM v, SQSched *s, SQInteger slot, SQInteger idx)
+{
+    if(idx < 0) idx = sq_gettop(v) + idx + 1;
+    sq_pushobject(v, s->_threads);
+    sq_pushinteger(v, slot);
+    if(idx) sq_push(v, idx);
+    else sq_pushnull(v);
+    sq_rawset(v, -3);
+    sq_pop(v, 1);
+}
+
+static void _sched_release(HSQUIRRELVM v, SQSched *s, SQInteger slot)
+{
+    SQSchedCoro &c = s->_coros[slot];
+    c._state = SQCORO_FREE;
+    c._thread = NULL;
+    c._next = s->_free;
+    s->_free = slot;
+    s->_alive--;
+    _sched_setthread(v, s, slot, 0);
+}
+
+//the closure and nargs arguments are on top of the stack, they are moved to a new thread
+static SQRESULT _sched_spawn(HSQUIRRELVM v, SQSched *s, SQInteger nargs)
+{
+    SQInteger fidx = sq_gettop(v) - nargs;
+    //sized like newthread(): the VM cannot grow the stack of a thread while it runs a metamethod
+    SQInteger stksize = 0;
+    if(SQ_FAILED(sq_getclosurestacksize(v, fidx, &stksize))) return SQ_ERROR;
+    stksize = (stksize << 1) + 2;
+    if(stksize < nargs + 2) stksize = nargs + 2;
+    HSQUIRRELVM t = sq_newthread(v, stksize);
+    if(!t) return sq_throwerror(v, _SC("cannot create the coroutine"));
+    sq_move(t, v, fidx);
+    sq_pushroottable(t);
+    for(SQInteger i = 1; i <= nargs; i++) sq_move(t, v, fidx + i);
+    SQInteger slot = _sched_alloc(v, s);
+    SQSchedCoro &c = s->_coros[slot];
+    c._thread = t;
+    c._nargs = nargs;
+    c._hasret = SQFalse;
+    _sched_setthread(v, s, slot, -1);
+    _sched_ready(s, slot);
+    return SQ_OK;
+}
+
+static void _sched_resume(HSQUIRRELVM v, SQSched *s, SQInteger slot)
+{
+    HSQUIRRELVM t = s->_coros[slot]._thread;
+    SQInteger nargs = s->_coros[slot]._nargs;
+    SQBool hasret = s->_coros[slot]._hasret;
+    s->_coros[slot]._state = SQCORO_RUNNING;
+    s->_coros[slot]._nargs = -1;
+    s->_coros[slot]._hasret = SQFalse;
+    s->_current = slot;
+    SQRESULT res = nargs >= 0 ? sq_call(t, nargs + 1, SQFalse, SQTrue)
+        : sq_wakeupvm(t, hasret, SQFalse, SQTrue, SQFalse);
+    s->_current = -1;
+    //the records may have moved, coroutines can spawn others
+    SQSchedCoro &c = s->_coros[slot];
+    if(SQ_SUCCEEDED(res) && sq_getvmstate(t) == SQ_VMSTATE_SUSPENDED) {
+        //suspend() outside of the scheduler functions yields until the next tick
+        if(c._state == SQCORO_RUNNING) {
+            c._state = SQCORO_NEXTTICK;
+            _sched_append(s, s->_nexttick, slot);
+        }
+        return;
+    }
+    //returned or failed, errors went to the error handler of the VM
+    _sched_release(v, s, slot);
+}
+
+static SQRESULT _sched_tick(HSQUIRRELVM v, SQSched *s, SQInteger now)
+{
+    if(s->_current != -1) return sq_throwerror(v, _SC("the scheduler is already running"));
+    SQInteger slot;
+    while((slot = _sched_popfront(s, s->_nexttick)) != -1) _sched_ready(s, slot);
+    _sched_advance(s, now);
+    while((slot = _sched_popfront(s, s->_ready)) != -1) _sched_resume(v, s, slot);
+    return SQ_OK;
+}
+
+static SQInteger _sched_signal(HSQUIRRELVM v, SQSched *s, SQInteger evidx, SQInteger validx)
+{
+    sq_pushobject(v, s->_events);
+    sq_push(v, evidx);
+    if(SQ_FAILED(sq_rawget(v, -2))) {
+        sq_pop(v, 1);
+        return 0;
+    }
+    SQInteger slot;
+    sq_getinteger(v, -1, &slot);
+    sq_pop(v, 1);
+    sq_push(v, evidx);
+    sq_rawdeleteslot(v, -2, SQFalse);
+    sq_pop(v, 1);
+    //the waiters are linked newest first, reverse to wake them in order
+    SQInteger prev = -1;
+    while(slot != -1) {
+        SQInteger next = s->_coros[slot]._next;
+        s->_coros[slot]._next = prev;
+        prev = slot;
+        slot = next;
+    }
+    SQInteger n = 0;
+    for(slot = prev; slot != -1; n++) {
+        SQInteger next = s->_coros[slot]._next;
+        if(validx) {
+            sq_move(s->_coros[slot]._thread, v, validx);
+            s->_coros[slot]._hasret = SQTrue;
+        }
+        _sched_ready(s, slot);
+        slot = next;
+    }
+    return n;
+}
+
+static SQInteger _sched_releasehook(SQUserPointer p, SQInteger SQ_UNUSED_ARG(size))
+{
+    SQSched *s = (SQSched *)p;
+    free(s->_coros);
+    return 1;
+}
+
+static void _sched_init(SQSched *s)
+{
+    s->_self = s;
+    s->_coros = NULL;
+    s->_allocated = 0;
+    s->_free = -1;
+    s->_alive = 0;
+    s->_ready._head = s->_ready._tail = -1;
+    s->_nexttick._head = s->_nexttick._tail = -1;
+    for(SQInteger i = 0; i < SQSTD_SCHED_WHEEL_SIZE; i++) s->_wheel[i] = -1;
+    s->_ntimers = 0;
+    s->_current = -1;
+}
+
+static void _sched_gethandles(HSQUIRRELVM v, SQSched *s)
+{
+    sq_pushregistrytable(v);
+    sq_pushstring(v, _SC("std_sched_threads"), -1);
+    sq_rawget(v, -2);
+    sq_getstackobj(v, -1, &s->_threads);
+    sq_pushstring(v, _SC("std_sched_events"), -1);
+    sq_rawget(v, -3);
+    sq_getstackobj(v, -1, &s->_events);
+    sq_pop(v, 3);
+}
+
+//the scheduler userdata at idx, a copy made by a VM snapshot still points into the heap it was
+//copied from and owns nothing: it is rebound to this VM (a snapshot never holds coroutines)
+static SQSched *_sched_bind(HSQUIRRELVM v, SQInteger idx)
+{
+    SQSched *s = NULL;
+    sq_getuserdata(v, idx, (SQUserPointer *)&s, NULL);
+    if(s->_self != s) {
+        _sched_init(s);
+        _sched_gethandles(v, s);
+        sq_setreleasehook(v, idx, _sched_releasehook);
+    }
+    return s;
+}
+
+static SQSched *_sched_get(HSQUIRRELVM v)
+{
+    SQSched *s = NULL;
+    sq_pushregistrytable(v);
+    sq_pushstring(v, _SC("std_sched"), -1);
+    if(SQ_SUCCEEDED(sq_rawget(v, -2)))
+        s = _sched_bind(v, -1);
+    sq_settop(v, sq_gettop(v) - (s ? 2 : 1));
+    return s;
+}
+
+//script functions get the scheduler as their free variable
+#define SETUP_SCHED(v) \
+    SQSched *s = _sched_bind(v, -1); \
+    sq_poptop(v);
+
+//slot of the coroutine calling a function that parks it
+static SQInteger _sched_self(HSQUIRRELVM v, SQSched *s)
+{
+    if(s->_current == -1 || s->_coros[s->_current]._thread != v) return -1;
+    return s->_current;
+}
+
+#define SETUP_COROUTINE(v) \
+    SETUP_SCHED(v); \
+    SQInteger self = _sched_self(v, s); \
+    if(self == -1) return sq_throwerror(v, _SC("not called from a scheduled coroutine")); \
+    SQRESULT suspend = sq_suspendvm(v); \
+    if(suspend == SQ_ERROR) return SQ_ERROR;
+
+static SQInteger _sched_spawnfunc(HSQUIRRELVM v)
+{
+    SETUP_SCHED(v);
+    SQInteger nargs = sq_gettop(v) - 2;
+    if(SQ_FAILED(_sched_spawn(v, s, nargs))) return SQ_ERROR;
+    return 1;
+}
+
+static SQInteger _sched_sleepfunc(HSQUIRRELVM v)
+{
+    SETUP_COROUTINE(v);
+    SQInteger ms;
+    sq_getinteger(v, 2, &ms);
+    _sched_sleep(s, self, s->_time + ms);
+    return suspend;
+}
+
+static SQInteger _sched_sleepuntilfunc(HSQUIRRELVM v)
+{
+    SETUP_COROUTINE(v);
+    SQInteger time;
+    sq_getinteger(v, 2, &time);
+    _sched_sleep(s, self, time);
+    return suspend;
+}
+
+static SQInteger _sched_nexttickfunc(HSQUIRRELVM v)
+{
+    SETUP_COROUTINE(v);
+    s->_coros[self]._state = SQCORO_NEXTTICK;
+    _sched_append(s, s->_nexttick, self);
+    return suspend;
+}
+
+static SQInteger _sched_waiteventfunc(HSQUIRRELVM v)
+{
+    if(sq_gettype(v, 2) == OT_NULL) return sq_throwerror(v, _SC("the event cannot be null"));
+    SETUP_COROUTINE(v);
+    SQInteger head = -1;
+    sq_pushobject(v, s->_events);
+    sq_push(v, 2);
+    if(SQ_SUCCEEDED(sq_rawget(v, -2))) {
+        sq_getinteger(v, -1, &head);
+        sq_poptop(v);
+    }
+    sq_push(v, 2);
+    sq_pushinteger(v, self);
+    sq_rawset(v, -3);
+    sq_poptop(v);
+    s->_coros[self]._state = SQCORO_WAITING;
+    s->_coros[self]._next = head;
+    return suspend;
+}
+
+static SQInteger _sched_signalfunc(HSQUIRRELVM v)
+{
+    SETUP_SCHED(v);
+    sq_pushinteger(v, _sched_signal(v, s, 2, sq_gettop(v) > 2 ? 3 : 0));
+    return 1;
+}
+
+static SQInteger _sched_schedtimefunc(HSQUIRRELVM v)
+{
+    SETUP_SCHED(v);
+    sq_pushinteger(v, s->_time);
+    return 1;
+}
+
+#define _DECL_SCHED_FUNC(name,nparams,typecheck) {_SC(#name),_sched_##name##func,nparams,typecheck}
+static const SQRegFunction schedlib_funcs[]={
+    _DECL_SCHED_FUNC(spawn,-2,_SC(".c")),
+    _DECL_SCHED_FUNC(sleep,2,_SC(".i")),
+    _DECL_SCHED_FUNC(sleepuntil,2,_SC(".i")),
+    _DECL_SCHED_FUNC(nexttick,1,NULL),
+    _DECL_SCHED_FUNC(waitevent,2,_SC("..")),
+    _DECL_SCHED_FUNC(signal,-2,_SC("...")),
+    _DECL_SCHED_FUNC(schedtime,1,NULL),
+    {NULL,(SQFUNCTION)0,0,NULL}
+};
+
+SQRESULT sqstd_schedspawn(HSQUIRRELVM v, SQInteger nargs)
+{
+    SQSched *s = _sched_get(v);
+    if(!s) return sq_throwerror(v, _SC("the scheduler library is not registered"));
+    if(SQ_FAILED(_sched_spawn(v, s, nargs))) return SQ_ERROR;
+    sq_pop(v, nargs + 2);
+    return SQ_OK;
+}
+
+SQRESULT sqstd_schedtick(HSQUIRRELVM v, SQInteger now)
+{
+    SQSched *s = _sched_get(v);
+    if(!s) return sq_throwerror(v, _SC("the scheduler library is not registered"));
+    return _sched_tick(v, s, now);
+}
+
+SQInteger sqstd_schedsignal(HSQUIRRELVM v, SQInteger evidx, SQInteger validx)
+{
+    SQSched *s = _sched_get(v);
+    if(!s) return sq_throwerror(v, _SC("the scheduler library is not registered"));
+    SQInteger top = sq_gettop(v);
+    if(evidx < 0) evidx = top + evidx + 1;
+    if(validx < 0) validx = top + validx + 1;
+    return _sched_signal(v, s, evidx, validx);
+}
+
+SQInteger sqstd_schedcount(HSQUIRRELVM v)
+{
+    SQSched *s = _sched_get(v);
+    return s ? s->_alive : 0;
+}
+
+SQRESULT sqstd_register_schedlib(HSQUIRRELVM v)
+{
+    SQSched *s = (SQSched *)sq_newuserdata(v, sizeof(SQSched));
+    memset(s, 0, sizeof(SQSched));
+    _sched_init(s);
+    sq_setreleasehook(v, -1, _sched_releasehook);
+    SQInteger sched = sq_gettop(v);
+
+    sq_pushregistrytable(v);
+    sq_pushstring(v, _SC("std_sched"), -1);
+    sq_push(v, sched);
+    sq_rawset(v, -3);
+    sq_pushstring(v, _SC("std_sched_threads"), -1);
+    sq_newarray(v, 0);
+    sq_getstackobj(v, -1, &s->_threads);
+    sq_rawset(v, -3);
+    sq_pushstring(v, _SC("std_sched_events"), -1);
+    sq_newtable(v);
+    sq_getstackobj(v, -1, &s->_events);
+    sq_rawset(v, -3);
+    sq_poptop(v);
+
+    SQInteger i = 0;
+    while(schedlib_funcs[i].name != 0) {
+        const SQRegFunction &f = schedlib_funcs[i];
+        sq_pushstring(v, f.name, -1);
+        sq_push(v, sched);
+        sq_newclosure(v, f.f, 1);
+        sq_setparamscheck(v, f.nparamscheck, f.typemask);
+        sq_setnativeclosurename(v, -1, f.name);
+        sq_newslot(v, -4, SQFalse);
+        i++;
+    }
+    sq_poptop(v);
+    return SQ_OK;
+}
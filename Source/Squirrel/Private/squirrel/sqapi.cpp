@@ -12,6 +12,8 @@
 #include "sqcompiler.h"
 #include "sqfuncstate.h"
 #include "sqclass.h"
+#include "sqsnapshot.h"
+#include "sqparallel.h"
 
 #pragma warning( disable : 4996)
 
@@ -26,6 +28,9 @@ static bool sq_aux_gettypedarg(HSQUIRRELVM v,SQInteger idx,SQObjectType type,SQO
     return true;
 }
 
+//binds the memory context of the state of v until the api call returns, see SQMemScope
+#define SQ_MEMSCOPE(v) SQMemScope _memscope(&_ss(v)->_memctx)
+
 #define _GETSAFE_OBJ(v,idx,type,o) { if(!sq_aux_gettypedarg(v,idx,type,&o)) return SQ_ERROR; }
 
 #define sq_aux_paramscheck(v,count) \
@@ -36,16 +41,33 @@ static bool sq_aux_gettypedarg(HSQUIRRELVM v,SQInteger idx,SQObjectType type,SQO
 
 SQInteger sq_aux_invalidtype(HSQUIRRELVM v,SQObjectType type)
 {
+    SQ_MEMSCOPE(v);
     SQUnsignedInteger buf_size = 100 *sizeof(SQChar);
     scsprintf(_ss(v)->GetScratchPad(buf_size), buf_size, _SC("unexpected type %s"), IdType2Name(type));
     return sq_throwerror(v, _ss(v)->GetScratchPad(-1));
 }
 
 HSQUIRRELVM sq_open(SQInteger initialstacksize)
+{
+    return sq_openex(initialstacksize, NULL);
+}
+
+HSQUIRRELVM sq_openex(SQInteger initialstacksize, const SQAllocator *allocator)
 {
     SQSharedState *ss;
     SQVM *v;
+    //the state is allocated through a temporary context, then takes over its counters
+    SQMemContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx._allocator = allocator;
+    SQMemScope scope(&ctx);
     sq_new(ss, SQSharedState);
+    ss->_memctx = ctx;
+    if(allocator) {
+        ss->_allocatorslot = *allocator;
+        ss->_memctx._allocator = &ss->_allocatorslot;
+    }
+    _sq_memctx = &ss->_memctx;
     ss->Init();
     v = (SQVM *)SQ_MALLOC(sizeof(SQVM));
     new (v) SQVM(ss);
@@ -61,6 +83,7 @@ HSQUIRRELVM sq_open(SQInteger initialstacksize)
 
 HSQUIRRELVM sq_newthread(HSQUIRRELVM friendvm, SQInteger initialstacksize)
 {
+    SQ_MEMSCOPE(friendvm);
     SQSharedState *ss;
     SQVM *v;
     ss=_ss(friendvm);
@@ -89,6 +112,7 @@ SQInteger sq_getvmstate(HSQUIRRELVM v)
 
 void sq_seterrorhandler(HSQUIRRELVM v)
 {
+    SQ_MEMSCOPE(v);
     SQObject o = stack_get(v, -1);
     if(sq_isclosure(o) || sq_isnativeclosure(o) || sq_isnull(o)) {
         v->_errorhandler = o;
@@ -105,6 +129,7 @@ void sq_setnativedebughook(HSQUIRRELVM v,SQDEBUGHOOK hook)
 
 void sq_setdebughook(HSQUIRRELVM v)
 {
+    SQ_MEMSCOPE(v);
     SQObject o = stack_get(v,-1);
     if(sq_isclosure(o) || sq_isnativeclosure(o) || sq_isnull(o)) {
         v->_debughook_closure = o;
@@ -117,8 +142,23 @@ void sq_setdebughook(HSQUIRRELVM v)
 void sq_close(HSQUIRRELVM v)
 {
     SQSharedState *ss = _ss(v);
+    SQMemScope scope(&ss->_memctx);
+    sq_stopallocprofiler(v);
+    if(ss->_parallel) ss->_parallel->Release();
+    //the context lives in the shared state, keep a copy to free the state itself
+    SQMemContext ctx = ss->_memctx;
+    SQAllocator a;
+    if(ctx._allocator) {
+        a = *ctx._allocator;
+        ctx._allocator = &a;
+    }
+    ctx._limit = 0;
+    _sq_memctx = &ctx;
+    SQSnapshot *snapshot = ss->_snapshot;
     _thread(ss->_root_vm)->Finalize();
     sq_delete(ss, SQSharedState);
+    if(ctx._allocator && a.release) a.release(a.up);
+    if(snapshot) snapshot->Release();
 }
 
 SQInteger sq_getversion()
@@ -128,6 +168,7 @@ SQInteger sq_getversion()
 
 SQRESULT sq_compile(HSQUIRRELVM v,SQLEXREADFUNC read,SQUserPointer p,const SQChar *sourcename,SQBool raiseerror)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr o;
 #ifndef NO_COMPILER
     if(Compile(v, read, p, sourcename, o, raiseerror?true:false, _ss(v)->_debuginfo)) {
@@ -152,11 +193,17 @@ void sq_notifyallexceptions(HSQUIRRELVM v, SQBool enable)
 
 void sq_addref(HSQUIRRELVM v,HSQOBJECT *po)
 {
+    SQ_MEMSCOPE(v);
     if(!ISREFCOUNTED(sq_type(*po))) return;
 #ifdef NO_GARBAGE_COLLECTOR
     __AddRef(po->_type,po->_unVal);
 #else
     _ss(v)->_refs_table.AddRef(*po);
+    //the atomic phase of the incremental collector doesn't scan the refs table again
+    if(_ss(v)->_gcstate == SQ_GC_PROPAGATE) {
+        SQObjectPtr o = *po;
+        SQSharedState::MarkObject(o,&_ss(v)->_gc_black);
+    }
 #endif
 }
 
@@ -172,6 +219,7 @@ SQUnsignedInteger sq_getrefcount(HSQUIRRELVM v,HSQOBJECT *po)
 
 SQBool sq_release(HSQUIRRELVM v,HSQOBJECT *po)
 {
+    SQ_MEMSCOPE(v);
     if(!ISREFCOUNTED(sq_type(*po))) return SQTrue;
 #ifdef NO_GARBAGE_COLLECTOR
     bool ret = (po->_unVal.pRefCounted->_uiRef <= 1) ? SQTrue : SQFalse;
@@ -185,7 +233,7 @@ SQBool sq_release(HSQUIRRELVM v,HSQOBJECT *po)
 SQUnsignedInteger sq_getvmrefcount(HSQUIRRELVM SQ_UNUSED_ARG(v), const HSQOBJECT *po)
 {
     if (!ISREFCOUNTED(sq_type(*po))) return 0;
-    return po->_unVal.pRefCounted->_uiRef;
+    return _refcount(po->_unVal.pRefCounted);
 }
 
 const SQChar *sq_objtostring(const HSQOBJECT *o)
@@ -235,6 +283,7 @@ void sq_pushnull(HSQUIRRELVM v)
 
 void sq_pushstring(HSQUIRRELVM v,const SQChar *s,SQInteger len)
 {
+    SQ_MEMSCOPE(v);
     if(s)
         v->Push(SQObjectPtr(SQString::Create(_ss(v), s, len)));
     else v->PushNull();
@@ -267,6 +316,7 @@ void sq_pushthread(HSQUIRRELVM v, HSQUIRRELVM thread)
 
 SQUserPointer sq_newuserdata(HSQUIRRELVM v,SQUnsignedInteger size)
 {
+    SQ_MEMSCOPE(v);
     SQUserData *ud = SQUserData::Create(_ss(v), size + SQ_ALIGNMENT);
     v->Push(ud);
     return (SQUserPointer)sq_aligning(ud + 1);
@@ -274,21 +324,25 @@ SQUserPointer sq_newuserdata(HSQUIRRELVM v,SQUnsignedInteger size)
 
 void sq_newtable(HSQUIRRELVM v)
 {
+    SQ_MEMSCOPE(v);
     v->Push(SQTable::Create(_ss(v), 0));
 }
 
 void sq_newtableex(HSQUIRRELVM v,SQInteger initialcapacity)
 {
+    SQ_MEMSCOPE(v);
     v->Push(SQTable::Create(_ss(v), initialcapacity));
 }
 
 void sq_newarray(HSQUIRRELVM v,SQInteger size)
 {
+    SQ_MEMSCOPE(v);
     v->Push(SQArray::Create(_ss(v), size));
 }
 
 SQRESULT sq_newclass(HSQUIRRELVM v,SQBool hasbase)
 {
+    SQ_MEMSCOPE(v);
     SQClass *baseclass = NULL;
     if(hasbase) {
         SQObjectPtr &base = stack_get(v,-1);
@@ -313,6 +367,7 @@ SQBool sq_instanceof(HSQUIRRELVM v)
 
 SQRESULT sq_arrayappend(HSQUIRRELVM v,SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     sq_aux_paramscheck(v,2);
     SQObjectPtr *arr;
     _GETSAFE_OBJ(v, idx, OT_ARRAY,arr);
@@ -323,6 +378,7 @@ SQRESULT sq_arrayappend(HSQUIRRELVM v,SQInteger idx)
 
 SQRESULT sq_arraypop(HSQUIRRELVM v,SQInteger idx,SQBool pushval)
 {
+    SQ_MEMSCOPE(v);
     sq_aux_paramscheck(v, 1);
     SQObjectPtr *arr;
     _GETSAFE_OBJ(v, idx, OT_ARRAY,arr);
@@ -336,6 +392,7 @@ SQRESULT sq_arraypop(HSQUIRRELVM v,SQInteger idx,SQBool pushval)
 
 SQRESULT sq_arrayresize(HSQUIRRELVM v,SQInteger idx,SQInteger newsize)
 {
+    SQ_MEMSCOPE(v);
     sq_aux_paramscheck(v,1);
     SQObjectPtr *arr;
     _GETSAFE_OBJ(v, idx, OT_ARRAY,arr);
@@ -349,6 +406,7 @@ SQRESULT sq_arrayresize(HSQUIRRELVM v,SQInteger idx,SQInteger newsize)
 
 SQRESULT sq_arrayreverse(HSQUIRRELVM v,SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     sq_aux_paramscheck(v, 1);
     SQObjectPtr *o;
     _GETSAFE_OBJ(v, idx, OT_ARRAY,o);
@@ -369,6 +427,7 @@ SQRESULT sq_arrayreverse(HSQUIRRELVM v,SQInteger idx)
 
 SQRESULT sq_arrayremove(HSQUIRRELVM v,SQInteger idx,SQInteger itemidx)
 {
+    SQ_MEMSCOPE(v);
     sq_aux_paramscheck(v, 1);
     SQObjectPtr *arr;
     _GETSAFE_OBJ(v, idx, OT_ARRAY,arr);
@@ -377,6 +436,7 @@ SQRESULT sq_arrayremove(HSQUIRRELVM v,SQInteger idx,SQInteger itemidx)
 
 SQRESULT sq_arrayinsert(HSQUIRRELVM v,SQInteger idx,SQInteger destpos)
 {
+    SQ_MEMSCOPE(v);
     sq_aux_paramscheck(v, 1);
     SQObjectPtr *arr;
     _GETSAFE_OBJ(v, idx, OT_ARRAY,arr);
@@ -385,8 +445,74 @@ SQRESULT sq_arrayinsert(HSQUIRRELVM v,SQInteger idx,SQInteger destpos)
     return ret;
 }
 
+// Bulk access to a range of the array, reading and writing the elements in place.
+// Every element of the range must have the exact type, no numeric conversion is made;
+// the elements are checked without branching so the copy loops can be vectorized
+static SQArray *sq_aux_arrayrange(HSQUIRRELVM v,SQInteger idx,SQInteger start,SQInteger count)
+{
+    SQObjectPtr *arr;
+    if(!sq_aux_gettypedarg(v,idx,OT_ARRAY,&arr)) return NULL;
+    SQArray *a = _array(*arr);
+    if(start < 0 || count < 0 || count > a->Size() - start) {
+        v->Raise_Error(_SC("index out of range"));
+        return NULL;
+    }
+    return a;
+}
+
+SQRESULT sq_arraygetintegers(HSQUIRRELVM v,SQInteger idx,SQInteger start,SQInteger count,SQInteger *dst)
+{
+    SQArray *a = sq_aux_arrayrange(v,idx,start,count);
+    if(!a) return SQ_ERROR;
+    const SQObjectPtr *vals = a->_values._vals + start;
+    SQUnsignedInteger bad = 0;
+    for(SQInteger i = 0; i < count; i++) {
+        bad |= sq_type(vals[i]) ^ OT_INTEGER;
+        dst[i] = vals[i]._unVal.nInteger;
+    }
+    return bad ? sq_throwerror(v,_SC("array element is not an integer")) : SQ_OK;
+}
+
+SQRESULT sq_arraygetfloats(HSQUIRRELVM v,SQInteger idx,SQInteger start,SQInteger count,SQFloat *dst)
+{
+    SQArray *a = sq_aux_arrayrange(v,idx,start,count);
+    if(!a) return SQ_ERROR;
+    const SQObjectPtr *vals = a->_values._vals + start;
+    SQUnsignedInteger bad = 0;
+    for(SQInteger i = 0; i < count; i++) {
+        bad |= sq_type(vals[i]) ^ OT_FLOAT;
+        dst[i] = vals[i]._unVal.fFloat;
+    }
+    return bad ? sq_throwerror(v,_SC("array element is not a float")) : SQ_OK;
+}
+
+SQRESULT sq_arraysetintegers(HSQUIRRELVM v,SQInteger idx,SQInteger start,SQInteger count,const SQInteger *src)
+{
+    SQ_MEMSCOPE(v);
+    SQArray *a = sq_aux_arrayrange(v,idx,start,count);
+    if(!a) return SQ_ERROR;
+    SQObjectPtr *vals = a->_values._vals + start;
+    for(SQInteger i = 0; i < count; i++) {
+        vals[i] = src[i];
+    }
+    return SQ_OK;
+}
+
+SQRESULT sq_arraysetfloats(HSQUIRRELVM v,SQInteger idx,SQInteger start,SQInteger count,const SQFloat *src)
+{
+    SQ_MEMSCOPE(v);
+    SQArray *a = sq_aux_arrayrange(v,idx,start,count);
+    if(!a) return SQ_ERROR;
+    SQObjectPtr *vals = a->_values._vals + start;
+    for(SQInteger i = 0; i < count; i++) {
+        vals[i] = src[i];
+    }
+    return SQ_OK;
+}
+
 void sq_newclosure(HSQUIRRELVM v,SQFUNCTION func,SQUnsignedInteger nfreevars)
 {
+    SQ_MEMSCOPE(v);
     SQNativeClosure *nc = SQNativeClosure::Create(_ss(v), func,nfreevars);
     nc->_nparamscheck = 0;
     for(SQUnsignedInteger i = 0; i < nfreevars; i++) {
@@ -416,8 +542,24 @@ SQRESULT sq_getclosureinfo(HSQUIRRELVM v,SQInteger idx,SQInteger *nparams,SQInte
     return sq_throwerror(v,_SC("the object is not a closure"));
 }
 
+//stack slots used by a frame of the closure, 0 for a native closure (it runs on the caller's stack)
+SQRESULT sq_getclosurestacksize(HSQUIRRELVM v,SQInteger idx,SQInteger *stacksize)
+{
+    SQObject o = stack_get(v, idx);
+    if(sq_type(o) == OT_CLOSURE) {
+        *stacksize = _closure(o)->_function->_stacksize;
+        return SQ_OK;
+    }
+    else if(sq_type(o) == OT_NATIVECLOSURE) {
+        *stacksize = 0;
+        return SQ_OK;
+    }
+    return sq_throwerror(v,_SC("the object is not a closure"));
+}
+
 SQRESULT sq_setnativeclosurename(HSQUIRRELVM v,SQInteger idx,const SQChar *name)
 {
+    SQ_MEMSCOPE(v);
     SQObject o = stack_get(v, idx);
     if(sq_isnativeclosure(o)) {
         SQNativeClosure *nc = _nativeclosure(o);
@@ -429,6 +571,7 @@ SQRESULT sq_setnativeclosurename(HSQUIRRELVM v,SQInteger idx,const SQChar *name)
 
 SQRESULT sq_setparamscheck(HSQUIRRELVM v,SQInteger nparamscheck,const SQChar *typemask)
 {
+    SQ_MEMSCOPE(v);
     SQObject o = stack_get(v, -1);
     if(!sq_isnativeclosure(o))
         return sq_throwerror(v, _SC("native closure expected"));
@@ -451,6 +594,7 @@ SQRESULT sq_setparamscheck(HSQUIRRELVM v,SQInteger nparamscheck,const SQChar *ty
 
 SQRESULT sq_bindenv(HSQUIRRELVM v,SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr &o = stack_get(v,idx);
     if(!sq_isnativeclosure(o) &&
         !sq_isclosure(o))
@@ -488,6 +632,7 @@ SQRESULT sq_bindenv(HSQUIRRELVM v,SQInteger idx)
 
 SQRESULT sq_getclosurename(HSQUIRRELVM v,SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr &o = stack_get(v,idx);
     if(!sq_isnativeclosure(o) &&
         !sq_isclosure(o))
@@ -504,6 +649,7 @@ SQRESULT sq_getclosurename(HSQUIRRELVM v,SQInteger idx)
 
 SQRESULT sq_setclosureroot(HSQUIRRELVM v,SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr &c = stack_get(v,idx);
     SQObject o = stack_get(v, -1);
     if(!sq_isclosure(c)) return sq_throwerror(v, _SC("closure expected"));
@@ -517,6 +663,7 @@ SQRESULT sq_setclosureroot(HSQUIRRELVM v,SQInteger idx)
 
 SQRESULT sq_getclosureroot(HSQUIRRELVM v,SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr &c = stack_get(v,idx);
     if(!sq_isclosure(c)) return sq_throwerror(v, _SC("closure expected"));
     v->Push(_closure(c)->_root->_obj);
@@ -525,6 +672,7 @@ SQRESULT sq_getclosureroot(HSQUIRRELVM v,SQInteger idx)
 
 SQRESULT sq_clear(HSQUIRRELVM v,SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     SQObject &o=stack_get(v,idx);
     switch(sq_type(o)) {
         case OT_TABLE: _table(o)->Clear();  break;
@@ -537,6 +685,28 @@ SQRESULT sq_clear(HSQUIRRELVM v,SQInteger idx)
     return SQ_OK;
 }
 
+SQRESULT sq_setweakmode(HSQUIRRELVM v,SQInteger idx,SQInteger mode)
+{
+    SQ_MEMSCOPE(v);
+    sq_aux_paramscheck(v, 1);
+    SQObjectPtr *o = NULL;
+    _GETSAFE_OBJ(v, idx, OT_TABLE,o);
+#ifndef NO_GARBAGE_COLLECTOR
+    if(mode & ~(SQ_WEAK_KEYS|SQ_WEAK_VALUES)) return sq_throwerror(v, _SC("invalid weak mode"));
+    _table(*o)->SetWeakMode(mode);
+    return SQ_OK;
+#else
+    return sq_throwerror(v, _SC("weak tables require a garbage collector build"));
+#endif
+}
+
+SQInteger sq_getweakmode(HSQUIRRELVM v,SQInteger idx)
+{
+    SQObjectPtr &o = stack_get(v, idx);
+    if(sq_type(o) != OT_TABLE) return 0;
+    return _table(o)->GetWeakMode();
+}
+
 void sq_pushroottable(HSQUIRRELVM v)
 {
     v->Push(v->_roottable);
@@ -554,6 +724,7 @@ void sq_pushconsttable(HSQUIRRELVM v)
 
 SQRESULT sq_setroottable(HSQUIRRELVM v)
 {
+    SQ_MEMSCOPE(v);
     SQObject o = stack_get(v, -1);
     if(sq_istable(o) || sq_isnull(o)) {
         v->_roottable = o;
@@ -565,6 +736,7 @@ SQRESULT sq_setroottable(HSQUIRRELVM v)
 
 SQRESULT sq_setconsttable(HSQUIRRELVM v)
 {
+    SQ_MEMSCOPE(v);
     SQObject o = stack_get(v, -1);
     if(sq_istable(o)) {
         _ss(v)->_consts = o;
@@ -626,6 +798,7 @@ SQObjectType sq_gettype(HSQUIRRELVM v,SQInteger idx)
 
 SQRESULT sq_typeof(HSQUIRRELVM v,SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr &o = stack_get(v, idx);
     SQObjectPtr res;
     if(!v->TypeOf(o,res)) {
@@ -637,6 +810,7 @@ SQRESULT sq_typeof(HSQUIRRELVM v,SQInteger idx)
 
 SQRESULT sq_tostring(HSQUIRRELVM v,SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr &o = stack_get(v, idx);
     SQObjectPtr res;
     if(!v->ToString(o,res)) {
@@ -713,6 +887,7 @@ SQRESULT sq_getthread(HSQUIRRELVM v,SQInteger idx,HSQUIRRELVM *thread)
 
 SQRESULT sq_clone(HSQUIRRELVM v,SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr &o = stack_get(v,idx);
     v->PushNull();
     if(!v->Clone(o, stack_get(v, -1))){
@@ -801,6 +976,7 @@ SQRESULT sq_setinstanceup(HSQUIRRELVM v, SQInteger idx, SQUserPointer p)
 
 SQRESULT sq_setclassudsize(HSQUIRRELVM v, SQInteger idx, SQInteger udsize)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr &o = stack_get(v,idx);
     if(sq_type(o) != OT_CLASS) return sq_throwerror(v,_SC("the object is not a class"));
     if(_class(o)->_locked) return sq_throwerror(v,_SC("the class is locked"));
@@ -809,6 +985,21 @@ SQRESULT sq_setclassudsize(HSQUIRRELVM v, SQInteger idx, SQInteger udsize)
 }
 
 
+SQRESULT sq_newnativefield(HSQUIRRELVM v,SQInteger idx,SQInteger offset,SQNativeFieldType type,SQBool readonly)
+{
+    SQ_MEMSCOPE(v);
+    SQObjectPtr &o = stack_get(v,idx);
+    if(sq_type(o) != OT_CLASS) return sq_throwerror(v,_SC("the object is not a class"));
+    SQObjectPtr &key = v->GetUp(-1);
+    if(sq_type(key) == OT_NULL) return sq_throwerror(v,_SC("null key"));
+    if(offset < 0 || type < SQNF_BOOL || type > SQNF_DOUBLE) return sq_throwerror(v,_SC("invalid native field"));
+    if(!_class(o)->NewNativeField(key,_make_nativefield(offset,(SQInteger)type,readonly))) {
+        return sq_throwerror(v,_SC("the class is locked or already has the member"));
+    }
+    v->Pop();
+    return SQ_OK;
+}
+
 SQRESULT sq_getinstanceup(HSQUIRRELVM v, SQInteger idx, SQUserPointer *p, SQUserPointer typetag, SQBool throwerror)
 {
 	SQObjectPtr &o = stack_get(v, idx);
@@ -833,6 +1024,7 @@ SQInteger sq_gettop(HSQUIRRELVM v)
 
 void sq_settop(HSQUIRRELVM v, SQInteger newtop)
 {
+    SQ_MEMSCOPE(v);
     SQInteger top = sq_gettop(v);
     if(top > newtop)
         sq_pop(v, top - newtop);
@@ -842,12 +1034,14 @@ void sq_settop(HSQUIRRELVM v, SQInteger newtop)
 
 void sq_pop(HSQUIRRELVM v, SQInteger nelemstopop)
 {
+    SQ_MEMSCOPE(v);
     assert(v->_top >= nelemstopop);
     v->Pop(nelemstopop);
 }
 
 void sq_poptop(HSQUIRRELVM v)
 {
+    SQ_MEMSCOPE(v);
     assert(v->_top >= 1);
     v->Pop();
 }
@@ -855,11 +1049,13 @@ void sq_poptop(HSQUIRRELVM v)
 
 void sq_remove(HSQUIRRELVM v, SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     v->Remove(idx);
 }
 
 SQInteger sq_cmp(HSQUIRRELVM v)
 {
+    SQ_MEMSCOPE(v);
     SQInteger res;
     v->ObjCmp(stack_get(v, -1), stack_get(v, -2),res);
     return res;
@@ -867,6 +1063,7 @@ SQInteger sq_cmp(HSQUIRRELVM v)
 
 SQRESULT sq_newslot(HSQUIRRELVM v, SQInteger idx, SQBool bstatic)
 {
+    SQ_MEMSCOPE(v);
     sq_aux_paramscheck(v, 3);
     SQObjectPtr &self = stack_get(v, idx);
     if(sq_type(self) == OT_TABLE || sq_type(self) == OT_CLASS) {
@@ -880,6 +1077,7 @@ SQRESULT sq_newslot(HSQUIRRELVM v, SQInteger idx, SQBool bstatic)
 
 SQRESULT sq_deleteslot(HSQUIRRELVM v,SQInteger idx,SQBool pushval)
 {
+    SQ_MEMSCOPE(v);
     sq_aux_paramscheck(v, 2);
     SQObjectPtr *self;
     _GETSAFE_OBJ(v, idx, OT_TABLE,self);
@@ -897,6 +1095,7 @@ SQRESULT sq_deleteslot(HSQUIRRELVM v,SQInteger idx,SQBool pushval)
 
 SQRESULT sq_set(HSQUIRRELVM v,SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr &self = stack_get(v, idx);
     if(v->Set(self, v->GetUp(-2), v->GetUp(-1),DONT_FALL_BACK)) {
         v->Pop(2);
@@ -907,6 +1106,7 @@ SQRESULT sq_set(HSQUIRRELVM v,SQInteger idx)
 
 SQRESULT sq_rawset(HSQUIRRELVM v,SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr &self = stack_get(v, idx);
     SQObjectPtr &key = v->GetUp(-2);
     if(sq_type(key) == OT_NULL) {
@@ -945,6 +1145,7 @@ SQRESULT sq_rawset(HSQUIRRELVM v,SQInteger idx)
 
 SQRESULT sq_newmember(HSQUIRRELVM v,SQInteger idx,SQBool bstatic)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr &self = stack_get(v, idx);
     if(sq_type(self) != OT_CLASS) return sq_throwerror(v, _SC("new member only works with classes"));
     SQObjectPtr &key = v->GetUp(-3);
@@ -959,6 +1160,7 @@ SQRESULT sq_newmember(HSQUIRRELVM v,SQInteger idx,SQBool bstatic)
 
 SQRESULT sq_rawnewmember(HSQUIRRELVM v,SQInteger idx,SQBool bstatic)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr &self = stack_get(v, idx);
     if(sq_type(self) != OT_CLASS) return sq_throwerror(v, _SC("new member only works with classes"));
     SQObjectPtr &key = v->GetUp(-3);
@@ -973,6 +1175,7 @@ SQRESULT sq_rawnewmember(HSQUIRRELVM v,SQInteger idx,SQBool bstatic)
 
 SQRESULT sq_setdelegate(HSQUIRRELVM v,SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr &self = stack_get(v, idx);
     SQObjectPtr &mt = v->GetUp(-1);
     SQObjectType type = sq_type(self);
@@ -1004,6 +1207,7 @@ SQRESULT sq_setdelegate(HSQUIRRELVM v,SQInteger idx)
 
 SQRESULT sq_rawdeleteslot(HSQUIRRELVM v,SQInteger idx,SQBool pushval)
 {
+    SQ_MEMSCOPE(v);
     sq_aux_paramscheck(v, 2);
     SQObjectPtr *self;
     _GETSAFE_OBJ(v, idx, OT_TABLE,self);
@@ -1021,6 +1225,7 @@ SQRESULT sq_rawdeleteslot(HSQUIRRELVM v,SQInteger idx,SQBool pushval)
 
 SQRESULT sq_getdelegate(HSQUIRRELVM v,SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr &self=stack_get(v,idx);
     switch(sq_type(self)){
     case OT_TABLE:
@@ -1039,6 +1244,7 @@ SQRESULT sq_getdelegate(HSQUIRRELVM v,SQInteger idx)
 
 SQRESULT sq_get(HSQUIRRELVM v,SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr &self=stack_get(v,idx);
     SQObjectPtr &obj = v->GetUp(-1);
     if(v->Get(self,obj,obj,false,DONT_FALL_BACK))
@@ -1049,6 +1255,7 @@ SQRESULT sq_get(HSQUIRRELVM v,SQInteger idx)
 
 SQRESULT sq_rawget(HSQUIRRELVM v,SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr &self=stack_get(v,idx);
     SQObjectPtr &obj = v->GetUp(-1);
     switch(sq_type(self)) {
@@ -1092,6 +1299,7 @@ SQRESULT sq_getstackobj(HSQUIRRELVM v,SQInteger idx,HSQOBJECT *po)
 
 const SQChar *sq_getlocal(HSQUIRRELVM v,SQUnsignedInteger level,SQUnsignedInteger idx)
 {
+    SQ_MEMSCOPE(v);
     SQUnsignedInteger cstksize=v->_callsstacksize;
     SQUnsignedInteger lvl=(cstksize-level)-1;
     SQInteger stackbase=v->_stackbase;
@@ -1125,14 +1333,90 @@ void sq_resetobject(HSQOBJECT *po)
     po->_unVal.pUserPointer=NULL;po->_type=OT_NULL;
 }
 
+void sq_resethandle(SQHandle *h)
+{
+    sq_resetobject(&h->_obj);
+    h->_prev = h->_next = NULL;
+    h->_vm = NULL;
+}
+
+//a linked handle releases its object through the state of the vm it was set with
+#define SQ_HANDLESCOPE(h) SQMemScope _memscope((h)->_next ? &_ss((h)->_vm)->_memctx : _sq_memctx)
+
+//the handles bump the refcount of the object directly, only the collector walks their list
+void sq_sethandle(HSQUIRRELVM v,SQHandle *h,const HSQOBJECT *po)
+{
+    SQ_MEMSCOPE(v);
+    SQObject o = *po, old = h->_obj;
+    if(ISREFCOUNTED(sq_type(o))) {
+        __AddRef(o._type,o._unVal);
+        if(!h->_next) SQSharedState::LinkHandle(h,&_ss(v)->_handles);
+        h->_vm = _thread(_ss(v)->_root_vm);
+#ifndef NO_GARBAGE_COLLECTOR
+        //same barrier as sq_addref, the atomic phase doesn't walk the handles again
+        if(_ss(v)->_gcstate == SQ_GC_PROPAGATE) {
+            SQObjectPtr t = o;
+            SQSharedState::MarkObject(t,&_ss(v)->_gc_black);
+        }
+#endif
+    }
+    else if(h->_next) SQSharedState::UnlinkHandle(h);
+    h->_obj = o;
+    __Release(old._type,old._unVal);
+}
+
+//a copy is linked next to its source, no vm is needed
+void sq_copyhandle(SQHandle *dst,const SQHandle *src)
+{
+    if(dst == src) return;
+    SQ_HANDLESCOPE(dst);
+    SQObject old = dst->_obj;
+    if(dst->_next) SQSharedState::UnlinkHandle(dst);
+    dst->_obj = src->_obj;
+    if(src->_next) {
+        __AddRef(dst->_obj._type,dst->_obj._unVal);
+        SQSharedState::LinkHandle(dst,const_cast<SQHandle *>(src));
+        dst->_vm = src->_vm;
+    }
+    __Release(old._type,old._unVal);
+}
+
+//dst takes the place of src in the list, the refcount isn't touched
+void sq_movehandle(SQHandle *dst,SQHandle *src)
+{
+    if(dst == src) return;
+    SQ_HANDLESCOPE(dst);
+    SQObject old = dst->_obj;
+    if(dst->_next) SQSharedState::UnlinkHandle(dst);
+    dst->_obj = src->_obj;
+    if(src->_next) {
+        SQSharedState::LinkHandle(dst,src);
+        SQSharedState::UnlinkHandle(src);
+        dst->_vm = src->_vm;
+    }
+    sq_resetobject(&src->_obj);
+    __Release(old._type,old._unVal);
+}
+
+void sq_releasehandle(SQHandle *h)
+{
+    SQ_HANDLESCOPE(h);
+    SQObject old = h->_obj;
+    if(h->_next) SQSharedState::UnlinkHandle(h);
+    sq_resetobject(&h->_obj);
+    __Release(old._type,old._unVal);
+}
+
 SQRESULT sq_throwerror(HSQUIRRELVM v,const SQChar *err)
 {
+    SQ_MEMSCOPE(v);
     v->_lasterror=SQString::Create(_ss(v),err);
     return SQ_ERROR;
 }
 
 SQRESULT sq_throwobject(HSQUIRRELVM v)
 {
+    SQ_MEMSCOPE(v);
     v->_lasterror = v->GetUp(-1);
     v->Pop();
     return SQ_ERROR;
@@ -1141,16 +1425,19 @@ SQRESULT sq_throwobject(HSQUIRRELVM v)
 
 void sq_reseterror(HSQUIRRELVM v)
 {
+    SQ_MEMSCOPE(v);
     v->_lasterror.Null();
 }
 
 void sq_getlasterror(HSQUIRRELVM v)
 {
+    SQ_MEMSCOPE(v);
     v->Push(v->_lasterror);
 }
 
 SQRESULT sq_reservestack(HSQUIRRELVM v,SQInteger nsize)
 {
+    SQ_MEMSCOPE(v);
     if (((SQUnsignedInteger)v->_top + nsize) > v->_stack.size()) {
         if(v->_nmetamethodscall) {
             return sq_throwerror(v,_SC("cannot resize stack while in a metamethod"));
@@ -1162,6 +1449,7 @@ SQRESULT sq_reservestack(HSQUIRRELVM v,SQInteger nsize)
 
 SQRESULT sq_resume(HSQUIRRELVM v,SQBool retval,SQBool raiseerror)
 {
+    SQ_MEMSCOPE(v);
     if (sq_type(v->GetUp(-1)) == OT_GENERATOR)
     {
         v->PushNull(); //retval
@@ -1176,6 +1464,7 @@ SQRESULT sq_resume(HSQUIRRELVM v,SQBool retval,SQBool raiseerror)
 
 SQRESULT sq_call(HSQUIRRELVM v,SQInteger params,SQBool retval,SQBool raiseerror)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr res;
     if(!v->Call(v->GetUp(-(params+1)),params,v->_top-params,res,raiseerror?true:false)){
         v->Pop(params); //pop args
@@ -1188,8 +1477,44 @@ SQRESULT sq_call(HSQUIRRELVM v,SQInteger params,SQBool retval,SQBool raiseerror)
     return SQ_OK;
 }
 
+//calls the closure at -2 'count' times with the "this" at -1, both stay on the stack.
+//a failed call is reported to 'result' and the batch goes on with the next one
+SQRESULT sq_callbatch(HSQUIRRELVM v,SQInteger count,SQBATCHARGS args,SQBATCHRESULT result,SQUserPointer up,SQBool raiseerror)
+{
+    SQ_MEMSCOPE(v);
+    if(sq_gettop(v) < 2)
+        return sq_throwerror(v,_SC("not enough params in the stack"));
+    SQObjectPtr closure = v->GetUp(-2);
+    SQObjectType type = sq_type(closure);
+    if(type != OT_CLOSURE && type != OT_NATIVECLOSURE && type != OT_CLASS)
+        return sq_throwerror(v,_SC("the target of a batch must be callable"));
+    const SQObjectPtr self = v->GetUp(-1);
+    const SQInteger top = sq_gettop(v);
+    SQObjectPtr res;
+    for(SQInteger i = 0; i < count; i++) {
+        SQInteger base = v->_top;
+        v->Push(self);
+        bool ok = SQ_SUCCEEDED(args(v,i,up));
+        if(ok) {
+            ok = v->Call(closure,v->_top - base,base,res,raiseerror?true:false);
+            if(v->_suspended)
+                return sq_throwerror(v,_SC("a batch call cannot suspend the vm"));
+        }
+        sq_settop(v,top);
+        if(!result) continue;
+        if(ok) {
+            v->Push(res);
+            res.Null();
+        }
+        result(v,i,ok?SQ_OK:SQ_ERROR,up);
+        sq_settop(v,top);
+    }
+    return SQ_OK;
+}
+
 SQRESULT sq_tailcall(HSQUIRRELVM v, SQInteger nparams)
 {
+    SQ_MEMSCOPE(v);
 	SQObjectPtr &res = v->GetUp(-(nparams + 1));
 	if (sq_type(res) != OT_CLOSURE) {
 		return sq_throwerror(v, _SC("only closure can be tail called"));
@@ -1209,11 +1534,13 @@ SQRESULT sq_tailcall(HSQUIRRELVM v, SQInteger nparams)
 
 SQRESULT sq_suspendvm(HSQUIRRELVM v)
 {
+    SQ_MEMSCOPE(v);
     return v->Suspend();
 }
 
 SQRESULT sq_wakeupvm(HSQUIRRELVM v,SQBool wakeupret,SQBool retval,SQBool raiseerror,SQBool throwerror)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr ret;
     if(!v->_suspended)
         return sq_throwerror(v,_SC("cannot resume a vm that is not running any code"));
@@ -1262,6 +1589,7 @@ void sq_setcompilererrorhandler(HSQUIRRELVM v,SQCOMPILERERROR f)
 
 SQRESULT sq_writeclosure(HSQUIRRELVM v,SQWRITEFUNC w,SQUserPointer up)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr *o = NULL;
     _GETSAFE_OBJ(v, -1, OT_CLOSURE,o);
     unsigned short tag = SQ_BYTECODE_STREAM_TAG;
@@ -1276,6 +1604,7 @@ SQRESULT sq_writeclosure(HSQUIRRELVM v,SQWRITEFUNC w,SQUserPointer up)
 
 SQRESULT sq_readclosure(HSQUIRRELVM v,SQREADFUNC r,SQUserPointer up)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr closure;
 
     unsigned short tag;
@@ -1289,13 +1618,110 @@ SQRESULT sq_readclosure(HSQUIRRELVM v,SQREADFUNC r,SQUserPointer up)
     return SQ_OK;
 }
 
+SQRESULT sq_sharecode(HSQUIRRELVM v,SQInteger idx,HSQCODE *code)
+{
+    SQ_MEMSCOPE(v);
+    SQObjectPtr *o = NULL;
+    _GETSAFE_OBJ(v, idx, OT_CLOSURE,o);
+    SQFunctionProto *f = _closure(*o)->_function;
+    if(f->_noutervalues)
+        return sq_throwerror(v,_SC("a closure with free variables bound cannot be shared"));
+    if(f->_shared) {
+        //already instantiated from shared code, hands out the same instructions
+        f->_shared->AddRef();
+        *code = f->_shared;
+        return SQ_OK;
+    }
+    SQSharedCode *c = SQSharedCode::Freeze(v,f,NULL);
+    if(!c)
+        return SQ_ERROR;
+    *code = c;
+    return SQ_OK;
+}
+
+SQRESULT sq_newclosurefromcode(HSQUIRRELVM v,HSQCODE code)
+{
+    SQ_MEMSCOPE(v);
+    v->Push(SQClosure::Create(_ss(v), SQFunctionProto::Instantiate(_ss(v),code), _table(v->_roottable)->GetWeakRef(OT_TABLE)));
+    return SQ_OK;
+}
+
+void sq_addrefcode(HSQCODE code)
+{
+    code->AddRef();
+}
+
+void sq_releasecode(HSQCODE code)
+{
+    code->Release();
+}
+
+SQRESULT sq_snapshot(HSQUIRRELVM v,HSQSNAPSHOT *snapshot)
+{
+    SQ_MEMSCOPE(v);
+    if(v != _thread(_ss(v)->_root_vm))
+        return sq_throwerror(v,_SC("only the root VM can be snapshot"));
+    if(v->_callsstacksize)
+        return sq_throwerror(v,_SC("cannot snapshot a running VM"));
+    sq_settop(v,0);
+#ifndef NO_GARBAGE_COLLECTOR
+    _ss(v)->CollectGarbage(v);
+#endif
+    SQSnapshot *s = SQSnapshot::Create(v);
+    if(!s)
+        return SQ_ERROR;
+    *snapshot = s;
+    return SQ_OK;
+}
+
+HSQUIRRELVM sq_openfromsnapshot(HSQSNAPSHOT snapshot,SQInteger initialstacksize,const SQAllocator *allocator)
+{
+    HSQUIRRELVM v = sq_openex(initialstacksize,allocator);
+    if(v) {
+        SQ_MEMSCOPE(v);
+        snapshot->Apply(v);
+    }
+    return v;
+}
+
+SQRESULT sq_resetfromsnapshot(HSQUIRRELVM v,HSQSNAPSHOT snapshot)
+{
+    SQ_MEMSCOPE(v);
+    SQSharedState *ss = _ss(v);
+    if(v != _thread(ss->_root_vm))
+        return sq_throwerror(v,_SC("only the root VM can be reset"));
+    if(v->_callsstacksize)
+        return sq_throwerror(v,_SC("cannot reset a running VM"));
+    sq_settop(v,0);
+    _table(v->_roottable)->Clear();
+    _table(v->_roottable)->SetDelegate(NULL);
+    ss->_registry = SQTable::Create(ss,0);
+    ss->_consts = SQTable::Create(ss,0);
+    v->_errorhandler.Null();
+    v->_debughook_closure.Null();
+    v->_debughook_native = NULL;
+    v->_debughook = false;
+#ifndef NO_GARBAGE_COLLECTOR
+    ss->CollectGarbage(v);
+#endif
+    snapshot->Apply(v);
+    return SQ_OK;
+}
+
+void sq_releasesnapshot(HSQSNAPSHOT snapshot)
+{
+    snapshot->Release();
+}
+
 SQChar *sq_getscratchpad(HSQUIRRELVM v,SQInteger minsize)
 {
+    SQ_MEMSCOPE(v);
     return _ss(v)->GetScratchPad(minsize);
 }
 
 SQRESULT sq_resurrectunreachable(HSQUIRRELVM v)
 {
+    SQ_MEMSCOPE(v);
 #ifndef NO_GARBAGE_COLLECTOR
     _ss(v)->ResurrectUnreachable(v);
     return SQ_OK;
@@ -1306,6 +1732,7 @@ SQRESULT sq_resurrectunreachable(HSQUIRRELVM v)
 
 SQInteger sq_collectgarbage(HSQUIRRELVM v)
 {
+    SQ_MEMSCOPE(v);
 #ifndef NO_GARBAGE_COLLECTOR
     return _ss(v)->CollectGarbage(v);
 #else
@@ -1313,8 +1740,60 @@ SQInteger sq_collectgarbage(HSQUIRRELVM v)
 #endif
 }
 
+SQInteger sq_collectgarbage_step(HSQUIRRELVM v,SQInteger budget_us)
+{
+    SQ_MEMSCOPE(v);
+#ifndef NO_GARBAGE_COLLECTOR
+    return _ss(v)->CollectGarbageStep(v,budget_us);
+#else
+    return -1;
+#endif
+}
+
+SQInteger sq_collectcycles(HSQUIRRELVM v)
+{
+    SQ_MEMSCOPE(v);
+#ifndef NO_GARBAGE_COLLECTOR
+    return _ss(v)->CollectCycles();
+#else
+    return -1;
+#endif
+}
+
+SQRESULT sq_getgcstats(HSQUIRRELVM v,SQGCStats *stats)
+{
+#ifndef NO_GARBAGE_COLLECTOR
+    _ss(v)->GetGCStats(stats);
+    return SQ_OK;
+#else
+    return sq_throwerror(v,_SC("sq_getgcstats requires a garbage collector build"));
+#endif
+}
+
+SQRESULT sq_setgcparams(HSQUIRRELVM v,const SQGCParams *params)
+{
+    SQ_MEMSCOPE(v);
+#ifndef NO_GARBAGE_COLLECTOR
+    _ss(v)->GCSetParams(*params);
+    return SQ_OK;
+#else
+    return sq_throwerror(v,_SC("sq_setgcparams requires a garbage collector build"));
+#endif
+}
+
+SQRESULT sq_getgcparams(HSQUIRRELVM v,SQGCParams *params)
+{
+#ifndef NO_GARBAGE_COLLECTOR
+    *params = _ss(v)->_gcparams;
+    return SQ_OK;
+#else
+    return sq_throwerror(v,_SC("sq_getgcparams requires a garbage collector build"));
+#endif
+}
+
 SQRESULT sq_getcallee(HSQUIRRELVM v)
 {
+    SQ_MEMSCOPE(v);
     if(v->_callsstacksize > 1)
     {
         v->Push(v->_callsstack[v->_callsstacksize - 2]._closure);
@@ -1325,6 +1804,7 @@ SQRESULT sq_getcallee(HSQUIRRELVM v)
 
 const SQChar *sq_getfreevariable(HSQUIRRELVM v,SQInteger idx,SQUnsignedInteger nval)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr &self=stack_get(v,idx);
     const SQChar *name = NULL;
     switch(sq_type(self))
@@ -1354,12 +1834,14 @@ const SQChar *sq_getfreevariable(HSQUIRRELVM v,SQInteger idx,SQUnsignedInteger n
 
 SQRESULT sq_setfreevariable(HSQUIRRELVM v,SQInteger idx,SQUnsignedInteger nval)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr &self=stack_get(v,idx);
     switch(sq_type(self))
     {
     case OT_CLOSURE:{
         SQFunctionProto *fp = _closure(self)->_function;
         if(((SQUnsignedInteger)fp->_noutervalues) > nval){
+            //outers are traversed again in the atomic phase, no barrier needed
             *(_outer(_closure(self)->_outervalues[nval])->_valptr) = stack_get(v,-1);
         }
         else return sq_throwerror(v,_SC("invalid free var index"));
@@ -1367,6 +1849,7 @@ SQRESULT sq_setfreevariable(HSQUIRRELVM v,SQInteger idx,SQUnsignedInteger nval)
         break;
     case OT_NATIVECLOSURE:
         if(_nativeclosure(self)->_noutervalues > nval){
+            SQ_GC_BARRIER(_nativeclosure(self));
             _nativeclosure(self)->_outervalues[nval] = stack_get(v,-1);
         }
         else return sq_throwerror(v,_SC("invalid free var index"));
@@ -1380,6 +1863,7 @@ SQRESULT sq_setfreevariable(HSQUIRRELVM v,SQInteger idx,SQUnsignedInteger nval)
 
 SQRESULT sq_setattributes(HSQUIRRELVM v,SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr *o = NULL;
     _GETSAFE_OBJ(v, idx, OT_CLASS,o);
     SQObjectPtr &key = stack_get(v,-2);
@@ -1387,6 +1871,7 @@ SQRESULT sq_setattributes(HSQUIRRELVM v,SQInteger idx)
     SQObjectPtr attrs;
     if(sq_type(key) == OT_NULL) {
         attrs = _class(*o)->_attributes;
+        SQ_GC_BARRIER(_class(*o));
         _class(*o)->_attributes = val;
         v->Pop(2);
         v->Push(attrs);
@@ -1402,6 +1887,7 @@ SQRESULT sq_setattributes(HSQUIRRELVM v,SQInteger idx)
 
 SQRESULT sq_getattributes(HSQUIRRELVM v,SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr *o = NULL;
     _GETSAFE_OBJ(v, idx, OT_CLASS,o);
     SQObjectPtr &key = stack_get(v,-1);
@@ -1422,12 +1908,14 @@ SQRESULT sq_getattributes(HSQUIRRELVM v,SQInteger idx)
 
 SQRESULT sq_getmemberhandle(HSQUIRRELVM v,SQInteger idx,HSQMEMBERHANDLE *handle)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr *o = NULL;
     _GETSAFE_OBJ(v, idx, OT_CLASS,o);
     SQObjectPtr &key = stack_get(v,-1);
     SQTable *m = _class(*o)->_members;
     SQObjectPtr val;
     if(m->Get(key,val)) {
+        if(_isnativefield(val)) return sq_throwerror(v,_SC("native fields have no handle"));
         handle->_static = _isfield(val) ? SQFalse : SQTrue;
         handle->_index = _member_idx(val);
         v->Pop();
@@ -1469,6 +1957,7 @@ SQRESULT _getmemberbyhandle(HSQUIRRELVM v,SQObjectPtr &self,const HSQMEMBERHANDL
 
 SQRESULT sq_getbyhandle(HSQUIRRELVM v,SQInteger idx,const HSQMEMBERHANDLE *handle)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr &self = stack_get(v,idx);
     SQObjectPtr *val = NULL;
     if(SQ_FAILED(_getmemberbyhandle(v,self,handle,val))) {
@@ -1480,12 +1969,21 @@ SQRESULT sq_getbyhandle(HSQUIRRELVM v,SQInteger idx,const HSQMEMBERHANDLE *handl
 
 SQRESULT sq_setbyhandle(HSQUIRRELVM v,SQInteger idx,const HSQMEMBERHANDLE *handle)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr &self = stack_get(v,idx);
     SQObjectPtr &newval = stack_get(v,-1);
     SQObjectPtr *val = NULL;
     if(SQ_FAILED(_getmemberbyhandle(v,self,handle,val))) {
         return SQ_ERROR;
     }
+    //instance handles can also address the methods of the class
+    if(sq_type(self) == OT_INSTANCE) {
+        SQ_GC_BARRIER(_instance(self));
+        SQ_GC_BARRIER(_instance(self)->_class);
+    }
+    else {
+        SQ_GC_BARRIER(_class(self));
+    }
     *val = newval;
     v->Pop();
     return SQ_OK;
@@ -1493,6 +1991,7 @@ SQRESULT sq_setbyhandle(HSQUIRRELVM v,SQInteger idx,const HSQMEMBERHANDLE *handl
 
 SQRESULT sq_getbase(HSQUIRRELVM v,SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr *o = NULL;
     _GETSAFE_OBJ(v, idx, OT_CLASS,o);
     if(_class(*o)->_base)
@@ -1504,6 +2003,7 @@ SQRESULT sq_getbase(HSQUIRRELVM v,SQInteger idx)
 
 SQRESULT sq_getclass(HSQUIRRELVM v,SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr *o = NULL;
     _GETSAFE_OBJ(v, idx, OT_INSTANCE,o);
     v->Push(SQObjectPtr(_instance(*o)->_class));
@@ -1512,6 +2012,7 @@ SQRESULT sq_getclass(HSQUIRRELVM v,SQInteger idx)
 
 SQRESULT sq_createinstance(HSQUIRRELVM v,SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr *o = NULL;
     _GETSAFE_OBJ(v, idx, OT_CLASS,o);
     v->Push(_class(*o)->CreateInstance());
@@ -1520,6 +2021,7 @@ SQRESULT sq_createinstance(HSQUIRRELVM v,SQInteger idx)
 
 void sq_weakref(HSQUIRRELVM v,SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     SQObject &o=stack_get(v,idx);
     if(ISREFCOUNTED(sq_type(o))) {
         v->Push(_refcounted(o)->GetWeakRef(sq_type(o)));
@@ -1530,6 +2032,7 @@ void sq_weakref(HSQUIRRELVM v,SQInteger idx)
 
 SQRESULT sq_getweakrefval(HSQUIRRELVM v,SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr &o = stack_get(v,idx);
     if(sq_type(o) != OT_WEAKREF) {
         return sq_throwerror(v,_SC("the object must be a weakref"));
@@ -1540,6 +2043,7 @@ SQRESULT sq_getweakrefval(HSQUIRRELVM v,SQInteger idx)
 
 SQRESULT sq_getdefaultdelegate(HSQUIRRELVM v,SQObjectType t)
 {
+    SQ_MEMSCOPE(v);
     SQSharedState *ss = _ss(v);
     switch(t) {
     case OT_TABLE: v->Push(ss->_table_default_delegate); break;
@@ -1559,6 +2063,7 @@ SQRESULT sq_getdefaultdelegate(HSQUIRRELVM v,SQObjectType t)
 
 SQRESULT sq_next(HSQUIRRELVM v,SQInteger idx)
 {
+    SQ_MEMSCOPE(v);
     SQObjectPtr o=stack_get(v,idx),&refpos = stack_get(v,-1),realkey,val;
     if(sq_type(o) == OT_GENERATOR) {
         return sq_throwerror(v,_SC("cannot iterate a generator"));
@@ -1631,3 +2136,107 @@ void sq_free(void *p,SQUnsignedInteger size)
 {
     SQ_FREE(p,size);
 }
+
+void sq_getmemstats(HSQUIRRELVM v,SQMemStats *stats)
+{
+    SQMemContext &c = _ss(v)->_memctx;
+    for(SQInteger i = 0; i < SQ_MEM_CATEGORIES; i++) stats->bytes[i] = c._bytes[i];
+    stats->total = c._total;
+    stats->peak = c._peak;
+    stats->limit = c._limit;
+}
+
+void sq_setmemorylimit(HSQUIRRELVM v,SQUnsignedInteger limit)
+{
+    SQ_MEMSCOPE(v);
+    SQMemContext &c = _ss(v)->_memctx;
+    c._limit = limit;
+    c._nextlimit = limit;
+    c._overlimit = limit && c._total > limit;
+}
+
+//the vm only checks the limit at its safe points; natives about to allocate a large block
+//call this first, so that the block never takes the state past the limit
+SQRESULT sq_checkmemorylimit(HSQUIRRELVM v,SQUnsignedInteger size)
+{
+    if(v->CanAllocate(size)) return SQ_OK;
+    SQ_MEMSCOPE(v);
+    v->Raise_MemoryLimitError();
+    return SQ_ERROR;
+}
+
+SQRESULT sq_startallocprofiler(HSQUIRRELVM v,SQUnsignedInteger samplerate)
+{
+    SQ_MEMSCOPE(v);
+    SQMemContext &c = _ss(v)->_memctx;
+    if(c._profile) return sq_throwerror(v,_SC("the allocation profiler is already running"));
+    if(samplerate == 0) samplerate = 1;
+    SQAllocProfile *p = (SQAllocProfile *)malloc(sizeof(SQAllocProfile));
+    if(!p) return sq_throwerror(v,_SC("cannot allocate the allocation profiler"));
+    memset(p,0,sizeof(SQAllocProfile));
+    p->_rate = samplerate;
+    p->_left = samplerate;
+    c._profile = p;
+    return SQ_OK;
+}
+
+void sq_stopallocprofiler(HSQUIRRELVM v)
+{
+    SQ_MEMSCOPE(v);
+    SQMemContext &c = _ss(v)->_memctx;
+    SQAllocProfile *p = c._profile;
+    if(!p) return;
+    c._profile = NULL;
+    for(SQUnsignedInteger i = 0; i < p->_capacity; i++) {
+        if(p->_sites[i]._count) __ObjRelease(p->_sites[i]._func);
+    }
+    free(p->_sites);
+    free(p);
+}
+
+static int sq_aux_allocsitecmp(const void *a,const void *b)
+{
+    SQUnsignedInteger ba = ((const SQAllocSite *)a)->_bytes, bb = ((const SQAllocSite *)b)->_bytes;
+    return ba < bb ? 1 : (ba > bb ? -1 : 0);
+}
+
+SQRESULT sq_getallocprofile(HSQUIRRELVM v)
+{
+    SQ_MEMSCOPE(v);
+    SQMemContext &c = _ss(v)->_memctx;
+    SQAllocProfile *p = c._profile;
+    if(!p) return sq_throwerror(v,_SC("the allocation profiler is not running"));
+    SQAllocSite *sites = (SQAllocSite *)malloc(sizeof(SQAllocSite) * (p->_numsites + 1));
+    if(!sites) return sq_throwerror(v,_SC("cannot allocate the allocation profile"));
+    SQUnsignedInteger n = 0;
+    for(SQUnsignedInteger i = 0; i < p->_capacity; i++) {
+        if(p->_sites[i]._count) sites[n++] = p->_sites[i];
+    }
+    qsort(sites,n,sizeof(SQAllocSite),sq_aux_allocsitecmp);
+    //the report allocates too, keep it out of the profile
+    c._profile = NULL;
+    sq_newarray(v,0);
+    for(SQUnsignedInteger i = 0; i < n; i++) {
+        SQFunctionProto *f = sites[i]._func;
+        sq_newtable(v);
+        sq_pushstring(v,_SC("func"),-1);
+        if(f) v->Push(f->_name); else sq_pushnull(v);
+        sq_newslot(v,-3,SQFalse);
+        sq_pushstring(v,_SC("source"),-1);
+        if(f) v->Push(f->_sourcename); else sq_pushnull(v);
+        sq_newslot(v,-3,SQFalse);
+        sq_pushstring(v,_SC("line"),-1);
+        sq_pushinteger(v,sites[i]._line);
+        sq_newslot(v,-3,SQFalse);
+        sq_pushstring(v,_SC("bytes"),-1);
+        sq_pushinteger(v,(SQInteger)sites[i]._bytes);
+        sq_newslot(v,-3,SQFalse);
+        sq_pushstring(v,_SC("samples"),-1);
+        sq_pushinteger(v,(SQInteger)sites[i]._count);
+        sq_newslot(v,-3,SQFalse);
+        sq_arrayappend(v,-2);
+    }
+    free(sites);
+    c._profile = p;
+    return SQ_OK;
+}
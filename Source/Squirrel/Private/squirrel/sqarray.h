@@ -12,12 +12,12 @@ private:
     }
 public:
     static SQArray* Create(SQSharedState *ss,SQInteger nInitialSize){
-        SQArray *newarray=(SQArray*)SQ_MALLOC(sizeof(SQArray));
+        SQArray *newarray=(SQArray*)SQ_MALLOC_CAT(sizeof(SQArray),SQ_MEM_ARRAY);
         new (newarray) SQArray(ss,nInitialSize);
         return newarray;
     }
 #ifndef NO_GARBAGE_COLLECTOR
-    void Mark(SQCollectable **chain);
+    void MarkChildren(SQCollectable **chain);
     SQObjectType GetType() {return OT_ARRAY;}
 #endif
     void Finalize(){
@@ -35,6 +35,7 @@ public:
     bool Set(const SQInteger nidx,const SQObjectPtr &val)
     {
         if(nidx>=0 && nidx<(SQInteger)_values.size()){
+            SQ_GC_BARRIER(this);
             _values[nidx]=val;
             return true;
         }
@@ -61,21 +62,23 @@ public:
         SQObjectPtr _null;
         Resize(size,_null);
     }
-    void Resize(SQInteger size,SQObjectPtr &fill) { _values.resize(size,fill); ShrinkIfNeeded(); }
+    void Resize(SQInteger size,SQObjectPtr &fill) { SQ_GC_BARRIER(this); _values.resize(size,fill); ShrinkIfNeeded(); }
     void Reserve(SQInteger size) { _values.reserve(size); }
-    void Append(const SQObject &o){_values.push_back(o);}
+    void Append(const SQObject &o){SQ_GC_BARRIER(this); _values.push_back(o);}
     void Extend(const SQArray *a);
+    SQInteger Find(const SQObjectPtr &val, SQInteger from = 0);
+    bool Contains(const SQObjectPtr &val) { return Find(val) >= 0; }
     SQObjectPtr &Top(){return _values.top();}
     void Pop(){_values.pop_back(); ShrinkIfNeeded(); }
     bool Insert(SQInteger idx,const SQObject &val){
         if(idx < 0 || idx > (SQInteger)_values.size())
             return false;
+        SQ_GC_BARRIER(this);
         _values.insert(idx,val);
         return true;
     }
     void ShrinkIfNeeded() {
-        if(_values.size() <= _values.capacity()>>2) //shrink the array
-            _values.shrinktofit();
+        _values.shrink();
     }
     bool Remove(SQInteger idx){
         if(idx < 0 || idx >= (SQInteger)_values.size())
@@ -86,7 +89,8 @@ public:
     }
     void Release()
     {
-        sq_delete(this,SQArray);
+        this->~SQArray();
+        SQ_FREE_CAT(this,sizeof(SQArray),SQ_MEM_ARRAY);
     }
 
     SQObjectPtrVec _values;
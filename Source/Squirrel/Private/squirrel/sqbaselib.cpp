@@ -9,6 +9,7 @@
 #include "sqfuncproto.h"
 #include "sqclosure.h"
 #include "sqclass.h"
+#include "sqparallel.h"
 #include <stdlib.h>
 #include <stdarg.h>
 #include <ctype.h>
@@ -54,6 +55,45 @@ static SQInteger base_collectgarbage(HSQUIRRELVM v)
     sq_pushinteger(v, sq_collectgarbage(v));
     return 1;
 }
+static SQInteger base_collectcycles(HSQUIRRELVM v)
+{
+    sq_pushinteger(v, sq_collectcycles(v));
+    return 1;
+}
+static void __gcstats_integer(HSQUIRRELVM v,const SQChar *name,SQInteger val)
+{
+    sq_pushstring(v, name, -1);
+    sq_pushinteger(v, val);
+    sq_newslot(v, -3, SQFalse);
+}
+static void __gcstats_types(HSQUIRRELVM v,const SQChar *name,const SQInteger *counts)
+{
+    static const SQChar *types[SQ_GC_TYPES] = { _SC("table"), _SC("array"), _SC("userdata"),
+        _SC("closure"), _SC("nativeclosure"), _SC("generator"), _SC("thread"), _SC("class"),
+        _SC("instance"), _SC("outer"), _SC("funcproto") };
+    sq_pushstring(v, name, -1);
+    sq_newtable(v);
+    for(SQInteger i = 0; i < SQ_GC_TYPES; i++) __gcstats_integer(v, types[i], counts[i]);
+    sq_newslot(v, -3, SQFalse);
+}
+static SQInteger base_gcstats(HSQUIRRELVM v)
+{
+    SQGCStats s;
+    sq_getgcstats(v, &s);
+    sq_newtable(v);
+    __gcstats_integer(v, _SC("collections"), s.collections);
+    __gcstats_types(v, _SC("marked"), s.marked);
+    __gcstats_types(v, _SC("freed"), s.freed);
+    __gcstats_integer(v, _SC("marktime"), s.marktime);
+    __gcstats_integer(v, _SC("sweeptime"), s.sweeptime);
+    __gcstats_integer(v, _SC("cyclesfreed"), s.cyclesfreed);
+    __gcstats_integer(v, _SC("chainlength"), s.chainlength);
+    __gcstats_integer(v, _SC("refs"), s.refs);
+    __gcstats_integer(v, _SC("refslots"), s.refslots);
+    __gcstats_integer(v, _SC("strings"), s.strings);
+    __gcstats_integer(v, _SC("stringslots"), s.stringslots);
+    return 1;
+}
 static SQInteger base_resurectureachable(HSQUIRRELVM v)
 {
     sq_resurrectunreachable(v);
@@ -254,6 +294,7 @@ static SQInteger base_array(HSQUIRRELVM v)
 {
     SQArray *a;
     SQObject &size = stack_get(v,2);
+    if(tointeger(size) > 0 && !v->CanAllocate(tointeger(size) * sizeof(SQObjectPtr))) { v->Raise_MemoryLimitError(); return SQ_ERROR; }
     if(sq_gettop(v) > 2) {
         a = SQArray::Create(_ss(v),0);
         a->Resize(tointeger(size),stack_get(v,3));
@@ -304,6 +345,8 @@ static const SQRegFunction base_funcs[]={
     {_SC("dummy"),base_dummy,0,NULL},
 #ifndef NO_GARBAGE_COLLECTOR
     {_SC("collectgarbage"),base_collectgarbage,0, NULL},
+    {_SC("collectcycles"),base_collectcycles,0, NULL},
+    {_SC("gcstats"),base_gcstats,0, NULL},
     {_SC("resurrectunreachable"),base_resurectureachable,0, NULL},
 #endif
     {NULL,(SQFUNCTION)0,0,NULL}
@@ -474,6 +517,31 @@ static SQInteger table_getdelegate(HSQUIRRELVM v)
     return SQ_SUCCEEDED(sq_getdelegate(v,-1))?1:SQ_ERROR;
 }
 
+//weak modes as in the "k", "v" and "kv" strings
+static SQInteger table_setweakmode(HSQUIRRELVM v)
+{
+    const SQChar *str;
+    sq_getstring(v,2,&str);
+    SQInteger mode = 0;
+    for(; *str; str++) {
+        if(*str == _SC('k')) mode |= SQ_WEAK_KEYS;
+        else if(*str == _SC('v')) mode |= SQ_WEAK_VALUES;
+        else return sq_throwerror(v,_SC("the weak mode can only contain 'k' and 'v'"));
+    }
+    if(SQ_FAILED(sq_setweakmode(v,1,mode)))
+        return SQ_ERROR;
+    sq_push(v,1);
+    return 1;
+}
+
+static SQInteger table_getweakmode(HSQUIRRELVM v)
+{
+    SQInteger mode = sq_getweakmode(v,1);
+    const SQChar *modes[] = { _SC(""), _SC("k"), _SC("v"), _SC("kv") };
+    sq_pushstring(v,modes[mode&(SQ_WEAK_KEYS|SQ_WEAK_VALUES)],-1);
+    return 1;
+}
+
 static SQInteger table_filter(HSQUIRRELVM v)
 {
     SQObject &o = stack_get(v,1);
@@ -563,6 +631,8 @@ const SQRegFunction SQSharedState::_table_default_delegate_funcz[]={
     {_SC("clear"),obj_clear,1, _SC(".")},
     {_SC("setdelegate"),table_setdelegate,2, _SC(".t|o")},
     {_SC("getdelegate"),table_getdelegate,1, _SC(".")},
+    {_SC("setweakmode"),table_setweakmode,2, _SC("ts")},
+    {_SC("getweakmode"),table_getweakmode,1, _SC("t")},
     {_SC("filter"),table_filter,2, _SC("tc")},
 	{_SC("map"),table_map,2, _SC("tc") },
 	{_SC("keys"),table_keys,1, _SC("t") },
@@ -638,6 +708,7 @@ static SQInteger array_resize(HSQUIRRELVM v)
         SQInteger sz = tointeger(nsize);
         if (sz<0)
           return sq_throwerror(v, _SC("resizing to negative length"));
+        if(!v->CanAllocate(sz * sizeof(SQObjectPtr))) { v->Raise_MemoryLimitError(); return SQ_ERROR; }
 
         if(sq_gettop(v) > 2)
             fill = stack_get(v, 3);
@@ -768,20 +839,22 @@ static SQInteger array_find(HSQUIRRELVM v)
 {
     SQObject &o = stack_get(v,1);
     SQObjectPtr &val = stack_get(v,2);
-    SQArray *a = _array(o);
-    SQInteger size = a->Size();
-    SQObjectPtr temp;
-    for(SQInteger n = 0; n < size; n++) {
-        bool res = false;
-        a->Get(n,temp);
-        if(SQVM::IsEqual(temp,val,res) && res) {
-            v->Push(n);
-            return 1;
-        }
+    SQInteger n = _array(o)->Find(val);
+    if(n >= 0) {
+        v->Push(n);
+        return 1;
     }
     return 0;
 }
 
+static SQInteger array_contains(HSQUIRRELVM v)
+{
+    SQObject &o = stack_get(v,1);
+    SQObjectPtr &val = stack_get(v,2);
+    v->Push(_array(o)->Contains(val));
+    return 1;
+}
+
 
 static bool _sort_compare(HSQUIRRELVM v, SQArray *arr, SQObjectPtr &a,SQObjectPtr &b,SQInteger func,SQInteger &ret)
 {
@@ -908,6 +981,269 @@ static SQInteger array_slice(HSQUIRRELVM v)
 
 }
 
+//PARALLEL ARRAY OPERATIONS
+//pmap(func[,chunks]), pfilter(func[,chunks]) and preduce(func[,chunks]) split the array
+//in 'chunks' slices (default: number of hardware threads) and run each slice on its own
+//worker VM and OS thread (SQParallelPool, kept by the state between the calls). Worker VMs
+//are independent (separate shared states), so the rules for the callback are:
+// - it must be a script closure without free variables; it is serialized and reloaded
+//   in every worker, so it only sees the base library in its root table (no globals,
+//   consts, classes or native bindings of the calling VM)
+// - arguments and return values must be plain data: null, bool, integer, float, string,
+//   arrays and tables of plain data. They are deep copied in and out of the workers,
+//   so changes made by the callback to its arguments are never visible to the caller
+// - pmap calls func(value[,index]), pfilter func(index,value), preduce func(prev,cur).
+//   preduce combines the partial results of the slices on the calling VM, so func must
+//   be associative
+// - globals set by the callback stay in the worker and may be seen by later calls
+//Workers are opened with the default allocator; every section that touches a worker's
+//objects binds that worker's memory context
+#define SQ_PARALLEL_MAX_DEPTH 64
+
+enum { PARALLEL_MAP, PARALLEL_FILTER, PARALLEL_REDUCE };
+
+static bool _copy_plain(SQSharedState *ss,const SQObjectPtr &src,SQObjectPtr &dst,SQInteger depth)
+{
+    if(depth > SQ_PARALLEL_MAX_DEPTH) return false;
+    switch(sq_type(src)) {
+    case OT_NULL: case OT_INTEGER: case OT_FLOAT: case OT_BOOL:
+        dst = src;
+        return true;
+    case OT_STRING:
+        dst = SQString::Create(ss,_stringval(src),_string(src)->_len);
+        return true;
+    case OT_WEAKREF:
+        return _copy_plain(ss,_realval(src),dst,depth);
+    case OT_ARRAY: {
+        SQArray *a = _array(src);
+        SQInteger size = a->Size();
+        SQArray *na = SQArray::Create(ss,size);
+        dst = na;
+        for(SQInteger n = 0; n < size; n++) {
+            if(!_copy_plain(ss,a->_values[n],na->_values[n],depth+1)) return false;
+        }
+        return true;
+    }
+    case OT_TABLE: {
+        SQTable *t = _table(src);
+        SQTable *nt = SQTable::Create(ss,t->CountUsed());
+        dst = nt;
+        SQObjectPtr refpos,key,val,nkey,nval;
+        SQInteger ridx;
+        while((ridx = t->Next(false,refpos,key,val)) != -1) {
+            if(!_copy_plain(ss,key,nkey,depth+1) || !_copy_plain(ss,val,nval,depth+1)) return false;
+            nt->NewSlot(nkey,nval);
+            refpos = ridx;
+        }
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+//_func, _in and _out are also kept on the stack of the worker, which is a root of its
+//collector: only the refcounts see the references held here
+struct SQParallelChunk
+{
+    HSQUIRRELVM _vm;
+    SQObjectPtr _func;
+    SQObjectPtr _in;
+    SQObjectPtr _out;
+    SQInteger _first; //index of _in[0] in the source array
+    SQInteger _nargs;
+    SQInteger _mode;
+    bool _failed;
+};
+
+static SQInteger _write_membuf(SQUserPointer up,SQUserPointer data,SQInteger size)
+{
+    sqvector<unsigned char> *buf = (sqvector<unsigned char> *)up;
+    for(SQInteger i = 0; i < size; i++) buf->push_back(((unsigned char *)data)[i]);
+    return size;
+}
+
+struct SQMemReader { const unsigned char *_data; SQInteger _size; SQInteger _pos; };
+
+static SQInteger _read_membuf(SQUserPointer up,SQUserPointer data,SQInteger size)
+{
+    SQMemReader *r = (SQMemReader *)up;
+    if(size > r->_size - r->_pos) size = r->_size - r->_pos;
+    memcpy(data,r->_data + r->_pos,(size_t)size);
+    r->_pos += size;
+    return size;
+}
+
+static void _parallel_run(void *arg)
+{
+    SQParallelChunk *c = (SQParallelChunk *)arg;
+    SQVM *v = c->_vm;
+    SQMemScope scope(&_ss(v)->_memctx);
+    SQArray *in = _array(c->_in);
+    SQInteger size = in->Size();
+    SQObjectPtr acc;
+    SQInteger n = 0;
+    if(c->_mode == PARALLEL_REDUCE && size > 0) acc = in->_values[n++];
+    for(; n < size; n++) {
+        SQObjectPtr &val = in->_values[n];
+        v->Push(c->_func);
+        v->Push(v->_roottable);
+        switch(c->_mode) {
+        case PARALLEL_MAP:
+            v->Push(val);
+            if(c->_nargs >= 3) v->Push(SQObjectPtr(c->_first + n));
+            break;
+        case PARALLEL_FILTER:
+            v->Push(SQObjectPtr(c->_first + n));
+            v->Push(val);
+            break;
+        case PARALLEL_REDUCE:
+            v->Push(acc);
+            v->Push(val);
+            break;
+        }
+        if(SQ_FAILED(sq_call(v,c->_nargs,SQTrue,SQFalse))) {
+            c->_failed = true;
+            return;
+        }
+        switch(c->_mode) {
+        case PARALLEL_MAP: _array(c->_out)->Append(v->GetUp(-1)); break;
+        case PARALLEL_FILTER: if(!SQVM::IsFalse(v->GetUp(-1))) _array(c->_out)->Append(val); break;
+        case PARALLEL_REDUCE: acc = v->GetUp(-1); break;
+        }
+        v->Pop(2); //result and func
+    }
+    if(c->_mode == PARALLEL_REDUCE) _array(c->_out)->Append(acc);
+}
+
+static SQInteger _parallel_op(HSQUIRRELVM v,SQInteger mode)
+{
+    SQObject &o = stack_get(v,1);
+    SQObjectPtr &func = stack_get(v,2);
+    SQArray *a = _array(o);
+    SQInteger size = a->Size();
+    SQInteger nchunks = (SQInteger)std::thread::hardware_concurrency();
+    if(sq_gettop(v) > 2) nchunks = tointeger(stack_get(v,3));
+    if(sq_type(func) != OT_CLOSURE)
+        return sq_throwerror(v,_SC("parallel callbacks must be script closures"));
+    SQInteger nargs = _closure(func)->_function->_nparameters;
+    if(nargs < 2 || nargs > 3 || (mode != PARALLEL_MAP && nargs != 3))
+        return sq_throwerror(v,_SC("wrong number of parameters in the parallel callback"));
+    if(nchunks > size) nchunks = size;
+    if(nchunks > SQ_PARALLEL_MAX_CHUNKS) nchunks = SQ_PARALLEL_MAX_CHUNKS;
+    if(nchunks < 1) nchunks = 1;
+
+    SQSharedState *ss = _ss(v);
+    if(!ss->_parallel) ss->_parallel = SQParallelPool::Create();
+    SQParallelPool *pool = ss->_parallel;
+    if(!pool->Reserve(nchunks))
+        return sq_throwerror(v,_SC("cannot open the worker vms"));
+
+    sqvector<unsigned char> code;
+    v->Push(func);
+    SQRESULT res = sq_writeclosure(v,_write_membuf,&code);
+    v->Pop();
+    if(SQ_FAILED(res)) return SQ_ERROR;
+
+    SQParallelChunk chunks[SQ_PARALLEL_MAX_CHUNKS];
+    SQInteger nworkers = 0;
+    const SQChar *err = NULL;
+    SQInteger step = size / nchunks, rest = size % nchunks, first = 0;
+    for(; nworkers < nchunks && !err; nworkers++) {
+        SQParallelChunk &c = chunks[nworkers];
+        SQInteger len = step + (nworkers < rest ? 1 : 0);
+        c._vm = pool->Worker(nworkers);
+        SQMemScope scope(&_ss(c._vm)->_memctx);
+        c._first = first;
+        c._nargs = nargs;
+        c._mode = mode;
+        c._failed = false;
+        SQMemReader r = { code._vals, (SQInteger)code.size(), 0 };
+        if(SQ_FAILED(sq_readclosure(c._vm,_read_membuf,&r))) { err = _SC("cannot load the callback in a worker vm"); continue; }
+        c._func = c._vm->Top();
+        SQArray *in = SQArray::Create(_ss(c._vm),len);
+        c._in = in;
+        c._out = SQArray::Create(_ss(c._vm),0);
+        c._vm->Push(c._in);
+        c._vm->Push(c._out);
+        _array(c._out)->Reserve(mode == PARALLEL_MAP ? len : 1);
+        for(SQInteger n = 0; n < len && !err; n++) {
+            if(!_copy_plain(_ss(c._vm),a->_values[first+n],in->_values[n],0))
+                err = _SC("parallel operations only accept plain data (null, bool, numbers, strings, arrays, tables)");
+        }
+        first += len;
+    }
+
+    if(!err) {
+        void *args[SQ_PARALLEL_MAX_CHUNKS];
+        for(SQInteger i = 0; i < nworkers; i++) args[i] = &chunks[i];
+        pool->Run(nworkers,_parallel_run,args);
+    }
+
+    SQObjectPtr ret;
+    SQObjectPtr wres;
+    if(mode == PARALLEL_REDUCE) ret.Null();
+    else ret = SQArray::Create(_ss(v),0);
+    bool hasacc = false;
+    for(SQInteger i = 0; i < nworkers && !err; i++) {
+        SQParallelChunk &c = chunks[i];
+        if(c._failed) {
+            SQObjectPtr &le = c._vm->_lasterror;
+            if(sq_type(le) == OT_STRING) v->Raise_Error(_SC("parallel callback failed: %s"),_stringval(le));
+            else v->Raise_Error(_SC("parallel callback failed"));
+            err = _SC("");
+            break;
+        }
+        SQArray *out = _array(c._out);
+        for(SQInteger n = 0; n < out->Size() && !err; n++) {
+            if(!_copy_plain(_ss(v),out->_values[n],wres,0)) {
+                err = _SC("parallel callbacks can only return plain data (null, bool, numbers, strings, arrays, tables)");
+                break;
+            }
+            if(mode != PARALLEL_REDUCE) { _array(ret)->Append(wres); continue; }
+            if(!hasacc) { ret = wres; hasacc = true; continue; }
+            v->Push(func);
+            v->Push(v->_roottable);
+            v->Push(ret);
+            v->Push(wres);
+            if(SQ_FAILED(sq_call(v,3,SQTrue,SQFalse))) { err = _SC(""); break; }
+            ret = v->GetUp(-1);
+            v->Pop(2);
+        }
+    }
+
+    for(SQInteger i = 0; i < nworkers; i++) {
+        SQMemScope scope(&_ss(chunks[i]._vm)->_memctx);
+        chunks[i]._func.Null();
+        chunks[i]._in.Null();
+        chunks[i]._out.Null();
+        sq_settop(chunks[i]._vm,0);
+        sq_reseterror(chunks[i]._vm);
+    }
+    if(err) {
+        if(err[0]) return sq_throwerror(v,err);
+        return SQ_ERROR;
+    }
+    if(mode == PARALLEL_REDUCE && !hasacc) return 0;
+    v->Push(ret);
+    return 1;
+}
+
+static SQInteger array_pmap(HSQUIRRELVM v)
+{
+    return _parallel_op(v,PARALLEL_MAP);
+}
+
+static SQInteger array_pfilter(HSQUIRRELVM v)
+{
+    return _parallel_op(v,PARALLEL_FILTER);
+}
+
+static SQInteger array_preduce(HSQUIRRELVM v)
+{
+    return _parallel_op(v,PARALLEL_REDUCE);
+}
+
 const SQRegFunction SQSharedState::_array_default_delegate_funcz[]={
     {_SC("len"),default_delegate_len,1, _SC("a")},
     {_SC("append"),array_append,2, _SC("a")},
@@ -929,6 +1265,10 @@ const SQRegFunction SQSharedState::_array_default_delegate_funcz[]={
     {_SC("reduce"),array_reduce,-2, _SC("ac.")},
     {_SC("filter"),array_filter,2, _SC("ac")},
     {_SC("find"),array_find,2, _SC("a.")},
+    {_SC("contains"),array_contains,2, _SC("a.")},
+    {_SC("pmap"),array_pmap,-2, _SC("acn")},
+    {_SC("pfilter"),array_pfilter,-2, _SC("acn")},
+    {_SC("preduce"),array_preduce,-2, _SC("acn")},
     {NULL,(SQFUNCTION)0,0,NULL}
 };
 
@@ -56,6 +56,7 @@ bool SQClass::NewSlot(SQSharedState *ss,const SQObjectPtr &key,const SQObjectPtr
     bool belongs_to_static_table = sq_type(val) == OT_CLOSURE || sq_type(val) == OT_NATIVECLOSURE || bstatic;
     if(_locked && !belongs_to_static_table)
         return false; //the class already has an instance so cannot be modified
+    SQ_GC_BARRIER(this);
     if(_members->Get(key,temp) && _isfield(temp)) //overrides the default value
     {
         _defaultvalues[_member_idx(temp)].val = val;
@@ -101,6 +102,19 @@ bool SQClass::NewSlot(SQSharedState *ss,const SQObjectPtr &key,const SQObjectPtr
     return true;
 }
 
+bool SQClass::NewNativeField(const SQObjectPtr &key,SQInteger desc)
+{
+    SQObjectPtr temp;
+    if(_locked || _members->Get(key,temp) || _members->CountUsed() >= MEMBER_MAX_COUNT)
+        return false;
+    SQ_GC_BARRIER(this);
+    SQClassMember m;
+    m.native = desc;
+    _members->NewSlot(key,SQObjectPtr(_make_nativefield_idx(_defaultvalues.size())));
+    _defaultvalues.push_back(m);
+    return true;
+}
+
 SQInstance *SQClass::CreateInstance()
 {
     if(!_locked) Lock();
@@ -126,6 +140,7 @@ SQInteger SQClass::Next(const SQObjectPtr &refpos, SQObjectPtr &outkey, SQObject
 bool SQClass::SetAttributes(const SQObjectPtr &key,const SQObjectPtr &val)
 {
     SQObjectPtr idx;
+    SQ_GC_BARRIER(this);
     if(_members->Get(key,idx)) {
         if(_isfield(idx))
             _defaultvalues[_member_idx(idx)].attrs = val;
@@ -192,6 +207,55 @@ SQInstance::~SQInstance()
     if(_class){ Finalize(); } //if _class is null it was already finalized by the GC
 }
 
+bool SQInstance::GetNative(SQInteger desc,SQObjectPtr &val)
+{
+    if(!_userpointer) { val.Null(); return true; }
+    void *p = (unsigned char *)_userpointer + _nativefield_offset(desc);
+    switch(_nativefield_type(desc)) {
+    case SQNF_BOOL: val = *(bool *)p; break;
+    case SQNF_INT8: val = (SQInteger)*(signed char *)p; break;
+    case SQNF_UINT8: val = (SQInteger)*(unsigned char *)p; break;
+    case SQNF_INT16: val = (SQInteger)*(short *)p; break;
+    case SQNF_UINT16: val = (SQInteger)*(unsigned short *)p; break;
+    case SQNF_INT32: val = (SQInteger)*(SQInt32 *)p; break;
+    case SQNF_UINT32: val = (SQInteger)*(SQUnsignedInteger32 *)p; break;
+    case SQNF_INT64: val = (SQInteger)*(long long *)p; break;
+    case SQNF_UINT64: val = (SQInteger)*(unsigned long long *)p; break;
+    case SQNF_FLOAT: val = (SQFloat)*(float *)p; break;
+    case SQNF_DOUBLE: val = (SQFloat)*(double *)p; break;
+    default: val.Null(); break;
+    }
+    return true;
+}
+
+bool SQInstance::SetNative(SQInteger desc,const SQObjectPtr &val)
+{
+    if(!_userpointer || (desc & NATIVE_FIELD_READONLY)) return false;
+    SQInteger i;
+    SQFloat f;
+    switch(sq_type(val)) {
+    case OT_INTEGER: case OT_BOOL: i = _integer(val); f = (SQFloat)i; break;
+    case OT_FLOAT: f = _float(val); i = (SQInteger)f; break;
+    default: return false;
+    }
+    void *p = (unsigned char *)_userpointer + _nativefield_offset(desc);
+    switch(_nativefield_type(desc)) {
+    case SQNF_BOOL: *(bool *)p = sq_type(val) == OT_FLOAT ? f != 0 : i != 0; break;
+    case SQNF_INT8: *(signed char *)p = (signed char)i; break;
+    case SQNF_UINT8: *(unsigned char *)p = (unsigned char)i; break;
+    case SQNF_INT16: *(short *)p = (short)i; break;
+    case SQNF_UINT16: *(unsigned short *)p = (unsigned short)i; break;
+    case SQNF_INT32: *(SQInt32 *)p = (SQInt32)i; break;
+    case SQNF_UINT32: *(SQUnsignedInteger32 *)p = (SQUnsignedInteger32)i; break;
+    case SQNF_INT64: *(long long *)p = (long long)i; break;
+    case SQNF_UINT64: *(unsigned long long *)p = (unsigned long long)i; break;
+    case SQNF_FLOAT: *(float *)p = (float)f; break;
+    case SQNF_DOUBLE: *(double *)p = (double)f; break;
+    default: return false;
+    }
+    return true;
+}
+
 bool SQInstance::GetMetaMethod(SQVM* SQ_UNUSED_ARG(v),SQMetaMethod mm,SQObjectPtr &res)
 {
     if(sq_type(_class->_metamethods[mm]) != OT_NULL) {
@@ -5,8 +5,10 @@
 struct SQInstance;
 
 struct SQClassMember {
+    SQClassMember() { native = 0; }
     SQObjectPtr val;
     SQObjectPtr attrs;
+    SQInteger native; //descriptor of a native field
     void Null() {
         val.Null();
         attrs.Null();
@@ -17,15 +19,24 @@ typedef sqvector<SQClassMember> SQClassMemberVec;
 
 #define MEMBER_TYPE_METHOD 0x01000000
 #define MEMBER_TYPE_FIELD 0x02000000
+#define MEMBER_TYPE_NATIVE 0x04000000 //a field stored in the user pointer of the instance
 #define MEMBER_MAX_COUNT 0x00FFFFFF
 
 #define _ismethod(o) (_integer(o)&MEMBER_TYPE_METHOD)
 #define _isfield(o) (_integer(o)&MEMBER_TYPE_FIELD)
 #define _make_method_idx(i) ((SQInteger)(MEMBER_TYPE_METHOD|i))
+#define _isnativefield(o) (_integer(o)&MEMBER_TYPE_NATIVE)
 #define _make_field_idx(i) ((SQInteger)(MEMBER_TYPE_FIELD|i))
+#define _make_nativefield_idx(i) ((SQInteger)(MEMBER_TYPE_FIELD|MEMBER_TYPE_NATIVE|i))
 #define _member_type(o) (_integer(o)&0xFF000000)
 #define _member_idx(o) (_integer(o)&0x00FFFFFF)
 
+//native field descriptor: byte offset in the user pointer, SQNativeFieldType and read only flag
+#define NATIVE_FIELD_READONLY 0x80
+#define _make_nativefield(offset,type,readonly) (((offset)<<8)|(type)|((readonly)?NATIVE_FIELD_READONLY:0))
+#define _nativefield_offset(d) ((d)>>8)
+#define _nativefield_type(d) ((d)&0x7F)
+
 struct SQClass : public CHAINABLE_OBJ
 {
     SQClass(SQSharedState *ss,SQClass *base);
@@ -37,6 +48,7 @@ public:
     }
     ~SQClass();
     bool NewSlot(SQSharedState *ss, const SQObjectPtr &key,const SQObjectPtr &val,bool bstatic);
+    bool NewNativeField(const SQObjectPtr &key,SQInteger desc);
     bool Get(const SQObjectPtr &key,SQObjectPtr &val) {
         if(_members->Get(key,val)) {
             if(_isfield(val)) {
@@ -67,7 +79,7 @@ public:
     }
     void Finalize();
 #ifndef NO_GARBAGE_COLLECTOR
-    void Mark(SQCollectable ** );
+    void MarkChildren(SQCollectable ** );
     SQObjectType GetType() {return OT_CLASS;}
 #endif
     SQInteger Next(const SQObjectPtr &refpos, SQObjectPtr &outkey, SQObjectPtr &outval);
@@ -97,7 +109,7 @@ public:
     static SQInstance* Create(SQSharedState *ss,SQClass *theclass) {
 
         SQInteger size = calcinstancesize(theclass);
-        SQInstance *newinst = (SQInstance *)SQ_MALLOC(size);
+        SQInstance *newinst = (SQInstance *)SQ_MALLOC_CAT(size,SQ_MEM_INSTANCE);
         new (newinst) SQInstance(ss, theclass,size);
         if(theclass->_udsize) {
             newinst->_userpointer = ((unsigned char *)newinst) + (size - theclass->_udsize);
@@ -107,7 +119,7 @@ public:
     SQInstance *Clone(SQSharedState *ss)
     {
         SQInteger size = calcinstancesize(_class);
-        SQInstance *newinst = (SQInstance *)SQ_MALLOC(size);
+        SQInstance *newinst = (SQInstance *)SQ_MALLOC_CAT(size,SQ_MEM_INSTANCE);
         new (newinst) SQInstance(ss, this,size);
         if(_class->_udsize) {
             newinst->_userpointer = ((unsigned char *)newinst) + (size - _class->_udsize);
@@ -118,6 +130,7 @@ public:
     bool Get(const SQObjectPtr &key,SQObjectPtr &val)  {
         if(_class->_members->Get(key,val)) {
             if(_isfield(val)) {
+                if(_isnativefield(val)) return GetNative(_class->_defaultvalues[_member_idx(val)].native,val);
                 SQObjectPtr &o = _values[_member_idx(val)];
                 val = _realval(o);
             }
@@ -131,23 +144,27 @@ public:
     bool Set(const SQObjectPtr &key,const SQObjectPtr &val) {
         SQObjectPtr idx;
         if(_class->_members->Get(key,idx) && _isfield(idx)) {
+            if(_isnativefield(idx)) return SetNative(_class->_defaultvalues[_member_idx(idx)].native,val);
+            SQ_GC_BARRIER(this);
             _values[_member_idx(idx)] = val;
             return true;
         }
         return false;
     }
+    bool GetNative(SQInteger desc,SQObjectPtr &val);
+    bool SetNative(SQInteger desc,const SQObjectPtr &val);
     void Release() {
         _uiRef++;
         if (_hook) { _hook(_userpointer,0);}
         _uiRef--;
-        if(_uiRef > 0) return;
+        if(_refcount(this) > 0) return;
         SQInteger size = _memsize;
         this->~SQInstance();
-        SQ_FREE(this, size);
+        SQ_FREE_CAT(this, size, SQ_MEM_INSTANCE);
     }
     void Finalize();
 #ifndef NO_GARBAGE_COLLECTOR
-    void Mark(SQCollectable ** );
+    void MarkChildren(SQCollectable ** );
     SQObjectType GetType() {return OT_INSTANCE;}
 #endif
     bool InstanceOf(SQClass *trg);
@@ -14,7 +14,7 @@ private:
 public:
     static SQClosure *Create(SQSharedState *ss,SQFunctionProto *func,SQWeakRef *root){
         SQInteger size = _CALC_CLOSURE_SIZE(func);
-        SQClosure *nc=(SQClosure*)SQ_MALLOC(size);
+        SQClosure *nc=(SQClosure*)SQ_MALLOC_CAT(size,SQ_MEM_CLOSURE);
         new (nc) SQClosure(ss,func);
         nc->_outervalues = (SQObjectPtr *)(nc + 1);
         nc->_defaultparams = &nc->_outervalues[func->_noutervalues];
@@ -31,7 +31,7 @@ public:
         _DESTRUCT_VECTOR(SQObjectPtr,f->_ndefaultparams,_defaultparams);
         __ObjRelease(_function);
         this->~SQClosure();
-        sq_vm_free(this,size);
+        SQ_FREE_CAT(this,size,SQ_MEM_CLOSURE);
     }
     void SetRoot(SQWeakRef *r)
     {
@@ -54,7 +54,7 @@ public:
     bool Save(SQVM *v,SQUserPointer up,SQWRITEFUNC write);
     static bool Load(SQVM *v,SQUserPointer up,SQREADFUNC read,SQObjectPtr &ret);
 #ifndef NO_GARBAGE_COLLECTOR
-    void Mark(SQCollectable **chain);
+    void MarkChildren(SQCollectable **chain);
     void Finalize(){
         SQFunctionProto *f = _function;
         _NULL_SQOBJECT_VECTOR(_outervalues,f->_noutervalues);
@@ -80,7 +80,7 @@ private:
 public:
     static SQOuter *Create(SQSharedState *ss, SQObjectPtr *outer)
     {
-        SQOuter *nc  = (SQOuter*)SQ_MALLOC(sizeof(SQOuter));
+        SQOuter *nc  = (SQOuter*)SQ_MALLOC_CAT(sizeof(SQOuter),SQ_MEM_CLOSURE);
         new (nc) SQOuter(ss, outer);
         return nc;
     }
@@ -89,11 +89,11 @@ public:
     void Release()
     {
         this->~SQOuter();
-        sq_vm_free(this,sizeof(SQOuter));
+        SQ_FREE_CAT(this,sizeof(SQOuter),SQ_MEM_CLOSURE);
     }
 
 #ifndef NO_GARBAGE_COLLECTOR
-    void Mark(SQCollectable **chain);
+    void MarkChildren(SQCollectable **chain);
     void Finalize() { _value.Null(); }
     SQObjectType GetType() {return OT_OUTER;}
 #endif
@@ -112,7 +112,7 @@ private:
     SQGenerator(SQSharedState *ss,SQClosure *closure){_closure=closure;_state=eRunning;_ci._generator=NULL;INIT_CHAIN();ADD_TO_CHAIN(&_ss(this)->_gc_chain,this);}
 public:
     static SQGenerator *Create(SQSharedState *ss,SQClosure *closure){
-        SQGenerator *nc=(SQGenerator*)SQ_MALLOC(sizeof(SQGenerator));
+        SQGenerator *nc=(SQGenerator*)SQ_MALLOC_CAT(sizeof(SQGenerator),SQ_MEM_CLOSURE);
         new (nc) SQGenerator(ss,closure);
         return nc;
     }
@@ -125,13 +125,14 @@ public:
         _stack.resize(0);
         _closure.Null();}
     void Release(){
-        sq_delete(this,SQGenerator);
+        this->~SQGenerator();
+        SQ_FREE_CAT(this,sizeof(SQGenerator),SQ_MEM_CLOSURE);
     }
 
     bool Yield(SQVM *v,SQInteger target);
     bool Resume(SQVM *v,SQObjectPtr &dest);
 #ifndef NO_GARBAGE_COLLECTOR
-    void Mark(SQCollectable **chain);
+    void MarkChildren(SQCollectable **chain);
     void Finalize(){_stack.resize(0);_closure.Null();}
     SQObjectType GetType() {return OT_GENERATOR;}
 #endif
@@ -152,7 +153,7 @@ public:
     static SQNativeClosure *Create(SQSharedState *ss,SQFUNCTION func,SQInteger nouters)
     {
         SQInteger size = _CALC_NATVIVECLOSURE_SIZE(nouters);
-        SQNativeClosure *nc=(SQNativeClosure*)SQ_MALLOC(size);
+        SQNativeClosure *nc=(SQNativeClosure*)SQ_MALLOC_CAT(size,SQ_MEM_CLOSURE);
         new (nc) SQNativeClosure(ss,func);
         nc->_outervalues = (SQObjectPtr *)(nc + 1);
         nc->_noutervalues = nouters;
@@ -179,11 +180,11 @@ public:
         SQInteger size = _CALC_NATVIVECLOSURE_SIZE(_noutervalues);
         _DESTRUCT_VECTOR(SQObjectPtr,_noutervalues,_outervalues);
         this->~SQNativeClosure();
-        sq_free(this,size);
+        SQ_FREE_CAT(this,size,SQ_MEM_CLOSURE);
     }
 
 #ifndef NO_GARBAGE_COLLECTOR
-    void Mark(SQCollectable **chain);
+    void MarkChildren(SQCollectable **chain);
     void Finalize() { _NULL_SQOBJECT_VECTOR(_outervalues,_noutervalues); }
     SQObjectType GetType() {return OT_NATIVECLOSURE;}
 #endif
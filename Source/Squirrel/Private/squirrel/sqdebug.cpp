@@ -118,3 +118,18 @@ void SQVM::Raise_ParamTypeError(SQInteger nparam,SQInteger typemask,SQInteger ty
     }
     Raise_Error(_SC("parameter %d has an invalid type '%s' ; expected: '%s'"), nparam, IdType2Name((SQObjectType)type), _stringval(exptypes));
 }
+
+void SQVM::Raise_MemoryLimitError()
+{
+    SQMemContext &c = _ss(this)->_memctx;
+    //leave some room to the error handlers before raising the error again
+    c._overlimit = false;
+    c._nextlimit = c._total + SQ_MEM_LIMIT_SLACK;
+    Raise_Error(_SC("not enough memory, the limit of ") _PRINT_INT_FMT _SC(" bytes has been exceeded"), (SQInteger)c._limit);
+}
+
+bool SQVM::CanAllocate(SQUnsignedInteger size)
+{
+    SQMemContext &c = _ss(this)->_memctx;
+    return !c._limit || c._total + size <= c._nextlimit;
+}
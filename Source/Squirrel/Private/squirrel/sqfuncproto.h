@@ -2,6 +2,7 @@
 #ifndef _SQFUNCTION_H_
 #define _SQFUNCTION_H_
 
+#include <atomic>
 #include "sqopcodes.h"
 
 enum SQOuterType {
@@ -48,6 +49,68 @@ struct SQLocalVarInfo
 
 struct SQLineInfo { SQInteger _line;SQInteger _op; };
 
+//immutable copy of a function prototype (sq_sharecode) that any number of shared states
+//can instantiate, from any thread. It holds no SQObjects: strings are kept as characters
+//and interned in the string table of the state that instantiates them, while instructions,
+//line infos and default parameters are referenced in place by every instance.
+//allocated with malloc, outside of any state; the root of the tree owns the reference count
+struct SQFrozenObject
+{
+    SQObjectType _type;
+    SQObjectValue _unVal;
+    SQChar *_str;
+    SQInteger _len;
+};
+
+struct SQFrozenOuterVar
+{
+    SQOuterType _type;
+    SQFrozenObject _name;
+    SQFrozenObject _src;
+};
+
+struct SQFrozenLocalVarInfo
+{
+    SQFrozenObject _name;
+    SQUnsignedInteger _start_op;
+    SQUnsignedInteger _end_op;
+    SQUnsignedInteger _pos;
+};
+
+struct SQSharedCode
+{
+    static SQSharedCode *Freeze(SQVM *v,SQFunctionProto *f,SQSharedCode *root);
+    void AddRef() { _root->_refs.fetch_add(1,std::memory_order_relaxed); }
+    void Release();
+    void Destroy();
+
+    SQSharedCode *_root;
+    std::atomic<SQInteger> _refs;
+    SQFrozenObject _sourcename;
+    SQFrozenObject _name;
+    SQInteger _stacksize;
+    bool _bgenerator;
+    SQInteger _varparams;
+
+    SQInteger _ninstructions;
+    SQInstruction *_instructions;
+    SQInteger _nlineinfos;
+    SQLineInfo *_lineinfos;
+    SQInteger _ndefaultparams;
+    SQInteger *_defaultparams;
+
+    SQInteger _nliterals;
+    SQFrozenObject *_literals;
+    SQInteger _nparameters;
+    SQFrozenObject *_parameters;
+    SQInteger _nfunctions;
+    SQSharedCode **_functions;
+    SQInteger _noutervalues;
+    SQFrozenOuterVar *_outervalues;
+    SQInteger _nlocalvarinfos;
+    SQFrozenLocalVarInfo *_localvarinfos;
+};
+
 typedef sqvector<SQOuterVar> SQOuterVarVec;
 typedef sqvector<SQLocalVarInfo> SQLocalVarInfoVec;
 typedef sqvector<SQLineInfo> SQLineInfoVec;
@@ -73,10 +136,11 @@ public:
     {
         SQFunctionProto *f;
         //I compact the whole class and members in a single memory allocation
-        f = (SQFunctionProto *)sq_vm_malloc(_FUNC_SIZE(ninstructions,nliterals,nparameters,nfunctions,noutervalues,nlineinfos,nlocalvarinfos,ndefaultparams));
+        f = (SQFunctionProto *)SQ_MALLOC_CAT(_FUNC_SIZE(ninstructions,nliterals,nparameters,nfunctions,noutervalues,nlineinfos,nlocalvarinfos,ndefaultparams),SQ_MEM_CLOSURE);
         new (f) SQFunctionProto(ss);
         f->_ninstructions = ninstructions;
-        f->_literals = (SQObjectPtr*)&f->_instructions[ninstructions];
+        f->_instructions = f->_inlineinstructions;
+        f->_literals = (SQObjectPtr*)&f->_inlineinstructions[ninstructions];
         f->_nliterals = nliterals;
         f->_parameters = (SQObjectPtr*)&f->_literals[nliterals];
         f->_nparameters = nparameters;
@@ -99,6 +163,7 @@ public:
         _CONSTRUCT_VECTOR(SQLocalVarInfo,f->_nlocalvarinfos,f->_localvarinfos);
         return f;
     }
+    static SQFunctionProto *Instantiate(SQSharedState *ss,SQSharedCode *code);
     void Release(){
         _DESTRUCT_VECTOR(SQObjectPtr,_nliterals,_literals);
         _DESTRUCT_VECTOR(SQObjectPtr,_nparameters,_parameters);
@@ -106,9 +171,12 @@ public:
         _DESTRUCT_VECTOR(SQOuterVar,_noutervalues,_outervalues);
         //_DESTRUCT_VECTOR(SQLineInfo,_nlineinfos,_lineinfos); //not required are 2 integers
         _DESTRUCT_VECTOR(SQLocalVarInfo,_nlocalvarinfos,_localvarinfos);
-        SQInteger size = _FUNC_SIZE(_ninstructions,_nliterals,_nparameters,_nfunctions,_noutervalues,_nlineinfos,_nlocalvarinfos,_ndefaultparams);
+        SQSharedCode *shared = _shared;
+        SQInteger size = shared ? _FUNC_SIZE(0,_nliterals,_nparameters,_nfunctions,_noutervalues,0,_nlocalvarinfos,0)
+            : _FUNC_SIZE(_ninstructions,_nliterals,_nparameters,_nfunctions,_noutervalues,_nlineinfos,_nlocalvarinfos,_ndefaultparams);
         this->~SQFunctionProto();
-        sq_vm_free(this,size);
+        SQ_FREE_CAT(this,size,SQ_MEM_CLOSURE);
+        if(shared) shared->Release();
     }
 
     const SQChar* GetLocal(SQVM *v,SQUnsignedInteger stackbase,SQUnsignedInteger nseq,SQUnsignedInteger nop);
@@ -116,7 +184,7 @@ public:
     bool Save(SQVM *v,SQUserPointer up,SQWRITEFUNC write);
     static bool Load(SQVM *v,SQUserPointer up,SQREADFUNC read,SQObjectPtr &ret);
 #ifndef NO_GARBAGE_COLLECTOR
-    void Mark(SQCollectable **chain);
+    void MarkChildren(SQCollectable **chain);
     void Finalize(){ _NULL_SQOBJECT_VECTOR(_literals,_nliterals); }
     SQObjectType GetType() {return OT_FUNCPROTO;}
 #endif
@@ -147,8 +215,13 @@ public:
     SQInteger _ndefaultparams;
     SQInteger *_defaultparams;
 
+    //code this prototype was instantiated from, the instructions, line infos and
+    //default parameters point into it instead of the inline storage
+    SQSharedCode *_shared;
+
     SQInteger _ninstructions;
-    SQInstruction _instructions[1];
+    SQInstruction *_instructions;
+    SQInstruction _inlineinstructions[1];
 };
 
 #endif //_SQFUNCTION_H_
@@ -2,10 +2,236 @@
     see copyright notice in squirrel.h
 */
 #include "sqpcheader.h"
+#include "sqvm.h"
+#include "sqfuncproto.h"
+#include "sqclosure.h"
+
+//memory context of the state whose api call is running on this thread (SQMemScope).
+//NULL (or a context without allocator) routes the allocations to malloc/realloc/free
+thread_local SQMemContext *_sq_memctx = NULL;
+
 #ifndef SQ_EXCLUDE_DEFAULT_MEMFUNCTIONS
-void *sq_vm_malloc(SQUnsignedInteger size){ return malloc(size); }
+void *sq_vm_malloc(SQUnsignedInteger size)
+{
+    SQMemContext *c = _sq_memctx;
+    if(c && c->_allocator) return c->_allocator->memalloc(c->_allocator->up, size);
+    return malloc(size);
+}
+
+void *sq_vm_realloc(void *p, SQUnsignedInteger oldsize, SQUnsignedInteger size)
+{
+    SQMemContext *c = _sq_memctx;
+    if(c && c->_allocator) return c->_allocator->memrealloc(c->_allocator->up, p, oldsize, size);
+    return realloc(p, size);
+}
+
+void sq_vm_free(void *p, SQUnsignedInteger size)
+{
+    SQMemContext *c = _sq_memctx;
+    if(c && c->_allocator) { c->_allocator->memfree(c->_allocator->up, p, size); return; }
+    free(p);
+}
+#endif
+
+//finds the script function and line running in the context and charges them 'samples'
+//samples of the profile. Runs before the allocation, so the call stack is still valid
+static void _profile_sample(SQMemContext *c, SQUnsignedInteger samples)
+{
+    SQAllocProfile *p = c->_profile;
+    SQFunctionProto *func = NULL;
+    SQInteger line = 0;
+    SQVM *v = c->_runningvm;
+    if(v) {
+        for(SQInteger i = v->_callsstacksize - 1; i >= 0; i--) {
+            SQVM::CallInfo &ci = v->_callsstack[i];
+            if(sq_type(ci._closure) == OT_CLOSURE) {
+                func = _closure(ci._closure)->_function;
+                line = func->GetLine(ci._ip);
+                break;
+            }
+        }
+    }
+    if((p->_numsites + 1) * 2 > p->_capacity) {
+        SQAllocSite *old = p->_sites;
+        SQUnsignedInteger oldcap = p->_capacity;
+        p->_capacity = oldcap ? oldcap * 2 : 64;
+        p->_sites = (SQAllocSite *)calloc(p->_capacity, sizeof(SQAllocSite));
+        for(SQUnsignedInteger i = 0; i < oldcap; i++) {
+            if(!old[i]._count) continue;
+            SQUnsignedInteger h = SQAllocProfile::Hash(old[i]._func, old[i]._line) & (p->_capacity - 1);
+            while(p->_sites[h]._count) h = (h + 1) & (p->_capacity - 1);
+            p->_sites[h] = old[i];
+        }
+        free(old);
+    }
+    SQUnsignedInteger h = SQAllocProfile::Hash(func, line) & (p->_capacity - 1);
+    while(p->_sites[h]._count && (p->_sites[h]._func != func || p->_sites[h]._line != line))
+        h = (h + 1) & (p->_capacity - 1);
+    SQAllocSite &site = p->_sites[h];
+    if(!site._count) {
+        site._func = func;
+        site._line = line;
+        if(func) __ObjAddRef(func);
+        p->_numsites++;
+    }
+    site._count += samples;
+    site._bytes += samples * p->_rate;
+}
+
+static inline void _mem_charge(SQMemContext *c, SQUnsignedInteger size, SQInteger cat)
+{
+    c->_bytes[cat] += size;
+    c->_total += size;
+    if(c->_total > c->_peak) c->_peak = c->_total;
+    if(c->_limit && c->_total > c->_nextlimit) c->_overlimit = true;
+    if(c->_total > c->_gcthreshold) c->_gcdue = true;
+}
+
+static inline void _mem_discharge(SQMemContext *c, SQUnsignedInteger size, SQInteger cat)
+{
+    c->_bytes[cat] -= size;
+    c->_total -= size;
+    if(c->_limit && c->_total <= c->_limit) {
+        c->_nextlimit = c->_limit;
+        c->_overlimit = false;
+    }
+}
+
+//one sample every _rate allocated bytes, an allocation can cover several of them
+static inline void _mem_profile(SQMemContext *c, SQUnsignedInteger size)
+{
+    SQAllocProfile *p = c->_profile;
+    if(size < p->_left) { p->_left -= size; return; }
+    SQUnsignedInteger over = size - p->_left;
+    p->_left = p->_rate - over % p->_rate;
+    _profile_sample(c, over / p->_rate + 1);
+}
+
+void *sq_mem_malloc(SQUnsignedInteger size, SQInteger cat)
+{
+    SQMemContext *c = _sq_memctx;
+    if(c) {
+        _mem_charge(c, size, cat);
+        if(c->_profile) _mem_profile(c, size);
+    }
+    return sq_vm_malloc(size);
+}
 
-void *sq_vm_realloc(void *p, SQUnsignedInteger SQ_UNUSED_ARG(oldsize), SQUnsignedInteger size){ return realloc(p, size); }
+void *sq_mem_realloc(void *p, SQUnsignedInteger oldsize, SQUnsignedInteger size, SQInteger cat)
+{
+    SQMemContext *c = _sq_memctx;
+    if(c) {
+        _mem_discharge(c, oldsize, cat);
+        _mem_charge(c, size, cat);
+        if(c->_profile && size > oldsize) _mem_profile(c, size - oldsize);
+    }
+    return sq_vm_realloc(p, oldsize, size);
+}
 
-void sq_vm_free(void *p, SQUnsignedInteger SQ_UNUSED_ARG(size)){ free(p); }
+void sq_mem_free(void *p, SQUnsignedInteger size, SQInteger cat)
+{
+    SQMemContext *c = _sq_memctx;
+    if(c) _mem_discharge(c, size, cat);
+    sq_vm_free(p, size);
+}
+
+//size-class pool allocator (sq_newpoolallocator).
+//blocks up to SQ_POOL_MAX_BLOCK bytes are carved out of SQ_POOL_CHUNK_SIZE chunks and
+//recycled through one free list per SQ_POOL_GRANULARITY bytes class; the size passed to
+//free tells the class, so blocks carry no header. Bigger blocks go to malloc.
+//chunks are only given back when the pool is released by sq_close
+#ifndef SQ_POOL_GRANULARITY
+#define SQ_POOL_GRANULARITY 16
+#endif
+#ifndef SQ_POOL_MAX_BLOCK
+#define SQ_POOL_MAX_BLOCK 512
+#endif
+#ifndef SQ_POOL_CHUNK_SIZE
+#define SQ_POOL_CHUNK_SIZE (64*1024)
 #endif
+#define SQ_POOL_CLASSES (SQ_POOL_MAX_BLOCK/SQ_POOL_GRANULARITY)
+#define _pool_class(size) ((size) ? ((size) - 1) / SQ_POOL_GRANULARITY : 0)
+
+struct SQPoolFreeBlock { SQPoolFreeBlock *_next; };
+union SQPoolChunk { SQPoolChunk *_next; unsigned char _align[SQ_POOL_GRANULARITY]; };
+
+struct SQPool
+{
+    SQPoolFreeBlock *_free[SQ_POOL_CLASSES];
+    SQPoolChunk *_chunks;
+    unsigned char *_cur;
+    unsigned char *_end;
+};
+
+static void *_pool_alloc(SQUserPointer up, SQUnsignedInteger size)
+{
+    if(size > SQ_POOL_MAX_BLOCK) return malloc(size);
+    SQPool *pool = (SQPool *)up;
+    SQUnsignedInteger cls = _pool_class(size);
+    SQPoolFreeBlock *b = pool->_free[cls];
+    if(b) {
+        pool->_free[cls] = b->_next;
+        return b;
+    }
+    SQUnsignedInteger bsize = (cls + 1) * SQ_POOL_GRANULARITY;
+    if(pool->_cur + bsize > pool->_end) {
+        SQPoolChunk *c = (SQPoolChunk *)malloc(SQ_POOL_CHUNK_SIZE);
+        if(!c) return NULL;
+        c->_next = pool->_chunks;
+        pool->_chunks = c;
+        pool->_cur = (unsigned char *)(c + 1);
+        pool->_end = ((unsigned char *)c) + SQ_POOL_CHUNK_SIZE;
+    }
+    void *ret = pool->_cur;
+    pool->_cur += bsize;
+    return ret;
+}
+
+static void _pool_free(SQUserPointer up, void *p, SQUnsignedInteger size)
+{
+    if(!p) return;
+    if(size > SQ_POOL_MAX_BLOCK) { free(p); return; }
+    SQPool *pool = (SQPool *)up;
+    SQUnsignedInteger cls = _pool_class(size);
+    SQPoolFreeBlock *b = (SQPoolFreeBlock *)p;
+    b->_next = pool->_free[cls];
+    pool->_free[cls] = b;
+}
+
+static void *_pool_realloc(SQUserPointer up, void *p, SQUnsignedInteger oldsize, SQUnsignedInteger size)
+{
+    if(!p) return _pool_alloc(up, size);
+    if(oldsize > SQ_POOL_MAX_BLOCK && size > SQ_POOL_MAX_BLOCK) return realloc(p, size);
+    if(oldsize <= SQ_POOL_MAX_BLOCK && size <= SQ_POOL_MAX_BLOCK && _pool_class(oldsize) == _pool_class(size))
+        return p;
+    void *newp = _pool_alloc(up, size);
+    if(!newp) return NULL;
+    memcpy(newp, p, oldsize < size ? oldsize : size);
+    _pool_free(up, p, oldsize);
+    return newp;
+}
+
+static void _pool_release(SQUserPointer up)
+{
+    SQPool *pool = (SQPool *)up;
+    SQPoolChunk *c = pool->_chunks;
+    while(c) {
+        SQPoolChunk *next = c->_next;
+        free(c);
+        c = next;
+    }
+    free(pool);
+}
+
+SQRESULT sq_newpoolallocator(SQAllocator *allocator)
+{
+    SQPool *pool = (SQPool *)malloc(sizeof(SQPool));
+    if(!pool) return SQ_ERROR;
+    memset(pool, 0, sizeof(SQPool));
+    allocator->memalloc = _pool_alloc;
+    allocator->memrealloc = _pool_realloc;
+    allocator->memfree = _pool_free;
+    allocator->release = _pool_release;
+    allocator->up = pool;
+    return SQ_OK;
+}
@@ -11,6 +11,11 @@
 #include "sqclass.h"
 #include "sqclosure.h"
 
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__x86_64__) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SQ_FIND_SSE2
+#endif
+
 #pragma warning( disable : 4456)
 
 const SQChar *IdType2Name(SQObjectType type)
@@ -126,6 +131,7 @@ bool SQDelegable::SetDelegate(SQTable *mt)
         if (temp->_delegate == this) return false; //cycle detected
         temp = temp->_delegate;
     }
+    SQ_GC_BARRIER(this);
     if (mt) __ObjAddRef(mt);
     __ObjRelease(_delegate);
     _delegate = mt;
@@ -213,6 +219,70 @@ void SQArray::Extend(const SQArray *a){
             Append(a->_values[i]);
 }
 
+//returns the first index >= from whose slot is either bit-identical to the needle
+//(type and value, or type only when 'typeonly' is set), of type 'alt' or a weakref.
+//the caller confirms the candidates with IsEqual
+static SQInteger _scan_candidates(const SQObjectPtr *vals,SQInteger from,SQInteger size,const SQObject &needle,bool typeonly,SQObjectType alt)
+{
+    SQInteger n = from;
+#ifdef SQ_FIND_SSE2
+    if(sizeof(SQObject) == 16 && sizeof(SQObjectType) == 4) {
+        //lane 0 is the type, lane 1 padding (never compared), lanes 2-3 the raw value
+        const int hitmask = typeonly ? 0x000F : 0xFF0F;
+        const __m128i pattern = _mm_loadu_si128((const __m128i *)&needle);
+        const __m128i alttype = _mm_set1_epi32((int)alt);
+        const __m128i weaktype = _mm_set1_epi32((int)OT_WEAKREF);
+        for(; n + 1 < size; n += 2) {
+            __m128i a = _mm_loadu_si128((const __m128i *)&vals[n]);
+            __m128i b = _mm_loadu_si128((const __m128i *)&vals[n + 1]);
+            int ha = _mm_movemask_epi8(_mm_cmpeq_epi32(a,pattern));
+            int hb = _mm_movemask_epi8(_mm_cmpeq_epi32(b,pattern));
+            int ka = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi32(a,alttype),_mm_cmpeq_epi32(a,weaktype)));
+            int kb = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi32(b,alttype),_mm_cmpeq_epi32(b,weaktype)));
+            if((ha & hitmask) == hitmask || (ka & 0xF)) return n;
+            if((hb & hitmask) == hitmask || (kb & 0xF)) return n + 1;
+        }
+    }
+#endif
+    for(; n < size; n++) {
+        SQObjectType t = sq_type(vals[n]);
+        if(t == sq_type(needle) && (typeonly || _rawval(vals[n]) == _rawval(needle)))
+            return n;
+        if(t == alt || t == OT_WEAKREF)
+            return n;
+    }
+    return -1;
+}
+
+SQInteger SQArray::Find(const SQObjectPtr &val, SQInteger from)
+{
+    SQInteger size = Size();
+    if(from < 0) from = 0;
+    //integers may equal floats and floats compare by value (0.0 == -0.0, nan != nan),
+    //everything else is equal only when type and raw payload (value or pointer) match
+    bool typeonly = false;
+    SQObjectType alt = (SQObjectType)0;
+    switch(sq_type(val)) {
+        case OT_INTEGER: alt = OT_FLOAT; break;
+        case OT_FLOAT: alt = OT_INTEGER; typeonly = true; break;
+        default: break;
+    }
+    SQObject needle;
+    memset(&needle,0,sizeof(needle));
+    needle._type = sq_type(val);
+    needle._unVal = val._unVal;
+    const SQObjectPtr *vals = _values._vals;
+    SQInteger n = from;
+    while((n = _scan_candidates(vals,n,size,needle,typeonly,alt)) >= 0) {
+        bool res = false;
+        SQObjectPtr o = _realval(vals[n]);
+        if(SQVM::IsEqual(o,val,res) && res)
+            return n;
+        n++;
+    }
+    return -1;
+}
+
 const SQChar* SQFunctionProto::GetLocal(SQVM *vm,SQUnsignedInteger stackbase,SQUnsignedInteger nseq,SQUnsignedInteger nop)
 {
     SQUnsignedInteger nvars=_nlocalvarinfos;
@@ -398,6 +468,7 @@ SQFunctionProto::SQFunctionProto(SQSharedState *ss)
 {
     _stacksize=0;
     _bgenerator=false;
+    _shared=NULL;
     INIT_CHAIN();ADD_TO_CHAIN(&_ss(this)->_gc_chain,this);
 }
 
@@ -551,128 +622,294 @@ bool SQFunctionProto::Load(SQVM *v,SQUserPointer up,SQREADFUNC read,SQObjectPtr
     return true;
 }
 
-#ifndef NO_GARBAGE_COLLECTOR
+static bool FreezeObject(SQVM *v,const SQObjectPtr &o,SQFrozenObject &fo)
+{
+    fo._type = sq_type(o);
+    fo._unVal = o._unVal;
+    switch(sq_type(o)){
+    case OT_STRING:
+        fo._len = _string(o)->_len;
+        fo._str = (SQChar *)malloc(sq_rsl(fo._len + 1));
+        memcpy(fo._str,_stringval(o),sq_rsl(fo._len + 1));
+        fo._unVal.pUserPointer = NULL;
+        break;
+    case OT_BOOL:
+    case OT_INTEGER:
+    case OT_FLOAT:
+    case OT_NULL:
+        break;
+    default:
+        v->Raise_Error(_SC("cannot share a %s"),GetTypeName(o));
+        return false;
+    }
+    return true;
+}
 
-#define START_MARK()    if(!(_uiRef&MARK_FLAG)){ \
-        _uiRef|=MARK_FLAG;
+static SQObjectPtr ThawObject(SQSharedState *ss,const SQFrozenObject &fo)
+{
+    if(fo._type == OT_STRING) return SQString::Create(ss,fo._str,fo._len);
+    SQObject o;
+    o._type = fo._type;
+    o._unVal = fo._unVal;
+    return o;
+}
+
+static void FreeFrozenObject(SQFrozenObject &fo)
+{
+    if(fo._type == OT_STRING) free(fo._str);
+}
+
+SQSharedCode *SQSharedCode::Freeze(SQVM *v,SQFunctionProto *f,SQSharedCode *root)
+{
+    SQInteger i;
+    SQSharedCode *c = (SQSharedCode *)calloc(1,sizeof(SQSharedCode));
+    new (&c->_refs) std::atomic<SQInteger>(1);
+    c->_root = root ? root : c;
+    c->_stacksize = f->_stacksize;
+    c->_bgenerator = f->_bgenerator;
+    c->_varparams = f->_varparams;
+
+    c->_ninstructions = f->_ninstructions;
+    c->_instructions = (SQInstruction *)malloc(f->_ninstructions * sizeof(SQInstruction));
+    memcpy(c->_instructions,f->_instructions,f->_ninstructions * sizeof(SQInstruction));
+    c->_nlineinfos = f->_nlineinfos;
+    c->_lineinfos = (SQLineInfo *)malloc(f->_nlineinfos * sizeof(SQLineInfo));
+    memcpy(c->_lineinfos,f->_lineinfos,f->_nlineinfos * sizeof(SQLineInfo));
+    c->_ndefaultparams = f->_ndefaultparams;
+    c->_defaultparams = (SQInteger *)malloc(f->_ndefaultparams * sizeof(SQInteger));
+    memcpy(c->_defaultparams,f->_defaultparams,f->_ndefaultparams * sizeof(SQInteger));
+
+    //the counts are set first, a failure frees the zeroed entries not reached yet
+    c->_nliterals = f->_nliterals;
+    c->_literals = (SQFrozenObject *)calloc(f->_nliterals,sizeof(SQFrozenObject));
+    c->_nparameters = f->_nparameters;
+    c->_parameters = (SQFrozenObject *)calloc(f->_nparameters,sizeof(SQFrozenObject));
+    c->_nfunctions = f->_nfunctions;
+    c->_functions = (SQSharedCode **)calloc(f->_nfunctions,sizeof(SQSharedCode *));
+    c->_noutervalues = f->_noutervalues;
+    c->_outervalues = (SQFrozenOuterVar *)calloc(f->_noutervalues,sizeof(SQFrozenOuterVar));
+    c->_nlocalvarinfos = f->_nlocalvarinfos;
+    c->_localvarinfos = (SQFrozenLocalVarInfo *)calloc(f->_nlocalvarinfos,sizeof(SQFrozenLocalVarInfo));
+
+    if(!FreezeObject(v,f->_sourcename,c->_sourcename) || !FreezeObject(v,f->_name,c->_name))
+        goto fail;
+    for(i = 0; i < f->_nliterals; i++)
+        if(!FreezeObject(v,f->_literals[i],c->_literals[i])) goto fail;
+    for(i = 0; i < f->_nparameters; i++)
+        if(!FreezeObject(v,f->_parameters[i],c->_parameters[i])) goto fail;
+    for(i = 0; i < f->_noutervalues; i++) {
+        c->_outervalues[i]._type = f->_outervalues[i]._type;
+        if(!FreezeObject(v,f->_outervalues[i]._name,c->_outervalues[i]._name)
+            || !FreezeObject(v,f->_outervalues[i]._src,c->_outervalues[i]._src)) goto fail;
+    }
+    for(i = 0; i < f->_nlocalvarinfos; i++) {
+        SQFrozenLocalVarInfo &lvi = c->_localvarinfos[i];
+        lvi._start_op = f->_localvarinfos[i]._start_op;
+        lvi._end_op = f->_localvarinfos[i]._end_op;
+        lvi._pos = f->_localvarinfos[i]._pos;
+        if(!FreezeObject(v,f->_localvarinfos[i]._name,lvi._name)) goto fail;
+    }
+    for(i = 0; i < f->_nfunctions; i++)
+        if(!(c->_functions[i] = Freeze(v,_funcproto(f->_functions[i]),c->_root))) goto fail;
+    return c;
+fail:
+    c->Destroy();
+    return NULL;
+}
 
-#define END_MARK() RemoveFromChain(&_sharedstate->_gc_chain, this); \
-        AddToChain(chain, this); }
+void SQSharedCode::Release()
+{
+    if(_root->_refs.fetch_sub(1,std::memory_order_acq_rel) == 1) _root->Destroy();
+}
 
-void SQVM::Mark(SQCollectable **chain)
+void SQSharedCode::Destroy()
 {
-    START_MARK()
-        SQSharedState::MarkObject(_lasterror,chain);
-        SQSharedState::MarkObject(_errorhandler,chain);
-        SQSharedState::MarkObject(_debughook_closure,chain);
-        SQSharedState::MarkObject(_roottable, chain);
-        SQSharedState::MarkObject(temp_reg, chain);
-        for(SQUnsignedInteger i = 0; i < _stack.size(); i++) SQSharedState::MarkObject(_stack[i], chain);
-        for(SQInteger k = 0; k < _callsstacksize; k++) SQSharedState::MarkObject(_callsstack[k]._closure, chain);
-    END_MARK()
+    SQInteger i;
+    FreeFrozenObject(_sourcename);
+    FreeFrozenObject(_name);
+    for(i = 0; i < _nliterals; i++) FreeFrozenObject(_literals[i]);
+    for(i = 0; i < _nparameters; i++) FreeFrozenObject(_parameters[i]);
+    for(i = 0; i < _noutervalues; i++) {
+        FreeFrozenObject(_outervalues[i]._name);
+        FreeFrozenObject(_outervalues[i]._src);
+    }
+    for(i = 0; i < _nlocalvarinfos; i++) FreeFrozenObject(_localvarinfos[i]._name);
+    for(i = 0; i < _nfunctions; i++)
+        if(_functions[i]) _functions[i]->Destroy();
+    free(_instructions);
+    free(_lineinfos);
+    free(_defaultparams);
+    free(_literals);
+    free(_parameters);
+    free(_functions);
+    free(_outervalues);
+    free(_localvarinfos);
+    _refs.~atomic();
+    free(this);
+}
+
+SQFunctionProto *SQFunctionProto::Instantiate(SQSharedState *ss,SQSharedCode *code)
+{
+    SQInteger i;
+    SQFunctionProto *f = Create(ss,0,code->_nliterals,code->_nparameters,code->_nfunctions,
+        code->_noutervalues,0,code->_nlocalvarinfos,0);
+    f->_shared = code;
+    code->AddRef();
+    f->_ninstructions = code->_ninstructions;
+    f->_instructions = code->_instructions;
+    f->_nlineinfos = code->_nlineinfos;
+    f->_lineinfos = code->_lineinfos;
+    f->_ndefaultparams = code->_ndefaultparams;
+    f->_defaultparams = code->_defaultparams;
+    f->_sourcename = ThawObject(ss,code->_sourcename);
+    f->_name = ThawObject(ss,code->_name);
+    f->_stacksize = code->_stacksize;
+    f->_bgenerator = code->_bgenerator;
+    f->_varparams = code->_varparams;
+    for(i = 0; i < code->_nliterals; i++) f->_literals[i] = ThawObject(ss,code->_literals[i]);
+    for(i = 0; i < code->_nparameters; i++) f->_parameters[i] = ThawObject(ss,code->_parameters[i]);
+    for(i = 0; i < code->_noutervalues; i++) {
+        SQFrozenOuterVar &ov = code->_outervalues[i];
+        f->_outervalues[i] = SQOuterVar(ThawObject(ss,ov._name),ThawObject(ss,ov._src),ov._type);
+    }
+    for(i = 0; i < code->_nlocalvarinfos; i++) {
+        SQFrozenLocalVarInfo &lvi = code->_localvarinfos[i];
+        f->_localvarinfos[i]._name = ThawObject(ss,lvi._name);
+        f->_localvarinfos[i]._start_op = lvi._start_op;
+        f->_localvarinfos[i]._end_op = lvi._end_op;
+        f->_localvarinfos[i]._pos = lvi._pos;
+    }
+    for(i = 0; i < code->_nfunctions; i++) f->_functions[i] = Instantiate(ss,code->_functions[i]);
+    return f;
 }
 
-void SQArray::Mark(SQCollectable **chain)
+#ifndef NO_GARBAGE_COLLECTOR
+
+void SQCollectable::Mark(SQCollectable **chain)
 {
-    START_MARK()
-        SQInteger len = _values.size();
-        for(SQInteger i = 0;i < len; i++) SQSharedState::MarkObject(_values[i], chain);
-    END_MARK()
+    if(_sharedstate->_gcstate >= SQ_GC_TRIAL_GRAY) {
+        //cycle detection from the possible roots visits the children with the same code
+        _sharedstate->TrialVisit(this);
+        return;
+    }
+    if(_uiRef&MARK_FLAG) return;
+    RemoveFromChain(_sharedstate->GCChainOf(this), this);
+    _uiRef=(_uiRef&~ROOT_FLAG)|MARK_FLAG;
+    if(_sharedstate->_gcstate == SQ_GC_PROPAGATE) {
+        //incremental collection, the children are traversed by a later step
+        _uiRef|=GRAY_FLAG;
+        AddToChain(&_sharedstate->_gc_gray, this);
+        return;
+    }
+    MarkChildren(chain);
+    AddToChain(chain, this);
 }
-void SQTable::Mark(SQCollectable **chain)
+
+void SQVM::MarkChildren(SQCollectable **chain)
 {
-    START_MARK()
-        if(_delegate) _delegate->Mark(chain);
-        SQInteger len = _numofnodes;
+    SQSharedState::MarkObject(_lasterror,chain);
+    SQSharedState::MarkObject(_errorhandler,chain);
+    SQSharedState::MarkObject(_debughook_closure,chain);
+    SQSharedState::MarkObject(_roottable, chain);
+    SQSharedState::MarkObject(temp_reg, chain);
+    for(SQUnsignedInteger i = 0; i < _stack.size(); i++) SQSharedState::MarkObject(_stack[i], chain);
+    for(SQInteger k = 0; k < _callsstacksize; k++) SQSharedState::MarkObject(_callsstack[k]._closure, chain);
+}
+
+void SQArray::MarkChildren(SQCollectable **chain)
+{
+    SQInteger len = _values.size();
+    for(SQInteger i = 0;i < len; i++) SQSharedState::MarkObject(_values[i], chain);
+}
+void SQTable::MarkChildren(SQCollectable **chain)
+{
+    if(_delegate) _delegate->Mark(chain);
+    SQInteger len = _numofnodes;
+    if(!_weakmode) {
         for(SQInteger i = 0; i < len; i++){
             SQSharedState::MarkObject(_nodes[i].key, chain);
             SQSharedState::MarkObject(_nodes[i].val, chain);
         }
-    END_MARK()
+        return;
+    }
+    //the weak parts hold no reference and are not traversed. The marking collectors reach the
+    //value of a weak key through the key only (SQSharedState::GCMarkEphemerons)
+    bool ephemerons = _sharedstate->_gcstate < SQ_GC_TRIAL_GRAY;
+    for(SQInteger i = 0; i < len; i++){
+        _HashNode &n = _nodes[i];
+        if(!_IsWeak(n.key,SQ_WEAK_KEYS)) SQSharedState::MarkObject(n.key, chain);
+        else if(ephemerons && !(_refcounted(n.key)->_uiRef&MARK_FLAG)) continue;
+        if(!_IsWeak(n.val,SQ_WEAK_VALUES)) SQSharedState::MarkObject(n.val, chain);
+    }
 }
 
-void SQClass::Mark(SQCollectable **chain)
+void SQClass::MarkChildren(SQCollectable **chain)
 {
-    START_MARK()
-        _members->Mark(chain);
-        if(_base) _base->Mark(chain);
-        SQSharedState::MarkObject(_attributes, chain);
-        for(SQUnsignedInteger i =0; i< _defaultvalues.size(); i++) {
-            SQSharedState::MarkObject(_defaultvalues[i].val, chain);
-            SQSharedState::MarkObject(_defaultvalues[i].attrs, chain);
-        }
-        for(SQUnsignedInteger j =0; j< _methods.size(); j++) {
-            SQSharedState::MarkObject(_methods[j].val, chain);
-            SQSharedState::MarkObject(_methods[j].attrs, chain);
-        }
-        for(SQUnsignedInteger k =0; k< MT_LAST; k++) {
-            SQSharedState::MarkObject(_metamethods[k], chain);
-        }
-    END_MARK()
+    _members->Mark(chain);
+    if(_base) _base->Mark(chain);
+    SQSharedState::MarkObject(_attributes, chain);
+    for(SQUnsignedInteger i =0; i< _defaultvalues.size(); i++) {
+        SQSharedState::MarkObject(_defaultvalues[i].val, chain);
+        SQSharedState::MarkObject(_defaultvalues[i].attrs, chain);
+    }
+    for(SQUnsignedInteger j =0; j< _methods.size(); j++) {
+        SQSharedState::MarkObject(_methods[j].val, chain);
+        SQSharedState::MarkObject(_methods[j].attrs, chain);
+    }
+    for(SQUnsignedInteger k =0; k< MT_LAST; k++) {
+        SQSharedState::MarkObject(_metamethods[k], chain);
+    }
 }
 
-void SQInstance::Mark(SQCollectable **chain)
+void SQInstance::MarkChildren(SQCollectable **chain)
 {
-    START_MARK()
-        _class->Mark(chain);
-        SQUnsignedInteger nvalues = _class->_defaultvalues.size();
-        for(SQUnsignedInteger i =0; i< nvalues; i++) {
-            SQSharedState::MarkObject(_values[i], chain);
-        }
-    END_MARK()
+    _class->Mark(chain);
+    SQUnsignedInteger nvalues = _class->_defaultvalues.size();
+    for(SQUnsignedInteger i =0; i< nvalues; i++) {
+        SQSharedState::MarkObject(_values[i], chain);
+    }
 }
 
-void SQGenerator::Mark(SQCollectable **chain)
+void SQGenerator::MarkChildren(SQCollectable **chain)
 {
-    START_MARK()
-        for(SQUnsignedInteger i = 0; i < _stack.size(); i++) SQSharedState::MarkObject(_stack[i], chain);
-        SQSharedState::MarkObject(_closure, chain);
-    END_MARK()
+    for(SQUnsignedInteger i = 0; i < _stack.size(); i++) SQSharedState::MarkObject(_stack[i], chain);
+    SQSharedState::MarkObject(_closure, chain);
 }
 
-void SQFunctionProto::Mark(SQCollectable **chain)
+void SQFunctionProto::MarkChildren(SQCollectable **chain)
 {
-    START_MARK()
-        for(SQInteger i = 0; i < _nliterals; i++) SQSharedState::MarkObject(_literals[i], chain);
-        for(SQInteger k = 0; k < _nfunctions; k++) SQSharedState::MarkObject(_functions[k], chain);
-    END_MARK()
+    for(SQInteger i = 0; i < _nliterals; i++) SQSharedState::MarkObject(_literals[i], chain);
+    for(SQInteger k = 0; k < _nfunctions; k++) SQSharedState::MarkObject(_functions[k], chain);
 }
 
-void SQClosure::Mark(SQCollectable **chain)
+void SQClosure::MarkChildren(SQCollectable **chain)
 {
-    START_MARK()
-        if(_base) _base->Mark(chain);
-        SQFunctionProto *fp = _function;
-        fp->Mark(chain);
-        for(SQInteger i = 0; i < fp->_noutervalues; i++) SQSharedState::MarkObject(_outervalues[i], chain);
-        for(SQInteger k = 0; k < fp->_ndefaultparams; k++) SQSharedState::MarkObject(_defaultparams[k], chain);
-    END_MARK()
+    if(_base) _base->Mark(chain);
+    SQFunctionProto *fp = _function;
+    fp->Mark(chain);
+    for(SQInteger i = 0; i < fp->_noutervalues; i++) SQSharedState::MarkObject(_outervalues[i], chain);
+    for(SQInteger k = 0; k < fp->_ndefaultparams; k++) SQSharedState::MarkObject(_defaultparams[k], chain);
 }
 
-void SQNativeClosure::Mark(SQCollectable **chain)
+void SQNativeClosure::MarkChildren(SQCollectable **chain)
 {
-    START_MARK()
-        for(SQUnsignedInteger i = 0; i < _noutervalues; i++) SQSharedState::MarkObject(_outervalues[i], chain);
-    END_MARK()
+    for(SQUnsignedInteger i = 0; i < _noutervalues; i++) SQSharedState::MarkObject(_outervalues[i], chain);
 }
 
-void SQOuter::Mark(SQCollectable **chain)
+void SQOuter::MarkChildren(SQCollectable **chain)
 {
-    START_MARK()
     /* If the valptr points to a closed value, that value is alive */
     if(_valptr == &_value) {
       SQSharedState::MarkObject(_value, chain);
     }
-    END_MARK()
 }
 
-void SQUserData::Mark(SQCollectable **chain){
-    START_MARK()
-        if(_delegate) _delegate->Mark(chain);
-    END_MARK()
+void SQUserData::MarkChildren(SQCollectable **chain)
+{
+    if(_delegate) _delegate->Mark(chain);
 }
 
-void SQCollectable::UnMark() { _uiRef&=~MARK_FLAG; }
+void SQCollectable::UnMark() { _uiRef&=~GC_FLAGS; }
 
 #endif
 
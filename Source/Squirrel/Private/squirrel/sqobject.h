@@ -110,15 +110,40 @@ struct SQObjectPtr;
             unval.pRefCounted->_uiRef++; \
         }
 
-#define __Release(type,unval) if(ISREFCOUNTED(type) && ((--unval.pRefCounted->_uiRef)==0))  \
+//the high bits of _uiRef are the flags of the garbage collector
+#define SQ_REFCOUNT_MASK 0x07FFFFFF
+#define _refcount(obj) ((obj)->_uiRef & SQ_REFCOUNT_MASK)
+
+#ifndef NO_GARBAGE_COLLECTOR
+#define MARK_FLAG 0x80000000
+//reached by the incremental collector, children not traversed yet (SQSharedState::_gc_gray)
+#define GRAY_FLAG 0x40000000
+//stacks traversed again by the atomic phase of the incremental collector (SQSharedState::_gc_grayagain)
+#define AGAIN_FLAG 0x20000000
+#define GC_FLAGS (MARK_FLAG|GRAY_FLAG|AGAIN_FLAG)
+//possible root of a garbage cycle (SQSharedState::_gc_roots)
+#define ROOT_FLAG 0x10000000
+//held by the weak part of a table (SQTable::_weakmode), its death clears the entries
+#define WEAK_FLAG 0x08000000
+//containers whose refcount drops to a nonzero value may be left in a garbage cycle
+#define SQ_GC_SUSPECT(type,obj) {if((_RAW_TYPE(type)&(_RT_TABLE|_RT_ARRAY|_RT_CLOSURE|_RT_INSTANCE)) && \
+        !((obj)->_uiRef&(GC_FLAGS|ROOT_FLAG))) sq_gc_possibleroot(obj);}
+void sq_gc_possibleroot(SQRefCounted *obj);
+#else
+#define SQ_GC_SUSPECT(type,obj) ((void)0)
+#endif
+
+#define __Release(type,unval) if(ISREFCOUNTED(type))  \
         {   \
-            unval.pRefCounted->Release();   \
+            if(((--unval.pRefCounted->_uiRef)&SQ_REFCOUNT_MASK)==0) \
+                unval.pRefCounted->Release();   \
+            else SQ_GC_SUSPECT(type,unval.pRefCounted); \
         }
 
 #define __ObjRelease(obj) { \
     if((obj)) { \
         (obj)->_uiRef--; \
-        if((obj)->_uiRef == 0) \
+        if(_refcount(obj) == 0) \
             (obj)->Release(); \
         (obj) = NULL;   \
     } \
@@ -309,14 +334,14 @@ inline void _Swap(SQObject &a,SQObject &b)
 
 /////////////////////////////////////////////////////////////////////////////////////
 #ifndef NO_GARBAGE_COLLECTOR
-#define MARK_FLAG 0x80000000
 struct SQCollectable : public SQRefCounted {
     SQCollectable *_next;
     SQCollectable *_prev;
     SQSharedState *_sharedstate;
     virtual SQObjectType GetType()=0;
     virtual void Release()=0;
-    virtual void Mark(SQCollectable **chain)=0;
+    void Mark(SQCollectable **chain);
+    virtual void MarkChildren(SQCollectable **chain)=0;
     void UnMark();
     virtual void Finalize()=0;
     static void AddToChain(SQCollectable **chain,SQCollectable *c);
@@ -324,14 +349,21 @@ struct SQCollectable : public SQRefCounted {
 };
 
 
-#define ADD_TO_CHAIN(chain,obj) AddToChain(chain,obj)
-#define REMOVE_FROM_CHAIN(chain,obj) {if(!(_uiRef&MARK_FLAG))RemoveFromChain(chain,obj);}
+#define ADD_TO_CHAIN(chain,obj) {AddToChain(chain,obj); _sharedstate->_gc_objects++;}
+#define REMOVE_FROM_CHAIN(chain,obj) {if(!(_uiRef&(MARK_FLAG|ROOT_FLAG)))RemoveFromChain(chain,obj); \
+        else RemoveFromChain(_sharedstate->GCChainOf(obj),obj); \
+        if(_uiRef&WEAK_FLAG) _sharedstate->WeakRelease(obj); \
+        _sharedstate->_gc_objects--;}
+//write barrier of the incremental collector: a traversed container storing a new reference
+//goes back to the gray list
+#define SQ_GC_BARRIER(obj) {if(((obj)->_uiRef&GC_FLAGS)==MARK_FLAG)(obj)->_sharedstate->GCBarrier(obj);}
 #define CHAINABLE_OBJ SQCollectable
 #define INIT_CHAIN() {_next=NULL;_prev=NULL;_sharedstate=ss;}
 #else
 
 #define ADD_TO_CHAIN(chain,obj) ((void)0)
 #define REMOVE_FROM_CHAIN(chain,obj) ((void)0)
+#define SQ_GC_BARRIER(obj) ((void)0)
 #define CHAINABLE_OBJ SQRefCounted
 #define INIT_CHAIN() ((void)0)
 #endif
@@ -0,0 +1,80 @@
+/*
+    see copyright notice in squirrel.h
+*/
+#include "sqpcheader.h"
+#include "sqvm.h"
+#include "sqparallel.h"
+
+//the pool is shared by the threads and must not move, it is allocated outside of the vm
+SQParallelPool *SQParallelPool::Create()
+{
+    SQParallelPool *p = (SQParallelPool *)malloc(sizeof(SQParallelPool));
+    new (p) SQParallelPool();
+    p->_nworkers = 0;
+    p->_generation = 0;
+    p->_njobs = 0;
+    p->_pending = 0;
+    p->_job = NULL;
+    p->_args = NULL;
+    p->_stop = false;
+    return p;
+}
+
+void SQParallelPool::Release()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _wake.notify_all();
+    for(SQInteger i = 1; i < _nworkers; i++) _threads[i].join();
+    for(SQInteger i = 0; i < _nworkers; i++) sq_close(_vms[i]);
+    this->~SQParallelPool();
+    free(this);
+}
+
+bool SQParallelPool::Reserve(SQInteger n)
+{
+    for(; _nworkers < n; _nworkers++) {
+        HSQUIRRELVM w = sq_open(SQ_PARALLEL_STACK);
+        if(!w) return false;
+        _vms[_nworkers] = w;
+        if(_nworkers) _threads[_nworkers] = std::thread(&SQParallelPool::Loop,this,_nworkers,_generation);
+    }
+    return true;
+}
+
+void SQParallelPool::Loop(SQInteger i,SQUnsignedInteger generation)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    for(;;) {
+        _wake.wait(lock,[&]{ return _stop || _generation != generation; });
+        if(_stop) return;
+        generation = _generation;
+        if(i >= _njobs) continue;
+        lock.unlock();
+        _job(_args[i]);
+        lock.lock();
+        if(--_pending == 0) _done.notify_one();
+    }
+}
+
+void SQParallelPool::Run(SQInteger n,SQPARALLELJOB job,void **args)
+{
+    if(n > 1) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _job = job;
+            _args = args;
+            _njobs = n;
+            _pending = n - 1;
+            _generation++;
+        }
+        _wake.notify_all();
+    }
+    job(args[0]);
+    if(n > 1) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _done.wait(lock,[&]{ return _pending == 0; });
+    }
+}
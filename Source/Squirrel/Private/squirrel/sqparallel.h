@@ -0,0 +1,45 @@
+/*  see copyright notice in squirrel.h */
+#ifndef _SQPARALLEL_H_
+#define _SQPARALLEL_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define SQ_PARALLEL_MAX_CHUNKS 64
+#define SQ_PARALLEL_STACK 1024
+
+typedef void (*SQPARALLELJOB)(void *arg);
+
+//worker vms of the parallel array operations (pmap, pfilter, preduce) of a state, opened on
+//first use and kept until sq_close. Each worker is an independent state with the base library;
+//worker 0 runs on the calling thread, the others on their own OS thread that sleeps between
+//two operations. The root table of a worker is not cleared between the operations
+struct SQParallelPool
+{
+    static SQParallelPool *Create();
+    void Release();
+    //opens the workers up to n, false if a vm cannot be opened
+    bool Reserve(SQInteger n);
+    HSQUIRRELVM Worker(SQInteger i) { return _vms[i]; }
+    //runs job(args[i]) on the workers 0 to n-1 and returns once all of them are done
+    void Run(SQInteger n,SQPARALLELJOB job,void **args);
+
+private:
+    void Loop(SQInteger i,SQUnsignedInteger generation);
+
+    HSQUIRRELVM _vms[SQ_PARALLEL_MAX_CHUNKS];
+    std::thread _threads[SQ_PARALLEL_MAX_CHUNKS];
+    SQInteger _nworkers;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    SQUnsignedInteger _generation; //bumped by every Run, wakes the workers
+    SQInteger _njobs;
+    SQInteger _pending;
+    SQPARALLELJOB _job;
+    void **_args;
+    bool _stop;
+};
+
+#endif //_SQPARALLEL_H_
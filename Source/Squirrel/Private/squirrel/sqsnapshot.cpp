@@ -0,0 +1,452 @@
+/*
+    see copyright notice in squirrel.h
+*/
+#include "sqpcheader.h"
+#include "sqvm.h"
+#include "sqstring.h"
+#include "sqtable.h"
+#include "sqarray.h"
+#include "sqfuncproto.h"
+#include "sqclosure.h"
+#include "sqclass.h"
+#include "squserdata.h"
+#include "sqsnapshot.h"
+
+//objects every state creates by itself, a snapshot refers to them instead of copying them
+static SQObjectPtr SQSharedState::*const _snap_builtins[] = {
+    &SQSharedState::_root_vm,
+    &SQSharedState::_table_default_delegate,
+    &SQSharedState::_array_default_delegate,
+    &SQSharedState::_string_default_delegate,
+    &SQSharedState::_number_default_delegate,
+    &SQSharedState::_generator_default_delegate,
+    &SQSharedState::_closure_default_delegate,
+    &SQSharedState::_thread_default_delegate,
+    &SQSharedState::_class_default_delegate,
+    &SQSharedState::_instance_default_delegate,
+    &SQSharedState::_weakref_default_delegate
+};
+#define SQ_SNAP_BUILTINS ((SQInteger)(sizeof(_snap_builtins)/sizeof(_snap_builtins[0])))
+
+//flattens the heap reachable from the roots of a VM, breadth first
+struct SQSnapBuilder
+{
+    SQSnapBuilder(SQVM *v):_v(v) { _index = SQTable::Create(_ss(v),0); }
+    SQInteger Index(const SQObject &o)
+    {
+        SQObjectPtr idx;
+        if(_table(_index)->Get(o,idx)) return _integer(idx);
+        SQSnapObject so;
+        so._type = sq_type(o);
+        so._unVal = o._unVal;
+        so._first = so._count = 0;
+        so._builtin = so._parent = so._pos = -1;
+        so._code = NULL;
+        _objects.push_back(so);
+        _table(_index)->NewSlot(o,(SQInteger)(_objects.size() - 1));
+        return _objects.size() - 1;
+    }
+    SQSnapValue Ref(const SQObject &o)
+    {
+        SQSnapValue sv;
+        sv._type = sq_type(o);
+        sv._unVal = o._unVal;
+        if(sq_type(o) == OT_WEAKREF) {
+            SQObject &ref = _weakref(o)->_obj;
+            if(sq_type(ref) == OT_NULL) sv._type = OT_NULL;
+            else sv._unVal.nInteger = Index(ref);
+        }
+        else if(ISREFCOUNTED(sq_type(o))) {
+            sv._unVal.nInteger = Index(o);
+        }
+        return sv;
+    }
+    void Add(const SQObject &o) { SQSnapValue sv = Ref(o); _values.push_back(sv); }
+    void AddWeak(SQWeakRef *w)
+    {
+        SQObject o;
+        o._type = w ? OT_WEAKREF : OT_NULL;
+        o._unVal.pWeakRef = w;
+        Add(o);
+    }
+    void AddObject(SQRefCounted *r,SQObjectType t)
+    {
+        SQObject o;
+        o._type = r ? t : OT_NULL;
+        o._unVal.pRefCounted = r;
+        Add(o);
+    }
+    bool Walk(SQInteger i);
+
+    SQVM *_v;
+    SQObjectPtr _index;
+    sqvector<SQSnapObject> _objects;
+    sqvector<SQSnapValue> _values;
+};
+
+bool SQSnapBuilder::Walk(SQInteger i)
+{
+    SQObject o;
+    o._type = _objects[i]._type;
+    o._unVal = _objects[i]._unVal;
+    SQInteger first = _values.size();
+    switch(sq_type(o)) {
+    case OT_STRING:
+        break;
+    case OT_TABLE: {
+        SQTable *t = _table(o);
+        AddObject(t->_delegate,OT_TABLE);
+        SQObjectPtr refidx,key,val;
+        SQInteger idx;
+        while((idx = t->Next(true,refidx,key,val)) != -1) {
+            Add(key);
+            Add(val);
+            refidx = idx;
+        }
+        }
+        break;
+    case OT_ARRAY: {
+        SQArray *a = _array(o);
+        for(SQUnsignedInteger n = 0; n < a->_values.size(); n++) Add(a->_values[n]);
+        }
+        break;
+    case OT_USERDATA:
+        AddObject(_userdata(o)->_delegate,OT_TABLE);
+        break;
+    case OT_FUNCPROTO: {
+        SQFunctionProto *f = _funcproto(o);
+        for(SQInteger n = 0; n < f->_nfunctions; n++) Add(f->_functions[n]);
+        }
+        break;
+    case OT_CLOSURE: {
+        SQClosure *c = _closure(o);
+        SQFunctionProto *f = c->_function;
+        AddObject(f,OT_FUNCPROTO);
+        AddWeak(c->_env);
+        AddWeak(c->_root);
+        AddObject(c->_base,OT_CLASS);
+        for(SQInteger n = 0; n < f->_noutervalues; n++) Add(c->_outervalues[n]);
+        for(SQInteger n = 0; n < f->_ndefaultparams; n++) Add(c->_defaultparams[n]);
+        }
+        break;
+    case OT_NATIVECLOSURE: {
+        SQNativeClosure *c = _nativeclosure(o);
+        AddWeak(c->_env);
+        Add(c->_name);
+        for(SQUnsignedInteger n = 0; n < c->_noutervalues; n++) Add(c->_outervalues[n]);
+        }
+        break;
+    case OT_OUTER:
+        if(_outer(o)->_valptr != &_outer(o)->_value) {
+            _v->Raise_Error(_SC("cannot snapshot a VM with open outer variables"));
+            return false;
+        }
+        Add(_outer(o)->_value);
+        break;
+    case OT_CLASS: {
+        SQClass *c = _class(o);
+        AddObject(c->_base,OT_CLASS);
+        AddObject(c->_members,OT_TABLE);
+        Add(c->_attributes);
+        for(SQInteger n = 0; n < MT_LAST; n++) Add(c->_metamethods[n]);
+        for(SQUnsignedInteger n = 0; n < c->_defaultvalues.size(); n++) {
+            Add(c->_defaultvalues[n].val);
+            Add(c->_defaultvalues[n].attrs);
+        }
+        for(SQUnsignedInteger n = 0; n < c->_methods.size(); n++) {
+            Add(c->_methods[n].val);
+            Add(c->_methods[n].attrs);
+        }
+        }
+        break;
+    case OT_INSTANCE: {
+        SQInstance *inst = _instance(o);
+        if(inst->_hook) {
+            _v->Raise_Error(_SC("cannot snapshot an instance owning a native object"));
+            return false;
+        }
+        AddObject(inst->_class,OT_CLASS);
+        for(SQUnsignedInteger n = 0; n < inst->_class->_defaultvalues.size(); n++) Add(inst->_values[n]);
+        }
+        break;
+    default:
+        _v->Raise_Error(_SC("cannot snapshot a %s"),GetTypeName(o));
+        return false;
+    }
+    _objects[i]._first = first;
+    _objects[i]._count = _values.size() - first;
+    return true;
+}
+
+SQSnapshot *SQSnapshot::Create(SQVM *v)
+{
+    SQSharedState *ss = _ss(v);
+    SQSnapBuilder b(v);
+    for(SQInteger i = 0; i < SQ_SNAP_BUILTINS; i++)
+        b._objects[b.Index(ss->*_snap_builtins[i])]._builtin = i;
+    SQInteger roottable = b.Index(v->_roottable);
+    SQInteger registry = b.Index(ss->_registry);
+    SQInteger consts = b.Index(ss->_consts);
+    SQSnapValue errorhandler = b.Ref(v->_errorhandler);
+    SQSnapValue debughook = b.Ref(v->_debughook_closure);
+    for(SQUnsignedInteger i = 0; i < b._objects.size(); i++) {
+        if(b._objects[i]._builtin == -1 && !b.Walk(i)) return NULL;
+    }
+    //the prototypes reached from an enclosing one are instantiated with it
+    for(SQUnsignedInteger i = 0; i < b._objects.size(); i++) {
+        SQSnapObject &so = b._objects[i];
+        if(so._type != OT_FUNCPROTO) continue;
+        for(SQInteger n = 0; n < so._count; n++) {
+            SQSnapObject &child = b._objects[b._values[so._first + n]._unVal.nInteger];
+            child._parent = i;
+            child._pos = n;
+        }
+    }
+    SQSnapshot *s = (SQSnapshot *)malloc(sizeof(SQSnapshot));
+    new (&s->_refs) std::atomic<SQInteger>(1);
+    s->_vm = v;
+    s->_nobjects = b._objects.size();
+    s->_objects = (SQSnapObject *)malloc(s->_nobjects * sizeof(SQSnapObject));
+    memcpy(s->_objects,&b._objects[0],s->_nobjects * sizeof(SQSnapObject));
+    s->_nvalues = b._values.size();
+    s->_values = (SQSnapValue *)malloc(s->_nvalues * sizeof(SQSnapValue));
+    if(s->_nvalues) memcpy(s->_values,&b._values[0],s->_nvalues * sizeof(SQSnapValue));
+    s->_roottable = roottable;
+    s->_registry = registry;
+    s->_consts = consts;
+    s->_errorhandler = errorhandler;
+    s->_debughook = debughook;
+    for(SQInteger i = 0; i < s->_nobjects; i++) {
+        SQSnapObject &so = s->_objects[i];
+        if(so._type != OT_FUNCPROTO || so._parent != -1) continue;
+        SQFunctionProto *f = (SQFunctionProto *)so._unVal.pFunctionProto;
+        if(f->_shared) {
+            f->_shared->AddRef();
+            so._code = f->_shared;
+        }
+        else if(!(so._code = SQSharedCode::Freeze(v,f,NULL))) {
+            s->_vm = NULL;
+            s->Release();
+            return NULL;
+        }
+    }
+    return s;
+}
+
+void SQSnapshot::Release()
+{
+    if(_refs.fetch_sub(1,std::memory_order_acq_rel) != 1) return;
+    for(SQInteger i = 0; i < _nobjects; i++) {
+        if(_objects[i]._code) _objects[i]._code->Release();
+    }
+    free(_objects);
+    free(_values);
+    if(_vm) sq_close(_vm);
+    _refs.~atomic();
+    free(this);
+}
+
+static SQFunctionProto *_snap_proto(SQSnapshot *s,SQObjectPtr *out,SQSharedState *ss,SQInteger i)
+{
+    if(sq_type(out[i]) == OT_NULL) {
+        SQSnapObject &so = s->_objects[i];
+        if(so._parent == -1) out[i] = SQFunctionProto::Instantiate(ss,so._code);
+        else out[i] = _snap_proto(s,out,ss,so._parent)->_functions[so._pos];
+    }
+    return _funcproto(out[i]);
+}
+
+static SQObjectPtr _snap_value(const SQObjectPtr *out,const SQSnapValue &sv)
+{
+    if(sv._type == OT_WEAKREF) {
+        const SQObjectPtr &o = out[sv._unVal.nInteger];
+        return _refcounted(o)->GetWeakRef(sq_type(o));
+    }
+    if(ISREFCOUNTED(sv._type)) return out[sv._unVal.nInteger];
+    SQObject o;
+    o._type = sv._type;
+    o._unVal = sv._unVal;
+    return o;
+}
+
+//creates every object of the snapshot in the state of v, then sets their contents.
+//the root table of v is kept and filled, so references to it stay valid
+void SQSnapshot::Apply(SQVM *v)
+{
+    SQSharedState *ss = _ss(v);
+    SQInteger i, n;
+    SQObjectPtrVec outvec;
+    outvec.resize(_nobjects);
+    SQObjectPtr *out = _nobjects ? &outvec[0] : NULL;
+    SQSnapValue *vals = _values;
+    for(i = 0; i < _nobjects; i++) {
+        SQSnapObject &so = _objects[i];
+        SQObject o;
+        o._type = so._type;
+        o._unVal = so._unVal;
+        if(so._builtin != -1) { out[i] = ss->*_snap_builtins[so._builtin]; continue; }
+        if(i == _roottable) { out[i] = v->_roottable; continue; }
+        switch(so._type) {
+        case OT_STRING: out[i] = SQString::Create(ss,_stringval(o),_string(o)->_len); break;
+        case OT_TABLE: out[i] = SQTable::Create(ss,(so._count - 1) / 2); break;
+        case OT_ARRAY: out[i] = SQArray::Create(ss,so._count); break;
+        case OT_USERDATA: {
+            SQUserData *src = _userdata(o);
+            SQUserData *ud = SQUserData::Create(ss,src->_size);
+            memcpy((SQUserPointer)sq_aligning(ud + 1),(SQUserPointer)sq_aligning(src + 1),src->_size);
+            ud->_typetag = src->_typetag;
+            out[i] = ud;
+            }
+            break;
+        case OT_CLASS: out[i] = SQClass::Create(ss,NULL); break;
+        case OT_NATIVECLOSURE: {
+            SQNativeClosure *src = _nativeclosure(o);
+            SQNativeClosure *nc = SQNativeClosure::Create(ss,src->_function,src->_noutervalues);
+            nc->_nparamscheck = src->_nparamscheck;
+            nc->_typecheck.copy(src->_typecheck);
+            out[i] = nc;
+            }
+            break;
+        case OT_OUTER: {
+            SQOuter *ou = SQOuter::Create(ss,NULL);
+            ou->_valptr = &ou->_value;
+            out[i] = ou;
+            }
+            break;
+        default: break;
+        }
+    }
+    for(i = 0; i < _nobjects; i++) {
+        if(_objects[i]._type == OT_FUNCPROTO && _objects[i]._builtin == -1) _snap_proto(this,out,ss,i);
+    }
+    //closures need their prototype, instances the shape of their class
+    for(i = 0; i < _nobjects; i++) {
+        SQSnapObject &so = _objects[i];
+        if(so._builtin != -1) continue;
+        if(so._type == OT_CLOSURE) {
+            out[i] = SQClosure::Create(ss,_funcproto(out[vals[so._first]._unVal.nInteger]),
+                _table(v->_roottable)->GetWeakRef(OT_TABLE));
+        }
+        else if(so._type == OT_CLASS) {
+            SQClass *src = (SQClass *)so._unVal.pClass;
+            SQClass *c = _class(out[i]);
+            __ObjRelease(c->_members);
+            c->_members = _table(out[vals[so._first + 1]._unVal.nInteger]);
+            __ObjAddRef(c->_members);
+            c->_defaultvalues.resize(src->_defaultvalues.size());
+            c->_methods.resize(src->_methods.size());
+            c->_udsize = src->_udsize;
+        }
+    }
+    for(i = 0; i < _nobjects; i++) {
+        SQSnapObject &so = _objects[i];
+        if(so._builtin != -1 || so._type != OT_INSTANCE) continue;
+        SQInstance *src = (SQInstance *)so._unVal.pInstance;
+        SQInstance *inst = SQInstance::Create(ss,_class(out[vals[so._first]._unVal.nInteger]));
+        if(src->_class->_udsize) memcpy(inst->_userpointer,src->_userpointer,src->_class->_udsize);
+        else inst->_userpointer = src->_userpointer;
+        out[i] = inst;
+    }
+    for(i = 0; i < _nobjects; i++) {
+        SQSnapObject &so = _objects[i];
+        if(so._builtin != -1) continue;
+        SQSnapValue *sv = &vals[so._first];
+        switch(so._type) {
+        case OT_TABLE: {
+            SQTable *t = _table(out[i]);
+            SQObjectPtr dlg = _snap_value(out,sv[0]);
+            t->SetDelegate(sq_type(dlg) == OT_TABLE ? _table(dlg) : NULL);
+#ifndef NO_GARBAGE_COLLECTOR
+            t->SetWeakMode(((SQTable *)so._unVal.pTable)->GetWeakMode());
+#endif
+            for(n = 1; n < so._count; n += 2) t->NewSlot(_snap_value(out,sv[n]),_snap_value(out,sv[n + 1]));
+            }
+            break;
+        case OT_ARRAY: {
+            SQArray *a = _array(out[i]);
+            for(n = 0; n < so._count; n++) a->_values[n] = _snap_value(out,sv[n]);
+            }
+            break;
+        case OT_USERDATA: {
+            SQObjectPtr dlg = _snap_value(out,sv[0]);
+            _userdata(out[i])->SetDelegate(sq_type(dlg) == OT_TABLE ? _table(dlg) : NULL);
+            }
+            break;
+        case OT_CLOSURE: {
+            SQClosure *c = _closure(out[i]);
+            SQFunctionProto *f = c->_function;
+            SQObjectPtr env = _snap_value(out,sv[1]);
+            SQObjectPtr root = _snap_value(out,sv[2]);
+            SQObjectPtr base = _snap_value(out,sv[3]);
+            if(sq_type(env) == OT_WEAKREF) { c->_env = _weakref(env); __ObjAddRef(c->_env); }
+            if(sq_type(root) == OT_WEAKREF) c->SetRoot(_weakref(root));
+            if(sq_type(base) == OT_CLASS) { c->_base = _class(base); __ObjAddRef(c->_base); }
+            sv += 4;
+            for(n = 0; n < f->_noutervalues; n++) c->_outervalues[n] = _snap_value(out,*sv++);
+            for(n = 0; n < f->_ndefaultparams; n++) c->_defaultparams[n] = _snap_value(out,*sv++);
+            }
+            break;
+        case OT_NATIVECLOSURE: {
+            SQNativeClosure *c = _nativeclosure(out[i]);
+            SQObjectPtr env = _snap_value(out,sv[0]);
+            if(sq_type(env) == OT_WEAKREF) { c->_env = _weakref(env); __ObjAddRef(c->_env); }
+            c->_name = _snap_value(out,sv[1]);
+            for(n = 0; n < (SQInteger)c->_noutervalues; n++) c->_outervalues[n] = _snap_value(out,sv[n + 2]);
+            }
+            break;
+        case OT_OUTER:
+            _outer(out[i])->_value = _snap_value(out,sv[0]);
+            break;
+        case OT_CLASS: {
+            SQClass *src = (SQClass *)so._unVal.pClass;
+            SQClass *c = _class(out[i]);
+            SQObjectPtr base = _snap_value(out,sv[0]);
+            if(sq_type(base) == OT_CLASS) { c->_base = _class(base); __ObjAddRef(c->_base); }
+            c->_attributes = _snap_value(out,sv[2]);
+            sv += 3;
+            for(n = 0; n < MT_LAST; n++) c->_metamethods[n] = _snap_value(out,*sv++);
+            for(n = 0; n < (SQInteger)c->_defaultvalues.size(); n++) {
+                c->_defaultvalues[n].val = _snap_value(out,*sv++);
+                c->_defaultvalues[n].attrs = _snap_value(out,*sv++);
+                c->_defaultvalues[n].native = src->_defaultvalues[n].native;
+            }
+            for(n = 0; n < (SQInteger)c->_methods.size(); n++) {
+                c->_methods[n].val = _snap_value(out,*sv++);
+                c->_methods[n].attrs = _snap_value(out,*sv++);
+            }
+            c->_typetag = src->_typetag;
+            c->_hook = src->_hook;
+            c->_locked = src->_locked;
+            c->_constructoridx = src->_constructoridx;
+            }
+            break;
+        case OT_INSTANCE: {
+            SQInstance *inst = _instance(out[i]);
+            for(n = 1; n < so._count; n++) inst->_values[n - 1] = _snap_value(out,sv[n]);
+            }
+            break;
+        default: break;
+        }
+    }
+    SQSharedState *src = _ss(_vm);
+    ss->_registry = out[_registry];
+    ss->_consts = out[_consts];
+    ss->_compilererrorhandler = src->_compilererrorhandler;
+    ss->_printfunc = src->_printfunc;
+    ss->_errorfunc = src->_errorfunc;
+    ss->_debuginfo = src->_debuginfo;
+    ss->_notifyallexceptions = src->_notifyallexceptions;
+    v->_errorhandler = _snap_value(out,_errorhandler);
+    v->_debughook_closure = _snap_value(out,_debughook);
+    v->_debughook_native = _vm->_debughook_native;
+    v->_debughook = _vm->_debughook;
+    if(ss->_snapshot != this) {
+        AddRef();
+        if(ss->_snapshot) ss->_snapshot->Release();
+        ss->_snapshot = this;
+    }
+#ifndef NO_GARBAGE_COLLECTOR
+    //the copy is live data, it does not count as allocation debt
+    ss->GCSetParams(src->_gcparams);
+#endif
+}
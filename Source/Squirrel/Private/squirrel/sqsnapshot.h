@@ -0,0 +1,56 @@
+/*  see copyright notice in squirrel.h */
+#ifndef _SQSNAPSHOT_H_
+#define _SQSNAPSHOT_H_
+
+#include <atomic>
+
+struct SQSharedCode;
+
+//a value of the snapshot heap, objects are referred by their index in SQSnapshot::_objects
+//(OT_WEAKREF refers to the object the weak reference points to)
+struct SQSnapValue
+{
+    SQObjectType _type;
+    SQObjectValue _unVal;
+};
+
+struct SQSnapObject
+{
+    SQObjectType _type;
+    SQObjectValue _unVal;   //the object in the snapshot state
+    SQInteger _first;       //its values in SQSnapshot::_values
+    SQInteger _count;
+    SQInteger _builtin;     //index in the builtin objects of a state, -1 for the others
+    SQInteger _parent;      //prototypes, index of the enclosing prototype or -1
+    SQInteger _pos;         //prototypes, position in the functions of _parent
+    SQSharedCode *_code;    //prototypes without _parent, code they are instantiated from
+};
+
+//heap of a fully initialized VM (sq_snapshot), flattened into a list of objects whose
+//references are indices. Opening a VM from it allocates every object then fixes up the
+//references in a second pass; compiled functions share their instructions (SQSharedCode).
+//the state the snapshot was taken from is kept, never runs again and is only read, so
+//any number of threads can open VMs from one snapshot. Userdata with a release hook are
+//copied without the hook, the memory they own stays with the snapshot: every VM opened
+//from it holds a reference and the snapshot is closed by the last one
+struct SQSnapshot
+{
+    static SQSnapshot *Create(SQVM *v);
+    void AddRef() { _refs.fetch_add(1,std::memory_order_relaxed); }
+    void Release();
+    void Apply(SQVM *v);
+
+    std::atomic<SQInteger> _refs;
+    SQVM *_vm;
+    SQSnapObject *_objects;
+    SQInteger _nobjects;
+    SQSnapValue *_values;
+    SQInteger _nvalues;
+    SQInteger _roottable;
+    SQInteger _registry;
+    SQInteger _consts;
+    SQSnapValue _errorhandler;
+    SQSnapValue _debughook;
+};
+
+#endif //_SQSNAPSHOT_H_
@@ -11,6 +11,26 @@
 #include "sqarray.h"
 #include "squserdata.h"
 #include "sqclass.h"
+#include <chrono>
+
+#ifndef NO_GARBAGE_COLLECTOR
+//defaults of the automatic collection (sq_setgcparams): a collection starts when the heap
+//reaches SQ_GC_PAUSE% of its size after the last one, and at least SQ_GC_MIN_DEBT bytes
+//more; an incremental collection runs a SQ_GC_STEP_BUDGET us step every SQ_GC_STEP_SIZE
+//allocated bytes
+#ifndef SQ_GC_PAUSE
+#define SQ_GC_PAUSE 200
+#endif
+#ifndef SQ_GC_MIN_DEBT
+#define SQ_GC_MIN_DEBT (256*1024)
+#endif
+#ifndef SQ_GC_STEP_SIZE
+#define SQ_GC_STEP_SIZE (64*1024)
+#endif
+#ifndef SQ_GC_STEP_BUDGET
+#define SQ_GC_STEP_BUDGET 500
+#endif
+#endif
 
 SQSharedState::SQSharedState()
 {
@@ -21,6 +41,12 @@ SQSharedState::SQSharedState()
     _notifyallexceptions = false;
     _foreignptr = NULL;
     _releasehook = NULL;
+    _snapshot = NULL;
+    _parallel = NULL;
+    sq_resetobject(&_handles._obj);
+    _handles._prev = _handles._next = &_handles;
+    _handles._vm = NULL;
+    memset(&_memctx, 0, sizeof(_memctx));
 }
 
 #define newsysstring(s) {   \
@@ -95,6 +121,18 @@ void SQSharedState::Init()
     _scratchpadsize=0;
 #ifndef NO_GARBAGE_COLLECTOR
     _gc_chain=NULL;
+    _gc_gray=NULL;
+    _gc_grayagain=NULL;
+    _gc_black=NULL;
+    _gc_roots=NULL;
+    _gcstate=SQ_GC_IDLE;
+    _gc_objects=0;
+    memset(&_gcstats,0,sizeof(SQGCStats));
+    memset(&_gccycle,0,sizeof(SQGCStats));
+    _gcparams.pause = SQ_GC_PAUSE;
+    _gcparams.stepsize = SQ_GC_STEP_SIZE;
+    _gcparams.stepbudget = SQ_GC_STEP_BUDGET;
+    _gcrunning = false;
 #endif
     _stringtable = (SQStringTable*)SQ_MALLOC(sizeof(SQStringTable));
     new (_stringtable) SQStringTable(this);
@@ -152,6 +190,9 @@ void SQSharedState::Init()
     _class_default_delegate = CreateDefaultDelegate(this,_class_default_delegate_funcz);
     _instance_default_delegate = CreateDefaultDelegate(this,_instance_default_delegate_funcz);
     _weakref_default_delegate = CreateDefaultDelegate(this,_weakref_default_delegate_funcz);
+#ifndef NO_GARBAGE_COLLECTOR
+    GCSetThreshold();
+#endif
 }
 
 SQSharedState::~SQSharedState()
@@ -180,21 +221,11 @@ SQSharedState::~SQSharedState()
     _class_default_delegate.Null();
     _instance_default_delegate.Null();
     _weakref_default_delegate.Null();
+    ReleaseHandles();
     _refs_table.Finalize();
 #ifndef NO_GARBAGE_COLLECTOR
-    SQCollectable *t = _gc_chain;
-    SQCollectable *nx = NULL;
-    if(t) {
-        t->_uiRef++;
-        while(t) {
-            t->Finalize();
-            nx = t->_next;
-            if(nx) nx->_uiRef++;
-            if(--t->_uiRef == 0)
-                t->Release();
-            t = nx;
-        }
-    }
+    GCReset();
+    Sweep(&_gc_chain);
     assert(_gc_chain==NULL); //just to proove a theory
     while(_gc_chain){
         _gc_chain->_uiRef++;
@@ -248,6 +279,15 @@ void SQSharedState::RunMark(SQVM* SQ_UNUSED_ARG(vm),SQCollectable **tchain)
     vms->Mark(tchain);
 
     _refs_table.Mark(tchain);
+    for(SQHandle *h = _handles._next; h != &_handles; h = h->_next) {
+        SQObjectPtr o = h->_obj;
+        MarkObject(o,tchain);
+    }
+    MarkRoots(tchain);
+}
+
+void SQSharedState::MarkRoots(SQCollectable **tchain)
+{
     MarkObject(_registry,tchain);
     MarkObject(_consts,tchain);
     MarkObject(_metamethodsmap,tchain);
@@ -261,7 +301,32 @@ void SQSharedState::RunMark(SQVM* SQ_UNUSED_ARG(vm),SQCollectable **tchain)
     MarkObject(_class_default_delegate,tchain);
     MarkObject(_instance_default_delegate,tchain);
     MarkObject(_weakref_default_delegate,tchain);
+}
 
+static SQInteger _gc_typeidx(SQObjectType type)
+{
+    switch(type) {
+    case OT_TABLE: return SQ_GC_TABLE;
+    case OT_ARRAY: return SQ_GC_ARRAY;
+    case OT_USERDATA: return SQ_GC_USERDATA;
+    case OT_CLOSURE: return SQ_GC_CLOSURE;
+    case OT_NATIVECLOSURE: return SQ_GC_NATIVECLOSURE;
+    case OT_GENERATOR: return SQ_GC_GENERATOR;
+    case OT_THREAD: return SQ_GC_THREAD;
+    case OT_CLASS: return SQ_GC_CLASS;
+    case OT_INSTANCE: return SQ_GC_INSTANCE;
+    case OT_OUTER: return SQ_GC_OUTER;
+    default: return SQ_GC_FUNCPROTO;
+    }
+}
+
+//microseconds since 'from', which moves to now
+static SQInteger _gc_lap(std::chrono::steady_clock::time_point &from)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    SQInteger us = (SQInteger)std::chrono::duration_cast<std::chrono::microseconds>(now - from).count();
+    from = now;
+    return us;
 }
 
 SQInteger SQSharedState::ResurrectUnreachable(SQVM *vm)
@@ -269,7 +334,13 @@ SQInteger SQSharedState::ResurrectUnreachable(SQVM *vm)
     SQInteger n=0;
     SQCollectable *tchain=NULL;
 
+    GCReset();
+    GCStatsBegin();
+    std::chrono::steady_clock::time_point lap = std::chrono::steady_clock::now();
+
     RunMark(vm,&tchain);
+    while(GCMarkEphemerons(&tchain));
+    _gccycle.marktime = _gc_lap(lap);
 
     SQCollectable *resurrected = _gc_chain;
     SQCollectable *t = resurrected;
@@ -304,9 +375,11 @@ SQInteger SQSharedState::ResurrectUnreachable(SQVM *vm)
 
     t = _gc_chain;
     while(t) {
+        if(t->_uiRef&MARK_FLAG) _gccycle.marked[_gc_typeidx(t->GetType())]++;
         t->UnMark();
         t = t->_next;
     }
+    GCStatsEnd(false);
 
     if(ret) {
         SQObjectPtr temp = ret;
@@ -318,37 +391,436 @@ SQInteger SQSharedState::ResurrectUnreachable(SQVM *vm)
     return n;
 }
 
-SQInteger SQSharedState::CollectGarbage(SQVM *vm)
+void SQSharedState::GCStatsBegin()
 {
-    SQInteger n = 0;
-    SQCollectable *tchain = NULL;
+    memset(&_gccycle,0,sizeof(SQGCStats));
+}
 
-    RunMark(vm,&tchain);
+//resurrectunreachable publishes its marking without counting as a collection
+void SQSharedState::GCStatsEnd(bool collection)
+{
+    _gccycle.collections = _gcstats.collections + (collection ? 1 : 0);
+    _gccycle.cyclesfreed = _gcstats.cyclesfreed;
+    _gcstats = _gccycle;
+    if(collection) GCSetThreshold();
+}
 
-    SQCollectable *t = _gc_chain;
+void SQSharedState::GetGCStats(SQGCStats *stats)
+{
+    *stats = _gcstats;
+    stats->chainlength = _gc_objects;
+    stats->refs = _refs_table.Used();
+    stats->refslots = _refs_table.Slots();
+    stats->handles = 0;
+    for(SQHandle *h = _handles._next; h != &_handles; h = h->_next) stats->handles++;
+    stats->strings = _stringtable->Used();
+    stats->stringslots = _stringtable->Slots();
+}
+
+//finalizes the garbage in 'chain', the objects still referenced from outside stay there
+SQInteger SQSharedState::Sweep(SQCollectable **chain)
+{
+    //no possible roots are recorded while the chain is walked
+    SQGCState state = _gcstate;
+    if(state == SQ_GC_IDLE) _gcstate = SQ_GC_SWEEP;
+    SQInteger n = 0;
+    SQCollectable *t = *chain;
     SQCollectable *nx = NULL;
     if(t) {
         t->_uiRef++;
         while(t) {
+            _gccycle.freed[_gc_typeidx(t->GetType())]++;
             t->Finalize();
             nx = t->_next;
             if(nx) nx->_uiRef++;
-            if(--t->_uiRef == 0)
+            t->_uiRef--;
+            if(_refcount(t) == 0)
                 t->Release();
             t = nx;
             n++;
         }
     }
+    _gcstate = state;
+    return n;
+}
+
+//a collection in progress (SQSharedState::_gcrunning) defers the automatic ones
+struct SQGCRunning
+{
+    SQGCRunning(bool *running) : _running(running), _prev(*running) { *running = true; }
+    ~SQGCRunning() { *_running = _prev; }
+    bool *_running;
+    bool _prev;
+};
 
-    t = tchain;
+SQInteger SQSharedState::CollectGarbage(SQVM *vm)
+{
+    SQGCRunning r(&_gcrunning);
+    //a full collection takes over the incremental cycle in progress
+    GCReset();
+    GCStatsBegin();
+    std::chrono::steady_clock::time_point lap = std::chrono::steady_clock::now();
+    RunMark(vm,&_gc_black);
+    while(GCMarkEphemerons(&_gc_black));
+    _gccycle.marktime = _gc_lap(lap);
+    GCClearWeak();
+
+    SQInteger n = Sweep(&_gc_chain);
+
+    SQCollectable *t = _gc_black;
     while(t) {
+        _gccycle.marked[_gc_typeidx(t->GetType())]++;
         t->UnMark();
+        if(!t->_next) {
+            t->_next = _gc_chain;
+            if(_gc_chain) _gc_chain->_prev = t;
+            _gc_chain = _gc_black;
+            break;
+        }
         t = t->_next;
     }
-    _gc_chain = tchain;
+    _gc_black = NULL;
+    _gccycle.sweeptime = _gc_lap(lap);
+    GCStatsEnd(true);
+
+    return n;
+}
+
+#ifndef SQ_GC_STEP_GRANULARITY
+#define SQ_GC_STEP_GRANULARITY 64
+#endif
+
+//time budget of CollectGarbageStep, the clock is read every SQ_GC_STEP_GRANULARITY objects
+struct SQGCBudget
+{
+    SQGCBudget(SQInteger budget) : _unlimited(budget <= 0), _work(0),
+        _deadline(std::chrono::steady_clock::now() + std::chrono::microseconds(budget)) {}
+    bool Expired() {
+        if(_unlimited || ++_work % SQ_GC_STEP_GRANULARITY) return false;
+        return std::chrono::steady_clock::now() >= _deadline;
+    }
+    bool _unlimited;
+    SQInteger _work;
+    std::chrono::steady_clock::time_point _deadline;
+};
+
+//incremental tri-color collection. The first step shades the roots (gray), the next ones
+//traverse the gray objects (black) while the write barriers bring back to gray the black
+//containers that store a new reference. Stacks, generators and outers are written without
+//barriers, the atomic phase traverses them again and frees what is still white; the
+//survivors are then whitened a slice at a time.
+//budget is in microseconds, <=0 completes the cycle; returns the number of objects freed
+SQInteger SQSharedState::CollectGarbageStep(SQVM *vm,SQInteger budget)
+{
+    SQGCRunning r(&_gcrunning);
+    SQGCBudget b(budget);
+    std::chrono::steady_clock::time_point lap = std::chrono::steady_clock::now();
+    SQInteger n = 0;
+    if(_gcstate == SQ_GC_IDLE) {
+        GCReset();
+        GCStatsBegin();
+        _gcstate = SQ_GC_PROPAGATE;
+        RunMark(vm,&_gc_black);
+    }
+    if(_gcstate == SQ_GC_PROPAGATE) {
+        while(_gc_gray) {
+            GCTraverse(_gc_gray,false);
+            if(b.Expired()) {
+                _gccycle.marktime += _gc_lap(lap);
+                return 0;
+            }
+        }
+        GCAtomic();
+        _gccycle.marktime += _gc_lap(lap);
+        //no barriers while the white objects are finalized
+        _gcstate = SQ_GC_WHITEN;
+        n = Sweep(&_gc_chain);
+    }
+    while(_gc_black) {
+        if(b.Expired()) {
+            _gccycle.sweeptime += _gc_lap(lap);
+            return n;
+        }
+        SQCollectable *c = _gc_black;
+        SQCollectable::RemoveFromChain(&_gc_black,c);
+        _gccycle.marked[_gc_typeidx(c->GetType())]++;
+        c->UnMark();
+        SQCollectable::AddToChain(&_gc_chain,c);
+    }
+    _gccycle.sweeptime += _gc_lap(lap);
+    GCStatsEnd(true);
+    _gcstate = SQ_GC_IDLE;
+    return n;
+}
+
+void SQSharedState::GCTraverse(SQCollectable *c,bool atomic)
+{
+    SQCollectable::RemoveFromChain(&_gc_gray,c);
+    c->_uiRef&=~GRAY_FLAG;
+    SQObjectType type = c->GetType();
+    if(!atomic && (type == OT_THREAD || type == OT_GENERATOR || type == OT_OUTER)) {
+        c->_uiRef|=AGAIN_FLAG;
+        SQCollectable::AddToChain(&_gc_grayagain,c);
+    }
+    else {
+        SQCollectable::AddToChain(&_gc_black,c);
+    }
+    c->MarkChildren(&_gc_black);
+}
+
+void SQSharedState::GCAtomic()
+{
+    //the roots of the state and the stacks changed since they were shaded
+    _thread(_root_vm)->Mark(&_gc_black);
+    MarkRoots(&_gc_black);
+    while(_gc_grayagain) {
+        SQCollectable *c = _gc_grayagain;
+        SQCollectable::RemoveFromChain(&_gc_grayagain,c);
+        c->_uiRef&=~AGAIN_FLAG;
+        SQCollectable::AddToChain(&_gc_black,c);
+        c->MarkChildren(&_gc_black);
+    }
+    while(_gc_gray) GCTraverse(_gc_gray,true);
+    while(GCMarkEphemerons(&_gc_black)) {
+        while(_gc_gray) GCTraverse(_gc_gray,true);
+    }
+    GCClearWeak();
+}
+
+void SQSharedState::GCBarrier(SQCollectable *c)
+{
+    if(_gcstate != SQ_GC_PROPAGATE) return;
+    SQCollectable::RemoveFromChain(&_gc_black,c);
+    c->_uiRef|=GRAY_FLAG;
+    SQCollectable::AddToChain(&_gc_gray,c);
+}
+
+//abandons the incremental cycle in progress and forgets the possible roots,
+//every object goes back to _gc_chain
+void SQSharedState::GCReset()
+{
+    SQCollectable **lists[] = { &_gc_gray, &_gc_grayagain, &_gc_black, &_gc_roots };
+    for(SQInteger i = 0; i < 4; i++) {
+        while(*lists[i]) {
+            SQCollectable *c = *lists[i];
+            SQCollectable::RemoveFromChain(lists[i],c);
+            c->_uiRef&=~(GC_FLAGS|ROOT_FLAG);
+            SQCollectable::AddToChain(&_gc_chain,c);
+        }
+    }
+    _gcstate = SQ_GC_IDLE;
+}
+
+//the heap size past which the next automatic collection starts, from the live heap
+//left by the collection just completed
+void SQSharedState::GCSetThreshold()
+{
+    SQMemContext &c = _memctx;
+    if(_gcparams.pause <= 0) {
+        c._gcthreshold = ~((SQUnsignedInteger)0);
+    }
+    else {
+        SQUnsignedInteger live = c._total;
+        c._gcthreshold = live / 100 * (SQUnsignedInteger)_gcparams.pause;
+        if(c._gcthreshold < live + SQ_GC_MIN_DEBT) c._gcthreshold = live + SQ_GC_MIN_DEBT;
+    }
+    c._gcdue = c._total > c._gcthreshold;
+}
+
+void SQSharedState::GCSetParams(const SQGCParams &params)
+{
+    _gcparams = params;
+    if(_gcparams.stepsize <= 0) _gcparams.stepsize = SQ_GC_STEP_SIZE;
+    if(_gcstate == SQ_GC_IDLE || _gcparams.pause <= 0) GCSetThreshold();
+}
+
+//runs the collection made due by the allocations (SQMemContext::_gcdue), called by the vms
+//at the safe points. The marking collectors don't see the objects referenced only by the
+//C stack, so they only run when no native frame is active: under a native call the cycles
+//are collected by trial deletion, that relies on the refcounts
+void SQSharedState::GCAutoStep(SQVM *vm)
+{
+    SQMemContext &c = _memctx;
+    c._gcdue = false;
+    //finalizers and release hooks can run scripts
+    if(_gcrunning) return;
+    if(c._nesting > 1) {
+        if(_gcstate == SQ_GC_IDLE) CollectCycles();
+    }
+    else if(_gcparams.stepbudget > 0) {
+        CollectGarbageStep(vm,_gcparams.stepbudget);
+    }
+    else {
+        CollectGarbage(vm);
+    }
+    //a completed collection has already set the next threshold
+    if(c._total > c._gcthreshold || _gcstate != SQ_GC_IDLE)
+        c._gcthreshold = c._total + (SQUnsignedInteger)_gcparams.stepsize;
+}
+
+void SQSharedState::AddWeakTable(SQTable *t)
+{
+    _weaktables.push_back(t);
+}
+
+void SQSharedState::RemoveWeakTable(SQTable *t)
+{
+    for(SQUnsignedInteger i = 0; i < _weaktables.size(); i++) {
+        if(_weaktables[i] == t) {
+            _weaktables[i] = _weaktables.back();
+            _weaktables.pop_back();
+            return;
+        }
+    }
+}
+
+//'c' is being freed: removes it from the weak tables. The other references of the entries
+//are released once the tables are consistent
+void SQSharedState::WeakRelease(SQCollectable *c)
+{
+    SQObjectPtrVec garbage;
+    for(SQUnsignedInteger i = 0; i < _weaktables.size(); i++) _weaktables[i]->ClearWeak(c,garbage);
+}
+
+//ephemerons: the value of a weak key is alive if the key is. Returns true if it marked
+//something, the marking goes on until nothing changes
+bool SQSharedState::GCMarkEphemerons(SQCollectable **chain)
+{
+    bool marked = false;
+    for(SQUnsignedInteger i = 0; i < _weaktables.size(); i++) {
+        SQTable *t = _weaktables[i];
+        if((t->_uiRef&MARK_FLAG) && t->MarkEphemerons(chain)) marked = true;
+    }
+    return marked;
+}
+
+//the entries referring weakly to what the marking didn't reach go before the sweep
+void SQSharedState::GCClearWeak()
+{
+    if(_weaktables.empty()) return;
+    SQGCState state = _gcstate;
+    if(state == SQ_GC_IDLE) _gcstate = SQ_GC_SWEEP;
+    {
+        SQObjectPtrVec garbage;
+        for(SQUnsignedInteger i = 0; i < _weaktables.size(); i++) _weaktables[i]->ClearUnmarked(garbage);
+    }
+    _gcstate = state;
+}
+
+SQCollectable **SQSharedState::GCChainOf(SQCollectable *c)
+{
+    if(!(c->_uiRef&MARK_FLAG)) return (c->_uiRef&ROOT_FLAG) ? &_gc_roots : &_gc_chain;
+    if(c->_uiRef&GRAY_FLAG) return &_gc_gray;
+    if(c->_uiRef&AGAIN_FLAG) return &_gc_grayagain;
+    return &_gc_black;
+}
 
+void sq_gc_possibleroot(SQRefCounted *obj)
+{
+    SQCollectable *c = static_cast<SQCollectable *>(obj);
+    c->_sharedstate->PossibleRoot(c);
+}
+
+//the marking collectors already visit the whole heap, roots are only recorded between them
+void SQSharedState::PossibleRoot(SQCollectable *c)
+{
+    if(_gcstate != SQ_GC_IDLE) return;
+    SQCollectable::RemoveFromChain(&_gc_chain,c);
+    c->_uiRef|=ROOT_FLAG;
+    SQCollectable::AddToChain(&_gc_roots,c);
+}
+
+//synchronous cycle collection by trial deletion (Bacon-Rajan), limited to the subgraphs
+//reachable from the possible roots: the references internal to the subgraphs are subtracted
+//(gray), what keeps a reference from outside is alive with everything it reaches (black),
+//the rest is garbage (white). During the trial the refcounts don't own the objects and
+//GRAY_FLAG/AGAIN_FLAG without MARK_FLAG are the gray and white colors.
+//returns the number of objects freed
+SQInteger SQSharedState::CollectCycles()
+{
+    if(_gcstate != SQ_GC_IDLE || !_gc_roots) return 0;
+    SQGCRunning r(&_gcrunning);
+    SQCollectable *c;
+    _gcstate = SQ_GC_TRIAL_GRAY;
+    for(c = _gc_roots; c; c = c->_next) TrialGray(c);
+    _gcstate = SQ_GC_TRIAL_SCAN;
+    for(c = _gc_roots; c; c = c->_next) TrialScan(c);
+    //the garbage is moved to _gc_black (marked)
+    _gcstate = SQ_GC_TRIAL_COLLECT;
+    while(_gc_roots) {
+        c = _gc_roots;
+        if(c->_uiRef&AGAIN_FLAG) {
+            TrialCollect(c);
+            continue;
+        }
+        SQCollectable::RemoveFromChain(&_gc_roots,c);
+        c->_uiRef&=~ROOT_FLAG;
+        SQCollectable::AddToChain(&_gc_chain,c);
+    }
+    //gives the garbage its references back, then finalizes it like the collectors do
+    _gcstate = SQ_GC_TRIAL_RESTORE;
+    for(c = _gc_black; c; c = c->_next) c->MarkChildren(NULL);
+    _gcstate = SQ_GC_IDLE;
+    SQInteger n = Sweep(&_gc_black);
+    _gcstats.cyclesfreed += n;
+    while(_gc_black) {
+        c = _gc_black;
+        SQCollectable::RemoveFromChain(&_gc_black,c);
+        c->UnMark();
+        SQCollectable::AddToChain(&_gc_chain,c);
+    }
     return n;
 }
+
+void SQSharedState::TrialVisit(SQCollectable *c)
+{
+    switch(_gcstate) {
+    case SQ_GC_TRIAL_GRAY: c->_uiRef--; TrialGray(c); break;
+    case SQ_GC_TRIAL_SCAN: TrialScan(c); break;
+    case SQ_GC_TRIAL_BLACK:
+        c->_uiRef++;
+        if(c->_uiRef&(GRAY_FLAG|AGAIN_FLAG)) TrialBlack(c);
+        break;
+    case SQ_GC_TRIAL_COLLECT: TrialCollect(c); break;
+    case SQ_GC_TRIAL_RESTORE: c->_uiRef++; break;
+    default: break;
+    }
+}
+
+void SQSharedState::TrialGray(SQCollectable *c)
+{
+    if(c->_uiRef&GRAY_FLAG) return;
+    c->_uiRef|=GRAY_FLAG;
+    c->MarkChildren(NULL);
+}
+
+void SQSharedState::TrialScan(SQCollectable *c)
+{
+    if(!(c->_uiRef&GRAY_FLAG)) return;
+    if(_refcount(c) > 0) {
+        _gcstate = SQ_GC_TRIAL_BLACK;
+        TrialBlack(c);
+        _gcstate = SQ_GC_TRIAL_SCAN;
+        return;
+    }
+    c->_uiRef=(c->_uiRef&~GRAY_FLAG)|AGAIN_FLAG;
+    c->MarkChildren(NULL);
+}
+
+void SQSharedState::TrialBlack(SQCollectable *c)
+{
+    c->_uiRef&=~(GRAY_FLAG|AGAIN_FLAG);
+    c->MarkChildren(NULL);
+}
+
+void SQSharedState::TrialCollect(SQCollectable *c)
+{
+    if(!(c->_uiRef&AGAIN_FLAG)) return;
+    SQCollectable::RemoveFromChain(GCChainOf(c),c);
+    c->_uiRef=(c->_uiRef&~(AGAIN_FLAG|ROOT_FLAG))|MARK_FLAG;
+    SQCollectable::AddToChain(&_gc_black,c);
+    c->MarkChildren(NULL);
+}
 #endif
 
 #ifndef NO_GARBAGE_COLLECTOR
@@ -389,6 +861,33 @@ SQChar* SQSharedState::GetScratchPad(SQInteger size)
     return _scratchpad;
 }
 
+void SQSharedState::LinkHandle(SQHandle *h,SQHandle *after)
+{
+    h->_prev = after;
+    h->_next = after->_next;
+    after->_next->_prev = h;
+    after->_next = h;
+}
+
+void SQSharedState::UnlinkHandle(SQHandle *h)
+{
+    h->_prev->_next = h->_next;
+    h->_next->_prev = h->_prev;
+    h->_prev = h->_next = NULL;
+}
+
+//the handles still alive when the vm is closed are emptied, releasing them later does nothing
+void SQSharedState::ReleaseHandles()
+{
+    while(_handles._next != &_handles) {
+        SQHandle *h = _handles._next;
+        SQObject o = h->_obj;
+        UnlinkHandle(h);
+        sq_resetobject(&h->_obj);
+        __Release(o._type,o._unVal);
+    }
+}
+
 RefTable::RefTable()
 {
     AllocNodes(4);
@@ -589,7 +1088,7 @@ SQString *SQStringTable::Add(const SQChar *news,SQInteger len)
             return s; //found
     }
 
-    SQString *t = (SQString *)SQ_MALLOC(sq_rsl(len)+sizeof(SQString));
+    SQString *t = (SQString *)SQ_MALLOC_CAT(sq_rsl(len)+sizeof(SQString),SQ_MEM_STRING);
     new (t) SQString;
     t->_sharedstate = _sharedstate;
     memcpy(t->_val,news,sq_rsl(len));
@@ -637,7 +1136,7 @@ void SQStringTable::Remove(SQString *bs)
             _slotused--;
             SQInteger slen = s->_len;
             s->~SQString();
-            SQ_FREE(s,sizeof(SQString) + sq_rsl(slen));
+            SQ_FREE_CAT(s,sizeof(SQString) + sq_rsl(slen),SQ_MEM_STRING);
             return;
         }
         prev = s;
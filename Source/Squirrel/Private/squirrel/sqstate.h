@@ -6,6 +6,8 @@
 #include "sqobject.h"
 struct SQString;
 struct SQTable;
+struct SQSnapshot;
+struct SQParallelPool;
 //max number of character for a printed number
 #define NUMBER_MAX_CHAR 50
 
@@ -15,6 +17,8 @@ struct SQStringTable
     ~SQStringTable();
     SQString *Add(const SQChar *,SQInteger len);
     void Remove(SQString *);
+    SQUnsignedInteger Used() const { return _slotused; }
+    SQUnsignedInteger Slots() const { return _numofslots; }
 private:
     void Resize(SQInteger size);
     void AllocNodes(SQInteger size);
@@ -35,6 +39,8 @@ struct RefTable {
     void AddRef(SQObject &obj);
     SQBool Release(SQObject &obj);
     SQUnsignedInteger GetRefCount(SQObject &obj);
+    SQUnsignedInteger Used() const { return _slotused; }
+    SQUnsignedInteger Slots() const { return _numofslots; }
 #ifndef NO_GARBAGE_COLLECTOR
     void Mark(SQCollectable **chain);
 #endif
@@ -56,6 +62,22 @@ private:
 
 struct SQObjectPtr;
 
+#ifndef NO_GARBAGE_COLLECTOR
+//phases of the incremental collector (SQSharedState::CollectGarbageStep)
+enum SQGCState {
+    SQ_GC_IDLE,
+    SQ_GC_PROPAGATE,
+    SQ_GC_WHITEN,
+    SQ_GC_SWEEP,
+    //trial deletion from the possible roots (SQSharedState::CollectCycles)
+    SQ_GC_TRIAL_GRAY,
+    SQ_GC_TRIAL_SCAN,
+    SQ_GC_TRIAL_BLACK,
+    SQ_GC_TRIAL_COLLECT,
+    SQ_GC_TRIAL_RESTORE
+};
+#endif
+
 struct SQSharedState
 {
     SQSharedState();
@@ -66,9 +88,37 @@ public:
     SQInteger GetMetaMethodIdxByName(const SQObjectPtr &name);
 #ifndef NO_GARBAGE_COLLECTOR
     SQInteger CollectGarbage(SQVM *vm);
+    SQInteger CollectGarbageStep(SQVM *vm,SQInteger budget);
+    SQInteger CollectCycles();
     void RunMark(SQVM *vm,SQCollectable **tchain);
+    void MarkRoots(SQCollectable **tchain);
     SQInteger ResurrectUnreachable(SQVM *vm);
     static void MarkObject(SQObjectPtr &o,SQCollectable **chain);
+    void GCBarrier(SQCollectable *c);
+    void GCReset();
+    SQCollectable **GCChainOf(SQCollectable *c);
+    void PossibleRoot(SQCollectable *c);
+    void TrialVisit(SQCollectable *c);
+    void GetGCStats(SQGCStats *stats);
+    void GCAutoStep(SQVM *vm);
+    void GCSetParams(const SQGCParams &params);
+    void AddWeakTable(SQTable *t);
+    void RemoveWeakTable(SQTable *t);
+    void WeakRelease(SQCollectable *c);
+private:
+    bool GCMarkEphemerons(SQCollectable **chain);
+    void GCClearWeak();
+    void GCSetThreshold();
+    void GCStatsBegin();
+    void GCStatsEnd(bool collection);
+    void GCTraverse(SQCollectable *c,bool atomic);
+    void GCAtomic();
+    SQInteger Sweep(SQCollectable **chain);
+    void TrialGray(SQCollectable *c);
+    void TrialScan(SQCollectable *c);
+    void TrialBlack(SQCollectable *c);
+    void TrialCollect(SQCollectable *c);
+public:
 #endif
     SQObjectPtrVec *_metamethods;
     SQObjectPtr _metamethodsmap;
@@ -76,11 +126,31 @@ public:
     SQObjectPtrVec *_types;
     SQStringTable *_stringtable;
     RefTable _refs_table;
+    //sentinel of the circular list of the linked handles (sq_sethandle)
+    SQHandle _handles;
+    static void LinkHandle(SQHandle *h,SQHandle *after);
+    static void UnlinkHandle(SQHandle *h);
+    void ReleaseHandles();
     SQObjectPtr _registry;
     SQObjectPtr _consts;
     SQObjectPtr _constructoridx;
 #ifndef NO_GARBAGE_COLLECTOR
+    //white objects; the other lists are only filled during a collection
     SQCollectable *_gc_chain;
+    SQCollectable *_gc_gray;
+    SQCollectable *_gc_grayagain;
+    SQCollectable *_gc_black;
+    SQCollectable *_gc_roots;
+    SQGCState _gcstate;
+    SQInteger _gc_objects;
+    //_gccycle is filled by the collection in progress and published to _gcstats at its end
+    SQGCStats _gcstats;
+    SQGCStats _gccycle;
+    //automatic collection driven by the allocation debt (GCAutoStep)
+    SQGCParams _gcparams;
+    bool _gcrunning;
+    //tables with a weak mode (SQTable::SetWeakMode)
+    sqvector<SQTable *> _weaktables;
 #endif
     SQObjectPtr _root_vm;
     SQObjectPtr _table_default_delegate;
@@ -111,6 +181,13 @@ public:
     bool _notifyallexceptions;
     SQUserPointer _foreignptr;
     SQRELEASEHOOK _releasehook;
+    //_memctx._allocator points to _allocatorslot for states opened with an allocator
+    SQMemContext _memctx;
+    SQAllocator _allocatorslot;
+    //snapshot this state was opened or reset from (sq_openfromsnapshot), released by sq_close
+    SQSnapshot *_snapshot;
+    //workers of pmap/pfilter/preduce, opened by the first call and released by sq_close
+    SQParallelPool *_parallel;
 private:
     SQChar *_scratchpad;
     SQInteger _scratchpadsize;
@@ -13,18 +13,88 @@ SQTable::SQTable(SQSharedState *ss,SQInteger nInitialSize)
     while(nInitialSize>pow2size)pow2size=pow2size<<1;
     AllocNodes(pow2size);
     _usednodes = 0;
+    _weakmode = 0;
     _delegate = NULL;
     INIT_CHAIN();
     ADD_TO_CHAIN(&_sharedstate->_gc_chain,this);
 }
 
+SQTable::~SQTable()
+{
+    SetDelegate(NULL);
+#ifndef NO_GARBAGE_COLLECTOR
+    if(_weakmode) _sharedstate->RemoveWeakTable(this);
+#endif
+    REMOVE_FROM_CHAIN(&_sharedstate->_gc_chain, this);
+    SQObjectPtr k,v;
+    for (SQInteger i = 0; i < _numofnodes; i++) {
+        _Forget(_nodes[i].key,SQ_WEAK_KEYS,k);
+        _Forget(_nodes[i].val,SQ_WEAK_VALUES,v);
+        k.Null();
+        v.Null();
+        _nodes[i].~_HashNode();
+    }
+    SQ_FREE_CAT(_nodes, _numofnodes * sizeof(_HashNode), SQ_MEM_TABLE);
+}
+
+//moves a node part without touching the refcount, 'dst' is empty
+static inline void _movepart(SQObjectPtr &dst,SQObjectPtr &src)
+{
+    dst._type = src._type;
+    dst._unVal = src._unVal;
+    src._type = OT_NULL;
+    src._unVal.raw = 0;
+}
+
+//stores 'o' in a node part, without a reference if the part is weak
+void SQTable::_Store(SQObjectPtr &slot,const SQObjectPtr &o,SQInteger part)
+{
+    SQObjectPtr old;
+    _Forget(slot,part,old);
+    if(_IsWeak(o,part)) {
+#ifndef NO_GARBAGE_COLLECTOR
+        _refcounted(o)->_uiRef|=WEAK_FLAG;
+#endif
+        slot._type = o._type;
+        slot._unVal = o._unVal;
+    }
+    else {
+        slot = o;
+    }
+}
+
+//empties a node part; the reference of a strong part goes to 'owned' (empty), so that the
+//caller decides when it is released
+void SQTable::_Forget(SQObjectPtr &slot,SQInteger part,SQObjectPtr &owned)
+{
+    if(_IsWeak(slot,part)) {
+        slot._type = OT_NULL;
+        slot._unVal.raw = 0;
+    }
+    else {
+        _movepart(owned,slot);
+    }
+}
+
+//removes an entry leaving its references in 'garbage', no rehash
+void SQTable::_RemoveNode(_HashNode *n,SQObjectPtrVec &garbage)
+{
+    SQObjectPtr k,v;
+    _Forget(n->key,SQ_WEAK_KEYS,k);
+    _Forget(n->val,SQ_WEAK_VALUES,v);
+    if(ISREFCOUNTED(sq_type(k))) garbage.push_back(k);
+    if(ISREFCOUNTED(sq_type(v))) garbage.push_back(v);
+    _usednodes--;
+}
+
 void SQTable::Remove(const SQObjectPtr &key)
 {
 
     _HashNode *n = _Get(key, HashObj(key) & (_numofnodes - 1));
     if (n) {
-        n->val.Null();
-        n->key.Null();
+        SQObjectPtr k,v;
+        _Forget(n->val,SQ_WEAK_VALUES,v);
+        _Forget(n->key,SQ_WEAK_KEYS,k);
         _usednodes--;
         Rehash(false);
     }
@@ -32,7 +102,7 @@ void SQTable::Remove(const SQObjectPtr &key)
 
 void SQTable::AllocNodes(SQInteger nSize)
 {
-    _HashNode *nodes=(_HashNode *)SQ_MALLOC(sizeof(_HashNode)*nSize);
+    _HashNode *nodes=(_HashNode *)SQ_MALLOC_CAT(sizeof(_HashNode)*nSize,SQ_MEM_TABLE);
     for(SQInteger i=0;i<nSize;i++){
         _HashNode &n = nodes[i];
         new (&n) _HashNode;
@@ -65,14 +135,24 @@ void SQTable::Rehash(bool force)
         if (sq_type(old->key) != OT_NULL)
             NewSlot(old->key,old->val);
     }
-    for(SQInteger k=0;k<oldsize;k++)
-        nold[k].~_HashNode();
-    SQ_FREE(nold,oldsize*sizeof(_HashNode));
+    //the new nodes took their own references
+    SQObjectPtr k,v;
+    for(SQInteger i=0;i<oldsize;i++) {
+        _Forget(nold[i].key,SQ_WEAK_KEYS,k);
+        _Forget(nold[i].val,SQ_WEAK_VALUES,v);
+        k.Null();
+        v.Null();
+        nold[i].~_HashNode();
+    }
+    SQ_FREE_CAT(nold,oldsize*sizeof(_HashNode),SQ_MEM_TABLE);
 }
 
 SQTable *SQTable::Clone()
 {
     SQTable *nt=Create(_opt_ss(this),_numofnodes);
+#ifndef NO_GARBAGE_COLLECTOR
+    nt->SetWeakMode(_weakmode);
+#endif
 #ifdef _FAST_CLONE
     _HashNode *basesrc = _nodes;
     _HashNode *basedst = nt->_nodes;
@@ -80,8 +160,8 @@ SQTable *SQTable::Clone()
     _HashNode *dst = nt->_nodes;
     SQInteger n = 0;
     for(n = 0; n < _numofnodes; n++) {
-        dst->key = src->key;
-        dst->val = src->val;
+        nt->_Store(dst->key,src->key,SQ_WEAK_KEYS);
+        nt->_Store(dst->val,src->val,SQ_WEAK_VALUES);
         if(src->next) {
             assert(src->next > basesrc);
             dst->next = basedst + (src->next - basesrc);
@@ -119,10 +199,11 @@ bool SQTable::Get(const SQObjectPtr &key,SQObjectPtr &val)
 bool SQTable::NewSlot(const SQObjectPtr &key,const SQObjectPtr &val)
 {
     assert(sq_type(key) != OT_NULL);
+    SQ_GC_BARRIER(this);
     SQHash h = HashObj(key) & (_numofnodes - 1);
     _HashNode *n = _Get(key, h);
     if (n) {
-        n->val = val;
+        _Store(n->val,val,SQ_WEAK_VALUES);
         return false;
     }
     _HashNode *mp = &_nodes[h];
@@ -144,11 +225,9 @@ bool SQTable::NewSlot(const SQObjectPtr &key,const SQObjectPtr &val)
                 othern = othern->next;  /* find previous */
             }
             othern->next = n;  /* redo the chain with `n' in place of `mp' */
-            n->key = mp->key;
-            n->val = mp->val;/* copy colliding node into free pos. (mp->next also goes) */
+            _movepart(n->key,mp->key);
+            _movepart(n->val,mp->val);/* copy colliding node into free pos. (mp->next also goes) */
             n->next = mp->next;
-            mp->key.Null();
-            mp->val.Null();
             mp->next = NULL;  /* now `mp' is free */
         }
         else{
@@ -158,11 +237,11 @@ bool SQTable::NewSlot(const SQObjectPtr &key,const SQObjectPtr &val)
             mp = n;
         }
     }
-    mp->key = key;
+    _Store(mp->key,key,SQ_WEAK_KEYS);
 
     for (;;) {  /* correct `firstfree' */
         if (sq_type(_firstfree->key) == OT_NULL && _firstfree->next == NULL) {
-            mp->val = val;
+            _Store(mp->val,val,SQ_WEAK_VALUES);
             _usednodes++;
             return true;  /* OK; table still has a free place */
         }
@@ -196,7 +275,8 @@ bool SQTable::Set(const SQObjectPtr &key, const SQObjectPtr &val)
 {
     _HashNode *n = _Get(key, HashObj(key) & (_numofnodes - 1));
     if (n) {
-        n->val = val;
+        SQ_GC_BARRIER(this);
+        _Store(n->val,val,SQ_WEAK_VALUES);
         return true;
     }
     return false;
@@ -204,7 +284,12 @@ bool SQTable::Set(const SQObjectPtr &key, const SQObjectPtr &val)
 
 void SQTable::_ClearNodes()
 {
-    for(SQInteger i = 0;i < _numofnodes; i++) { _HashNode &n = _nodes[i]; n.key.Null(); n.val.Null(); }
+    for(SQInteger i = 0;i < _numofnodes; i++) {
+        _HashNode &n = _nodes[i];
+        SQObjectPtr k,v;
+        _Forget(n.key,SQ_WEAK_KEYS,k);
+        _Forget(n.val,SQ_WEAK_VALUES,v);
+    }
 }
 
 void SQTable::Finalize()
@@ -219,3 +304,88 @@ void SQTable::Clear()
     _usednodes = 0;
     Rehash(true);
 }
+
+#ifndef NO_GARBAGE_COLLECTOR
+//the parts becoming strong get their reference back, the ones becoming weak give it up:
+//what only this table kept alive is freed and leaves the table
+void SQTable::SetWeakMode(SQInteger mode)
+{
+    mode &= (SQ_WEAK_KEYS|SQ_WEAK_VALUES);
+    if(mode == _weakmode) return;
+    SQ_GC_BARRIER(this);
+    if(!_weakmode) _sharedstate->AddWeakTable(this);
+    else if(!mode) _sharedstate->RemoveWeakTable(this);
+    SQInteger oldmode = _weakmode;
+    SQObjectPtrVec owned;
+    for(SQInteger i = 0; i < _numofnodes; i++) {
+        _HashNode &n = _nodes[i];
+        SQObjectPtr *parts[2] = { &n.key, &n.val };
+        for(SQInteger p = 0; p < 2; p++) {
+            SQObjectPtr &o = *parts[p];
+            SQInteger part = p ? SQ_WEAK_VALUES : SQ_WEAK_KEYS;
+            if(!_isweakable(sq_type(o)) || (oldmode&part) == (mode&part)) continue;
+            if(oldmode&part) {
+                _refcounted(o)->_uiRef++;
+            }
+            else {
+                owned.push_back(o);
+                _refcounted(o)->_uiRef=(_refcounted(o)->_uiRef-1)|WEAK_FLAG;
+            }
+        }
+    }
+    _weakmode = mode;
+}
+
+//marks the values whose weak key was found alive, returns true if something was marked
+bool SQTable::MarkEphemerons(SQCollectable **chain)
+{
+    bool marked = false;
+    for(SQInteger i = 0; i < _numofnodes; i++) {
+        _HashNode &n = _nodes[i];
+        if(!_IsWeak(n.key,SQ_WEAK_KEYS) || !(_refcounted(n.key)->_uiRef&MARK_FLAG)) continue;
+        if(!_isweakable(sq_type(n.val)) || _IsWeak(n.val,SQ_WEAK_VALUES) || (_refcounted(n.val)->_uiRef&MARK_FLAG)) continue;
+        SQSharedState::MarkObject(n.val,chain);
+        marked = true;
+    }
+    return marked;
+}
+
+//removes the entries whose weak part was not marked, before the sweep frees it
+void SQTable::ClearUnmarked(SQObjectPtrVec &garbage)
+{
+    for(SQInteger i = 0; i < _numofnodes; i++) {
+        _HashNode &n = _nodes[i];
+        bool dead = false;
+        if(_IsWeak(n.key,SQ_WEAK_KEYS) && !(_refcounted(n.key)->_uiRef&MARK_FLAG)) {
+            _refcounted(n.key)->_uiRef&=~WEAK_FLAG;
+            dead = true;
+        }
+        if(_IsWeak(n.val,SQ_WEAK_VALUES) && !(_refcounted(n.val)->_uiRef&MARK_FLAG)) {
+            _refcounted(n.val)->_uiRef&=~WEAK_FLAG;
+            dead = true;
+        }
+        if(dead) _RemoveNode(&n,garbage);
+    }
+}
+
+//removes the entries referring weakly to 'obj', that is being freed. A weak key is found by
+//its hash, weak values need a scan of the table
+void SQTable::ClearWeak(SQRefCounted *obj,SQObjectPtrVec &garbage)
+{
+    if(_weakmode&SQ_WEAK_KEYS) {
+        _HashNode *n = &_nodes[hashptr(obj) & (_numofnodes - 1)];
+        do{
+            if(_IsWeak(n->key,SQ_WEAK_KEYS) && _refcounted(n->key) == obj) {
+                _RemoveNode(n,garbage);
+                break;
+            }
+        }while((n = n->next));
+    }
+    if(_weakmode&SQ_WEAK_VALUES) {
+        for(SQInteger i = 0; i < _numofnodes; i++) {
+            _HashNode &n = _nodes[i];
+            if(_IsWeak(n.val,SQ_WEAK_VALUES) && _refcounted(n.val) == obj) _RemoveNode(&n,garbage);
+        }
+    }
+}
+#endif
@@ -24,6 +24,10 @@ inline SQHash HashObj(const SQObject &key)
     }
 }
 
+//objects held without a reference by the weak parts of a table
+#define _isweakable(t) (_RAW_TYPE(t)&(_RT_TABLE|_RT_ARRAY|_RT_USERDATA|_RT_CLOSURE|_RT_NATIVECLOSURE| \
+        _RT_GENERATOR|_RT_THREAD|_RT_CLASS|_RT_INSTANCE))
+
 struct SQTable : public SQDelegable
 {
 private:
@@ -38,33 +42,38 @@ private:
     _HashNode *_nodes;
     SQInteger _numofnodes;
     SQInteger _usednodes;
+    //SQ_WEAK_KEYS|SQ_WEAK_VALUES, the weak parts of the nodes don't own a reference
+    SQInteger _weakmode;
 
 ///////////////////////////
     void AllocNodes(SQInteger nSize);
     void Rehash(bool force);
     SQTable(SQSharedState *ss, SQInteger nInitialSize);
     void _ClearNodes();
+    inline bool _IsWeak(const SQObject &o,SQInteger part) { return (_weakmode&part) && _isweakable(sq_type(o)); }
+    void _Store(SQObjectPtr &slot,const SQObjectPtr &o,SQInteger part);
+    void _Forget(SQObjectPtr &slot,SQInteger part,SQObjectPtr &owned);
+    void _RemoveNode(_HashNode *n,SQObjectPtrVec &garbage);
 public:
     static SQTable* Create(SQSharedState *ss,SQInteger nInitialSize)
     {
-        SQTable *newtable = (SQTable*)SQ_MALLOC(sizeof(SQTable));
+        SQTable *newtable = (SQTable*)SQ_MALLOC_CAT(sizeof(SQTable),SQ_MEM_TABLE);
         new (newtable) SQTable(ss, nInitialSize);
         newtable->_delegate = NULL;
         return newtable;
     }
     void Finalize();
     SQTable *Clone();
-    ~SQTable()
-    {
-        SetDelegate(NULL);
-        REMOVE_FROM_CHAIN(&_sharedstate->_gc_chain, this);
-        for (SQInteger i = 0; i < _numofnodes; i++) _nodes[i].~_HashNode();
-        SQ_FREE(_nodes, _numofnodes * sizeof(_HashNode));
-    }
+    ~SQTable();
 #ifndef NO_GARBAGE_COLLECTOR
-    void Mark(SQCollectable **chain);
+    void MarkChildren(SQCollectable **chain);
     SQObjectType GetType() {return OT_TABLE;}
+    void SetWeakMode(SQInteger mode);
+    bool MarkEphemerons(SQCollectable **chain);
+    void ClearUnmarked(SQObjectPtrVec &garbage);
+    void ClearWeak(SQRefCounted *obj,SQObjectPtrVec &garbage);
 #endif
+    SQInteger GetWeakMode() { return _weakmode; }
     inline _HashNode *_Get(const SQObjectPtr &key,SQHash hash)
     {
         _HashNode *n = &_nodes[hash];
@@ -104,7 +113,8 @@ public:
     void Clear();
     void Release()
     {
-        sq_delete(this, SQTable);
+        this->~SQTable();
+        SQ_FREE_CAT(this, sizeof(SQTable), SQ_MEM_TABLE);
     }
 
 };
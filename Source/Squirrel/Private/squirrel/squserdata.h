@@ -12,14 +12,14 @@ struct SQUserData : SQDelegable
     }
     static SQUserData* Create(SQSharedState *ss, SQInteger size)
     {
-        SQUserData* ud = (SQUserData*)SQ_MALLOC(sq_aligning(sizeof(SQUserData))+size);
+        SQUserData* ud = (SQUserData*)SQ_MALLOC_CAT(sq_aligning(sizeof(SQUserData))+size,SQ_MEM_USERDATA);
         new (ud) SQUserData(ss);
         ud->_size = size;
         ud->_typetag = 0;
         return ud;
     }
 #ifndef NO_GARBAGE_COLLECTOR
-    void Mark(SQCollectable **chain);
+    void MarkChildren(SQCollectable **chain);
     void Finalize(){SetDelegate(NULL);}
     SQObjectType GetType(){ return OT_USERDATA;}
 #endif
@@ -27,7 +27,7 @@ struct SQUserData : SQDelegable
         if (_hook) _hook((SQUserPointer)sq_aligning(this + 1),_size);
         SQInteger tsize = _size;
         this->~SQUserData();
-        SQ_FREE(this, sq_aligning(sizeof(SQUserData)) + tsize);
+        SQ_FREE_CAT(this, sq_aligning(sizeof(SQUserData)) + tsize, SQ_MEM_USERDATA);
     }
 
 
@@ -6,14 +6,94 @@ void *sq_vm_malloc(SQUnsignedInteger size);
 void *sq_vm_realloc(void *p,SQUnsignedInteger oldsize,SQUnsignedInteger size);
 void sq_vm_free(void *p,SQUnsignedInteger size);
 
-#define sq_new(__ptr,__type) {__ptr=(__type *)sq_vm_malloc(sizeof(__type));new (__ptr) __type;}
-#define sq_delete(__ptr,__type) {__ptr->~__type();sq_vm_free(__ptr,sizeof(__type));}
-#define SQ_MALLOC(__size) sq_vm_malloc((__size));
-#define SQ_FREE(__ptr,__size) sq_vm_free((__ptr),(__size));
-#define SQ_REALLOC(__ptr,__oldsize,__size) sq_vm_realloc((__ptr),(__oldsize),(__size));
+struct SQVM;
+struct SQFunctionProto;
+
+//allocation profiler (sq_startallocprofiler): an open addressing map of (function,line)
+//to sampled bytes. It lives outside the accounted memory and holds a ref to the functions
+struct SQAllocSite
+{
+    SQFunctionProto *_func; //NULL for allocations made outside script code
+    SQInteger _line;
+    SQUnsignedInteger _bytes;
+    SQUnsignedInteger _count;
+};
+
+struct SQAllocProfile
+{
+    static SQUnsignedInteger Hash(SQFunctionProto *func,SQInteger line) { return (((SQUnsignedInteger)func) >> 4) * 31 + (SQUnsignedInteger)line; }
+    SQUnsignedInteger _rate;
+    SQUnsignedInteger _left;
+    SQAllocSite *_sites;
+    SQUnsignedInteger _numsites;
+    SQUnsignedInteger _capacity;
+};
+
+//memory bookkeeping of a shared state: its allocator, the live bytes per SQ_MEM_* category,
+//the limit, the allocation debt of the automatic collection and the allocation profiler.
+//Every entry of the api binds the context of the state it works on to the calling thread for
+//the duration of the call (SQMemScope), and every SQ_MALLOC is charged to the bound context.
+//The limit is checked at the safe points of the vms and before the large allocations
+//(array(), resize(), sq_checkmemorylimit), so a state can go past it by at most one object
+struct SQMemContext
+{
+    const SQAllocator *_allocator;
+    SQUnsignedInteger _bytes[SQ_MEM_CATEGORIES];
+    SQUnsignedInteger _total;
+    SQUnsignedInteger _peak;
+    SQUnsignedInteger _limit;
+    SQUnsignedInteger _nextlimit;
+    bool _overlimit;
+    //allocation debt of the state: _gcdue is set when _total goes past _gcthreshold and
+    //the safe points of the vms of this state only run SQSharedState::GCAutoStep
+    SQUnsignedInteger _gcthreshold;
+    bool _gcdue;
+    SQAllocProfile *_profile;
+    SQVM *_runningvm;
+    //SQVM::Execute frames active on the vms of the state
+    SQInteger _nesting;
+};
+//bytes a state may allocate past its limit before the error is raised again,
+//so that error handlers and catch blocks have room to run
+#ifndef SQ_MEM_LIMIT_SLACK
+#define SQ_MEM_LIMIT_SLACK (64*1024)
+#endif
+//memory context bound to the calling thread, NULL outside of the api
+extern thread_local SQMemContext *_sq_memctx;
+//binds a context for the lifetime of the scope and restores the previous one, so that a
+//native function working on a vm of another state doesn't leave that state bound
+struct SQMemScope
+{
+    SQMemScope(SQMemContext *ctx) { _prev = _sq_memctx; _sq_memctx = ctx; }
+    ~SQMemScope() { _sq_memctx = _prev; }
+    SQMemContext *_prev;
+};
+void *sq_mem_malloc(SQUnsignedInteger size,SQInteger cat);
+void *sq_mem_realloc(void *p,SQUnsignedInteger oldsize,SQUnsignedInteger size,SQInteger cat);
+void sq_mem_free(void *p,SQUnsignedInteger size,SQInteger cat);
+
+#define sq_new(__ptr,__type) {__ptr=(__type *)sq_mem_malloc(sizeof(__type),SQ_MEM_OTHER);new (__ptr) __type;}
+#define sq_delete(__ptr,__type) {__ptr->~__type();sq_mem_free(__ptr,sizeof(__type),SQ_MEM_OTHER);}
+#define SQ_MALLOC(__size) sq_mem_malloc((__size),SQ_MEM_OTHER);
+#define SQ_FREE(__ptr,__size) sq_mem_free((__ptr),(__size),SQ_MEM_OTHER);
+#define SQ_REALLOC(__ptr,__oldsize,__size) sq_mem_realloc((__ptr),(__oldsize),(__size),SQ_MEM_OTHER);
+#define SQ_MALLOC_CAT(__size,__cat) sq_mem_malloc((__size),(__cat))
+#define SQ_FREE_CAT(__ptr,__size,__cat) sq_mem_free((__ptr),(__size),(__cat))
+#define SQ_REALLOC_CAT(__ptr,__oldsize,__size,__cat) sq_mem_realloc((__ptr),(__oldsize),(__size),(__cat))
 
 #define sq_aligning(v) (((size_t)(v) + (SQ_ALIGNMENT-1)) & (~(SQ_ALIGNMENT-1)))
 
+//sqvector capacity policy: the capacity a full vector grows to, and the fill ratio
+//(size <= capacity/SQ_VECTOR_SHRINK_RATIO) under which shrink() gives memory back.
+//shrink() only halves the excess so that push/pop around the threshold stays amortized
+#ifndef SQ_VECTOR_GROWTH
+#define SQ_VECTOR_GROWTH(capacity) ((capacity) * 2)
+#endif
+#ifndef SQ_VECTOR_SHRINK_RATIO
+#define SQ_VECTOR_SHRINK_RATIO 4
+#endif
+#define SQ_VECTOR_MIN_CAPACITY 4
+
 //sqvector mini vector class, supports objects by value
 template<typename T> class sqvector
 {
@@ -47,14 +127,14 @@ public:
         if(_allocated) {
             for(SQUnsignedInteger i = 0; i < _size; i++)
                 _vals[i].~T();
-            SQ_FREE(_vals, (_allocated * sizeof(T)));
+            SQ_FREE_CAT(_vals, (_allocated * sizeof(T)), SQ_MEM_VECTOR);
         }
     }
     void reserve(SQUnsignedInteger newsize) { _realloc(newsize); }
     void resize(SQUnsignedInteger newsize, const T& fill = T())
     {
         if(newsize > _allocated)
-            _realloc(newsize);
+            _realloc(_allocated ? _grown(newsize) : newsize);
         if(newsize > _size) {
             while(_size < newsize) {
                 new ((void *)&_vals[_size]) T(fill);
@@ -69,13 +149,20 @@ public:
         }
     }
     void shrinktofit() { if(_size > 4) { _realloc(_size); } }
+    void shrink()
+    {
+        if(_allocated > SQ_VECTOR_MIN_CAPACITY && _size <= _allocated / SQ_VECTOR_SHRINK_RATIO) {
+            SQUnsignedInteger newsize = SQ_VECTOR_GROWTH(_size);
+            if(newsize < _allocated) _realloc(newsize);
+        }
+    }
     T& top() const { return _vals[_size - 1]; }
     inline SQUnsignedInteger size() const { return _size; }
     bool empty() const { return (_size <= 0); }
     inline T &push_back(const T& val = T())
     {
         if(_allocated <= _size)
-            _realloc(_size * 2);
+            _realloc(_grown(_size + 1));
         return *(new ((void *)&_vals[_size++]) T(val));
     }
     inline void pop_back()
@@ -84,17 +171,22 @@ public:
     }
     void insert(SQUnsignedInteger idx, const T& val)
     {
-        resize(_size + 1);
-        for(SQUnsignedInteger i = _size - 1; i > idx; i--) {
-            _vals[i] = _vals[i - 1];
+        T temp(val); //val may live in the buffer that is about to move
+        if(_allocated <= _size)
+            _realloc(_grown(_size + 1));
+        if(idx < _size) {
+            //the elements are relocated bytewise like _realloc does, none of the types stored in
+            //a sqvector points into itself; the void* casts tell the compiler it is intended
+            memmove((void *)&_vals[idx+1], (const void *)&_vals[idx], sizeof(T) * (_size - idx));
         }
-        _vals[idx] = val;
+        new ((void *)&_vals[idx]) T(temp);
+        _size++;
     }
     void remove(SQUnsignedInteger idx)
     {
         _vals[idx].~T();
         if(idx < (_size - 1)) {
-            memmove(&_vals[idx], &_vals[idx+1], sizeof(T) * (_size - idx - 1));
+            memmove((void *)&_vals[idx], (const void *)&_vals[idx+1], sizeof(T) * (_size - idx - 1));
         }
         _size--;
     }
@@ -103,10 +195,16 @@ public:
     inline T& operator[](SQUnsignedInteger pos) const{ return _vals[pos]; }
     T* _vals;
 private:
+    SQUnsignedInteger _grown(SQUnsignedInteger minsize) const
+    {
+        SQUnsignedInteger newsize = SQ_VECTOR_GROWTH(_allocated);
+        if(newsize < minsize) newsize = minsize;
+        return newsize > SQ_VECTOR_MIN_CAPACITY ? newsize : SQ_VECTOR_MIN_CAPACITY;
+    }
     void _realloc(SQUnsignedInteger newsize)
     {
-        newsize = (newsize > 0)?newsize:4;
-        _vals = (T*)SQ_REALLOC(_vals, _allocated * sizeof(T), newsize * sizeof(T));
+        newsize = (newsize > 0)?newsize:SQ_VECTOR_MIN_CAPACITY;
+        _vals = (T*)SQ_REALLOC_CAT(_vals, _allocated * sizeof(T), newsize * sizeof(T), SQ_MEM_VECTOR);
         _allocated = newsize;
     }
     SQUnsignedInteger _size;
@@ -131,6 +131,9 @@ SQVM::SQVM(SQSharedState *ss)
     ci = NULL;
     _releasehook = NULL;
     INIT_CHAIN();ADD_TO_CHAIN(&_ss(this)->_gc_chain,this);
+#ifndef NO_GARBAGE_COLLECTOR
+    SQCollectable::_sharedstate = ss;
+#endif
 }
 
 void SQVM::Finalize()
@@ -383,6 +386,7 @@ bool SQVM::Init(SQVM *friendvm, SQInteger stacksize)
 bool SQVM::StartCall(SQClosure *closure,SQInteger target,SQInteger args,SQInteger stackbase,bool tailcall)
 {
     SQFunctionProto *func = closure->_function;
+    if(_ss(this)->_memctx._overlimit) { Raise_MemoryLimitError(); return false; }
 
     SQInteger paramssize = func->_nparameters;
     const SQInteger newtop = stackbase + func->_stacksize;
@@ -590,6 +594,12 @@ bool SQVM::FOREACH_OP(SQObjectPtr &o1,SQObjectPtr &o2,SQObjectPtr
 #define SQ_THROW() { goto exception_trap; }
 
 #define _GUARD(exp) { if(!exp) { SQ_THROW();} }
+//the automatic collection runs between two instructions, where the objects in use are on the stacks
+#ifndef NO_GARBAGE_COLLECTOR
+#define SQ_GC_SAFEPOINT() { if(_ss(this)->_memctx._gcdue) _ss(this)->GCAutoStep(this); }
+#else
+#define SQ_GC_SAFEPOINT()
+#endif
 
 bool SQVM::CLOSURE_OP(SQObjectPtr &target, SQFunctionProto *func,SQInteger boundtarget)
 {
@@ -656,6 +666,7 @@ bool SQVM::CLASS_OP(SQObjectPtr &target,SQInteger baseclass,SQInteger attributes
         }
         Pop(nparams);
     }
+    SQ_GC_BARRIER(_class(target));
     _class(target)->_attributes = attrs;
     return true;
 }
@@ -702,6 +713,7 @@ bool SQVM::Execute(SQObjectPtr &closure, SQInteger nargs, SQInteger stackbase,SQ
     if ((_nnativecalls + 1) > MAX_NATIVE_CALLS) { Raise_Error(_SC("Native stack overflow")); return false; }
     _nnativecalls++;
     AutoDec ad(&_nnativecalls);
+    AutoRunningVM arv(&_ss(this)->_memctx,this);
     SQInteger traps = 0;
     CallInfo *prevci = ci;
 
@@ -766,6 +778,7 @@ exception_restore:
                 }
                               }
             case _OP_CALL: {
+                    SQ_GC_SAFEPOINT();
                     SQObjectPtr clo = STK(arg1);
                     switch (sq_type(clo)) {
                     case OT_CLOSURE:
@@ -902,7 +915,11 @@ exception_restore:
                 continue;
             case _OP_LOADBOOL: TARGET = arg1?true:false; continue;
             case _OP_DMOVE: STK(arg0) = STK(arg1); STK(arg2) = STK(arg3); continue;
-            case _OP_JMP: ci->_ip += (sarg1); continue;
+            case _OP_JMP:
+                ci->_ip += (sarg1);
+                if(_ss(this)->_memctx._overlimit) { Raise_MemoryLimitError(); SQ_THROW(); }
+                SQ_GC_SAFEPOINT();
+                continue;
             //case _OP_JNZ: if(!IsFalse(STK(arg0))) ci->_ip+=(sarg1); continue;
             case _OP_JCMP:
                 _GUARD(CMP_OP((CmpOP)arg3,STK(arg2),STK(arg0),temp_reg));
@@ -990,7 +1007,9 @@ exception_restore:
 
                         } continue;
             case _OP_CMP:   _GUARD(CMP_OP((CmpOP)arg3,STK(arg2),STK(arg1),TARGET))  continue;
-            case _OP_EXISTS: TARGET = Get(STK(arg1), STK(arg2), temp_reg, GET_FLAG_DO_NOT_RAISE_ERROR | GET_FLAG_RAW, DONT_FALL_BACK) ? true : false; continue;
+            case _OP_EXISTS:
+                if(sq_type(STK(arg1)) == OT_ARRAY) { TARGET = _array(STK(arg1))->Contains(STK(arg2)); continue; }
+                TARGET = Get(STK(arg1), STK(arg2), temp_reg, GET_FLAG_DO_NOT_RAISE_ERROR | GET_FLAG_RAW, DONT_FALL_BACK) ? true : false; continue;
             case _OP_INSTANCEOF:
                 if(sq_type(STK(arg1)) != OT_CLASS)
                 {Raise_Error(_SC("cannot apply instanceof between a %s and a %s"),GetTypeName(STK(arg1)),GetTypeName(STK(arg2))); SQ_THROW();}
@@ -1238,6 +1257,11 @@ bool SQVM::CallNative(SQNativeClosure *nclosure, SQInteger nargs, SQInteger newb
         Raise_Error(_lasterror);
         return false;
     }
+    else if (_ss(this)->_memctx._overlimit) {
+        LeaveFrame();
+        Raise_MemoryLimitError();
+        return false;
+    }
     if(ret) {
         retval = _stack._vals[_top-1];
     }
@@ -1388,8 +1412,17 @@ bool SQVM::Set(const SQObjectPtr &self,const SQObjectPtr &key,const SQObjectPtr
     case OT_TABLE:
         if(_table(self)->Set(key,val)) return true;
         break;
-    case OT_INSTANCE:
+    case OT_INSTANCE: {
         if(_instance(self)->Set(key,val)) return true;
+        SQObjectPtr idx;
+        SQInstance *inst = _instance(self);
+        if(inst->_class->_members->Get(key,idx) && _isnativefield(idx)) {
+            if(!inst->_userpointer) Raise_Error(_SC("the instance has no native object"));
+            else if(inst->_class->_defaultvalues[_member_idx(idx)].native & NATIVE_FIELD_READONLY) Raise_Error(_SC("the native field is read only"));
+            else Raise_Error(_SC("cannot assign a %s to a native field"),GetTypeName(val));
+            return false;
+        }
+        }
         break;
     case OT_ARRAY:
         if(!sq_isnumeric(key)) { Raise_Error(_SC("indexing %s with %s"),GetTypeName(self),GetTypeName(key)); return false; }
@@ -1683,6 +1716,19 @@ void SQVM::FindOuter(SQObjectPtr &target, SQObjectPtr *stackindex)
 
 bool SQVM::EnterFrame(SQInteger newbase, SQInteger newtop, bool tailcall)
 {
+    //checked before the frame is pushed: on failure the caller still pops its own arguments
+    if(newtop + MIN_STACK_OVERHEAD > (SQInteger)_stack.size()) {
+        if(_nmetamethodscall) {
+            Raise_Error(_SC("stack overflow, cannot resize stack while in a metamethod"));
+            return false;
+        }
+        //the headroom grows with the stack, at least the fixed one: a metamethod called
+        //later cannot resize it
+        SQInteger headroom = (SQInteger)_stack.size() >> 1;
+        if(headroom < (MIN_STACK_OVERHEAD << 2)) headroom = MIN_STACK_OVERHEAD << 2;
+        _stack.resize(newtop + headroom);
+        RelocateOuters();
+    }
     if( !tailcall ) {
         if( _callsstacksize == _alloccallsstacksize ) {
             GrowCallStack();
@@ -1701,14 +1747,6 @@ bool SQVM::EnterFrame(SQInteger newbase, SQInteger newtop, bool tailcall)
 
     _stackbase = newbase;
     _top = newtop;
-    if(newtop + MIN_STACK_OVERHEAD > (SQInteger)_stack.size()) {
-        if(_nmetamethodscall) {
-            Raise_Error(_SC("stack overflow, cannot resize stack while in a metamethod"));
-            return false;
-        }
-        _stack.resize(newtop + (MIN_STACK_OVERHEAD << 2));
-        RelocateOuters();
-    }
     return true;
 }
 
@@ -89,6 +89,8 @@ public:
     void Raise_IdxError(const SQObjectPtr &o);
     void Raise_CompareError(const SQObject &o1, const SQObject &o2);
     void Raise_ParamTypeError(SQInteger nparam,SQInteger typemask,SQInteger type);
+    void Raise_MemoryLimitError();
+    bool CanAllocate(SQUnsignedInteger size);
 
     void FindOuter(SQObjectPtr &target, SQObjectPtr *stackindex);
     void RelocateOuters();
@@ -115,7 +117,7 @@ public:
 #endif
 
 #ifndef NO_GARBAGE_COLLECTOR
-    void Mark(SQCollectable **chain);
+    void MarkChildren(SQCollectable **chain);
     SQObjectType GetType() {return OT_THREAD;}
 #endif
     void Finalize();
@@ -185,6 +187,16 @@ struct AutoDec{
     SQInteger *_n;
 };
 
+//also binds the context of the state, so a vm entered from a finalizer or a native function
+//of another state charges its allocations and its gc debt to its own state
+struct AutoRunningVM{
+    AutoRunningVM(SQMemContext *c,SQVM *v) : _scope(c) { _c = c; _prev = c->_runningvm; c->_runningvm = v; c->_nesting++; }
+    ~AutoRunningVM() { _c->_runningvm = _prev; _c->_nesting--; }
+    SQMemScope _scope;
+    SQMemContext *_c;
+    SQVM *_prev;
+};
+
 inline SQObjectPtr &stack_get(HSQUIRRELVM v,SQInteger idx){return ((idx>=0)?(v->GetAt(idx+v->_stackbase-1)):(v->GetUp(idx)));}
 
 #define _ss(_vm_) (_vm_)->_sharedstate
@@ -65,7 +65,7 @@ namespace ssq {
             sq_setreleasehook(vm, -2 -off, &detail::classDestructor<T>);
 
             sq_getclass(vm, -2 -off);
-            sq_settypetag(vm, -1, reinterpret_cast<SQUserPointer>(typeid(T*).hash_code()));
+            sq_settypetag(vm, -1, typeTag<T>());
             sq_pop(vm, 1); // Pop class
             return nparams;
         }
@@ -82,11 +82,83 @@ namespace ssq {
             sq_setinstanceup(vm, -2 -off, p);
 
             sq_getclass(vm, -2 -off);
-            sq_settypetag(vm, -1, reinterpret_cast<SQUserPointer>(typeid(T*).hash_code()));
+            sq_settypetag(vm, -1, typeTag<T>());
             sq_pop(vm, 1); // Pop class
             return nparams;
         }
 
+        template<class T, class... Args, size_t... Is>
+        static void callInlineConstructor(HSQUIRRELVM vm, SQUserPointer storage, index_list<Is...>) {
+            new (storage) T(detail::pop<Args>(vm, Is + 2)...);
+        }
+
+        // the object is constructed in the user data of the instance (see Class::InlineCtor)
+        template<class T, class... Args>
+        static SQInteger inlineClassAllocator(HSQUIRRELVM vm) {
+            try {
+                SQUserPointer storage;
+                sq_getinstanceup(vm, 1, &storage, nullptr);
+                if (sq_getreleasehook(vm, 1)) {
+                    sq_setreleasehook(vm, 1, nullptr);
+                    static_cast<T*>(storage)->~T();
+                }
+
+                callInlineConstructor<T, Args...>(vm, storage, index_range<0, sizeof...(Args)>());
+                sq_setreleasehook(vm, 1, &detail::inlineClassDestructor<T>);
+
+                sq_getclass(vm, 1);
+                sq_settypetag(vm, -1, typeTag<T>());
+                sq_pop(vm, 1); // Pop class
+                return 0;
+            }
+#ifdef SQUNICODE
+            catch (std::exception& e) {
+                return sq_throwerror(vm, UTF8_TO_TCHAR(e.what()));
+            }
+            catch (Exception& e) {
+                return sq_throwerror(vm, *e.what());
+            }
+#else
+            catch (std::exception& e) {
+                return sq_throwerror(vm, e.what());
+            }
+#endif
+        }
+
+        template<class T>
+        static SQInteger inlineClassCopy(HSQUIRRELVM vm, SQUserPointer storage, const T* other, std::true_type) {
+            new (storage) T(*other);
+            sq_setreleasehook(vm, 1, &detail::inlineClassDestructor<T>);
+            return 0;
+        }
+
+        template<class T>
+        static SQInteger inlineClassCopy(HSQUIRRELVM vm, SQUserPointer storage, const T* other, std::false_type) {
+            return sq_throwerror(vm, _SC("the object cannot be cloned"));
+        }
+
+        // _cloned of an inline class: the new instance has storage but no object yet
+        template<class T>
+        static SQInteger inlineClassCloned(HSQUIRRELVM vm) {
+            SQUserPointer storage, other;
+            sq_getinstanceup(vm, 1, &storage, nullptr);
+            if (SQ_FAILED(sq_getinstanceup(vm, 2, &other, nullptr)) || !sq_getreleasehook(vm, 2)) {
+                return 0;
+            }
+            try {
+                return inlineClassCopy<T>(vm, storage, static_cast<const T*>(other), std::is_copy_constructible<T>());
+            }
+#ifdef SQUNICODE
+            catch (std::exception& e) {
+                return sq_throwerror(vm, UTF8_TO_TCHAR(e.what()));
+            }
+#else
+            catch (std::exception& e) {
+                return sq_throwerror(vm, e.what());
+            }
+#endif
+        }
+
         template<class Ret, class... Args>
         static SQInteger funcReleaseHook(SQUserPointer p, SQInteger size) {
             auto funcPtr = reinterpret_cast<FuncPtr<Ret(Args...)>*>(p);
@@ -100,7 +172,7 @@ namespace ssq {
      */
     template<typename T>
     inline T Object::to() const {
-        sq_pushobject(vm, obj);
+        sq_pushobject(vm, handle._obj);
         try {
             auto ret = detail::pop<T>(vm, -1);
             sq_pop(vm, 1);
@@ -3,8 +3,11 @@
 #define SSQ_ARGS_HEADER_H
 
 #include "exceptions.hpp"
+#include "result.hpp"
+#include "stringview.hpp"
 #include <squirrel/squirrel.h>
 #include <iostream>
+#include <new>
 #include <typeinfo>
 #include <vector>
 
@@ -13,11 +16,38 @@ namespace ssq {
     class Enum;
     class VM;
     class SqWeakRef;
+    class String;
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
     namespace detail {
-        SQUIRREL_API SSQ_API void addClassObj(HSQUIRRELVM vm, size_t hashCode, const HSQOBJECT& obj);
-        SQUIRREL_API SSQ_API const HSQOBJECT& getClassObj(HSQUIRRELVM vm, size_t hashCode);
+        // Index of the type of that name in the registry of the plugin, the same in every module
+        SQUIRREL_API SSQ_API size_t registerTypeIndex(const char* name);
+        SQUIRREL_API SSQ_API void addClassObj(HSQUIRRELVM vm, size_t typeIndex, const HSQOBJECT& obj);
+        SQUIRREL_API SSQ_API const HSQOBJECT* findClassObj(HSQUIRRELVM vm, size_t typeIndex);
+        // Throws the runtime error reported by the last failed call of the VM
+        SQUIRREL_API SSQ_API void throwRuntimeError(HSQUIRRELVM vm);
+        // The error left by the last failed call of the VM, without its call stack
+        SQUIRREL_API SSQ_API Error lastError(HSQUIRRELVM vm);
+        // The error of a value at index that cannot be popped
+        SQUIRREL_API SSQ_API Error popError(HSQUIRRELVM vm, SQInteger index);
+        // Raises the error of an argument at index of a bound function that cannot be popped
+        SQUIRREL_API SSQ_API SQInteger throwArgError(HSQUIRRELVM vm, SQInteger index);
+
+        // Dense index of T, the slot of its class object in the VM; starts at 1.
+        // Every module (DLL) has its own copy of the static below, they all get the index
+        // that the registry gave to the name of T, so a class bound in one module is found
+        // by the others. The lookup only runs the first time a module uses T.
+        template<typename T>
+        inline size_t typeIndex() {
+            static const size_t index = registerTypeIndex(typeid(T).name());
+            return index;
+        }
+
+        // Typetag of the classes and userdata bound to T
+        template<typename T>
+        inline SQUserPointer typeTag() {
+            return reinterpret_cast<SQUserPointer>(typeIndex<T>());
+        }
 
         template<class T>
         static SQInteger classDestructor(SQUserPointer ptr, SQInteger size) {
@@ -26,6 +56,12 @@ namespace ssq {
             return 0;
         }
 
+        template<class T>
+        static SQInteger inlineClassDestructor(SQUserPointer ptr, SQInteger size) {
+            static_cast<T*>(ptr)->~T();
+            return 0;
+        }
+
         template<class T>
         static SQInteger classPtrDestructor(SQUserPointer ptr, SQInteger size) {
             T** p = static_cast<T**>(ptr);
@@ -60,7 +96,7 @@ namespace ssq {
             if(type == OT_USERDATA) {
                 sq_getuserdata(vm, index, &ptr, &typetag);
 
-                if(reinterpret_cast<size_t>(typetag) != typeid(T).hash_code()) {
+                if(typetag != typeTag<T>()) {
                     throw TypeException("bad cast", typeid(T).name(), "UNKNOWN");
                 }
 
@@ -71,7 +107,7 @@ namespace ssq {
                 sq_getinstanceup(vm, index, &ptr, &typetag);
                 sq_gettypetag(vm, index, &typetag);
 
-                if(reinterpret_cast<size_t>(typetag) != typeid(T*).hash_code()) {
+                if(typetag != typeTag<T>()) {
                     throw TypeException("bad cast", typeid(T).name(), "UNKNOWN");
                 }
 
@@ -115,7 +151,7 @@ namespace ssq {
         inline Object popValue(HSQUIRRELVM vm, SQInteger index){
             Object val(vm);
             if (SQ_FAILED(sq_getstackobj(vm, index, &val.getRaw()))) throw TypeException("Could not get Object from squirrel stack");
-            sq_addref(vm, &val.getRaw());
+            val.addRef();
             return val;
         }
 
@@ -260,14 +296,14 @@ namespace ssq {
         inline FString popValue(HSQUIRRELVM vm, SQInteger index){
             checkType(vm, index, OT_STRING);
             const SQChar* val;
-            if (SQ_FAILED(sq_getstring(vm, index, &val))) throw TypeException("Could not get string from squirrel stack");
+            SQInteger len;
+            if (SQ_FAILED(sq_getstringandsize(vm, index, &val, &len))) throw TypeException("Could not get string from squirrel stack");
 
             if(val == nullptr)
             {
                 return FString(L""); 
             }
 
-            SQInteger len = sq_getsize(vm,index);    
             return FString(val,len);
         }
 #else
@@ -275,18 +311,27 @@ namespace ssq {
         inline std::string popValue(HSQUIRRELVM vm, SQInteger index){
             checkType(vm, index, OT_STRING);
             const SQChar* val;
-            if (SQ_FAILED(sq_getstring(vm, index, &val))) throw TypeException("Could not get string from squirrel stack");
+            SQInteger len;
+            if (SQ_FAILED(sq_getstringandsize(vm, index, &val, &len))) throw TypeException("Could not get string from squirrel stack");
 
             if(val == nullptr)
             {
                 return std::string(""); 
             }
 
-            SQInteger len = sq_getsize(vm,index);    
             return std::string(val,len);
         }
 #endif
 
+        template<>
+        inline StringView popValue(HSQUIRRELVM vm, SQInteger index){
+            checkType(vm, index, OT_STRING);
+            const SQChar* val;
+            SQInteger len;
+            if (SQ_FAILED(sq_getstringandsize(vm, index, &val, &len))) throw TypeException("Could not get string from squirrel stack");
+            return StringView(val, static_cast<size_t>(len));
+        }
+
         template <typename T> inline typename std::enable_if<!std::is_pointer<T>::value, T>::type
         pop(HSQUIRRELVM vm, SQInteger index) { 
             return popValue<typename std::remove_cv<T>::type>(vm, index); 
@@ -297,23 +342,115 @@ namespace ssq {
             return popPointer<T>(vm, index);
         }
 
+        // Checks, without throwing, that popValue<T> accepts the value at index; once it
+        // did, popValue<T> does not throw for a type mismatch
+        template<typename T, typename Enable = void>
+        struct PopCheck {
+            static bool check(HSQUIRRELVM vm, SQInteger index) {
+                SQObjectType type = sq_gettype(vm, index);
+                SQUserPointer ptr;
+                SQUserPointer typetag = nullptr;
+                if (type == OT_USERDATA) {
+                    sq_getuserdata(vm, index, &ptr, &typetag);
+                }
+                else if (type == OT_INSTANCE) {
+                    sq_gettypetag(vm, index, &typetag);
+                }
+                else {
+                    return false;
+                }
+                return typetag == typeTag<T>();
+            }
+        };
+
+        template<SQObjectType expected>
+        struct PopCheckType {
+            static bool check(HSQUIRRELVM vm, SQInteger index) {
+                return isType(vm, index, expected);
+            }
+        };
+
+        struct PopCheckNumber {
+            static bool check(HSQUIRRELVM vm, SQInteger index) {
+                return isType(vm, index, OT_INTEGER) || isType(vm, index, OT_FLOAT);
+            }
+        };
+
+        struct PopCheckAny {
+            static bool check(HSQUIRRELVM, SQInteger) {
+                return true;
+            }
+        };
+
+        template<> struct PopCheck<Object> : PopCheckAny {};
+        template<> struct PopCheck<bool> : PopCheckType<OT_BOOL> {};
+        template<> struct PopCheck<char> : PopCheckType<OT_INTEGER> {};
+        template<> struct PopCheck<signed char> : PopCheckType<OT_INTEGER> {};
+        template<> struct PopCheck<short> : PopCheckType<OT_INTEGER> {};
+        template<> struct PopCheck<int> : PopCheckType<OT_INTEGER> {};
+        template<> struct PopCheck<long> : PopCheckType<OT_INTEGER> {};
+        template<> struct PopCheck<unsigned char> : PopCheckType<OT_INTEGER> {};
+        template<> struct PopCheck<unsigned short> : PopCheckType<OT_INTEGER> {};
+        template<> struct PopCheck<unsigned int> : PopCheckType<OT_INTEGER> {};
+        template<> struct PopCheck<unsigned long> : PopCheckType<OT_INTEGER> {};
+#ifdef _SQ64
+        template<> struct PopCheck<long long> : PopCheckNumber {};
+        template<> struct PopCheck<unsigned long long> : PopCheckNumber {};
+#endif
+#ifdef SQUSEDOUBLE
+        template<> struct PopCheck<double> : PopCheckNumber {};
+#else
+        template<> struct PopCheck<float> : PopCheckType<OT_FLOAT> {};
+#endif
+#ifdef SQUNICODE
+        template<> struct PopCheck<FString> : PopCheckType<OT_STRING> {};
+#else
+        template<> struct PopCheck<std::string> : PopCheckType<OT_STRING> {};
+#endif
+        template<> struct PopCheck<StringView> : PopCheckType<OT_STRING> {};
+
+        template<typename T> inline typename std::enable_if<!std::is_pointer<T>::value, bool>::type
+        canPop(HSQUIRRELVM vm, SQInteger index) {
+            return PopCheck<typename std::remove_cv<T>::type>::check(vm, index);
+        }
+
+        template<typename T> inline typename std::enable_if<std::is_pointer<T>::value, bool>::type
+        canPop(HSQUIRRELVM vm, SQInteger index) {
+            SQObjectType type = sq_gettype(vm, index);
+            return type == OT_USERPOINTER || type == OT_INSTANCE || type == OT_NULL;
+        }
+
+        // Pops the value at index, returning a type mismatch as an error instead of throwing it
+        template<typename T>
+        inline Result<T> tryPop(HSQUIRRELVM vm, SQInteger index) {
+            if (!canPop<T>(vm, index)) return popError(vm, index);
+            return pop<T>(vm, index);
+        }
+
         template<typename T>
         inline void pushByCopy(HSQUIRRELVM vm, const T& value) {
-            static const auto hashCode = typeid(T*).hash_code();
-            try {
-                sq_pushobject(vm, getClassObj(vm, hashCode));
+            const HSQOBJECT* cls = findClassObj(vm, typeIndex<T>());
+            if (cls) {
+                sq_pushobject(vm, *cls);
                 sq_createinstance(vm, -1);
                 sq_remove(vm, -2);
 
-                sq_setinstanceup(vm, -1, reinterpret_cast<SQUserPointer>(new T(value)));
-                sq_settypetag(vm, -1, reinterpret_cast<SQUserPointer>(hashCode));
-                sq_setreleasehook(vm, -1, classDestructor<T>);
-            } catch (std::out_of_range& e) {
-                (void)e;
+                // classes bound with Class::InlineCtor keep the object in the instance
+                SQUserPointer storage = nullptr;
+                sq_getinstanceup(vm, -1, &storage, nullptr, SQFalse);
+                if (storage) {
+                    new (storage) T(value);
+                    sq_setreleasehook(vm, -1, inlineClassDestructor<T>);
+                } else {
+                    sq_setinstanceup(vm, -1, reinterpret_cast<SQUserPointer>(new T(value)));
+                    sq_setreleasehook(vm, -1, classDestructor<T>);
+                }
+                sq_settypetag(vm, -1, typeTag<T>());
+            } else {
                 T** data = reinterpret_cast<T**>(sq_newuserdata(vm, sizeof(T*)));
                 *data = new T(value);
                 sq_setreleasehook(vm, -1, classPtrDestructor<T>);
-                sq_settypetag(vm, -1, reinterpret_cast<SQUserPointer>(typeid(T).hash_code()));
+                sq_settypetag(vm, -1, typeTag<T>());
             }
         }
 
@@ -330,6 +467,7 @@ namespace ssq {
         SQUIRREL_API SSQ_API void pushRaw(HSQUIRRELVM vm, const Enum& value);
         SQUIRREL_API SSQ_API void pushRaw(HSQUIRRELVM vm, const Array& value);
         SQUIRREL_API SSQ_API void pushRaw(HSQUIRRELVM vm, const SqWeakRef& value);
+        SQUIRREL_API SSQ_API void pushRaw(HSQUIRRELVM vm, const String& value);
 
         template<>
         inline void pushValue(HSQUIRRELVM vm, const std::nullptr_t& value){
@@ -382,6 +520,11 @@ namespace ssq {
             pushRaw(vm, value);
         }
 
+        template<>
+        inline void pushValue(HSQUIRRELVM vm, const String& value){
+            pushRaw(vm, value);
+        }
+
         template<>
         inline void pushValue(HSQUIRRELVM vm, const bool& value) {
             sq_pushbool(vm, value);
@@ -468,24 +611,27 @@ namespace ssq {
         }
 #endif
 
+        template<>
+        inline void pushValue(HSQUIRRELVM vm, const StringView& value) {
+            sq_pushstring(vm, value.data(), static_cast<SQInteger>(value.size()));
+        }
+
         template<typename T>
         inline void pushByPtr(HSQUIRRELVM vm, T* value) {
-            static const auto hashCode = typeid(T*).hash_code();
             if (value == nullptr) {
                 sq_pushnull(vm);
+                return;
+            }
+            const HSQOBJECT* cls = findClassObj(vm, typeIndex<T>());
+            if (cls) {
+                sq_pushobject(vm, *cls);
+                sq_createinstance(vm, -1);
+                sq_remove(vm, -2);
+                sq_setinstanceup(vm, -1, (SQUserPointer)(value));
+                sq_settypetag(vm, -1, typeTag<T>());
             }
             else {
-                try {
-                    sq_pushobject(vm, getClassObj(vm, hashCode));
-                    sq_createinstance(vm, -1);
-                    sq_remove(vm, -2);
-                    sq_setinstanceup(vm, -1, (SQUserPointer)(value));
-                    sq_settypetag(vm, -1, reinterpret_cast<SQUserPointer>(hashCode));
-                }
-                catch (std::out_of_range& e) {
-                    (void)e;
-                    sq_pushuserpointer(vm, (SQUserPointer)(value));
-                }
+                sq_pushuserpointer(vm, (SQUserPointer)(value));
             }
         }
 
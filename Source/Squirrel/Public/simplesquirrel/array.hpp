@@ -8,6 +8,91 @@
 #include <vector>
 
 namespace ssq {
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    namespace detail {
+        // Numbers are copied between the arrays and C++ in bulk, as SQInteger or SQFloat
+        template<typename T, typename Enable = void>
+        struct BulkType {
+            typedef void type;
+        };
+
+        template<typename T>
+        struct BulkType<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type> {
+            typedef SQInteger type;
+        };
+
+        template<typename T>
+        struct BulkType<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+            typedef SQFloat type;
+        };
+
+        template<typename T>
+        struct IsBulk : std::integral_constant<bool, !std::is_void<typename BulkType<T>::type>::value> {};
+
+        inline SQRESULT getBulk(HSQUIRRELVM vm, SQInteger idx, SQInteger start, SQInteger count, SQInteger* dst) {
+            return sq_arraygetintegers(vm, idx, start, count, dst);
+        }
+
+        inline SQRESULT getBulk(HSQUIRRELVM vm, SQInteger idx, SQInteger start, SQInteger count, SQFloat* dst) {
+            return sq_arraygetfloats(vm, idx, start, count, dst);
+        }
+
+        inline SQRESULT setBulk(HSQUIRRELVM vm, SQInteger idx, SQInteger start, SQInteger count, const SQInteger* src) {
+            return sq_arraysetintegers(vm, idx, start, count, src);
+        }
+
+        inline SQRESULT setBulk(HSQUIRRELVM vm, SQInteger idx, SQInteger start, SQInteger count, const SQFloat* src) {
+            return sq_arraysetfloats(vm, idx, start, count, src);
+        }
+
+        static const SQInteger bulkChunk = 256;
+
+        // Reads count numbers of the array at idx, converted to T through a small buffer.
+        // Returns false if an element is not of the exact type, the caller then pops them
+        // one by one to convert or report it
+        template<typename T>
+        inline bool readBulk(HSQUIRRELVM vm, SQInteger idx, T* dst, SQInteger count) {
+            typename BulkType<T>::type buf[bulkChunk];
+            for (SQInteger start = 0; start < count; start += bulkChunk) {
+                SQInteger n = count - start < bulkChunk ? count - start : bulkChunk;
+                if (SQ_FAILED(getBulk(vm, idx, start, n, buf))) {
+                    sq_reseterror(vm);
+                    return false;
+                }
+                for (SQInteger i = 0; i < n; i++) dst[start + i] = static_cast<T>(buf[i]);
+            }
+            return true;
+        }
+
+        // Writes count numbers to the array at idx, which must be large enough
+        template<typename T>
+        inline void writeBulk(HSQUIRRELVM vm, SQInteger idx, const T* src, SQInteger count) {
+            typename BulkType<T>::type buf[bulkChunk];
+            for (SQInteger start = 0; start < count; start += bulkChunk) {
+                SQInteger n = count - start < bulkChunk ? count - start : bulkChunk;
+                for (SQInteger i = 0; i < n; i++) buf[i] = static_cast<typename BulkType<T>::type>(src[start + i]);
+                setBulk(vm, idx, start, n, buf);
+            }
+        }
+
+        // Pops the elements of the array on top of the stack one by one, passing them to add
+        template<typename T, typename F>
+        inline void readElements(HSQUIRRELVM vm, SQInteger count, F add) {
+            for (SQInteger i = 0; i < count; i++) {
+                sq_pushinteger(vm, i);
+                if (SQ_FAILED(sq_rawget(vm, -2))) throw TypeException("Failed to get value from the array");
+                try {
+                    add(detail::pop<T>(vm, -1));
+                } catch (...) {
+                    sq_pop(vm, 1);
+                    throw;
+                }
+                sq_pop(vm, 1);
+            }
+        }
+    }
+#endif
+
     /**
     * @brief Squirrel intance of array object
     * @ingroup simplesquirrel
@@ -24,21 +109,26 @@ namespace ssq {
         virtual ~Array() = default;
         /**
         * @brief Constructs array out of std::vector
+        * @details Vectors of numbers are copied in bulk
         */
         template<typename T>
         Array(HSQUIRRELVM vm, const std::vector<T>& vector):Object(vm) {
             sq_newarray(vm, 0);
-            sq_getstackobj(vm, -1, &obj);
-            sq_addref(vm, &obj);
-
-            for(const auto& val : vector) {
-                detail::push(vm, val);
-                if(SQ_FAILED(sq_arrayappend(vm, -2))) {
-                    sq_pop(vm, 2);
-                    throw TypeException("Failed to push value to back of the array");
-                }
-            }
-
+            sq_getstackobj(vm, -1, &handle._obj);
+            addRef();
+            write(vector, detail::IsBulk<T>());
+            sq_pop(vm, 1); // Pop array
+        }
+        /**
+        * @brief Constructs array out of TArray
+        * @details Arrays of numbers are copied in bulk
+        */
+        template<typename T>
+        Array(HSQUIRRELVM vm, const TArray<T>& array):Object(vm) {
+            sq_newarray(vm, 0);
+            sq_getstackobj(vm, -1, &handle._obj);
+            addRef();
+            write(array, detail::IsBulk<T>());
             sq_pop(vm, 1); // Pop array
         }
         /**
@@ -63,7 +153,7 @@ namespace ssq {
         */
         template<typename T>
         void push(const T& value) {
-            sq_pushobject(vm, obj);
+            sq_pushobject(vm, handle._obj);
             detail::push(vm, value);
             if(SQ_FAILED(sq_arrayappend(vm, -2))) {
                 sq_pop(vm, 2);
@@ -76,7 +166,7 @@ namespace ssq {
         */
         template<typename T>
         T popAndGet() {
-            sq_pushobject(vm, obj);
+            sq_pushobject(vm, handle._obj);
             auto s = sq_getsize(vm, -1);
             if(s == 0) {
                 sq_pop(vm, 1);
@@ -106,7 +196,7 @@ namespace ssq {
         */
         template<typename T>
         T get(size_t index) {
-            sq_pushobject(vm, obj);
+            sq_pushobject(vm, handle._obj);
             auto s = static_cast<size_t>(sq_getsize(vm, -1));
             if(index >= s) {
                 sq_pop(vm, 1);
@@ -150,7 +240,7 @@ namespace ssq {
         */
         template<typename T>
         void set(size_t index, const T& value) {
-            sq_pushobject(vm, obj);
+            sq_pushobject(vm, handle._obj);
             auto s = static_cast<size_t>(sq_getsize(vm, -1));
             if(index >= s) {
                 sq_pop(vm, 1);
@@ -170,18 +260,13 @@ namespace ssq {
         std::vector<Object> convertRaw();
         /**
          * @brief Converts this array to std::vector of specific type T
+         * @details Arrays of numbers are copied in bulk
+         * @throws TypeException if an element cannot be converted
          */
         template<typename T>
         std::vector<T> convert() {
-            sq_pushobject(vm, obj);
-            auto s = static_cast<size_t>(sq_getsize(vm, -1));
             std::vector<T> ret;
-            ret.reserve(s);
-            while(s--) {
-                sq_arraypop(vm, -1, true);
-                ret.push_back(detail::pop<T>(vm, -1));
-            }
-            sq_pop(vm, 1);
+            read(ret, detail::IsBulk<T>());
             return ret;
         }
         /**
@@ -197,25 +282,114 @@ namespace ssq {
         template<class T>
         inline TArray<T> readArray() {
           TArray<T> a;
+          read(a, detail::IsBulk<T>());
+          return a;
+        }
 
-          a.Reserve(size());
-          for (int i = 0; i < size(); i++)
-            a.Add(get<T>(i));
+    private:
+        template<typename T>
+        void read(std::vector<T>& out, std::true_type) {
+            sq_pushobject(vm, handle._obj);
+            SQInteger s = sq_getsize(vm, -1);
+            out.resize(static_cast<size_t>(s));
+            bool copied = detail::readBulk(vm, -1, out.data(), s);
+            sq_pop(vm, 1);
+            if (!copied) {
+                out.clear();
+                read(out, std::false_type());
+            }
+        }
 
-          return a;
+        template<typename T>
+        void read(std::vector<T>& out, std::false_type) {
+            sq_pushobject(vm, handle._obj);
+            SQInteger s = sq_getsize(vm, -1);
+            out.reserve(static_cast<size_t>(s));
+            try {
+                detail::readElements<T>(vm, s, [&out](T&& val) { out.push_back(std::move(val)); });
+            } catch (...) {
+                sq_pop(vm, 1);
+                throw;
+            }
+            sq_pop(vm, 1);
+        }
+
+        template<typename T>
+        void read(TArray<T>& out, std::true_type) {
+            sq_pushobject(vm, handle._obj);
+            SQInteger s = sq_getsize(vm, -1);
+            out.SetNumUninitialized(static_cast<int>(s));
+            bool copied = detail::readBulk(vm, -1, out.GetData(), s);
+            sq_pop(vm, 1);
+            if (!copied) {
+                out = TArray<T>();
+                read(out, std::false_type());
+            }
         }
 
+        template<typename T>
+        void read(TArray<T>& out, std::false_type) {
+            sq_pushobject(vm, handle._obj);
+            SQInteger s = sq_getsize(vm, -1);
+            out.Reserve(static_cast<int>(s));
+            try {
+                detail::readElements<T>(vm, s, [&out](T&& val) { out.Add(std::move(val)); });
+            } catch (...) {
+                sq_pop(vm, 1);
+                throw;
+            }
+            sq_pop(vm, 1);
+        }
+
+        // Writes the values to the new array on top of the stack
+        template<typename T>
+        void write(const std::vector<T>& values, std::true_type) {
+            sq_arrayresize(vm, -1, static_cast<SQInteger>(values.size()));
+            detail::writeBulk(vm, -1, values.data(), static_cast<SQInteger>(values.size()));
+        }
+
+        template<typename T>
+        void write(const std::vector<T>& values, std::false_type) {
+            for(const auto& val : values) {
+                append(val);
+            }
+        }
+
+        template<typename T>
+        void write(const TArray<T>& values, std::true_type) {
+            sq_arrayresize(vm, -1, values.Num());
+            detail::writeBulk(vm, -1, values.GetData(), values.Num());
+        }
+
+        template<typename T>
+        void write(const TArray<T>& values, std::false_type) {
+            for (int i = 0; i < values.Num(); i++) {
+                append(values[i]);
+            }
+        }
+
+        template<typename T>
+        void append(const T& val) {
+            detail::push(vm, val);
+            if(SQ_FAILED(sq_arrayappend(vm, -2))) {
+                sq_pop(vm, 2);
+                throw TypeException("Failed to push value to back of the array");
+            }
+        }
     };
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
     namespace detail {
         template<>
         inline Array popValue(HSQUIRRELVM vm, SQInteger index){
             checkType(vm, index, OT_ARRAY);
-            Array val(vm);
+            // Array(vm) would allocate a new array
+            Object val(vm);
             if (SQ_FAILED(sq_getstackobj(vm, index, &val.getRaw()))) throw TypeException("Could not get Array from squirrel stack");
-            sq_addref(vm, &val.getRaw());
-            return val;
+            val.addRef();
+            return Array(val);
         }
+
+        template<> struct PopCheck<Array> : PopCheckType<OT_ARRAY> {};
     }
 #endif
 }
@@ -63,6 +63,8 @@ namespace ssq {
 #else
         template <> struct Param<std::string> {static const char type = 's';};
 #endif
+        template <> struct Param<StringView> {static const char type = 's';};
+        template <> struct Param<String> {static const char type = 's';};
         template <> struct Param<Class> {static const char type = 'y';};
         template <> struct Param<Function> {static const char type = 'c';};
         template <> struct Param<Table> {static const char type = 't';};
@@ -108,7 +110,7 @@ namespace ssq {
 #ifdef SQUNICODE
         template<typename T, typename... Args>
         static Object addClass(HSQUIRRELVM vm, const FString &name, const std::function<T* (Args...)>& allocator, bool release = true) {
-          static const auto hashCode = typeid(T*).hash_code();
+          static const auto typeIdx = typeIndex<T>();
           static const std::size_t nparams = sizeof...(Args);
 
           Object clsObj(vm);
@@ -118,16 +120,16 @@ namespace ssq {
 
           HSQOBJECT obj;
           sq_getstackobj(vm, -1, &obj);
-          addClassObj(vm, hashCode, obj);
+          addClassObj(vm, typeIdx, obj);
 
           sq_getstackobj(vm, -1, &clsObj.getRaw());
-          sq_addref(vm, &clsObj.getRaw());
+          clsObj.addRef();
 
-          sq_settypetag(vm, -1, reinterpret_cast<SQUserPointer>(hashCode));
+          sq_settypetag(vm, -1, typeTag<T>());
 
           sq_pushstring(vm, TEXT("constructor"), -1);
           bindUserData<T*>(vm, allocator);
-          static TCHAR params[33];
+          TCHAR params[sizeof...(Args) + 2];
           paramPacker<T*, Args...>(params);
 
           if (release) {
@@ -147,7 +149,7 @@ namespace ssq {
 #else
         template<typename T, typename... Args>
         static Object addClass(HSQUIRRELVM vm, const char* name, const std::function<T*(Args...)>& allocator, bool release = true) {
-            static const auto hashCode = typeid(T*).hash_code();
+            static const auto typeIdx = typeIndex<T>();
             static const std::size_t nparams = sizeof...(Args);
 
             Object clsObj(vm);
@@ -157,16 +159,16 @@ namespace ssq {
 
             HSQOBJECT obj;
             sq_getstackobj(vm, -1, &obj);
-            addClassObj(vm, hashCode, obj);
+            addClassObj(vm, typeIdx, obj);
 
             sq_getstackobj(vm, -1, &clsObj.getRaw());
-            sq_addref(vm, &clsObj.getRaw());
+            clsObj.addRef();
 
-            sq_settypetag(vm, -1, reinterpret_cast<SQUserPointer>(hashCode));
+            sq_settypetag(vm, -1, typeTag<T>());
 
             sq_pushstring(vm, "constructor", -1);
             bindUserData<T*>(vm, allocator);
-            static char params[33];
+            char params[sizeof...(Args) + 2];
             paramPacker<T*, Args...>(params);
 
             if (release) {
@@ -184,10 +186,88 @@ namespace ssq {
         }
 #endif
 
+#ifdef SQUNICODE
+        template<typename T, typename... Args>
+        static Object addInlineClass(HSQUIRRELVM vm, const FString &name) {
+          static_assert(alignof(T) <= SQ_ALIGNMENT, "the class needs a stricter alignment than SQ_ALIGNMENT");
+          static const auto typeIdx = typeIndex<T>();
+          static const std::size_t nparams = sizeof...(Args);
+
+          Object clsObj(vm);
+
+          sq_pushstring(vm, *name, name.Len());
+          sq_newclass(vm, false);
+
+          HSQOBJECT obj;
+          sq_getstackobj(vm, -1, &obj);
+          addClassObj(vm, typeIdx, obj);
+
+          sq_getstackobj(vm, -1, &clsObj.getRaw());
+          clsObj.addRef();
+
+          sq_settypetag(vm, -1, typeTag<T>());
+          sq_setclassudsize(vm, -1, sizeof(T));
+
+          sq_pushstring(vm, TEXT("constructor"), -1);
+          TCHAR params[sizeof...(Args) + 2];
+          paramPacker<T*, Args...>(params);
+
+          sq_newclosure(vm, &detail::inlineClassAllocator<T, Args...>, 0);
+          sq_setparamscheck(vm, nparams + 1, params);
+          sq_newslot(vm, -3, false); // Add the constructor method
+
+          sq_pushstring(vm, TEXT("_cloned"), -1);
+          sq_newclosure(vm, &detail::inlineClassCloned<T>, 0);
+          sq_newslot(vm, -3, false); // Add the clone metamethod
+
+          sq_newslot(vm, -3, SQFalse); // Add the class
+
+          return clsObj;
+        }
+#else
+        template<typename T, typename... Args>
+        static Object addInlineClass(HSQUIRRELVM vm, const char* name) {
+            static_assert(alignof(T) <= SQ_ALIGNMENT, "the class needs a stricter alignment than SQ_ALIGNMENT");
+            static const auto typeIdx = typeIndex<T>();
+            static const std::size_t nparams = sizeof...(Args);
+
+            Object clsObj(vm);
+
+            sq_pushstring(vm, name, strlen(name));
+            sq_newclass(vm, false);
+
+            HSQOBJECT obj;
+            sq_getstackobj(vm, -1, &obj);
+            addClassObj(vm, typeIdx, obj);
+
+            sq_getstackobj(vm, -1, &clsObj.getRaw());
+            clsObj.addRef();
+
+            sq_settypetag(vm, -1, typeTag<T>());
+            sq_setclassudsize(vm, -1, sizeof(T));
+
+            sq_pushstring(vm, "constructor", -1);
+            char params[sizeof...(Args) + 2];
+            paramPacker<T*, Args...>(params);
+
+            sq_newclosure(vm, &detail::inlineClassAllocator<T, Args...>, 0);
+            sq_setparamscheck(vm, nparams + 1, params);
+            sq_newslot(vm, -3, false); // Add the constructor method
+
+            sq_pushstring(vm, "_cloned", -1);
+            sq_newclosure(vm, &detail::inlineClassCloned<T>, 0);
+            sq_newslot(vm, -3, false); // Add the clone metamethod
+
+            sq_newslot(vm, -3, SQFalse); // Add the class
+
+            return clsObj;
+        }
+#endif
+
 #ifdef SQUNICODE
         template<typename T>
         static Object addAbstractClass(HSQUIRRELVM vm, const FString &name) {
-          static const auto hashCode = typeid(T*).hash_code();
+          static const auto typeIdx = typeIndex<T>();
           Object clsObj(vm);
 
           sq_pushstring(vm, *name, name.Len());
@@ -195,12 +275,12 @@ namespace ssq {
 
           HSQOBJECT obj;
           sq_getstackobj(vm, -1, &obj);
-          addClassObj(vm, hashCode, obj);
+          addClassObj(vm, typeIdx, obj);
 
           sq_getstackobj(vm, -1, &clsObj.getRaw());
-          sq_addref(vm, &clsObj.getRaw());
+          clsObj.addRef();
 
-          sq_settypetag(vm, -1, reinterpret_cast<SQUserPointer>(hashCode));
+          sq_settypetag(vm, -1, typeTag<T>());
           sq_newslot(vm, -3, SQFalse); // Add the class
 
           return clsObj;
@@ -208,7 +288,7 @@ namespace ssq {
 #else
         template<typename T>
         static Object addAbstractClass(HSQUIRRELVM vm, const char* name) {
-            static const auto hashCode = typeid(T*).hash_code();
+            static const auto typeIdx = typeIndex<T>();
             Object clsObj(vm);
 
             sq_pushstring(vm, name, strlen(name));
@@ -216,20 +296,61 @@ namespace ssq {
 
             HSQOBJECT obj;
             sq_getstackobj(vm, -1, &obj);
-            addClassObj(vm, hashCode, obj);
+            addClassObj(vm, typeIdx, obj);
 
             sq_getstackobj(vm, -1, &clsObj.getRaw());
-            sq_addref(vm, &clsObj.getRaw());
+            clsObj.addRef();
 
-            sq_settypetag(vm, -1, reinterpret_cast<SQUserPointer>(hashCode));
+            sq_settypetag(vm, -1, typeTag<T>());
             sq_newslot(vm, -3, SQFalse); // Add the class
 
             return clsObj;
         }
 #endif
+        // Returns the stack index of the first argument that cannot be popped as its type, or 0.
+        // Checked before the call, so a mismatch is raised in the script without a C++ exception
+        template<typename... Args, size_t... Is>
+        inline SQInteger checkArgs(HSQUIRRELVM vm, index_list<Is...>) {
+            const bool ok[] = { true, canPop<typename std::remove_reference<Args>::type>(vm, Is + 1)... };
+            const SQInteger index[] = { 0, static_cast<SQInteger>(Is + 1)... };
+            for (size_t i = 1; i < sizeof...(Args) + 1; i++) {
+                if (!ok[i]) return index[i];
+            }
+            return 0;
+        }
+
+#ifdef SQUNICODE
+        inline SQInteger throwError(HSQUIRRELVM vm, const Error& error) {
+            return sq_throwerror(vm, *error.what());
+        }
+#else
+        inline SQInteger throwError(HSQUIRRELVM vm, const Error& error) {
+            return sq_throwerror(vm, error.what());
+        }
+#endif
+
+        // Pushes the value returned by a bound function; a failed Result raises its error
+        template<typename R>
+        inline SQInteger pushResult(HSQUIRRELVM vm, const R& value) {
+            push(vm, value);
+            return 1;
+        }
+
+        template<typename T>
+        inline SQInteger pushResult(HSQUIRRELVM vm, const Result<T>& value) {
+            if (!value) return throwError(vm, value.error());
+            push(vm, value.value());
+            return 1;
+        }
+
+        inline SQInteger pushResult(HSQUIRRELVM vm, const Result<void>& value) {
+            if (!value) return throwError(vm, value.error());
+            return 0;
+        }
+
         template<class Ret, class... Args, size_t... Is>
         static Ret callGlobal(HSQUIRRELVM vm, FuncPtr<Ret(Args...)>* funcPtr, index_list<Is...>) {
-            Object::caller_vm = vm;
+            CallerScope caller(vm);
             return funcPtr->ptr->operator()(detail::pop<typename std::remove_reference<Args>::type>(vm, Is + 1)...);
         }
 
@@ -239,11 +360,13 @@ namespace ssq {
                 try {
                     static const std::size_t nparams = sizeof...(Args);
 
+                    SQInteger bad = checkArgs<Args...>(vm, index_range<offet, sizeof...(Args) + offet>());
+                    if (bad) return throwArgError(vm, bad);
+
                     FuncPtr<R(Args...)>* funcPtr;
                     sq_getuserdata(vm, -1, reinterpret_cast<void**>(&funcPtr), nullptr);
 
-                    push(vm, std::forward<R>(callGlobal(vm, funcPtr, index_range<offet, sizeof...(Args) + offet>())));
-                    return 1;
+                    return pushResult(vm, callGlobal(vm, funcPtr, index_range<offet, sizeof...(Args) + offet>()));
                 } 
 #ifdef SQUNICODE
                 catch (std::exception& e) {
@@ -264,6 +387,9 @@ namespace ssq {
         struct func<offet, void, Args...> {
             static SQInteger global(HSQUIRRELVM vm) {
                 try {
+                    SQInteger bad = checkArgs<Args...>(vm, index_range<offet, sizeof...(Args) + offet>());
+                    if (bad) return throwArgError(vm, bad);
+
                     FuncPtr<void(Args...)>* funcPtr;
                     sq_getuserdata(vm, -1, reinterpret_cast<void**>(&funcPtr), nullptr);
 
@@ -285,6 +411,194 @@ namespace ssq {
             }
         };
 
+        // Functions bound at compile time: the function pointer is a template argument, so the
+        // generated SQFUNCTION calls it directly, without a free variable or a std::function
+        template<typename F, F fn>
+        struct bound;
+
+        template<typename R, typename... Args, R(*fn)(Args...)>
+        struct bound<R(*)(Args...), fn> {
+            typedef R Ret;
+            static const std::size_t nparams = sizeof...(Args);
+
+            template<size_t... Is>
+            static R call(HSQUIRRELVM vm, index_list<Is...>) {
+                return fn(detail::pop<typename std::remove_reference<Args>::type>(vm, Is + 1)...);
+            }
+
+            template<int offet>
+            static SQInteger check(HSQUIRRELVM vm) {
+                return checkArgs<Args...>(vm, index_range<offet, sizeof...(Args) + offet>());
+            }
+
+            template<int offet>
+            static R invoke(HSQUIRRELVM vm) {
+                return call(vm, index_range<offet, sizeof...(Args) + offet>());
+            }
+#ifdef SQUNICODE
+            static void params(TCHAR* ptr, bool member) {
+#else
+            static void params(char* ptr, bool member) {
+#endif
+                if (member) paramPacker<Args...>(ptr);
+                else paramPacker<void, Args...>(ptr);
+            }
+        };
+
+        // the object is the first argument, as with std::function<R(T*, Args...)>
+        template<typename R, typename T, typename... Args, R(T::*fn)(Args...)>
+        struct bound<R(T::*)(Args...), fn> {
+            typedef R Ret;
+            static const std::size_t nparams = sizeof...(Args) + 1;
+
+            template<size_t I, size_t... Is>
+            static R call(HSQUIRRELVM vm, index_list<I, Is...>) {
+                return (detail::pop<T*>(vm, I + 1)->*fn)(detail::pop<typename std::remove_reference<Args>::type>(vm, Is + 1)...);
+            }
+
+            template<int offet>
+            static SQInteger check(HSQUIRRELVM vm) {
+                return checkArgs<T*, Args...>(vm, index_range<offet, sizeof...(Args) + 1 + offet>());
+            }
+
+            template<int offet>
+            static R invoke(HSQUIRRELVM vm) {
+                return call(vm, index_range<offet, sizeof...(Args) + 1 + offet>());
+            }
+#ifdef SQUNICODE
+            static void params(TCHAR* ptr, bool member) {
+#else
+            static void params(char* ptr, bool member) {
+#endif
+                if (member) paramPacker<T*, Args...>(ptr);
+                else paramPacker<void, T*, Args...>(ptr);
+            }
+        };
+
+        // the object is the first argument, as with std::function<R(T*, Args...)>
+        template<typename R, typename T, typename... Args, R(T::*fn)(Args...) const>
+        struct bound<R(T::*)(Args...) const, fn> {
+            typedef R Ret;
+            static const std::size_t nparams = sizeof...(Args) + 1;
+
+            template<size_t I, size_t... Is>
+            static R call(HSQUIRRELVM vm, index_list<I, Is...>) {
+                return (detail::pop<T*>(vm, I + 1)->*fn)(detail::pop<typename std::remove_reference<Args>::type>(vm, Is + 1)...);
+            }
+
+            template<int offet>
+            static SQInteger check(HSQUIRRELVM vm) {
+                return checkArgs<T*, Args...>(vm, index_range<offet, sizeof...(Args) + 1 + offet>());
+            }
+
+            template<int offet>
+            static R invoke(HSQUIRRELVM vm) {
+                return call(vm, index_range<offet, sizeof...(Args) + 1 + offet>());
+            }
+#ifdef SQUNICODE
+            static void params(TCHAR* ptr, bool member) {
+#else
+            static void params(char* ptr, bool member) {
+#endif
+                if (member) paramPacker<T*, Args...>(ptr);
+                else paramPacker<void, T*, Args...>(ptr);
+            }
+        };
+
+        template<int offet, typename F, F fn, typename R = typename bound<F, fn>::Ret>
+        struct boundFunc {
+            static SQInteger global(HSQUIRRELVM vm) {
+                try {
+                    SQInteger bad = bound<F, fn>::template check<offet>(vm);
+                    if (bad) return throwArgError(vm, bad);
+                    CallerScope caller(vm);
+                    return pushResult(vm, bound<F, fn>::template invoke<offet>(vm));
+                }
+#ifdef SQUNICODE
+                catch (std::exception& e) {
+                  return sq_throwerror(vm, UTF8_TO_TCHAR(e.what()));
+                }
+                catch (Exception& e) {
+                  return sq_throwerror(vm, *e.what());
+                }
+#else
+                catch (std::exception& e) {
+                  return sq_throwerror(vm, e.what());
+                }
+#endif
+            }
+        };
+
+        template<int offet, typename F, F fn>
+        struct boundFunc<offet, F, fn, void> {
+            static SQInteger global(HSQUIRRELVM vm) {
+                try {
+                    SQInteger bad = bound<F, fn>::template check<offet>(vm);
+                    if (bad) return throwArgError(vm, bad);
+                    CallerScope caller(vm);
+                    bound<F, fn>::template invoke<offet>(vm);
+                    return 0;
+                }
+#ifdef SQUNICODE
+                catch (std::exception& e) {
+                  return sq_throwerror(vm, UTF8_TO_TCHAR(e.what()));
+                }
+                catch (Exception& e) {
+                  return sq_throwerror(vm, *e.what());
+                }
+#else
+                catch (std::exception& e) {
+                  return sq_throwerror(vm, e.what());
+                }
+#endif
+            }
+        };
+
+#ifdef SQUNICODE
+        template<typename F, F fn>
+        static void addBoundFunc(HSQUIRRELVM vm, const FString &name, bool member, bool isStatic) {
+          typedef bound<F, fn> B;
+
+          sq_pushstring(vm, *name, name.Len());
+
+          TCHAR params[B::nparams + 2];
+          B::params(params, member);
+
+          if (member) {
+            sq_newclosure(vm, &detail::boundFunc<0, F, fn>::global, 0);
+            sq_setparamscheck(vm, B::nparams, params);
+          }
+          else {
+            sq_newclosure(vm, &detail::boundFunc<1, F, fn>::global, 0);
+            sq_setparamscheck(vm, B::nparams + 1, params);
+          }
+          if (SQ_FAILED(sq_newslot(vm, -3, isStatic))) {
+            throw TypeException("Failed to bind function");
+          }
+        }
+#else
+        template<typename F, F fn>
+        static void addBoundFunc(HSQUIRRELVM vm, const char* name, bool member, bool isStatic) {
+            typedef bound<F, fn> B;
+
+            sq_pushstring(vm, name, strlen(name));
+
+            char params[B::nparams + 2];
+            B::params(params, member);
+
+            if (member) {
+                sq_newclosure(vm, &detail::boundFunc<0, F, fn>::global, 0);
+                sq_setparamscheck(vm, B::nparams, params);
+            } else {
+                sq_newclosure(vm, &detail::boundFunc<1, F, fn>::global, 0);
+                sq_setparamscheck(vm, B::nparams + 1, params);
+            }
+            if(SQ_FAILED(sq_newslot(vm, -3, isStatic))) {
+                throw TypeException("Failed to bind function");
+            }
+        }
+#endif
+
 #ifdef SQUNICODE
         template<typename R, typename... Args>
         static void addFunc(HSQUIRRELVM vm, const FString &name, const std::function<R(Args...)>& func) {
@@ -293,7 +607,7 @@ namespace ssq {
           sq_pushstring(vm, *name, name.Len());
 
           bindUserData(vm, func);
-          static TCHAR params[33];
+          TCHAR params[sizeof...(Args) + 2];
           paramPacker<void, Args...>(params);
 
           sq_newclosure(vm, &detail::func<1, R, Args...>::global, 1);
@@ -310,7 +624,7 @@ namespace ssq {
             sq_pushstring(vm, name, strlen(name));
 
             bindUserData(vm, func);
-            static char params[33];
+            char params[sizeof...(Args) + 2];
             paramPacker<void, Args...>(params);
 
             sq_newclosure(vm, &detail::func<1, R, Args...>::global, 1);
@@ -329,7 +643,7 @@ namespace ssq {
           sq_pushstring(vm, *name, name.Len());
 
           bindUserData(vm, func);
-          static TCHAR params[33];
+          TCHAR params[sizeof...(Args) + 2];
           paramPacker<Args...>(params);
 
           sq_newclosure(vm, &detail::func<0, R, Args...>::global, 1);
@@ -347,7 +661,7 @@ namespace ssq {
             sq_pushstring(vm, name, strlen(name));
 
             bindUserData(vm, func);
-            static char params[33];
+            char params[sizeof...(Args) + 2];
             paramPacker<Args...>(params);
 
             sq_newclosure(vm, &detail::func<0, R, Args...>::global, 1);
@@ -7,6 +7,43 @@
 #include "binding.hpp"
 
 namespace ssq {
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    namespace detail {
+        // Member variables of these types become native fields of the class
+        template<typename V, bool integral = std::is_integral<V>::value>
+        struct NativeField {
+            static const bool supported = false;
+            static const SQNativeFieldType type = SQNF_BOOL;
+        };
+
+        template<typename V>
+        struct NativeField<V, true> {
+            static const bool supported = sizeof(V) <= 8;
+            static const SQNativeFieldType type = std::is_same<V, bool>::value ? SQNF_BOOL :
+                sizeof(V) == 1 ? (std::is_signed<V>::value ? SQNF_INT8 : SQNF_UINT8) :
+                sizeof(V) == 2 ? (std::is_signed<V>::value ? SQNF_INT16 : SQNF_UINT16) :
+                sizeof(V) == 4 ? (std::is_signed<V>::value ? SQNF_INT32 : SQNF_UINT32) :
+                (std::is_signed<V>::value ? SQNF_INT64 : SQNF_UINT64);
+        };
+
+        template<> struct NativeField<float, false> {
+            static const bool supported = true;
+            static const SQNativeFieldType type = SQNF_FLOAT;
+        };
+
+        template<> struct NativeField<double, false> {
+            static const bool supported = true;
+            static const SQNativeFieldType type = SQNF_DOUBLE;
+        };
+
+        template<typename T, typename V>
+        inline SQInteger fieldOffset(V T::* ptr) {
+            alignas(T) static char storage[sizeof(T)];
+            T* obj = reinterpret_cast<T*>(storage);
+            return reinterpret_cast<char*>(&(obj->*ptr)) - storage;
+        }
+    }
+#endif
     /**
     * @brief Squirrel class object
     * @ingroup simplesquirrel
@@ -24,6 +61,18 @@ namespace ssq {
             static T* allocate(Args&&... args) {
                 return new T(std::forward<Args>(args)...);
             }
+        };
+        /**
+        * @brief Constructor helper class for objects stored inside the instance
+        * @details The object is constructed in the user data of the squirrel instance
+        * rather than in an allocation of its own, and destroyed with the instance.
+        * Returning such an object to the script costs one allocation instead of two
+        */
+        template<class Signature>
+        struct InlineCtor;
+
+        template<class T, class... Args>
+        struct InlineCtor<T(Args...)> {
         };
 		/**
         * @brief Creates an empty invalid class
@@ -73,7 +122,7 @@ namespace ssq {
         Function addFunc(const char* name, const std::function<Return(Object*, Args...)>& func, bool isStatic = false) {
             if (vm == nullptr) throw RuntimeException("VM is not initialised");
             Function ret(vm);
-            sq_pushobject(vm, obj);
+            sq_pushobject(vm, handle._obj);
             detail::addMemberFunc(vm, name, func, isStatic);
             sq_pop(vm, 1);
             return ret;
@@ -102,6 +151,35 @@ namespace ssq {
             auto func = std::function<Return(Object*, Args...)>(std::mem_fn(memfunc));
             return addFunc(name, func, isStatic);
         }
+        /**
+        * @brief Adds a function bound at compile time to this class
+        * @details The generated native function calls the function pointer directly,
+        * without allocating a std::function: addFunc<decltype(&Foo::bar), &Foo::bar>("bar").
+        * A free function gets the "this" pointer as its first argument
+        * @param name Name of the function to add
+        * @throws RuntimeException if VM is invalid
+        * @returns Function object references the added function
+        */
+        template <typename F, F fn>
+        Function addFunc(const char* name, bool isStatic = false) {
+            if (vm == nullptr) throw RuntimeException("VM is not initialised");
+            Function ret(vm);
+            sq_pushobject(vm, handle._obj);
+            detail::addBoundFunc<F, fn>(vm, name, true, isStatic);
+            sq_pop(vm, 1);
+            return ret;
+        }
+#ifdef __cpp_nontype_template_parameter_auto
+        /**
+        * @brief Adds a function bound at compile time to this class: addFunc<&Foo::bar>("bar")
+        * @throws RuntimeException if VM is invalid
+        * @returns Function object references the added function
+        */
+        template <auto fn>
+        Function addFunc(const char* name, bool isStatic = false) {
+            return addFunc<decltype(fn), fn>(name, isStatic);
+        }
+#endif
         /**
         * @brief Adds a new function type to this class
         * @param name Name of the function to add
@@ -117,6 +195,9 @@ namespace ssq {
         }
         template<typename T, typename V>
         void addVar(const FString& name, V T::* ptr, bool isStatic = false) {
+            if (!isStatic && detail::NativeField<V>::supported && bindNativeVar<T, V>(name, ptr, false)) {
+                return;
+            }
             findTable("_get", tableGet, dlgGetStub);
             findTable("_set", tableSet, dlgSetStub);
 
@@ -125,6 +206,9 @@ namespace ssq {
         }
         template<typename T, typename V>
         void addConstVar(const FString& name, V T::* ptr, bool isStatic = false) {
+            if (!isStatic && detail::NativeField<V>::supported && bindNativeVar<T, V>(name, ptr, true)) {
+                return;
+            }
             findTable("_get", tableGet, dlgGetStub);
 
             bindVar<T, V>(name, ptr, tableGet.getRaw(), varGetStub<T, V>, isStatic);
@@ -136,6 +220,9 @@ namespace ssq {
         }
         template<typename T, typename V>
         void addVar(const std::string& name, V T::* ptr, bool isStatic = false) {
+            if (!isStatic && detail::NativeField<V>::supported && bindNativeVar<T, V>(name, ptr, false)) {
+                return;
+            }
             findTable("_get", tableGet, dlgGetStub);
             findTable("_set", tableSet, dlgSetStub);
 
@@ -144,6 +231,9 @@ namespace ssq {
         }
         template<typename T, typename V>
         void addConstVar(const std::string& name, V T::* ptr, bool isStatic = false) {
+            if (!isStatic && detail::NativeField<V>::supported && bindNativeVar<T, V>(name, ptr, true)) {
+                return;
+            }
             findTable("_get", tableGet, dlgGetStub);
 
             bindVar<T, V>(name, ptr, tableGet.getRaw(), varGetStub<T, V>, isStatic);
@@ -159,17 +249,17 @@ namespace ssq {
         Class& operator = (Class&& other) NOEXCEPT;
 
         bool operator==(const Class &other) const {
-          return obj._type==other.obj._type && obj._unVal.pClass == other.obj._unVal.pClass;
+          return handle._obj._type==other.handle._obj._type && handle._obj._unVal.pClass == other.handle._obj._unVal.pClass;
         }
 
         // get base class from current
         Class getBase() {
-          sq_pushobject(vm, obj);
+          sq_pushobject(vm, handle._obj);
           sq_getbase(vm, -1);
           Object base(vm);
           if (SQ_FAILED(sq_getstackobj(vm, -1, &base.getRaw())))
             return Class();// throw TypeException("Could not get base class from squirrel stack");
-          sq_addref(vm, &base.getRaw());
+          base.addRef();
           sq_pop(vm, 2);
           return base.getType()==Type::CLASS ? base.toClass() : Class();
         };
@@ -185,7 +275,7 @@ namespace ssq {
         }
 
         void beginIteration() {
-          sq_pushobject(vm, obj);
+          sq_pushobject(vm, handle._obj);
           sq_pushnull(vm);
         }
 
@@ -194,9 +284,9 @@ namespace ssq {
             Object k(vm);
             Object v(vm);
             if (SQ_FAILED(sq_getstackobj(vm, -2, &k.getRaw()))) throw TypeException("Could not get key from squirrel stack");
-            sq_addref(vm, &k.getRaw());
+            k.addRef();
             if (SQ_FAILED(sq_getstackobj(vm, -1, &v.getRaw()))) throw TypeException("Could not get value from squirrel stack");
-            sq_addref(vm, &v.getRaw());
+            v.addRef();
             sq_pop(vm, 2);
             key = k;
             val = v;
@@ -262,6 +352,38 @@ namespace ssq {
         }
 #endif
 
+#ifdef SQUNICODE
+        // arithmetic members are read and written by the VM in the object, like script fields.
+        // A class with instances is locked and takes no new field: false, the caller binds the
+        // member through the _get/_set tables instead
+        template<typename T, typename V>
+        bool bindNativeVar(const FString& name, V T::* ptr, bool readonly) {
+            sq_pushobject(vm, handle._obj);
+            sq_pushstring(vm, *name, name.Len());
+            if (SQ_FAILED(sq_newnativefield(vm, -2, detail::fieldOffset(ptr), detail::NativeField<V>::type, readonly))) {
+                sq_pop(vm, 2);
+                return false;
+            }
+            sq_pop(vm, 1);
+            return true;
+        }
+#else
+        // arithmetic members are read and written by the VM in the object, like script fields.
+        // A class with instances is locked and takes no new field: false, the caller binds the
+        // member through the _get/_set tables instead
+        template<typename T, typename V>
+        bool bindNativeVar(const std::string& name, V T::* ptr, bool readonly) {
+            sq_pushobject(vm, handle._obj);
+            sq_pushstring(vm, name.c_str(), name.size());
+            if (SQ_FAILED(sq_newnativefield(vm, -2, detail::fieldOffset(ptr), detail::NativeField<V>::type, readonly))) {
+                sq_pop(vm, 2);
+                return false;
+            }
+            sq_pop(vm, 1);
+            return true;
+        }
+#endif
+
         template<typename T, typename V>
         static SQInteger varGetStub(HSQUIRRELVM vm) {
             T* ptr;
@@ -301,9 +423,11 @@ namespace ssq {
             checkType(vm, index, OT_CLASS);
             Class val(vm);
             if (SQ_FAILED(sq_getstackobj(vm, index, &val.getRaw()))) throw TypeException("Could not get Class from squirrel stack");
-            sq_addref(vm, &val.getRaw());
+            val.addRef();
             return val;
         }
+
+        template<> struct PopCheck<Class> : PopCheckType<OT_CLASS> {};
     }
 #endif
 }
@@ -42,7 +42,7 @@ namespace ssq {
          */
         template<typename T>
         void addSlot(const char* name, const T& value) {
-            sq_pushobject(vm, obj);
+            sq_pushobject(vm, handle._obj);
             sq_pushstring(vm, name, strlen(name));
             detail::push<T>(vm, value);
             sq_newslot(vm, -3, false);
@@ -56,9 +56,11 @@ namespace ssq {
             checkType(vm, index, OT_CLOSURE);
             Function val(vm);
             if (SQ_FAILED(sq_getstackobj(vm, index, &val.getRaw()))) throw TypeException("Could not get Table from squirrel stack");
-            sq_addref(vm, &val.getRaw());
+            val.addRef();
             return val;
         }
+
+        template<> struct PopCheck<Function> : PopCheckType<OT_CLOSURE> {};
     }
 #endif
 }
@@ -0,0 +1,149 @@
+#pragma once
+#ifndef SSQ_FUNCTIONREF_HEADER_H
+#define SSQ_FUNCTIONREF_HEADER_H
+
+#include "object.hpp"
+#include "function.hpp"
+#include "exceptions.hpp"
+#include "result.hpp"
+#include "args.hpp"
+
+namespace ssq {
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    namespace detail {
+        template<typename R>
+        struct CallResult {
+            // The returned string is released with the stack before the call returns
+            static_assert(!std::is_same<R, StringView>::value, "StringView cannot be returned, use String");
+            static const SQBool retval = SQTrue;
+            static R get(HSQUIRRELVM vm, SQInteger top) {
+                try {
+                    R ret = detail::pop<R>(vm, -1);
+                    sq_settop(vm, top);
+                    return ret;
+                } catch (...) {
+                    sq_settop(vm, top);
+                    throw;
+                }
+            }
+            static Result<R> tryGet(HSQUIRRELVM vm, SQInteger top) {
+                Result<R> ret = detail::tryPop<R>(vm, -1);
+                sq_settop(vm, top);
+                return ret;
+            }
+        };
+
+        template<>
+        struct CallResult<void> {
+            static const SQBool retval = SQFalse;
+            static void get(HSQUIRRELVM vm, SQInteger top) {
+                sq_settop(vm, top);
+            }
+            static Result<void> tryGet(HSQUIRRELVM vm, SQInteger top) {
+                sq_settop(vm, top);
+                return Result<void>();
+            }
+        };
+    }
+#endif
+
+    template<typename F> class FunctionRef;
+
+    /**
+    * @brief Squirrel function bound to a C++ signature, for the functions called often
+    * @details The number of parameters is checked once when the function is bound. A call
+    * pushes the arguments directly and pops the return value as R from the stack, it does
+    * not create any Object nor hold the result with a reference.
+    * @ingroup simplesquirrel
+    */
+    template<typename R, typename... Args>
+    class FunctionRef<R(Args...)> {
+    public:
+        /**
+        * @brief Creates an empty function reference
+        */
+        FunctionRef() {}
+        /**
+        * @brief Binds a function called with the root table as "this"
+        * @throws RuntimeException if the number of parameters does not match
+        */
+        explicit FunctionRef(const Function& func):func(func), env(func.getHandle()) {
+            HSQUIRRELVM vm = func.getHandle();
+            checkParams();
+            sq_pushroottable(vm);
+            sq_getstackobj(vm, -1, &env.getRaw());
+            env.addRef();
+            sq_pop(vm, 1);
+        }
+        /**
+        * @brief Binds a function called with env as "this"
+        * @throws RuntimeException if the number of parameters does not match
+        */
+        FunctionRef(const Function& func, const Object& env):func(func), env(env) {
+            checkParams();
+        }
+        /**
+        * @brief Returns true if no function is bound
+        */
+        bool isEmpty() const {
+            return func.isEmpty();
+        }
+        /**
+        * @brief Returns the bound function
+        */
+        const Function& getFunction() const {
+            return func;
+        }
+        /**
+        * @brief Calls the function
+        * @throws RuntimeException if the function throws or nothing is bound
+        * @throws TypeException if the return value cannot be converted to R
+        */
+        R operator()(Args... args) const {
+            if (func.isEmpty()) throw RuntimeException("Empty function reference");
+            HSQUIRRELVM vm = func.getHandle();
+            SQInteger top = sq_gettop(vm);
+            sq_pushobject(vm, func.getRaw());
+            sq_pushobject(vm, env.getRaw());
+            int pushed[] = { 0, (detail::push(vm, args), 0)... };
+            (void)pushed;
+            if (SQ_FAILED(sq_call(vm, 1 + sizeof...(Args), detail::CallResult<R>::retval, SQTrue))) {
+                sq_settop(vm, top);
+                detail::throwRuntimeError(vm);
+            }
+            return detail::CallResult<R>::get(vm, top);
+        }
+        /**
+        * @brief Calls the function, returning its error instead of throwing it
+        * @details The runtime error handler of the VM is not called, the error holds the
+        * message without the call stack. A return value that cannot be converted to R is
+        * returned as an error too.
+        */
+        Result<R> tryCall(Args... args) const {
+            if (func.isEmpty()) return Error(_SC("Empty function reference"));
+            HSQUIRRELVM vm = func.getHandle();
+            SQInteger top = sq_gettop(vm);
+            sq_pushobject(vm, func.getRaw());
+            sq_pushobject(vm, env.getRaw());
+            int pushed[] = { 0, (detail::push(vm, args), 0)... };
+            (void)pushed;
+            if (SQ_FAILED(sq_call(vm, 1 + sizeof...(Args), detail::CallResult<R>::retval, SQFalse))) {
+                Error err = detail::lastError(vm);
+                sq_settop(vm, top);
+                return err;
+            }
+            return detail::CallResult<R>::tryGet(vm, top);
+        }
+    private:
+        void checkParams() const {
+            if (func.getNumOfParams() != sizeof...(Args)) {
+                throw RuntimeException("Number of arguments does not match");
+            }
+        }
+
+        Function func;
+        Object env;
+    };
+}
+
+#endif
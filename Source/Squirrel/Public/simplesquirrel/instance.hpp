@@ -86,10 +86,12 @@ namespace ssq {
             checkType(vm, index, OT_INSTANCE);
             Instance val(vm);
             if (SQ_FAILED(sq_getstackobj(vm, index, &val.getRaw()))) throw TypeException("Could not get Instance from squirrel stack");
-            sq_addref(vm, &val.getRaw());
+            val.addRef();
             return val;
         }
 
+        template<> struct PopCheck<Instance> : PopCheckType<OT_INSTANCE> {};
+
         template<>
         inline SqWeakRef popValue(HSQUIRRELVM vm, SQInteger index){
             checkType(vm, index, OT_INSTANCE);
@@ -97,6 +99,8 @@ namespace ssq {
             if (SQ_FAILED(sq_getstackobj(vm, index, &val.getRaw()))) throw TypeException("Could not get Instance from squirrel stack");
             return val;
         }
+
+        template<> struct PopCheck<SqWeakRef> : PopCheckType<OT_INSTANCE> {};
     }
 #endif
 }
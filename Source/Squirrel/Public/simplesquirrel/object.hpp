@@ -107,7 +107,7 @@ namespace ssq {
         const HSQUIRRELVM& getHandle() const;
         /**
         * @brief Returns the typetag associated with this object
-        * @note The typetag is equal to hash value of typeid(T)
+        * @note The typetag of the bound classes is the type index of T (see detail::typeIndex())
         */
         size_t getTypeTag() const;
         /**
@@ -119,6 +119,13 @@ namespace ssq {
         */
         void reset();
         /**
+        * @brief Takes a strong reference to the object written through getRaw()
+        * @details The reference is an intrusive handle of the VM, so copying the object
+        * afterwards only bumps the refcount instead of going through sq_addref. The object
+        * referenced before, if any, is released
+        */
+        void addRef();
+        /**
         * @brief Returns the integer value of this object
         * @throws TypeException if this object is not an integer
         */
@@ -190,7 +197,7 @@ namespace ssq {
             if (getType() != Type::INSTANCE) {
                 throw ssq::TypeException("bad cast", "INSTANCE", getTypeStr());
             }
-            sq_pushobject(vm, obj);
+            sq_pushobject(vm, handle._obj);
             SQUserPointer val;
             sq_getinstanceup(vm, -1, &val, nullptr);
             sq_pop(vm, 1);
@@ -204,13 +211,36 @@ namespace ssq {
         * @brief Move assingment operator
         */
         Object& operator = (Object&& other) NOEXCEPT;
-
-        static HSQUIRRELVM caller_vm; 
+        /**
+        * @brief Returns the VM calling the bound C++ function running on this thread
+        * @details nullptr outside of the bound functions. Each thread has its own caller VM,
+        * so VMs running on different threads do not see each other.
+        */
+        static HSQUIRRELVM getCallerVM();
     protected:
         HSQUIRRELVM vm;
-        HSQOBJECT obj;
+        SQHandle handle;
+        HSQOBJECT held; // object referenced by the linked handle, getRaw() may overwrite handle._obj
         bool weak;
     };
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    namespace detail {
+        /**
+        * @brief Sets the caller VM of this thread for the scope of a bound function call
+        * @details Restores the previous caller VM, so nested calls through other VMs are fine
+        */
+        class SQUIRREL_API SSQ_API CallerScope {
+        public:
+            explicit CallerScope(HSQUIRRELVM vm);
+            ~CallerScope();
+            CallerScope(const CallerScope& other) = delete;
+            CallerScope& operator = (const CallerScope& other) = delete;
+        private:
+            HSQUIRRELVM prev;
+        };
+    }
+#endif
 }
 
 #endif
@@ -0,0 +1,168 @@
+#pragma once
+#ifndef SSQ_RESULT_HEADER_H
+#define SSQ_RESULT_HEADER_H
+
+#include <squirrel/squirrel.h>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace ssq {
+    /**
+    * @brief Error reported by a Result
+    * @ingroup simplesquirrel
+    */
+    class Error {
+    public:
+        Error() {
+        }
+#ifdef SQUNICODE
+        explicit Error(const FString& msg):message(msg) {
+        }
+        /**
+        * @brief Returns the error message
+        */
+        const FString& what() const {
+            return message;
+        }
+    private:
+        FString message;
+#else
+        explicit Error(const std::string& msg):message(msg) {
+        }
+        /**
+        * @brief Returns the error message
+        */
+        const char* what() const {
+            return message.c_str();
+        }
+    private:
+        std::string message;
+#endif
+    };
+
+    /**
+    * @brief Value of type T, or the Error that prevented it
+    * @details Returned by the calls that report their errors without throwing. A bound
+    * function returning a Result raises its error in the script with sq_throwerror.
+    * @ingroup simplesquirrel
+    */
+    template<typename T>
+    class Result {
+    public:
+        /**
+        * @brief Creates a result holding the value
+        */
+        Result(const T& value):ok(true) {
+            new (&storage) T(value);
+        }
+        Result(T&& value):ok(true) {
+            new (&storage) T(std::move(value));
+        }
+        /**
+        * @brief Creates a failed result
+        */
+        Result(const Error& error):ok(false), err(error) {
+        }
+        Result(const Result& other):ok(other.ok), err(other.err) {
+            if (ok) new (&storage) T(other.value());
+        }
+        Result(Result&& other):ok(other.ok), err(std::move(other.err)) {
+            if (ok) new (&storage) T(std::move(other.value()));
+        }
+        ~Result() {
+            reset();
+        }
+        Result& operator = (const Result& other) {
+            if (this != &other) {
+                reset();
+                ok = other.ok;
+                err = other.err;
+                if (ok) new (&storage) T(other.value());
+            }
+            return *this;
+        }
+        Result& operator = (Result&& other) {
+            if (this != &other) {
+                reset();
+                ok = other.ok;
+                err = std::move(other.err);
+                if (ok) new (&storage) T(std::move(other.value()));
+            }
+            return *this;
+        }
+        /**
+        * @brief Returns true if the result holds a value
+        */
+        bool hasValue() const {
+            return ok;
+        }
+        explicit operator bool() const {
+            return ok;
+        }
+        /**
+        * @brief Returns the value, only valid if hasValue() is true
+        */
+        T& value() {
+            return *reinterpret_cast<T*>(&storage);
+        }
+        const T& value() const {
+            return *reinterpret_cast<const T*>(&storage);
+        }
+        /**
+        * @brief Returns the error, only valid if hasValue() is false
+        */
+        const Error& error() const {
+            return err;
+        }
+    private:
+        void reset() {
+            if (ok) value().~T();
+            ok = false;
+        }
+
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+        bool ok;
+        Error err;
+    };
+
+    /**
+    * @brief Success, or the Error of an operation without a value
+    * @ingroup simplesquirrel
+    */
+    template<>
+    class Result<void> {
+    public:
+        /**
+        * @brief Creates a successful result
+        */
+        Result():ok(true) {
+        }
+        /**
+        * @brief Creates a failed result
+        */
+        Result(const Error& error):ok(false), err(error) {
+        }
+        /**
+        * @brief Returns true if the operation succeeded
+        */
+        bool hasValue() const {
+            return ok;
+        }
+        explicit operator bool() const {
+            return ok;
+        }
+        /**
+        * @brief Returns the error, only valid if hasValue() is false
+        */
+        const Error& error() const {
+            return err;
+        }
+    private:
+        bool ok;
+        Error err;
+    };
+}
+
+#endif
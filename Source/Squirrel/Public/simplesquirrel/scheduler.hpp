@@ -0,0 +1,122 @@
+#pragma once
+#ifndef SSQ_SCHEDULER_HEADER_H
+#define SSQ_SCHEDULER_HEADER_H
+
+#include "vm.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _MSC_VER
+#pragma warning( push )
+#pragma warning( disable: 4251 )
+#endif
+
+namespace ssq {
+    /**
+    * @brief Runs script jobs on a set of independent VMs with a pool of worker threads
+    * @details Every VM has its own queue of jobs. A VM with queued jobs is owned by one
+    * worker at a time, which runs its jobs in submission order; idle workers steal VMs
+    * from the busy ones. Jobs of different VMs run in parallel, jobs of one VM never do,
+    * so a job can use its VM without any locking.
+    * @ingroup simplesquirrel
+    */
+    class SQUIRREL_API SSQ_API Scheduler {
+    public:
+        /**
+        * @brief A job, called with the VM it runs on
+        */
+        typedef std::function<void(VM&)> Job;
+        /**
+        * @brief Creates a scheduler running the given VMs
+        * @param workerCount Number of worker threads, 0 for one per hardware thread
+        * @throws RuntimeException if there is no VM
+        */
+        Scheduler(std::vector<VM>&& vms, size_t workerCount = 0);
+        /**
+        * @brief Creates a scheduler running vmCount VMs created from a snapshot
+        * @param workerCount Number of worker threads, 0 for one per hardware thread
+        * @throws RuntimeException if vmCount is 0 or the snapshot is empty
+        */
+        Scheduler(const VMSnapshot& snapshot, size_t vmCount, size_t workerCount = 0, size_t stackSize = 1024);
+        /**
+        * @brief Destructor, runs the queued jobs then stops the workers
+        */
+        ~Scheduler();
+        /**
+        * @brief Deleted copy constructor
+        */
+        Scheduler(const Scheduler& other) = delete;
+        /**
+        * @brief Deleted copy assignment operator
+        */
+        Scheduler& operator = (const Scheduler& other) = delete;
+        /**
+        * @brief Queues a job on any VM
+        * @details The VMs are picked in turn, use submit(size_t, Job) when jobs
+        * depend on the state left by previous ones
+        */
+        void submit(Job job);
+        /**
+        * @brief Queues a job on the VM with the given index
+        * @throws RuntimeException if the index is out of range
+        */
+        void submit(size_t vmIndex, Job job);
+        /**
+        * @brief Waits until every job submitted so far has run
+        * @details Rethrows the first exception thrown by a job since the previous wait()
+        * @throws RuntimeException if called from a job
+        */
+        void wait();
+        /**
+        * @brief Returns the number of VMs
+        */
+        size_t getVMCount() const {
+            return slots.size();
+        }
+        /**
+        * @brief Returns the number of worker threads
+        */
+        size_t getWorkerCount() const {
+            return workers.size();
+        }
+        /**
+        * @brief Returns the VM with the given index
+        * @note Only safe to use while no job is queued, for example right after wait()
+        * @throws RuntimeException if the index is out of range
+        */
+        VM& getVM(size_t vmIndex);
+    private:
+        struct Slot;
+        struct Worker;
+
+        void start(size_t workerCount);
+        void push(Slot* slot, size_t worker, bool front);
+        Slot* take(size_t worker);
+        void runSlot(Slot* slot, size_t worker);
+        void run(size_t worker);
+
+        std::vector<std::unique_ptr<Slot>> slots;
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::atomic<size_t> next;
+        std::atomic<size_t> ready;
+        std::atomic<size_t> pending;
+        bool stopping;
+        std::mutex sleepMutex;
+        std::condition_variable sleepCond;
+        std::mutex doneMutex;
+        std::condition_variable doneCond;
+        std::exception_ptr error;
+    };
+}
+
+#ifdef _MSC_VER
+#pragma warning( pop )
+#endif
+
+#endif
@@ -40,6 +40,58 @@ namespace ssq {
         */
         Script& operator = (Script&& other) NOEXCEPT;
     };
+    /**
+    * @brief Compiled script shared between virtual machines
+    * @details Holds the instructions of a script once, read-only and outside of
+    * any VM. Any number of VMs, on any thread, can instantiate it with VM::loadScript()
+    * without copying the code. Copies share the same code.
+    * @ingroup simplesquirrel
+    */
+    class SQUIRREL_API SSQ_API SharedScript {
+    public:
+        /**
+        * @brief Creates empty shared script
+        */
+        SharedScript();
+        /**
+        * @brief Takes the ownership of a code handle returned by sq_sharecode
+        */
+        explicit SharedScript(HSQCODE code);
+        /**
+        * @brief Destructor
+        */
+        ~SharedScript();
+        /**
+        * @brief Swaps two shared scripts
+        */
+        void swap(SharedScript& other) NOEXCEPT;
+        /**
+        * @brief Copy constructor
+        */
+        SharedScript(const SharedScript& other);
+        /**
+        * @brief Move constructor
+        */
+        SharedScript(SharedScript&& other) NOEXCEPT;
+        /**
+        * @brief Copy assignment operator
+        */
+        SharedScript& operator = (const SharedScript& other);
+        /**
+        * @brief Move assignment operator
+        */
+        SharedScript& operator = (SharedScript&& other) NOEXCEPT;
+        /**
+        * @brief Checks if the shared script holds no code
+        */
+        bool isEmpty() const;
+        /**
+        * @brief Returns the raw code handle
+        */
+        HSQCODE getRaw() const;
+    private:
+        HSQCODE code;
+    };
 }
 
 #endif
\ No newline at end of file
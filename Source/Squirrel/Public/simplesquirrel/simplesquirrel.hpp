@@ -9,13 +9,19 @@
 
 #include "type.hpp"
 #include "exceptions.hpp"
+#include "result.hpp"
 #include "object.hpp"
+#include "stringview.hpp"
+#include "string.hpp"
 #include "function.hpp"
+#include "functionref.hpp"
 #include "enum.hpp"
 #include "array.hpp"
 #include "table.hpp"
 #include "instance.hpp"
 #include "script.hpp"
 #include "vm.hpp"
+#include "vmpool.hpp"
+#include "scheduler.hpp"
 
 #endif
\ No newline at end of file
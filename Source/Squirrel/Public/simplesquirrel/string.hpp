@@ -0,0 +1,90 @@
+#pragma once
+#ifndef SSQ_STRING_HEADER_H
+#define SSQ_STRING_HEADER_H
+
+#include "object.hpp"
+#include "args.hpp"
+#include "stringview.hpp"
+#include <squirrel/squirrel.h>
+
+namespace ssq {
+    /**
+    * @brief Squirrel string held by reference
+    * @details The characters are copied and interned once, when the string is created.
+    * Pushing it to the VM afterwards only pushes the reference, without hashing nor copying
+    * the characters again, which pays off for the large texts passed to the scripts often.
+    * @ingroup simplesquirrel
+    */
+    class SQUIRREL_API SSQ_API String: public Object {
+    public:
+        /**
+        * @brief Creates an empty object
+        */
+        explicit String(HSQUIRRELVM vm);
+        /**
+        * @brief Interns len characters at str
+        */
+        String(HSQUIRRELVM vm, const SQChar* str, size_t len);
+        /**
+        * @brief Interns the characters of the view
+        */
+        String(HSQUIRRELVM vm, const StringView& str);
+        /**
+        * @brief Interns a copy of the string
+        */
+#ifdef SQUNICODE
+        String(HSQUIRRELVM vm, const FString& str);
+#else
+        String(HSQUIRRELVM vm, const std::string& str);
+#endif
+        /**
+        * @brief Destructor
+        */
+        virtual ~String() = default;
+        /**
+        * @brief Converts Object to String
+        * @throws TypeException if the Object is not type of a string
+        */
+        explicit String(const Object& object);
+        /**
+        * @brief Copy constructor
+        */
+        String(const String& other);
+        /**
+        * @brief Move constructor
+        */
+        String(String&& other) NOEXCEPT;
+        /**
+        * @brief Returns the characters of the string, valid while this object holds it
+        */
+        StringView getView() const;
+        /**
+        * @brief Returns the number of characters
+        */
+        size_t size() const;
+        /**
+        * @brief Copy assingment operator
+        */
+        String& operator = (const String& other);
+        /**
+        * @brief Move assingment operator
+        */
+        String& operator = (String&& other) NOEXCEPT;
+    };
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    namespace detail {
+        template<>
+        inline String popValue(HSQUIRRELVM vm, SQInteger index){
+            checkType(vm, index, OT_STRING);
+            String val(vm);
+            if (SQ_FAILED(sq_getstackobj(vm, index, &val.getRaw()))) throw TypeException("Could not get String from squirrel stack");
+            val.addRef();
+            return val;
+        }
+
+        template<> struct PopCheck<String> : PopCheckType<OT_STRING> {};
+    }
+#endif
+}
+
+#endif
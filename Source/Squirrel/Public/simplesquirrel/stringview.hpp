@@ -0,0 +1,78 @@
+#pragma once
+#ifndef SSQ_STRINGVIEW_HEADER_H
+#define SSQ_STRINGVIEW_HEADER_H
+
+#include <squirrel/squirrel.h>
+#include <cstring>
+#include <string>
+
+namespace ssq {
+    /**
+    * @brief Characters of a Squirrel string borrowed from the VM
+    * @details Points into the interned string without copying it. As a parameter of a bound
+    * function the view is valid until the function returns. Taken from an Object or a String,
+    * it is valid while they hold the string. It must not be kept after that.
+    * @ingroup simplesquirrel
+    */
+    class StringView {
+    public:
+        /**
+        * @brief Creates an empty view
+        */
+        StringView():ptr(_SC("")), len(0) {}
+        /**
+        * @brief Creates a view of len characters at ptr
+        */
+        StringView(const SQChar* ptr, size_t len):ptr(ptr), len(len) {}
+        /**
+        * @brief Returns the characters, terminated by zero when borrowed from the VM
+        */
+        const SQChar* data() const {
+            return ptr;
+        }
+        /**
+        * @brief Returns the number of characters
+        */
+        size_t size() const {
+            return len;
+        }
+        /**
+        * @brief Checks if the view is empty
+        */
+        bool empty() const {
+            return len == 0;
+        }
+        /**
+        * @brief Returns the character at index i
+        */
+        SQChar operator [] (size_t i) const {
+            return ptr[i];
+        }
+        /**
+        * @brief Compares the characters of two views
+        */
+        bool operator == (const StringView& other) const {
+            return len == other.len && memcmp(ptr, other.ptr, len * sizeof(SQChar)) == 0;
+        }
+        bool operator != (const StringView& other) const {
+            return !(*this == other);
+        }
+        /**
+        * @brief Returns a copy of the characters
+        */
+#ifdef SQUNICODE
+        FString toString() const {
+            return FString(ptr, len);
+        }
+#else
+        std::string toString() const {
+            return std::string(ptr, len);
+        }
+#endif
+    private:
+        const SQChar* ptr;
+        size_t len;
+    };
+}
+
+#endif
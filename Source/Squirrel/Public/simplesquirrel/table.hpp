@@ -59,7 +59,7 @@ namespace ssq {
         */
         template<typename T, typename... Args>
         Class addClass(const char* name, const std::function<T*(Args...)>& allocator = std::bind(&detail::defaultClassAllocator<T>), bool release = true){
-            sq_pushobject(vm, obj);
+            sq_pushobject(vm, handle._obj);
             Class cls(detail::addClass(vm, name, allocator, release));
             sq_pop(vm, 1);
             return cls;
@@ -74,6 +74,17 @@ namespace ssq {
             return addClass<T>(name, func, release);
         }
         /**
+        * @brief Adds a new class type to this table whose objects live inside the instances
+        * @returns Class object references the added class
+        */
+        template<typename T, typename... Args>
+        Class addClass(const char* name, const Class::InlineCtor<T(Args...)>& constructor){
+            sq_pushobject(vm, handle._obj);
+            Class cls(detail::addInlineClass<T, Args...>(vm, name));
+            sq_pop(vm, 1);
+            return cls;
+        }
+        /**
         * @brief Adds a new class type to this table
         * @returns Class object references the added class
         */
@@ -87,7 +98,7 @@ namespace ssq {
         */
         template<typename T>
         Class addAbstractClass(const char* name) {
-            sq_pushobject(vm, obj);
+            sq_pushobject(vm, handle._obj);
             Class cls(detail::addAbstractClass<T>(vm, name));
             sq_pop(vm, 1);
             return cls;
@@ -99,7 +110,7 @@ namespace ssq {
         template<typename R, typename... Args>
         Function addFunc(const char* name, const std::function<R(Args...)>& func){
             Function ret(vm);
-            sq_pushobject(vm, obj);
+            sq_pushobject(vm, handle._obj);
             detail::addFunc(vm, name, func);
             sq_pop(vm, 1);
             return ret;
@@ -112,13 +123,37 @@ namespace ssq {
         Function addFunc(const char* name, const F& lambda) {
             return addFunc(name, detail::make_function(lambda));
         }
+        /**
+        * @brief Adds a function bound at compile time to this table
+        * @details The generated native function calls the function pointer directly,
+        * without allocating a std::function: addFunc<decltype(&foo), &foo>("foo")
+        * @returns Function object references the added function
+        */
+        template<typename F, F fn>
+        Function addFunc(const char* name) {
+            Function ret(vm);
+            sq_pushobject(vm, handle._obj);
+            detail::addBoundFunc<F, fn>(vm, name, false, false);
+            sq_pop(vm, 1);
+            return ret;
+        }
+#ifdef __cpp_nontype_template_parameter_auto
+        /**
+        * @brief Adds a function bound at compile time to this table: addFunc<&foo>("foo")
+        * @returns Function object references the added function
+        */
+        template<auto fn>
+        Function addFunc(const char* name) {
+            return addFunc<decltype(fn), fn>(name);
+        }
+#endif
         /**
          * @brief Adds a new key-value pair to this table
          */
 #ifdef SQUNICODE
         template<typename T>
         inline void set(const FString &name, const T& value) {
-          sq_pushobject(vm, obj);
+          sq_pushobject(vm, handle._obj);
           sq_pushstring(vm, *name, name.Len());
           detail::push<T>(vm, value);
           sq_newslot(vm, -3, false);
@@ -127,7 +162,7 @@ namespace ssq {
 
         template<typename T>
         inline void set(int uid, const T& value) {
-          sq_pushobject(vm, obj);
+          sq_pushobject(vm, handle._obj);
           sq_pushinteger(vm, uid);
           detail::push<T>(vm, value);
           sq_newslot(vm, -3, false);
@@ -141,7 +176,7 @@ namespace ssq {
 #else
         template<typename T>
         inline void set(const char* name, const T& value) {
-            sq_pushobject(vm, obj);
+            sq_pushobject(vm, handle._obj);
             sq_pushstring(vm, name, strlen(name));
             detail::push<T>(vm, value);
             sq_newslot(vm, -3, false);
@@ -153,6 +188,17 @@ namespace ssq {
         }
 #endif
         size_t size();
+        /**
+         * @brief Sets the weak mode of this table, SQ_WEAK_KEYS and/or SQ_WEAK_VALUES
+         * @details Weak keys and values don't keep their objects alive, the entries are removed
+         * when the objects are freed. 0 makes the table strong again
+         * @throws RuntimeException if the mode is invalid or the VM has no garbage collector
+         */
+        void setWeakMode(SQInteger mode);
+        /**
+         * @brief Returns the weak mode of this table
+         */
+        SQInteger getWeakMode() const;
         /**
          * @brief Adds a new table to this table
          */
@@ -171,7 +217,7 @@ namespace ssq {
         Table& operator = (Table&& other) NOEXCEPT;
 
         void beginIteration() {
-          sq_pushobject(vm, obj);
+          sq_pushobject(vm, handle._obj);
           sq_pushnull(vm);
         }
 
@@ -180,9 +226,9 @@ namespace ssq {
             Object k(vm);
             Object v(vm);
             if (SQ_FAILED(sq_getstackobj(vm, -2, &k.getRaw()))) throw TypeException("Could not get key from squirrel stack");
-            sq_addref(vm, &k.getRaw());
+            k.addRef();
             if (SQ_FAILED(sq_getstackobj(vm, -1, &v.getRaw()))) throw TypeException("Could not get value from squirrel stack");
-            sq_addref(vm, &v.getRaw());
+            v.addRef();
             sq_pop(vm, 2);
             key = k;
             val = v;
@@ -201,13 +247,22 @@ namespace ssq {
         inline TMap<KEY, VALUE> readTable() {
           TMap<KEY, VALUE> m;
 
-          beginIteration();
-          Object key;
-          Object val;
-          while (nextIteration(key, val)) {
-            m.Add(key.to<KEY>(), val.to<VALUE>());
+          // The keys and values are popped right where sq_next pushed them,
+          // without holding each of them with an Object
+          SQInteger top = sq_gettop(vm);
+          sq_pushobject(vm, handle._obj);
+          m.Reserve(static_cast<int>(sq_getsize(vm, -1)));
+          sq_pushnull(vm);
+          try {
+            while (SQ_SUCCEEDED(sq_next(vm, -2))) {
+              m.Add(detail::pop<KEY>(vm, -2), detail::pop<VALUE>(vm, -1));
+              sq_pop(vm, 2);
+            }
+          } catch (...) {
+            sq_settop(vm, top);
+            throw;
           }
-          EndIteration();
+          sq_settop(vm, top);
 
           return m;
         }
@@ -218,11 +273,14 @@ namespace ssq {
         template<>
         inline Table popValue(HSQUIRRELVM vm, SQInteger index){
             checkType(vm, index, OT_TABLE);
-            Table val(vm);
+            // Table(vm) would allocate a new table
+            Object val(vm);
             if (SQ_FAILED(sq_getstackobj(vm, index, &val.getRaw()))) throw TypeException("Could not get Table from squirrel stack");
-            sq_addref(vm, &val.getRaw());
-            return val;
+            val.addRef();
+            return Table(val);
         }
+
+        template<> struct PopCheck<Table> : PopCheckType<OT_TABLE> {};
     }
 #endif
 }
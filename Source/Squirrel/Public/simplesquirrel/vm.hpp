@@ -12,6 +12,8 @@
 #include "array.hpp"
 
 #include <memory>
+#include <tuple>
+#include <vector>
 
 #ifdef _MSC_VER
 #pragma warning( push )
@@ -47,9 +49,137 @@ namespace ssq {
         static const Flag MATH = 0x0004;
         static const Flag SYSTEM = 0x0008;
         static const Flag STRING = 0x0010;
+        static const Flag CHANNEL = 0x0020;
+        static const Flag SCHED = 0x0040;
         static const Flag ALL = 0xFFFF;
     };
 
+    /**
+    * @brief Heap of a fully initialized VM that new VMs are copied from
+    * @details Created by VM::snapshot(). Opening a VM from a snapshot copies its root
+    * table, classes, constants and closures with a bulk copy instead of running the
+    * initialization again, and the compiled code is shared rather than copied.
+    * Any number of threads can open VMs from one snapshot at the same time.
+    * @ingroup simplesquirrel
+    */
+    class SQUIRREL_API SSQ_API VMSnapshot {
+    public:
+        /**
+        * @brief Creates empty snapshot
+        */
+        VMSnapshot();
+        /**
+        * @brief Takes the ownership of a snapshot handle returned by sq_snapshot
+        */
+        explicit VMSnapshot(HSQSNAPSHOT snapshot);
+        /**
+        * @brief Destructor
+        * @details The snapshot itself is freed with the last VM opened from it
+        */
+        ~VMSnapshot();
+        /**
+        * @brief Swaps two snapshots
+        */
+        void swap(VMSnapshot& other) NOEXCEPT;
+        /**
+        * @brief Deleted copy constructor
+        */
+        VMSnapshot(const VMSnapshot& other) = delete;
+        /**
+        * @brief Move constructor
+        */
+        VMSnapshot(VMSnapshot&& other) NOEXCEPT;
+        /**
+        * @brief Deleted copy assignment operator
+        */
+        VMSnapshot& operator = (const VMSnapshot& other) = delete;
+        /**
+        * @brief Move assignment operator
+        */
+        VMSnapshot& operator = (VMSnapshot&& other) NOEXCEPT;
+        /**
+        * @brief Checks if the snapshot is empty
+        */
+        bool isEmpty() const;
+        /**
+        * @brief Returns the raw snapshot handle
+        */
+        HSQSNAPSHOT getRaw() const;
+    private:
+        HSQSNAPSHOT snapshot;
+    };
+
+    /**
+    * @brief Error of one call of VM::callBatch()
+    * @ingroup simplesquirrel
+    */
+    struct BatchError {
+        size_t index;
+        RuntimeException error;
+    };
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    namespace detail {
+        template<class R>
+        struct BatchResults {
+            static_assert(!std::is_same<R, StringView>::value, "StringView cannot be returned, use String");
+            std::vector<R>* values;
+            void store(HSQUIRRELVM vm, SQInteger i) {
+                (*values)[static_cast<size_t>(i)] = detail::pop<R>(vm, -1);
+            }
+        };
+
+        template<>
+        struct BatchResults<void> {
+            void store(HSQUIRRELVM, SQInteger) {
+            }
+        };
+
+        // Callbacks of sq_callbatch for the tuples of a VM::callBatch()
+        template<class R, class... Args>
+        struct Batch {
+            const std::vector<std::tuple<Args...>>& args;
+            BatchResults<R> results;
+            std::vector<BatchError> errors;
+
+            template<size_t... Is>
+            static void pushTuple(HSQUIRRELVM vm, const std::tuple<Args...>& t, index_list<Is...>) {
+                int pushed[] = { 0, (detail::push(vm, std::get<Is>(t)), 0)... };
+                (void)pushed;
+            }
+
+            static SQRESULT push(HSQUIRRELVM vm, SQInteger i, SQUserPointer up) {
+                Batch* batch = static_cast<Batch*>(up);
+                try {
+                    pushTuple(vm, batch->args[static_cast<size_t>(i)], index_range<0, sizeof...(Args)>());
+                    return SQ_OK;
+                } catch (...) {
+                    return sq_throwerror(vm, _SC("Could not push the arguments"));
+                }
+            }
+
+            static void result(HSQUIRRELVM vm, SQInteger i, SQRESULT res, SQUserPointer up) {
+                Batch* batch = static_cast<Batch*>(up);
+                if (SQ_FAILED(res)) {
+                    const SQChar* err = nullptr;
+                    sq_getlasterror(vm);
+                    if (SQ_FAILED(sq_getstring(vm, -1, &err))) {
+                        err = _SC("Unknown squirrel runtime error");
+                    }
+                    batch->errors.push_back(BatchError{ static_cast<size_t>(i), RuntimeException(err) });
+                    sq_pop(vm, 1);
+                    return;
+                }
+                try {
+                    batch->results.store(vm, i);
+                } catch (TypeException& e) {
+                    batch->errors.push_back(BatchError{ static_cast<size_t>(i), RuntimeException(e.what()) });
+                }
+            }
+        };
+    }
+#endif
+
     /**
     * @brief Squirrel Virtual Machine object
     * @ingroup simplesquirrel
@@ -60,8 +190,73 @@ namespace ssq {
 
         /**
         * @brief Creates a VM with a fixed stack size
+        * @param allocator Optional memory allocator for this VM (see sq_openex), copied by the VM
+        */
+        VM(size_t stackSize, Libs::Flag flags = 0x00, const SQAllocator* allocator = nullptr);
+        /**
+        * @brief Creates a VM from a snapshot
+        * @details The VM starts with a copy of everything the snapshot VM held: root
+        * table, registered classes, constants and closures.
+        * @throws RuntimeException if the snapshot is empty
         */
-        VM(size_t stackSize, Libs::Flag flags = 0x00);
+        VM(const VMSnapshot& snapshot, size_t stackSize = 1024, const SQAllocator* allocator = nullptr);
+        /**
+        * @brief Turns this VM into a snapshot other VMs can be created from
+        * @details The VM is handed over to the snapshot and is empty afterwards. Instances
+        * owning a C++ object, generators and threads cannot be part of a snapshot.
+        * @throws RuntimeException if the VM is running or holds objects that cannot be copied
+        */
+        VMSnapshot snapshot();
+        /**
+        * @brief Discards the contents of this VM and copies the snapshot into it again
+        * @details Keeps the allocations of the VM itself, which is cheaper than creating
+        * a new one. The root table object stays the same.
+        * @throws RuntimeException if the snapshot is empty or the VM is running
+        */
+        void reset(const VMSnapshot& snapshot);
+        /**
+        * @brief Returns the live bytes of this VM per SQ_MEM_* category, the total and the peak
+        */
+        SQMemStats getMemoryStats() const;
+        /**
+        * @brief Returns the statistics of the garbage collector
+        * @details Objects marked and freed per SQ_GC_* type and the mark and sweep times of the
+        * last collection, plus the current number of collectable objects, refs and strings
+        * @throws RuntimeException if the VM was built without garbage collector
+        */
+        SQGCStats getGCStats() const;
+        /**
+        * @brief Sets when the garbage collector runs on its own, see SQGCParams
+        * @details A pause of 0 disables the automatic collection of this VM
+        * @throws RuntimeException if the VM was built without garbage collector
+        */
+        void setGCParams(const SQGCParams& params);
+        /**
+        * @brief Returns the parameters of the automatic garbage collection
+        * @throws RuntimeException if the VM was built without garbage collector
+        */
+        SQGCParams getGCParams() const;
+        /**
+        * @brief Sets the memory limit of this VM in bytes, 0 removes it
+        * @details Scripts allocating past the limit get a catchable runtime error
+        */
+        void setMemoryLimit(size_t bytes);
+        /**
+        * @brief Starts the allocation profiler, sampling once every sampleRate allocated bytes
+        * @throws RuntimeException if the profiler is already running
+        */
+        void startAllocProfiler(size_t sampleRate = 4096);
+        /**
+        * @brief Stops the allocation profiler and discards its samples
+        */
+        void stopAllocProfiler();
+        /**
+        * @brief Returns the samples of the allocation profiler
+        * @details An array of tables with the keys func, source, line, bytes and samples,
+        * sorted by bytes. Allocations made outside script code have a null func.
+        * @throws RuntimeException if the profiler is not running
+        */
+        Array getAllocProfile() const;
         /**
         * @brief Destroys the VM and all of this objects
         */
@@ -142,6 +337,26 @@ namespace ssq {
         */
         void run(const Script& script) const;
         /**
+        * @brief Runs a script, returning its error instead of throwing it
+        * @details The runtime error handler of the VM is not called, the error holds the
+        * message without the call stack.
+        */
+        Result<void> tryRun(const Script& script) const;
+        /**
+        * @brief Freezes a compiled script into code any VM can load
+        * @details The script is copied once; loading it into other VMs, even
+        * from other threads, shares its instructions.
+        * @throws RuntimeException if the script is empty or cannot be shared
+        */
+        SharedScript shareScript(const Script& script) const;
+        /**
+        * @brief Creates a script of this VM from shared code
+        * @details Only the literal strings and names are created in this VM, the
+        * instructions stay in the shared script.
+        * @throws RuntimeException if the shared script is empty
+        */
+        Script loadScript(const SharedScript& shared);
+        /**
         * @brief Calls a global function
         * @param func The instance of a function
         * @param args Any number of arguments
@@ -166,6 +381,56 @@ namespace ssq {
             return callAndReturn(params, top);
         }
         /**
+        * @brief Calls a global function, returning its error instead of throwing it
+        * @details The runtime error handler of the VM is not called, the error holds the
+        * message without the call stack.
+        * @see callFunc()
+        */
+        template<class... Args>
+        Result<Object> tryCallFunc(const Function& func, const Object& env, Args&&... args) const {
+            static const std::size_t params = sizeof...(Args);
+
+            if(func.getNumOfParams() != params){
+                return Error(_SC("Number of arguments does not match"));
+            }
+
+            auto top = sq_gettop(vm);
+            sq_pushobject(vm, func.getRaw());
+            sq_pushobject(vm, env.getRaw());
+
+            pushArgs(std::forward<Args>(args)...);
+
+            return tryCallAndReturn(params, top);
+        }
+        /**
+        * @brief Calls a function once per tuple of arguments
+        * @details The function and "this" are set up once for the whole batch. A call that
+        * throws, or whose return value cannot be converted to R, does not stop the batch:
+        * its error is returned with the index of its tuple and its result is left default
+        * constructed. The error handler of the VM is not called for these errors.
+        * @param results Resized to one result per tuple
+        * @throws RuntimeException if func cannot be called
+        */
+        template<class R, class... Args>
+        std::vector<BatchError> callBatch(const Function& func, const Object& env,
+            const std::vector<std::tuple<Args...>>& args, std::vector<R>& results) const {
+            results.assign(args.size(), R());
+            detail::Batch<R, Args...> batch{ args, { &results }, {} };
+            runBatch(func, env, args.size(), &detail::Batch<R, Args...>::push, &detail::Batch<R, Args...>::result, &batch);
+            return std::move(batch.errors);
+        }
+        /**
+        * @brief Calls a function once per tuple of arguments, ignoring the return values
+        * @see callBatch()
+        */
+        template<class... Args>
+        std::vector<BatchError> callBatch(const Function& func, const Object& env,
+            const std::vector<std::tuple<Args...>>& args) const {
+            detail::Batch<void, Args...> batch{ args, {}, {} };
+            runBatch(func, env, args.size(), &detail::Batch<void, Args...>::push, &detail::Batch<void, Args...>::result, &batch);
+            return std::move(batch.errors);
+        }
+        /**
         * @brief Creates a new instance of class and call constructor with given arguments
         * @param cls The object of a class
         * @param args Any number of arguments
@@ -189,7 +454,7 @@ namespace ssq {
             sq_createinstance(vm, -1);
             sq_remove(vm, -2);
             sq_getstackobj(vm, -1, &inst.getRaw());
-            sq_addref(vm, &inst.getRaw());
+            inst.addRef();
             sq_pop(vm, 1);
             return inst;
         }
@@ -237,12 +502,14 @@ namespace ssq {
         void debugStack() const;
 		/**
         * @brief Add registered class object into the table of known classes
+        * @param typeIndex Slot of the C++ type, see detail::typeIndex()
         */
-    void addClassObj(size_t hashCode, const HSQOBJECT& obj);
+    void addClassObj(size_t typeIndex, const HSQOBJECT& obj);
 		/**
-        * @brief Get registered class object from hash code
+        * @brief Get registered class object of a C++ type
+        * @return nullptr if no class was registered for the type
         */
-		const HSQOBJECT& getClassObj(size_t hashCode);
+		const HSQOBJECT* findClassObj(size_t typeIndex) const;
         /**
         * @brief Copy assingment operator
         */
@@ -252,12 +519,18 @@ namespace ssq {
         */
         VM& operator = (VM&& other) NOEXCEPT;
     private:
+        friend void detail::throwRuntimeError(HSQUIRRELVM vm);
+
         std::unique_ptr<CompileException> compileException;
         std::unique_ptr<RuntimeException> runtimeException;
-		std::unordered_map<size_t, HSQOBJECT> classMap;
+		std::vector<HSQOBJECT> classSlots;
 
         static void pushArgs();
 
+        void saveClassMap();
+
+        void loadClassMap();
+
         template <class First, class... Rest> 
         void pushArgs(First&& first, Rest&&... rest) const {
             detail::push(vm, first);
@@ -266,6 +539,11 @@ namespace ssq {
 
         Object callAndReturn(SQUnsignedInteger nparams, SQInteger top) const;
 
+        Result<Object> tryCallAndReturn(SQUnsignedInteger nparams, SQInteger top) const;
+
+        void runBatch(const Function& func, const Object& env, size_t count,
+            SQBATCHARGS args, SQBATCHRESULT result, SQUserPointer up) const;
+
         static void defaultPrintFunc(HSQUIRRELVM vm, const SQChar *s, ...);
 
         static void defaultErrorFunc(HSQUIRRELVM vm, const SQChar *s, ...);
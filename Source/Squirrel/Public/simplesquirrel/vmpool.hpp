@@ -0,0 +1,79 @@
+#pragma once
+#ifndef SSQ_VMPOOL_HEADER_H
+#define SSQ_VMPOOL_HEADER_H
+
+#include "vm.hpp"
+#include <mutex>
+#include <vector>
+
+#ifdef _MSC_VER
+#pragma warning( push )
+#pragma warning( disable: 4251 )
+#endif
+
+namespace ssq {
+    /**
+    * @brief Pool of VMs created from one snapshot
+    * @details acquire() hands out a VM holding a fresh copy of the snapshot, release()
+    * resets the VM and keeps it for the next acquire(), so a session only pays for the
+    * reset instead of a full VM creation. The pool can be used from several threads.
+    * @ingroup simplesquirrel
+    */
+    class SQUIRREL_API SSQ_API VMPool {
+    public:
+        /**
+        * @brief Creates an empty pool
+        * @param snapshot Snapshot every VM of the pool is copied from, see VM::snapshot()
+        * @param stackSize Stack size of the VMs
+        * @throws RuntimeException if the snapshot is empty
+        */
+        VMPool(VMSnapshot&& snapshot, size_t stackSize = 1024);
+        /**
+        * @brief Destructor, destroys the idle VMs
+        */
+        ~VMPool() = default;
+        /**
+        * @brief Deleted copy constructor
+        */
+        VMPool(const VMPool& other) = delete;
+        /**
+        * @brief Deleted copy assignment operator
+        */
+        VMPool& operator = (const VMPool& other) = delete;
+        /**
+        * @brief Returns a VM with a fresh copy of the snapshot
+        * @details Takes an idle VM if there is one, otherwise creates a new VM.
+        */
+        VM acquire();
+        /**
+        * @brief Resets a VM to the snapshot and keeps it for a next acquire()
+        * @details The VM must come from this pool and not be running.
+        */
+        void release(VM&& vm);
+        /**
+        * @brief Creates VMs until the pool holds count idle VMs
+        */
+        void reserve(size_t count);
+        /**
+        * @brief Returns the number of idle VMs
+        */
+        size_t size() const;
+        /**
+        * @brief Returns the snapshot of the pool
+        */
+        const VMSnapshot& getSnapshot() const {
+            return snapshot;
+        }
+    private:
+        VMSnapshot snapshot;
+        size_t stackSize;
+        std::vector<VM> idle;
+        mutable std::mutex mutex;
+    };
+}
+
+#ifdef _MSC_VER
+#pragma warning( pop )
+#endif
+
+#endif
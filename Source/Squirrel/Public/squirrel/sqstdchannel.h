@@ -0,0 +1,25 @@
+/*  see copyright notice in squirrel.h */
+#ifndef _SQSTD_CHANNEL_H_
+#define _SQSTD_CHANNEL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct SQChannel* HSQCHANNEL;
+
+SQUIRREL_API HSQCHANNEL sqstd_newchannel(SQInteger capacity);
+SQUIRREL_API void sqstd_addrefchannel(HSQCHANNEL ch);
+SQUIRREL_API void sqstd_releasechannel(HSQCHANNEL ch);
+SQUIRREL_API SQRESULT sqstd_pushchannel(HSQUIRRELVM v,HSQCHANNEL ch);
+SQUIRREL_API SQRESULT sqstd_getchannel(HSQUIRRELVM v,SQInteger idx,HSQCHANNEL *ch);
+SQUIRREL_API SQRESULT sqstd_channelsend(HSQUIRRELVM v,HSQCHANNEL ch,SQInteger idx);
+SQUIRREL_API SQRESULT sqstd_channelrecv(HSQUIRRELVM v,HSQCHANNEL ch);
+
+SQUIRREL_API SQRESULT sqstd_register_channellib(HSQUIRRELVM v);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*_SQSTD_CHANNEL_H_*/
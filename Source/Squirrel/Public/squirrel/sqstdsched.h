@@ -0,0 +1,20 @@
+/*  see copyright notice in squirrel.h */
+#ifndef _SQSTD_SCHED_H_
+#define _SQSTD_SCHED_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+SQUIRREL_API SQRESULT sqstd_schedspawn(HSQUIRRELVM v,SQInteger nargs);
+SQUIRREL_API SQRESULT sqstd_schedtick(HSQUIRRELVM v,SQInteger now);
+SQUIRREL_API SQInteger sqstd_schedsignal(HSQUIRRELVM v,SQInteger evidx,SQInteger validx);
+SQUIRREL_API SQInteger sqstd_schedcount(HSQUIRRELVM v);
+
+SQUIRREL_API SQRESULT sqstd_register_schedlib(HSQUIRRELVM v);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*_SQSTD_SCHED_H_*/
@@ -160,6 +160,39 @@ typedef struct tagSQObject
     SQObjectValue _unVal;
 }SQObject;
 
+/* strong reference to an object kept by the host (sq_sethandle); the handles of a vm are
+   linked together and marked by the collector, copying or releasing one doesn't touch the
+   refs table of sq_addref. A handle that doesn't hold a refcounted object isn't linked */
+typedef struct tagSQHandle
+{
+    SQObject _obj;
+    struct tagSQHandle *_prev;
+    struct tagSQHandle *_next;
+    struct SQVM *_vm; /* root vm of the state owning the object, set while linked */
+}SQHandle;
+
+/* weak modes of a table (sq_setweakmode): the weak keys or values don't keep alive the
+   tables, arrays, userdata, closures, generators, threads, classes and instances they refer to,
+   whose entries are removed when they are freed */
+#define SQ_WEAK_KEYS    1
+#define SQ_WEAK_VALUES  2
+
+/* C types of the native fields of a class (sq_newnativefield), read and written in the user
+   pointer of the instances without calling any metamethod */
+typedef enum tagSQNativeFieldType{
+    SQNF_BOOL = 0,
+    SQNF_INT8,
+    SQNF_UINT8,
+    SQNF_INT16,
+    SQNF_UINT16,
+    SQNF_INT32,
+    SQNF_UINT32,
+    SQNF_INT64,
+    SQNF_UINT64,
+    SQNF_FLOAT,
+    SQNF_DOUBLE
+}SQNativeFieldType;
+
 typedef struct  tagSQMemberHandle{
     SQBool _static;
     SQInteger _index;
@@ -174,6 +207,8 @@ typedef struct tagSQStackInfos{
 typedef struct SQVM* HSQUIRRELVM;
 typedef SQObject HSQOBJECT;
 typedef SQMemberHandle HSQMEMBERHANDLE;
+typedef struct SQSharedCode* HSQCODE;
+typedef struct SQSnapshot* HSQSNAPSHOT;
 typedef SQInteger (*SQFUNCTION)(HSQUIRRELVM);
 typedef SQInteger (*SQRELEASEHOOK)(SQUserPointer,SQInteger size);
 typedef void (*SQCOMPILERERROR)(HSQUIRRELVM,const SQChar * /*desc*/,const SQChar * /*source*/,SQInteger /*line*/,SQInteger /*column*/);
@@ -181,6 +216,10 @@ typedef void (*SQPRINTFUNCTION)(HSQUIRRELVM,const SQChar * ,...);
 typedef void (*SQDEBUGHOOK)(HSQUIRRELVM /*v*/, SQInteger /*type*/, const SQChar * /*sourcename*/, SQInteger /*line*/, const SQChar * /*funcname*/);
 typedef SQInteger (*SQWRITEFUNC)(SQUserPointer,SQUserPointer,SQInteger);
 typedef SQInteger (*SQREADFUNC)(SQUserPointer,SQUserPointer,SQInteger);
+/* sq_callbatch: pushes the parameters of the call 'i' after "this", and receives its result
+   on top of the stack (or SQ_ERROR with the error in sq_getlasterror) */
+typedef SQRESULT (*SQBATCHARGS)(HSQUIRRELVM /*v*/,SQInteger /*i*/,SQUserPointer /*up*/);
+typedef void (*SQBATCHRESULT)(HSQUIRRELVM /*v*/,SQInteger /*i*/,SQRESULT /*res*/,SQUserPointer /*up*/);
 
 typedef SQInteger (*SQLEXREADFUNC)(SQUserPointer);
 
@@ -198,8 +237,73 @@ typedef struct tagSQFunctionInfo {
     SQInteger line;
 }SQFunctionInfo;
 
+typedef void *(*SQALLOCFUNC)(SQUserPointer /*up*/,SQUnsignedInteger /*size*/);
+typedef void *(*SQREALLOCFUNC)(SQUserPointer /*up*/,void * /*p*/,SQUnsignedInteger /*oldsize*/,SQUnsignedInteger /*newsize*/);
+typedef void (*SQFREEFUNC)(SQUserPointer /*up*/,void * /*p*/,SQUnsignedInteger /*size*/);
+typedef void (*SQALLOCRELEASEFUNC)(SQUserPointer /*up*/);
+
+typedef struct tagSQAllocator{
+    SQALLOCFUNC memalloc;
+    SQREALLOCFUNC memrealloc;
+    SQFREEFUNC memfree; /* size is always the size the block was allocated with */
+    SQALLOCRELEASEFUNC release; /* optional, called by sq_close once the last block is freed */
+    SQUserPointer up;
+}SQAllocator;
+
+#define SQ_MEM_STRING   0
+#define SQ_MEM_TABLE    1
+#define SQ_MEM_ARRAY    2
+#define SQ_MEM_CLOSURE  3 /* closures, function prototypes, generators and outers */
+#define SQ_MEM_INSTANCE 4
+#define SQ_MEM_USERDATA 5
+#define SQ_MEM_VECTOR   6 /* stacks and the storage of arrays, classes and the compiler */
+#define SQ_MEM_OTHER    7
+#define SQ_MEM_CATEGORIES 8
+
+typedef struct tagSQMemStats{
+    SQUnsignedInteger bytes[SQ_MEM_CATEGORIES]; /* live bytes per SQ_MEM_* category */
+    SQUnsignedInteger total;
+    SQUnsignedInteger peak;
+    SQUnsignedInteger limit; /* 0 if unlimited */
+}SQMemStats;
+
+#define SQ_GC_TABLE         0
+#define SQ_GC_ARRAY         1
+#define SQ_GC_USERDATA      2
+#define SQ_GC_CLOSURE       3
+#define SQ_GC_NATIVECLOSURE 4
+#define SQ_GC_GENERATOR     5
+#define SQ_GC_THREAD        6
+#define SQ_GC_CLASS         7
+#define SQ_GC_INSTANCE      8
+#define SQ_GC_OUTER         9
+#define SQ_GC_FUNCPROTO     10
+#define SQ_GC_TYPES         11
+
+typedef struct tagSQGCStats{
+    SQInteger collections; /* full and incremental collections completed */
+    SQInteger marked[SQ_GC_TYPES]; /* objects found alive by the last collection, per SQ_GC_* type */
+    SQInteger freed[SQ_GC_TYPES]; /* objects freed by the last collection */
+    SQInteger marktime; /* microseconds spent marking by the last collection */
+    SQInteger sweeptime; /* microseconds spent freeing and unmarking */
+    SQInteger cyclesfreed; /* objects freed by sq_collectcycles since the vm was opened */
+    SQInteger chainlength; /* collectable objects alive */
+    SQInteger refs; /* objects held by sq_addref */
+    SQInteger refslots;
+    SQInteger handles; /* objects held by sq_sethandle */
+    SQInteger strings; /* strings in the string table */
+    SQInteger stringslots;
+}SQGCStats;
+
+typedef struct tagSQGCParams{
+    SQInteger pause; /* a collection starts when the heap reaches pause% of its size after the last one, 0 disables the automatic collection */
+    SQInteger stepsize; /* bytes allocated between two steps of an incremental collection */
+    SQInteger stepbudget; /* microseconds per incremental step, <=0 runs full collections */
+}SQGCParams;
+
 /*vm*/
 SQUIRREL_API HSQUIRRELVM sq_open(SQInteger initialstacksize);
+SQUIRREL_API HSQUIRRELVM sq_openex(SQInteger initialstacksize,const SQAllocator *allocator);
 SQUIRREL_API HSQUIRRELVM sq_newthread(HSQUIRRELVM friendvm, SQInteger initialstacksize);
 SQUIRREL_API void sq_seterrorhandler(HSQUIRRELVM v);
 SQUIRREL_API void sq_close(HSQUIRRELVM v);
@@ -277,11 +381,13 @@ SQUIRREL_API SQRELEASEHOOK sq_getreleasehook(HSQUIRRELVM v,SQInteger idx);
 SQUIRREL_API SQChar *sq_getscratchpad(HSQUIRRELVM v,SQInteger minsize);
 SQUIRREL_API SQRESULT sq_getfunctioninfo(HSQUIRRELVM v,SQInteger level,SQFunctionInfo *fi);
 SQUIRREL_API SQRESULT sq_getclosureinfo(HSQUIRRELVM v,SQInteger idx,SQInteger *nparams,SQInteger *nfreevars);
+SQUIRREL_API SQRESULT sq_getclosurestacksize(HSQUIRRELVM v,SQInteger idx,SQInteger *stacksize);
 SQUIRREL_API SQRESULT sq_getclosurename(HSQUIRRELVM v,SQInteger idx);
 SQUIRREL_API SQRESULT sq_setnativeclosurename(HSQUIRRELVM v,SQInteger idx,const SQChar *name);
 SQUIRREL_API SQRESULT sq_setinstanceup(HSQUIRRELVM v, SQInteger idx, SQUserPointer p);
 SQUIRREL_API SQRESULT sq_getinstanceup(HSQUIRRELVM v, SQInteger idx, SQUserPointer *p,SQUserPointer typetag,SQBool throwerror=true);
 SQUIRREL_API SQRESULT sq_setclassudsize(HSQUIRRELVM v, SQInteger idx, SQInteger udsize);
+SQUIRREL_API SQRESULT sq_newnativefield(HSQUIRRELVM v,SQInteger idx,SQInteger offset,SQNativeFieldType type,SQBool readonly);
 SQUIRREL_API SQRESULT sq_newclass(HSQUIRRELVM v,SQBool hasbase);
 SQUIRREL_API SQRESULT sq_createinstance(HSQUIRRELVM v,SQInteger idx);
 SQUIRREL_API SQRESULT sq_setattributes(HSQUIRRELVM v,SQInteger idx);
@@ -314,6 +420,10 @@ SQUIRREL_API SQRESULT sq_arrayresize(HSQUIRRELVM v,SQInteger idx,SQInteger newsi
 SQUIRREL_API SQRESULT sq_arrayreverse(HSQUIRRELVM v,SQInteger idx);
 SQUIRREL_API SQRESULT sq_arrayremove(HSQUIRRELVM v,SQInteger idx,SQInteger itemidx);
 SQUIRREL_API SQRESULT sq_arrayinsert(HSQUIRRELVM v,SQInteger idx,SQInteger destpos);
+SQUIRREL_API SQRESULT sq_arraygetintegers(HSQUIRRELVM v,SQInteger idx,SQInteger start,SQInteger count,SQInteger *dst);
+SQUIRREL_API SQRESULT sq_arraygetfloats(HSQUIRRELVM v,SQInteger idx,SQInteger start,SQInteger count,SQFloat *dst);
+SQUIRREL_API SQRESULT sq_arraysetintegers(HSQUIRRELVM v,SQInteger idx,SQInteger start,SQInteger count,const SQInteger *src);
+SQUIRREL_API SQRESULT sq_arraysetfloats(HSQUIRRELVM v,SQInteger idx,SQInteger start,SQInteger count,const SQFloat *src);
 SQUIRREL_API SQRESULT sq_setdelegate(HSQUIRRELVM v,SQInteger idx);
 SQUIRREL_API SQRESULT sq_getdelegate(HSQUIRRELVM v,SQInteger idx);
 SQUIRREL_API SQRESULT sq_clone(HSQUIRRELVM v,SQInteger idx);
@@ -321,9 +431,12 @@ SQUIRREL_API SQRESULT sq_setfreevariable(HSQUIRRELVM v,SQInteger idx,SQUnsignedI
 SQUIRREL_API SQRESULT sq_next(HSQUIRRELVM v,SQInteger idx);
 SQUIRREL_API SQRESULT sq_getweakrefval(HSQUIRRELVM v,SQInteger idx);
 SQUIRREL_API SQRESULT sq_clear(HSQUIRRELVM v,SQInteger idx);
+SQUIRREL_API SQRESULT sq_setweakmode(HSQUIRRELVM v,SQInteger idx,SQInteger mode);
+SQUIRREL_API SQInteger sq_getweakmode(HSQUIRRELVM v,SQInteger idx);
 
 /*calls*/
 SQUIRREL_API SQRESULT sq_call(HSQUIRRELVM v,SQInteger params,SQBool retval,SQBool raiseerror);
+SQUIRREL_API SQRESULT sq_callbatch(HSQUIRRELVM v,SQInteger count,SQBATCHARGS args,SQBATCHRESULT result,SQUserPointer up,SQBool raiseerror);
 SQUIRREL_API SQRESULT sq_resume(HSQUIRRELVM v,SQBool retval,SQBool raiseerror);
 SQUIRREL_API const SQChar *sq_getlocal(HSQUIRRELVM v,SQUnsignedInteger level,SQUnsignedInteger idx);
 SQUIRREL_API SQRESULT sq_getcallee(HSQUIRRELVM v);
@@ -341,6 +454,11 @@ SQUIRREL_API void sq_addref(HSQUIRRELVM v,HSQOBJECT *po);
 SQUIRREL_API SQBool sq_release(HSQUIRRELVM v,HSQOBJECT *po);
 SQUIRREL_API SQUnsignedInteger sq_getrefcount(HSQUIRRELVM v,HSQOBJECT *po);
 SQUIRREL_API void sq_resetobject(HSQOBJECT *po);
+SQUIRREL_API void sq_resethandle(SQHandle *h);
+SQUIRREL_API void sq_sethandle(HSQUIRRELVM v,SQHandle *h,const HSQOBJECT *po);
+SQUIRREL_API void sq_copyhandle(SQHandle *dst,const SQHandle *src);
+SQUIRREL_API void sq_movehandle(SQHandle *dst,SQHandle *src);
+SQUIRREL_API void sq_releasehandle(SQHandle *h);
 SQUIRREL_API const SQChar *sq_objtostring(const HSQOBJECT *o);
 SQUIRREL_API SQBool sq_objtobool(const HSQOBJECT *o);
 SQUIRREL_API SQInteger sq_objtointeger(const HSQOBJECT *o);
@@ -353,15 +471,39 @@ SQUIRREL_API SQUnsignedInteger sq_getvmrefcount(HSQUIRRELVM v, const HSQOBJECT *
 /*GC*/
 SQUIRREL_API SQInteger sq_collectgarbage(HSQUIRRELVM v);
 SQUIRREL_API SQRESULT sq_resurrectunreachable(HSQUIRRELVM v);
+SQUIRREL_API SQInteger sq_collectgarbage_step(HSQUIRRELVM v,SQInteger budget_us);
+SQUIRREL_API SQInteger sq_collectcycles(HSQUIRRELVM v);
+SQUIRREL_API SQRESULT sq_getgcstats(HSQUIRRELVM v,SQGCStats *stats);
+SQUIRREL_API SQRESULT sq_setgcparams(HSQUIRRELVM v,const SQGCParams *params);
+SQUIRREL_API SQRESULT sq_getgcparams(HSQUIRRELVM v,SQGCParams *params);
 
 /*serialization*/
 SQUIRREL_API SQRESULT sq_writeclosure(HSQUIRRELVM vm,SQWRITEFUNC writef,SQUserPointer up);
 SQUIRREL_API SQRESULT sq_readclosure(HSQUIRRELVM vm,SQREADFUNC readf,SQUserPointer up);
 
+/*shared code*/
+SQUIRREL_API SQRESULT sq_sharecode(HSQUIRRELVM v,SQInteger idx,HSQCODE *code);
+SQUIRREL_API SQRESULT sq_newclosurefromcode(HSQUIRRELVM v,HSQCODE code);
+SQUIRREL_API void sq_addrefcode(HSQCODE code);
+SQUIRREL_API void sq_releasecode(HSQCODE code);
+
+/*snapshots*/
+SQUIRREL_API SQRESULT sq_snapshot(HSQUIRRELVM v,HSQSNAPSHOT *snapshot);
+SQUIRREL_API HSQUIRRELVM sq_openfromsnapshot(HSQSNAPSHOT snapshot,SQInteger initialstacksize,const SQAllocator *allocator);
+SQUIRREL_API SQRESULT sq_resetfromsnapshot(HSQUIRRELVM v,HSQSNAPSHOT snapshot);
+SQUIRREL_API void sq_releasesnapshot(HSQSNAPSHOT snapshot);
+
 /*mem allocation*/
 SQUIRREL_API void *sq_malloc(SQUnsignedInteger size);
 SQUIRREL_API void *sq_realloc(void* p,SQUnsignedInteger oldsize,SQUnsignedInteger newsize);
 SQUIRREL_API void sq_free(void *p,SQUnsignedInteger size);
+SQUIRREL_API SQRESULT sq_newpoolallocator(SQAllocator *allocator);
+SQUIRREL_API void sq_getmemstats(HSQUIRRELVM v,SQMemStats *stats);
+SQUIRREL_API void sq_setmemorylimit(HSQUIRRELVM v,SQUnsignedInteger limit);
+SQUIRREL_API SQRESULT sq_checkmemorylimit(HSQUIRRELVM v,SQUnsignedInteger size);
+SQUIRREL_API SQRESULT sq_startallocprofiler(HSQUIRRELVM v,SQUnsignedInteger samplerate);
+SQUIRREL_API void sq_stopallocprofiler(HSQUIRRELVM v);
+SQUIRREL_API SQRESULT sq_getallocprofile(HSQUIRRELVM v);
 
 /*debug*/
 SQUIRREL_API SQRESULT sq_stackinfos(HSQUIRRELVM v,SQInteger level,SQStackInfos *si);